@@ -53,8 +53,10 @@ extern "C"
     void BusFault_Handler(void);
     void UsageFault_Handler(void);
     void DebugMon_Handler(void);
+    void CAN1_TX_IRQHandler(void);
     void CAN1_RX0_IRQHandler(void);
     void CAN1_RX1_IRQHandler(void);
+    void CAN1_SCE_IRQHandler(void);
     void EXTI15_10_IRQHandler(void);
     void TIM6_DAC_IRQHandler(void);
     void TIM7_IRQHandler(void);
@@ -0,0 +1,96 @@
+#include "BusState.h"
+#include <assert.h>
+#include <string.h>
+
+/* CANTask is the only writer and updates the one copy in place. Readers never take a lock, they copy it out and take
+ * another copy if the sequence moved or was odd. The write itself is a handful of stores done inside a critical
+ * section, so a reader running above CANTask can't preempt it halfway and then spin on a write that can't finish */
+typedef struct
+{
+    BusState_t state;
+    /* Odd while an update is in progress */
+    uint32_t sequence;
+} BusStateStore_t;
+
+static_assert(sizeof(BusState_t) <= 64, "Bus state should fit one 64 byte line");
+
+static BusStateStore_t *getBusStateStore(void)
+{
+    static BusStateStore_t store = {0};
+    return &store;
+}
+
+/**
+ * @brief Start an update, must be called from CANTask and followed by EndBusStateUpdate once the new values are in
+ * @return The shared state, to be written in place
+ */
+BusState_t *BeginBusStateUpdate(void)
+{
+    BusStateStore_t *const store = getBusStateStore();
+    taskENTER_CRITICAL();
+    const uint32_t sequence = __atomic_load_n(&store->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&store->sequence, sequence + 1U, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return &(store->state);
+}
+
+/**
+ * @brief Stamp the field that was updated and let readers at it
+ * @param field Frame the values came from
+ * @param rxTick Tick the frame arrived on
+ */
+void EndBusStateUpdate(const BusStateField_t field, const Timestamp_t rxTick)
+{
+    assert(field < BUS_STATE_FIELD_COUNT);
+    BusStateStore_t *const store = getBusStateStore();
+    store->state.rxTick[field] = rxTick;
+    store->state.validMask |= (uint8_t)(1U << field);
+
+    const uint32_t sequence = __atomic_load_n(&store->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&store->sequence, sequence + 1U, __ATOMIC_RELEASE);
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Copy out the bus state, from any task
+ * @param state Output, all zero until the first frame
+ */
+void ReadBusState(BusState_t *const state)
+{
+    assert(NULL != state);
+    const BusStateStore_t *const store = getBusStateStore();
+    uint32_t before = 0;
+    uint32_t after = 0;
+    do
+    {
+        before = __atomic_load_n(&store->sequence, __ATOMIC_ACQUIRE);
+        *state = store->state;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&store->sequence, __ATOMIC_RELAXED);
+    } while ((0U != (before & 1U)) || (before != after));
+}
+
+/**
+ * @brief Whether a field has been heard within maxAge of now
+ * @param state A copy from ReadBusState
+ * @param field Field to check
+ * @param now Current tick
+ * @param maxAge Oldest a value can be and still count
+ */
+bool BusStateFresh(const BusState_t *const state, const BusStateField_t field, const Timestamp_t now, const Timestamp_t maxAge)
+{
+    assert(NULL != state);
+    assert(field < BUS_STATE_FIELD_COUNT);
+    return (0U != (state->validMask & (1U << field))) && ((now - state->rxTick[field]) <= maxAge);
+}
+
+#ifdef TESTING
+/**
+ * @brief Back to nothing heard
+ */
+void ResetBusState(void)
+{
+    BusStateStore_t *const store = getBusStateStore();
+    (void)memset(store, 0, sizeof(*store));
+}
+#endif
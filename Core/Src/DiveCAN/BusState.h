@@ -0,0 +1,75 @@
+#pragma once
+#include <stdbool.h>
+#include "../common.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief The frames the bus state is built from, index into BusState_t.rxTick and bit in validMask
+     */
+    typedef enum
+    {
+        /** @brief PPO2_SETPOINT_ID */
+        BUS_STATE_SETPOINT = 0,
+        /** @brief DIVING_ID */
+        BUS_STATE_DIVING,
+        /** @brief PPO2_ATMOS_ID */
+        BUS_STATE_ATMOS,
+        /** @brief PPO2_MILLIS_ID */
+        BUS_STATE_MILLIS,
+        /** @brief TANK_PRESSURE_ID */
+        BUS_STATE_TANK_PRESSURE,
+        /** @brief BUS_STATUS_ID */
+        BUS_STATE_STATUS,
+        BUS_STATE_FIELD_COUNT
+    } BusStateField_t;
+
+#define BUS_STATE_CELL_COUNT 3
+/* Whole CAN payload, TANK_PRESSURE_ID is kept raw until its layout is known */
+#define BUS_STATE_TANK_PRESSURE_BYTES 8
+
+    /**
+     * @brief Latest decoded value of each state-like frame and the tick it arrived on. Ticks sit together ahead of the
+     * values so a freshness check reads one run of words, and the whole thing fits one 64 byte line
+     */
+    typedef struct
+    {
+        /** @brief Tick each field last arrived on, only meaningful with its validMask bit set */
+        Timestamp_t rxTick[BUS_STATE_FIELD_COUNT];
+        /** @brief Cell millivolts from PPO2_MILLIS_ID, 0.01mV per count */
+        Millivolts_t millivolts[BUS_STATE_CELL_COUNT];
+        /** @brief Ambient pressure from PPO2_ATMOS_ID, mbar */
+        uint16_t atmosPressure;
+        /** @brief TANK_PRESSURE_ID payload as sent, decoding is deferred until the frame layout is known */
+        uint8_t tankPressure[BUS_STATE_TANK_PRESSURE_BYTES];
+        /** @brief Bytes of tankPressure the frame carried, the rest are 0 */
+        uint8_t tankPressureLength;
+        /** @brief Setpoint from PPO2_SETPOINT_ID */
+        PPO2_t setpoint;
+        /** @brief DIVING_ID says a dive is under way */
+        bool diving;
+        /** @brief BUS_STATUS_ID battery voltage, 0.1V per count */
+        BatteryV_t batteryVoltage;
+        /** @brief BUS_STATUS_ID setpoint */
+        PPO2_t statusSetpoint;
+        /** @brief BUS_STATUS_ID DiveCANError_t bits */
+        uint8_t statusError;
+        /** @brief Bit per BusStateField_t, set once that frame has been heard */
+        uint8_t validMask;
+    } BusState_t;
+
+    BusState_t *BeginBusStateUpdate(void);
+    void EndBusStateUpdate(const BusStateField_t field, const Timestamp_t rxTick);
+    void ReadBusState(BusState_t *const state);
+    bool BusStateFresh(const BusState_t *const state, const BusStateField_t field, const Timestamp_t now, const Timestamp_t maxAge);
+
+#ifdef TESTING
+    void ResetBusState(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,260 @@
+#include "CellSnapshot.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* CANTask is the only writer. It fills the copy readers aren't pointed at and then bumps the version, which flips them
+ * over to it, so a reader is never looking at a half written copy and never has to wait on CANTask. A reader that gets
+ * preempted for long enough that CANTask publishes twice can come back to a copy that was rewritten under it, the
+ * version will have moved and it takes another copy */
+#define CELL_SNAPSHOT_COPIES 2U
+
+typedef struct
+{
+    CellSnapshot_t copies[CELL_SNAPSHOT_COPIES];
+    /* Publishes so far, copies[version % CELL_SNAPSHOT_COPIES] is current */
+    uint32_t version;
+} CellSnapshotStore_t;
+
+static CellSnapshotStore_t *getCellSnapshotStore(void)
+{
+    static CellSnapshotStore_t store = {0};
+    return &store;
+}
+
+/* Last reading from each source, CANTask only */
+static CellSourceReading_t *getCellSourceReading(const DiveCANType_t source)
+{
+    static CellSourceReading_t readings[CELL_SOURCE_COUNT] = {0};
+    return &(readings[source]);
+}
+
+/* Written by SetCellSourceConfig from any task, CANTask reads it a field at a time */
+static CellSourceConfig_t *getCellSourceConfig(void)
+{
+    static CellSourceConfig_t config = CELL_SOURCE_DEFAULT_CONFIG;
+    return &config;
+}
+
+/* Readings that disagreed with another live source, written by CANTask, read from anywhere */
+static uint32_t *getCellSourceMismatches(void)
+{
+    static uint32_t mismatches = 0;
+    return &mismatches;
+}
+
+/** @brief Start a publish, must be called from CANTask
+ * @return The copy readers aren't using, holding the current snapshot for the caller to update
+ */
+static CellSnapshot_t *beginPublish(void)
+{
+    CellSnapshotStore_t *const store = getCellSnapshotStore();
+    const uint32_t version = __atomic_load_n(&store->version, __ATOMIC_RELAXED);
+    CellSnapshot_t *const next = &(store->copies[(version + 1U) % CELL_SNAPSHOT_COPIES]);
+    *next = store->copies[version % CELL_SNAPSHOT_COPIES];
+    return next;
+}
+
+/** @brief Point readers at the copy beginPublish handed out */
+static void endPublish(void)
+{
+    CellSnapshotStore_t *const store = getCellSnapshotStore();
+    const uint32_t version = __atomic_load_n(&store->version, __ATOMIC_RELAXED);
+    __atomic_store_n(&store->version, version + 1U, __ATOMIC_RELEASE);
+}
+
+/** @brief Whether a source has been heard from within fallbackTicks of now */
+static bool sourceLive(const CellSourceReading_t *const reading, const Timestamp_t now, const Timestamp_t fallbackTicks)
+{
+    return (0U != reading->count) && ((now - reading->rxTick) < fallbackTicks);
+}
+
+/** @brief Whether two sources' takes on a cell are too far apart, a failed cell on either side isn't compared */
+static bool cellDisagrees(const int16_t cell, const int16_t other)
+{
+    return (PPO2_FAIL != cell) && (PPO2_FAIL != other) && (abs(cell - other) > MAX_DEVIATION);
+}
+
+/** @brief Compare a reading against every other live source
+ * @param failDisagreeing Mark the cells that disagree as PPO2_FAIL in values
+ * @return True if any cell disagreed with any source
+ */
+static bool checkAgreement(CellValues_t *const values, const DiveCANType_t source, const Timestamp_t now,
+                           const Timestamp_t fallbackTicks, const bool failDisagreeing)
+{
+    bool mismatch = false;
+    for (uint8_t other = 0; other < CELL_SOURCE_COUNT; ++other)
+    {
+        const CellSourceReading_t *const reading = getCellSourceReading((DiveCANType_t)other);
+        if ((other != source) && sourceLive(reading, now, fallbackTicks))
+        {
+            int16_t *const cells[] = {&values->C1, &values->C2, &values->C3};
+            const int16_t otherCells[] = {reading->values.C1, reading->values.C2, reading->values.C3};
+            for (uint8_t i = 0; i < (sizeof(otherCells) / sizeof(otherCells[0])); ++i)
+            {
+                if (cellDisagrees(*cells[i], otherCells[i]))
+                {
+                    mismatch = true;
+                    if (failDisagreeing)
+                    {
+                        *cells[i] = PPO2_FAIL;
+                    }
+                }
+            }
+        }
+    }
+    return mismatch;
+}
+
+/**
+ * @brief File a PPO2_PPO2_ID reading under its source and publish it if the selection policy picks it, must be called
+ * from CANTask. Every reading is checked against the other live sources whatever the policy, a disagreement counts
+ * towards GetCellSourceMismatches
+ * @param values Cell values
+ * @param source Source nibble of the frame, readings from outside the DiveCANType_t range are ignored
+ * @param rxTick Tick the frame arrived on
+ */
+void PublishCellValues(const CellValues_t *const values, const DiveCANType_t source, const Timestamp_t rxTick)
+{
+    assert(NULL != values);
+    if (source < CELL_SOURCE_COUNT)
+    {
+        const CellSourceConfig_t *const config = getCellSourceConfig();
+        const CellSourcePolicy_t policy = __atomic_load_n(&config->policy, __ATOMIC_RELAXED);
+        const DiveCANType_t preferred = __atomic_load_n(&config->preferred, __ATOMIC_RELAXED);
+        const Timestamp_t fallbackTicks = __atomic_load_n(&config->fallbackTicks, __ATOMIC_RELAXED);
+
+        CellValues_t shown = *values;
+        if (checkAgreement(&shown, source, rxTick, fallbackTicks, CELL_SOURCE_AGREEMENT == policy))
+        {
+            (void)__atomic_fetch_add(getCellSourceMismatches(), 1U, __ATOMIC_RELAXED);
+        }
+
+        /* Only asks whether the preferred source is live before this reading is filed, so a quiet preferred source
+         * doesn't count itself as live */
+        const bool selected = (CELL_SOURCE_FRESHEST == policy) || (source == preferred) ||
+                              (!sourceLive(getCellSourceReading(preferred), rxTick, fallbackTicks));
+
+        CellSourceReading_t *const reading = getCellSourceReading(source);
+        reading->values = *values;
+        reading->rxTick = rxTick;
+        ++reading->count;
+
+        if (selected)
+        {
+            CellSnapshot_t *const next = beginPublish();
+            next->values = shown;
+            next->rxTick = rxTick;
+            next->source = source;
+            ++next->sequence;
+            endPublish();
+        }
+    }
+}
+
+/**
+ * @brief Publish a PPO2_STATUS_ID voting mask, must be called from CANTask
+ * @param statusMask Bit per cell, set if it is voted in
+ * @param rxTick Tick the frame arrived on
+ */
+void PublishCellStatus(const uint8_t statusMask, const Timestamp_t rxTick)
+{
+    CellSnapshot_t *const next = beginPublish();
+    next->statusMask = statusMask;
+    next->statusTick = rxTick;
+    ++next->statusSequence;
+    endPublish();
+}
+
+/**
+ * @brief Copy out the latest cell readings, from any task. Doesn't consume anything, every caller sees the same
+ * snapshot until the next publish
+ * @param snapshot Output, all zero until the first publish
+ */
+void ReadCellSnapshot(CellSnapshot_t *const snapshot)
+{
+    assert(NULL != snapshot);
+    const CellSnapshotStore_t *const store = getCellSnapshotStore();
+    uint32_t before = 0;
+    uint32_t after = 0;
+    do
+    {
+        before = __atomic_load_n(&store->version, __ATOMIC_ACQUIRE);
+        *snapshot = store->copies[before % CELL_SNAPSHOT_COPIES];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&store->version, __ATOMIC_RELAXED);
+    } while (before != after);
+}
+
+/**
+ * @brief The last reading heard from one source, must be called from CANTask
+ * @param source Source to look up
+ * @param reading Output
+ * @return false if the source has never been heard from or is out of range, reading is then untouched
+ */
+bool GetCellSourceReading(const DiveCANType_t source, CellSourceReading_t *const reading)
+{
+    assert(NULL != reading);
+    bool heard = false;
+    if ((source < CELL_SOURCE_COUNT) && (0U != getCellSourceReading(source)->count))
+    {
+        *reading = *getCellSourceReading(source);
+        heard = true;
+    }
+    return heard;
+}
+
+/**
+ * @brief How many readings have disagreed with another live source by more than MAX_DEVIATION on some cell
+ */
+uint32_t GetCellSourceMismatches(void)
+{
+    return __atomic_load_n(getCellSourceMismatches(), __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Choose how readings from several sources are shown, takes effect from the next reading
+ * @param config Policy, preferred source (must be a DiveCANType_t) and a non-zero fallback
+ */
+void SetCellSourceConfig(const CellSourceConfig_t *const config)
+{
+    assert(NULL != config);
+    assert(config->preferred < CELL_SOURCE_COUNT);
+    assert(config->fallbackTicks > 0);
+
+    CellSourceConfig_t *const current = getCellSourceConfig();
+    __atomic_store_n(&current->policy, config->policy, __ATOMIC_RELAXED);
+    __atomic_store_n(&current->preferred, config->preferred, __ATOMIC_RELAXED);
+    __atomic_store_n(&current->fallbackTicks, config->fallbackTicks, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Read back the source selection settings
+ * @param config Output
+ */
+void GetCellSourceConfig(CellSourceConfig_t *const config)
+{
+    assert(NULL != config);
+    const CellSourceConfig_t *const current = getCellSourceConfig();
+    config->policy = __atomic_load_n(&current->policy, __ATOMIC_RELAXED);
+    config->preferred = __atomic_load_n(&current->preferred, __ATOMIC_RELAXED);
+    config->fallbackTicks = __atomic_load_n(&current->fallbackTicks, __ATOMIC_RELAXED);
+}
+
+#ifdef TESTING
+/**
+ * @brief Back to nothing published, no sources heard and the default selection
+ */
+void ResetCellSnapshot(void)
+{
+    CellSnapshotStore_t *const store = getCellSnapshotStore();
+    (void)memset(store, 0, sizeof(*store));
+    for (uint8_t source = 0; source < CELL_SOURCE_COUNT; ++source)
+    {
+        (void)memset(getCellSourceReading((DiveCANType_t)source), 0, sizeof(CellSourceReading_t));
+    }
+    const CellSourceConfig_t defaultConfig = CELL_SOURCE_DEFAULT_CONFIG;
+    *getCellSourceConfig() = defaultConfig;
+    __atomic_store_n(getCellSourceMismatches(), 0U, __ATOMIC_RELAXED);
+}
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+#include "../common.h"
+#include "DiveCAN.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Rows in the per source table, indexed by the source nibble, which is a DiveCANType_t on a real bus */
+#define CELL_SOURCE_COUNT (DIVECAN_REVO + 1)
+
+/* Until set otherwise we show the SOLO, and another source only once the SOLO has gone quiet for 2s */
+#define CELL_SOURCE_DEFAULT_CONFIG {CELL_SOURCE_PREFERRED, DIVECAN_SOLO, TIMEOUT_2S_TICKS}
+
+    /**
+     * @brief Which source's PPO2_PPO2_ID readings get shown when more than one is on the bus
+     */
+    typedef enum
+    {
+        /** @brief The preferred source, another only while the preferred one has been quiet for fallbackTicks */
+        CELL_SOURCE_PREFERRED = 0,
+        /** @brief Whichever source was heard from last */
+        CELL_SOURCE_FRESHEST,
+        /** @brief As CELL_SOURCE_PREFERRED, but a cell another live source disagrees on by more than MAX_DEVIATION is
+         * shown as failed */
+        CELL_SOURCE_AGREEMENT
+    } CellSourcePolicy_t;
+
+    typedef struct
+    {
+        CellSourcePolicy_t policy;
+        DiveCANType_t preferred;
+        /** @brief How long after its last reading a source still counts as live, for fallback and comparison */
+        Timestamp_t fallbackTicks;
+    } CellSourceConfig_t;
+
+    /**
+     * @brief The last PPO2_PPO2_ID reading from one source
+     */
+    typedef struct
+    {
+        CellValues_t values;
+        /** @brief Tick the values arrived on */
+        Timestamp_t rxTick;
+        /** @brief Readings from this source, 0 if never heard from */
+        uint32_t count;
+    } CellSourceReading_t;
+
+    /**
+     * @brief The latest cell readings heard on the bus, CANTask publishes and any task can take a copy
+     */
+    typedef struct
+    {
+        /** @brief Latest PPO2_PPO2_ID values */
+        CellValues_t values;
+        /** @brief Tick the values arrived on */
+        Timestamp_t rxTick;
+        /** @brief Source the values came from */
+        DiveCANType_t source;
+        /** @brief PPO2_PPO2_ID frames published, 0 if none yet. A reader that last saw a lower number has a new reading */
+        uint32_t sequence;
+        /** @brief Latest PPO2_STATUS_ID voting mask, bit per cell */
+        uint8_t statusMask;
+        /** @brief Tick the status mask arrived on */
+        Timestamp_t statusTick;
+        /** @brief PPO2_STATUS_ID frames published, 0 if none yet */
+        uint32_t statusSequence;
+    } CellSnapshot_t;
+
+    void PublishCellValues(const CellValues_t *const values, const DiveCANType_t source, const Timestamp_t rxTick);
+    void PublishCellStatus(const uint8_t statusMask, const Timestamp_t rxTick);
+    void ReadCellSnapshot(CellSnapshot_t *const snapshot);
+    bool GetCellSourceReading(const DiveCANType_t source, CellSourceReading_t *const reading);
+    uint32_t GetCellSourceMismatches(void);
+    void SetCellSourceConfig(const CellSourceConfig_t *const config);
+    void GetCellSourceConfig(CellSourceConfig_t *const config);
+
+#ifdef TESTING
+    void ResetCellSnapshot(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,11 +1,17 @@
 #include "DiveCAN.h"
 #include <string.h>
+#include <assert.h>
 #include "cmsis_os.h"
-#include "../Hardware/pwr_management.h"
+#include "main.h"
 #include "../Hardware/printer.h"
 #include "../errors.h"
+#include "../shutdown_state_machine.h"
+#include "Sniffer.h"
+#include "CellSnapshot.h"
+#include "BusState.h"
 
 void CANTask(void *arg);
+void DispatchMessage(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
 void RespBusInit(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
 void RespPing(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
 void RespCal(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
@@ -14,18 +20,24 @@ void RespSetpoint(const DiveCANMessage_t *const message, const DiveCANDevice_t *
 void RespAtmos(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
 void RespShutdown(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
 void RespSerialNumber(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void RespRxStats(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void RespLatencyHistogram(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void RespSniffer(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void RespSnifferRead(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void DispatchStampedMessage(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec, const uint32_t rxCycles, const Timestamp_t rxTick);
+void RecordDiveCANRx(const DiveCANMessage_t *const message, const Timestamp_t arrivalTick);
 void RespPPO2(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
 void RespPPO2Status(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
-void RespDiving(const DiveCANMessage_t *const message);
+void RespDiving(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void RespMillivolts(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void RespTankPressure(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+void RespBusStatus(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
 void updatePIDPGain(const DiveCANMessage_t *const message);
 void updatePIDIGain(const DiveCANMessage_t *const message);
 void updatePIDDGain(const DiveCANMessage_t *const message);
 
 static const uint8_t DIVECAN_TYPE_MASK = 0xF;
 
-extern osMessageQueueId_t PPO2QueueHandle;
-extern osMessageQueueId_t CellStatQueueHandle;
-
 /* FreeRTOS tasks */
 
 static osThreadId_t *getOSThreadId(void)
@@ -41,8 +53,6 @@ typedef struct
 
 void InitDiveCAN(const DiveCANDevice_t *const deviceSpec)
 {
-    InitRXQueue();
-
     static uint8_t CANTask_buffer[CANTASK_STACK_SIZE];
     static StaticTask_t CANTask_ControlBlock;
     static DiveCANTask_params_t task_params;
@@ -62,6 +72,476 @@ void InitDiveCAN(const DiveCANDevice_t *const deviceSpec)
     *CANTaskHandle = osThreadNew(CANTask, &task_params, &CANTask_attributes);
 }
 
+typedef void (*DiveCANHandler_t)(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+
+/* Source device filters, a bit per DiveCANType_t, DIVECAN_SOURCE_ANY lets everything through */
+#define DIVECAN_SOURCE(devType) (1UL << (devType))
+#define DIVECAN_SOURCE_ANY 0UL
+#define DIVECAN_SOURCE_HEAD (DIVECAN_SOURCE(DIVECAN_SOLO) | DIVECAN_SOURCE(DIVECAN_OBOE))
+
+/* Every message type we recognise, X(ID, handler or NULL if we don't act on it, sources we act on).
+ * Adding a handler is a line here, the lookup tables are generated from it */
+#define DIVECAN_DISPATCH_LIST(X)                                     \
+    X(BUS_ID_ID, RespPing, DIVECAN_SOURCE_HEAD)                      \
+    X(BUS_NAME_ID, NULL, DIVECAN_SOURCE_ANY)                         \
+    X(BUS_OFF_ID, RespShutdown, DIVECAN_SOURCE_ANY)                  \
+    X(PPO2_PPO2_ID, RespPPO2, DIVECAN_SOURCE_ANY)                    \
+    X(HUD_STAT_ID, NULL, DIVECAN_SOURCE_ANY)                         \
+    X(PPO2_ATMOS_ID, RespAtmos, DIVECAN_SOURCE_ANY)                  \
+    X(MENU_ID, NULL, DIVECAN_SOURCE_ANY)                             \
+    X(TANK_PRESSURE_ID, RespTankPressure, DIVECAN_SOURCE_ANY)        \
+    X(PPO2_MILLIS_ID, RespMillivolts, DIVECAN_SOURCE_ANY)            \
+    X(CAL_ID, NULL, DIVECAN_SOURCE_ANY)                              \
+    X(CAL_REQ_ID, NULL, DIVECAN_SOURCE_ANY)                          \
+    X(CO2_STATUS_ID, NULL, DIVECAN_SOURCE_ANY)                       \
+    X(CO2_ID, NULL, DIVECAN_SOURCE_ANY)                              \
+    X(CO2_CAL_ID, NULL, DIVECAN_SOURCE_ANY)                          \
+    X(CO2_CAL_REQ_ID, NULL, DIVECAN_SOURCE_ANY)                      \
+    X(BUS_MENU_OPEN_ID, NULL, DIVECAN_SOURCE_ANY)                    \
+    X(BUS_INIT_ID, NULL, DIVECAN_SOURCE_ANY)                         \
+    X(RMS_TEMP_ID, NULL, DIVECAN_SOURCE_ANY)                         \
+    X(RMS_TEMP_ENABLED_ID, NULL, DIVECAN_SOURCE_ANY)                 \
+    X(PPO2_SETPOINT_ID, RespSetpoint, DIVECAN_SOURCE_ANY)            \
+    X(PPO2_STATUS_ID, RespPPO2Status, DIVECAN_SOURCE_ANY)            \
+    X(BUS_STATUS_ID, RespBusStatus, DIVECAN_SOURCE_ANY)              \
+    X(DIVING_ID, RespDiving, DIVECAN_SOURCE_ANY)                     \
+    X(CAN_SERIAL_NUMBER_ID, RespSerialNumber, DIVECAN_SOURCE_ANY)    \
+    X(RX_STATS_REQ_ID, RespRxStats, DIVECAN_SOURCE_ANY)              \
+    X(LATENCY_HIST_REQ_ID, RespLatencyHistogram, DIVECAN_SOURCE_ANY) \
+    X(SNIFFER_REQ_ID, RespSniffer, DIVECAN_SOURCE_ANY)               \
+    X(SNIFFER_READ_REQ_ID, RespSnifferRead, DIVECAN_SOURCE_ANY)
+
+typedef enum
+{
+    DISPATCH_UNKNOWN = 0, /* Slot 0 catches everything not in DIVECAN_DISPATCH_LIST */
+#define DIVECAN_DISPATCH_ENUM(listId, handler, sources) DISPATCH_##listId,
+    DIVECAN_DISPATCH_LIST(DIVECAN_DISPATCH_ENUM)
+#undef DIVECAN_DISPATCH_ENUM
+        DISPATCH_COUNT
+} DiveCANDispatchSlot_t;
+
+static_assert(DISPATCH_COUNT <= 256, "Dispatch slots must fit the uint8_t index");
+
+/* Every ID that CANTask does something with must get through the hardware filters. A NULL handler doesn't have the
+ * handler type, so _Generic picks those entries out without evaluating anything */
+#define DIVECAN_DISPATCH_HANDLED(handler) _Generic((handler), DiveCANHandler_t: true, default: false)
+#define DIVECAN_DISPATCH_FILTER_CHECK(listId, handler, sources) \
+    static_assert((!DIVECAN_DISPATCH_HANDLED(handler)) || DIVECAN_RX_ACCEPTED(listId), #listId " handled but filtered out");
+DIVECAN_DISPATCH_LIST(DIVECAN_DISPATCH_FILTER_CHECK)
+#undef DIVECAN_DISPATCH_FILTER_CHECK
+#undef DIVECAN_DISPATCH_HANDLED
+
+typedef struct
+{
+    uint32_t id; /* Full masked ID, the type byte alone isn't unique (BUS_ID vs LOG_TEXT) */
+    DiveCANHandler_t handler;
+    uint32_t sources;
+} DiveCANDispatch_t;
+
+static const DiveCANDispatch_t dispatchTable[DISPATCH_COUNT] = {
+    [DISPATCH_UNKNOWN] = {0, NULL, DIVECAN_SOURCE_ANY},
+#define DIVECAN_DISPATCH_ENTRY(listId, handler, sources) [DISPATCH_##listId] = {(listId), (handler), (sources)},
+    DIVECAN_DISPATCH_LIST(DIVECAN_DISPATCH_ENTRY)
+#undef DIVECAN_DISPATCH_ENTRY
+};
+
+/* Type byte -> dispatch slot, anything not listed is 0 (DISPATCH_UNKNOWN) */
+static const uint8_t dispatchIndex[DIVECAN_ID_TYPE_COUNT] = {
+#define DIVECAN_DISPATCH_INDEX(listId, handler, sources) [DIVECAN_ID_TYPE(listId)] = DISPATCH_##listId,
+    DIVECAN_DISPATCH_LIST(DIVECAN_DISPATCH_INDEX)
+#undef DIVECAN_DISPATCH_INDEX
+};
+
+/* Debug names, only read when logging so they stay out of the dispatch path */
+static const char *const dispatchNames[DISPATCH_COUNT] = {
+    [DISPATCH_UNKNOWN] = "UNKNOWN",
+#define DIVECAN_DISPATCH_NAME(listId, handler, sources) [DISPATCH_##listId] = #listId,
+    DIVECAN_DISPATCH_LIST(DIVECAN_DISPATCH_NAME)
+#undef DIVECAN_DISPATCH_NAME
+};
+
+/* Per slot counters, only touched by CANTask */
+static DiveCANDispatchCount_t *getDispatchCounts(void)
+{
+    static DiveCANDispatchCount_t dispatchCounts[DISPATCH_COUNT] = {0};
+    return dispatchCounts;
+}
+
+/* Source nibbles, the reception statistics keep a column per possible source */
+#define DIVECAN_SOURCE_COUNT 16U
+
+/* Reception statistics, a row per dispatch slot and a column per source, only touched by CANTask */
+static DiveCANRxStat_t *getRxStat(const DiveCANDispatchSlot_t slot, const uint32_t source)
+{
+    static DiveCANRxStat_t rxStats[DISPATCH_COUNT][DIVECAN_SOURCE_COUNT] = {0};
+    return &(rxStats[slot][source & DIVECAN_TYPE_MASK]);
+}
+
+static_assert((DIVECAN_UNKNOWN_ID_SLOTS & (DIVECAN_UNKNOWN_ID_SLOTS - 1U)) == 0, "DIVECAN_UNKNOWN_ID_SLOTS must be a power of two");
+
+/* Fibonacci hashing constant, 2^32 / golden ratio */
+#define UNKNOWN_ID_HASH 2654435761U
+#define CAN_EXT_ID_MASK 0x1FFFFFFFU
+
+/* Open addressed (linear probe) set of unknown IDs, an entry with a count of 0 is free. Only touched by CANTask */
+typedef struct
+{
+    DiveCANUnknownId_t entries[DIVECAN_UNKNOWN_ID_SLOTS];
+    /* Each entry's count as of the last summary, so only IDs seen since get logged again */
+    uint32_t summarised[DIVECAN_UNKNOWN_ID_SLOTS];
+    /* Frames with an ID that found the set full */
+    uint32_t overflow;
+    uint32_t overflowSummarised;
+    Timestamp_t lastSummary;
+} DiveCANUnknownIds_t;
+
+static DiveCANUnknownIds_t *getUnknownIds(void)
+{
+    static DiveCANUnknownIds_t unknownIds = {0};
+    return &unknownIds;
+}
+
+/* RX ISR entry stamp of the frame being dispatched, so handlers can pass it downstream. Only touched by CANTask */
+static uint32_t *getDispatchRxCycles(void)
+{
+    static uint32_t rxCycles = 0;
+    return &rxCycles;
+}
+
+/* Tick the frame being dispatched arrived on, for handlers that publish its payload. Only touched by CANTask */
+static Timestamp_t *getDispatchRxTick(void)
+{
+    static Timestamp_t rxTick = 0;
+    return &rxTick;
+}
+
+/* Sequence of the value CANTask last took from each coalesced slot. Only touched by CANTask */
+static uint32_t *getCoalescedSeen(void)
+{
+    static uint32_t seen[CAN_COALESCED_SLOT_COUNT] = {0};
+    return seen;
+}
+
+/* PPO2 frame to LED histogram, only written by the RGB task, CANTask reads it for the debug reply */
+static PPO2LatencyHistogram_t *getLatencyHistogram(void)
+{
+    static PPO2LatencyHistogram_t histogram = {0};
+    return &histogram;
+}
+
+/** @brief Constant time lookup of the dispatch slot for an ID, any source/dest */
+static DiveCANDispatchSlot_t dispatchSlot(const uint32_t id)
+{
+    DiveCANDispatchSlot_t slot = (DiveCANDispatchSlot_t)dispatchIndex[DIVECAN_ID_TYPE(id)];
+    if (dispatchTable[slot].id != (id & ID_MASK))
+    {
+        slot = DISPATCH_UNKNOWN;
+    }
+    return slot;
+}
+
+/** @brief Slot an ID lives in, or the free slot it would go in, or DIVECAN_UNKNOWN_ID_SLOTS if it isn't there and the set is full */
+static uint32_t unknownIdSlot(const DiveCANUnknownIds_t *const unknownIds, const uint32_t id)
+{
+    uint32_t slot = (id * UNKNOWN_ID_HASH) & (DIVECAN_UNKNOWN_ID_SLOTS - 1U);
+    uint32_t found = DIVECAN_UNKNOWN_ID_SLOTS;
+    for (uint32_t probe = 0; (probe < DIVECAN_UNKNOWN_ID_SLOTS) && (DIVECAN_UNKNOWN_ID_SLOTS == found); ++probe)
+    {
+        const DiveCANUnknownId_t *const entry = &(unknownIds->entries[slot]);
+        if ((0U == entry->count) || (id == entry->id))
+        {
+            found = slot;
+        }
+        slot = (slot + 1U) & (DIVECAN_UNKNOWN_ID_SLOTS - 1U);
+    }
+    return found;
+}
+
+/** @brief Count a frame we don't handle against its ID, logging it the first time that ID turns up.
+ * Repeats only bump the count, ReportDiveCANUnknownIds summarises them
+ * @param message Unknown message
+ */
+static void recordUnknownId(const DiveCANMessage_t *const message)
+{
+    DiveCANUnknownIds_t *const unknownIds = getUnknownIds();
+    const uint32_t id = message->id & CAN_EXT_ID_MASK;
+    const Timestamp_t now = osKernelGetTickCount();
+    const uint32_t slot = unknownIdSlot(unknownIds, id);
+
+    if (DIVECAN_UNKNOWN_ID_SLOTS == slot)
+    {
+        ++unknownIds->overflow;
+    }
+    else
+    {
+        DiveCANUnknownId_t *const entry = &(unknownIds->entries[slot]);
+        if (0U == entry->count)
+        {
+            entry->id = id;
+            entry->firstTick = now;
+            serial_printf("Unknown message 0x%x: [0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x]\n\r", id,
+                          message->data[0], message->data[1], message->data[2], message->data[3], message->data[4], message->data[5], message->data[6], message->data[7]);
+        }
+        ++entry->count;
+        entry->lastTick = now;
+    }
+}
+
+/** @brief Act on a single inbound message, whichever path (ring or coalesced slot) it came through
+ * @param message Message to handle
+ * @param deviceSpec Our device details for any response
+ */
+void DispatchMessage(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    const DiveCANDispatchSlot_t slot = dispatchSlot(message->id);
+    const DiveCANDispatch_t *const entry = &(dispatchTable[slot]);
+    DiveCANDispatchCount_t *const count = &(getDispatchCounts()[slot]);
+
+    if (DISPATCH_UNKNOWN == slot)
+    {
+        ++count->hits;
+        recordUnknownId(message);
+    }
+    else if ((DIVECAN_SOURCE_ANY != entry->sources) && (0U == (entry->sources & DIVECAN_SOURCE(message->id & DIVECAN_TYPE_MASK))))
+    {
+        /* Not from a device we listen to for this message */
+        ++count->filtered;
+    }
+    else
+    {
+        ++count->hits;
+        if (NULL != entry->handler)
+        {
+            entry->handler(message, deviceSpec);
+        }
+    }
+}
+
+/** @brief Dispatch a message along with the DWT cycle count its RX ISR was entered at, which the PPO2 handler carries to the LEDs,
+ * and the tick it arrived on
+ * @param message Message to handle
+ * @param deviceSpec Our device details for any response
+ * @param rxCycles DWT->CYCCNT at RX ISR entry
+ * @param rxTick Kernel tick the frame arrived on
+ */
+void DispatchStampedMessage(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec, const uint32_t rxCycles, const Timestamp_t rxTick)
+{
+    *getDispatchRxCycles() = rxCycles;
+    *getDispatchRxTick() = rxTick;
+    DispatchMessage(message, deviceSpec);
+}
+
+/** @brief Dispatch counters for a message type, must be called from CANTask
+ * @param id Message ID, source/dest are ignored
+ * @param count Output
+ * @return false if the ID isn't one we recognise (see GetDiveCANUnknownCount)
+ */
+bool GetDiveCANDispatchCount(const uint32_t id, DiveCANDispatchCount_t *const count)
+{
+    const DiveCANDispatchSlot_t slot = dispatchSlot(id);
+    *count = getDispatchCounts()[slot];
+    return DISPATCH_UNKNOWN != slot;
+}
+
+/** @brief How many messages we didn't recognise, must be called from CANTask */
+uint32_t GetDiveCANUnknownCount(void)
+{
+    return getDispatchCounts()[DISPATCH_UNKNOWN].hits;
+}
+
+/** @brief Look up an unknown ID, must be called from CANTask
+ * @param id Full 29 bit ID
+ * @param unknown Output, zeroed if the ID hasn't been seen (or didn't fit)
+ * @return True if the ID is being tracked
+ */
+bool GetDiveCANUnknownId(const uint32_t id, DiveCANUnknownId_t *const unknown)
+{
+    const DiveCANUnknownIds_t *const unknownIds = getUnknownIds();
+    const uint32_t slot = unknownIdSlot(unknownIds, id & CAN_EXT_ID_MASK);
+    DiveCANUnknownId_t entry = {0};
+    if (DIVECAN_UNKNOWN_ID_SLOTS != slot)
+    {
+        entry = unknownIds->entries[slot];
+    }
+    *unknown = entry;
+    return 0U != entry.count;
+}
+
+/** @brief Frames with an unknown ID that arrived after the set was full, must be called from CANTask */
+uint32_t GetDiveCANUnknownOverflow(void)
+{
+    return getUnknownIds()->overflow;
+}
+
+/** @brief Log a line per unknown ID seen again since the last summary, at most every DIVECAN_UNKNOWN_SUMMARY_MS.
+ * Must be called from CANTask, cheap to call on every housekeeping pass
+ * @param now Current kernel tick
+ */
+void ReportDiveCANUnknownIds(const Timestamp_t now)
+{
+    DiveCANUnknownIds_t *const unknownIds = getUnknownIds();
+    if ((now - unknownIds->lastSummary) >= pdMS_TO_TICKS(DIVECAN_UNKNOWN_SUMMARY_MS))
+    {
+        unknownIds->lastSummary = now;
+        for (uint32_t slot = 0; slot < DIVECAN_UNKNOWN_ID_SLOTS; ++slot)
+        {
+            const DiveCANUnknownId_t *const entry = &(unknownIds->entries[slot]);
+            if (entry->count != unknownIds->summarised[slot])
+            {
+                serial_printf("Unknown 0x%x: %u (+%u), first %u, last %u\n\r", entry->id, entry->count,
+                              entry->count - unknownIds->summarised[slot], entry->firstTick, entry->lastTick);
+                unknownIds->summarised[slot] = entry->count;
+            }
+        }
+        if (unknownIds->overflow != unknownIds->overflowSummarised)
+        {
+            serial_printf("Unknown, untracked: %u (+%u)\n\r", unknownIds->overflow, unknownIds->overflow - unknownIds->overflowSummarised);
+            unknownIds->overflowSummarised = unknownIds->overflow;
+        }
+    }
+}
+
+/** @brief Fold one arrival into the reception statistics for its type and source, must be called from CANTask
+ * @param message Received message
+ * @param arrivalTick Kernel tick it arrived on
+ */
+void RecordDiveCANRx(const DiveCANMessage_t *const message, const Timestamp_t arrivalTick)
+{
+    DiveCANRxStat_t *const stat = getRxStat(dispatchSlot(message->id), message->id);
+
+    if (0U != stat->count)
+    {
+        const uint32_t elapsed = arrivalTick - stat->lastTick;
+        const uint16_t interval = (elapsed > UINT16_MAX) ? UINT16_MAX : (uint16_t)elapsed;
+        const uint32_t scaled = (uint32_t)interval << DIVECAN_RX_STAT_MEAN_FRAC_BITS;
+
+        if (1U == stat->count)
+        {
+            /* First interval seeds everything */
+            stat->minInterval = interval;
+            stat->maxInterval = interval;
+            stat->meanInterval = scaled;
+        }
+        else
+        {
+            if (interval < stat->minInterval)
+            {
+                stat->minInterval = interval;
+            }
+            if (interval > stat->maxInterval)
+            {
+                stat->maxInterval = interval;
+            }
+            const int32_t error = (int32_t)scaled - (int32_t)stat->meanInterval;
+            stat->meanInterval = (uint32_t)((int32_t)stat->meanInterval + (error / (int32_t)(1UL << DIVECAN_RX_STAT_EWMA_SHIFT)));
+        }
+    }
+    stat->lastTick = arrivalTick;
+    ++stat->count;
+}
+
+/** @brief Fold a value taken from a coalesced slot into the reception statistics, must be called from CANTask.
+ * The slot's sequence moving on by more than one since we last took it means the frames in between were overwritten
+ * before we saw them, they are counted as such
+ * @param slot Slot it was read from
+ * @param latest What ReadCoalescedCAN gave
+ */
+void RecordDiveCANCoalescedRx(const CANCoalescedSlot_t slot, const CANCoalesced_t *const latest)
+{
+    uint32_t *const seen = &(getCoalescedSeen()[slot]);
+    const uint32_t overwritten = (latest->sequence - *seen) - 1U;
+    *seen = latest->sequence;
+
+    RecordDiveCANRx(&(latest->message), latest->timestamp);
+    getRxStat(dispatchSlot(latest->message.id), latest->message.id)->overwritten += overwritten;
+}
+
+/** @brief Reception statistics for one message type from one source, must be called from CANTask
+ * @param id Message ID, the source nibble picks the column, dest is ignored
+ * @param stat Output
+ * @return false if the ID isn't one we recognise, stat is then the unknown row for that source
+ */
+bool GetDiveCANRxStat(const uint32_t id, DiveCANRxStat_t *const stat)
+{
+    const DiveCANDispatchSlot_t slot = dispatchSlot(id);
+    *stat = *getRxStat(slot, id);
+    return DISPATCH_UNKNOWN != slot;
+}
+
+/** @brief Close out a PPO2 value's trip from the wire to the LEDs, call from the RGB task when blinkCode first shows it
+ * @param rxCycles DWT cycle count at RX ISR entry, from CellValues_t
+ */
+void RecordPPO2RenderLatency(const uint32_t rxCycles)
+{
+    const uint32_t cyclesPerMicrosecond = SystemCoreClock / 1000000U;
+    uint32_t micros = (DWT->CYCCNT - rxCycles) / ((0U == cyclesPerMicrosecond) ? 1U : cyclesPerMicrosecond);
+
+    /* Bucket is the bit length of the latency in microseconds */
+    uint32_t bucket = 0;
+    while ((micros > 0U) && (bucket < (PPO2_LATENCY_BUCKET_COUNT - 1U)))
+    {
+        micros >>= 1U;
+        ++bucket;
+    }
+    ++getLatencyHistogram()->buckets[bucket];
+}
+
+/** @brief Snapshot the PPO2 frame to LED latency histogram
+ * @param histogram Output
+ */
+void GetPPO2LatencyHistogram(PPO2LatencyHistogram_t *const histogram)
+{
+    *histogram = *getLatencyHistogram();
+}
+
+/** @brief Debug name for a message ID, for logging only
+ * @param id Message ID, source/dest are ignored
+ * @return Name of the ID macro, or "UNKNOWN"
+ */
+const char *DiveCANMessageName(const uint32_t id)
+{
+    return dispatchNames[dispatchSlot(id)];
+}
+
+#ifdef TESTING
+/** @brief Zero the dispatch counters */
+void ResetDiveCANDispatchCounts(void)
+{
+    (void)memset(getDispatchCounts(), 0, sizeof(DiveCANDispatchCount_t) * DISPATCH_COUNT);
+    (void)memset(getRxStat(DISPATCH_UNKNOWN, 0), 0, sizeof(DiveCANRxStat_t) * DISPATCH_COUNT * DIVECAN_SOURCE_COUNT);
+    (void)memset(getUnknownIds(), 0, sizeof(DiveCANUnknownIds_t));
+    (void)memset(getCoalescedSeen(), 0, sizeof(uint32_t) * CAN_COALESCED_SLOT_COUNT);
+    *getDispatchRxCycles() = 0;
+    *getDispatchRxTick() = 0;
+}
+
+/** @brief Empty the PPO2 latency histogram */
+void ResetPPO2LatencyHistogram(void)
+{
+    (void)memset(getLatencyHistogram(), 0, sizeof(PPO2LatencyHistogram_t));
+}
+#endif
+
+/* While frames keep arriving CANTask runs its housekeeping at most this often, a single tick */
+#define CAN_SERVICE_PERIOD_TICKS pdMS_TO_TICKS(10U)
+
+/** @brief CANTask's housekeeping. Each call keeps its own, slower, schedule on top of this, so running them more than
+ * once a tick only costs time a burst of frames needs for dispatch
+ */
+static void serviceCANTask(void)
+{
+    UpdateCANBusLoad();
+    UpdateCANTxThroughput();
+    ServiceCANTxThrottle();
+    ServiceCANSniffer();
+    if (ServiceCANErrorState())
+    {
+        /* Anyone that saw us drop off needs to hear from us again */
+        txStartDevice(DIVECAN_MONITOR, DIVECAN_CONTROLLER);
+    }
+    ReportDiveCANUnknownIds(osKernelGetTickCount());
+}
+
 /** @brief This task is the context in which we handle inbound CAN messages (which sometimes requires a response), dispatch of our other outgoing traffic may occur elsewhere
  * @param arg
  */
@@ -71,104 +551,67 @@ void CANTask(void *arg)
     const DiveCANDevice_t *const deviceSpec = &(task_params->deviceSpec);
 
     txStartDevice(DIVECAN_MONITOR, DIVECAN_CONTROLLER);
+    Timestamp_t lastService = osKernelGetTickCount() - CAN_SERVICE_PERIOD_TICKS;
     while (true)
     {
-        DiveCANMessage_t message = {0};
-        if (pdTRUE == GetLatestCAN(TIMEOUT_1S_TICKS, &message))
+        /* Handled in place in the RX ring, the slot is ours until we release it.
+         * While bus-off nothing will arrive, so poll the recovery instead of waiting a full second.
+         * A pending shutdown is woken by the CAN_EN edge, the poll is a backstop that also catches the timeout */
+        Timestamp_t blockTime = TIMEOUT_1S_TICKS;
+        if (CANBusRecovering())
+        {
+            blockTime = TIMEOUT_10MS_TICKS;
+        }
+        else if (ShutdownPending())
+        {
+            blockTime = TIMEOUT_100MS_TICKS;
+        }
+        else
         {
-            uint32_t message_id = message.id & ID_MASK; /* Drop the source/dest stuff, we're listening for anything from anyone */
-            switch (message_id)
+            /* Nothing to poll for */
+        }
+        /* A frame held back by the bandwidth cap goes as soon as the bucket covers it */
+        blockTime = CANTxThrottleBlockTime(blockTime);
+        const CANRxFrame_t *const frame = GetLatestCAN(blockTime);
+
+        /* Housekeeping at most once a tick however many frames arrive, a timed out wait has always run that long.
+         * A tick is finer than any of it works to and the sniffer's two RAM blocks last longer than one */
+        const Timestamp_t now = osKernelGetTickCount();
+        const bool serviceDue = (now - lastService) >= CAN_SERVICE_PERIOD_TICKS;
+        if (serviceDue)
+        {
+            lastService = now;
+            serviceCANTask();
+        }
+
+        /* Coalesced state frames go first, so whatever is queued in the ring can't hold up the newest PPO2 */
+        const uint32_t dirty = TakeCoalescedCAN();
+        for (uint32_t slot = 0; slot < CAN_COALESCED_SLOT_COUNT; ++slot)
+        {
+            CANCoalesced_t latest = {0};
+            if ((0 != (dirty & (1UL << slot))) && ReadCoalescedCAN((CANCoalescedSlot_t)slot, &latest))
             {
-            case BUS_ID_ID:
-                message.type = "BUS_ID";
-                /* Respond to pings */
-                RespPing(&message, deviceSpec);
-                break;
-            case BUS_NAME_ID:
-                message.type = "BUS_NAME";
-                break;
-            case BUS_OFF_ID:
-                message.type = "BUS_OFF";
-                /* Turn off bus */
-                RespShutdown(&message, deviceSpec);
-                break;
-            case PPO2_PPO2_ID:
-                message.type = "PPO2_PPO2";
-                RespPPO2(&message, deviceSpec);
-                break;
-            case HUD_STAT_ID:
-                message.type = "HUD_STAT";
-                break;
-            case PPO2_ATMOS_ID:
-                message.type = "PPO2_ATMOS";
-                break;
-            case MENU_ID:
-                message.type = "MENU";
-                break;
-            case TANK_PRESSURE_ID:
-                message.type = "TANK_PRESSURE";
-                break;
-            case PPO2_MILLIS_ID:
-                message.type = "PPO2_MILLIS";
-                break;
-            case CAL_ID:
-                message.type = "CAL";
-                break;
-            case CAL_REQ_ID:
-                message.type = "CAL_REQ";
-                break;
-            case CO2_STATUS_ID:
-                message.type = "CO2_STATUS";
-                break;
-            case CO2_ID:
-                message.type = "CO2";
-                break;
-            case CO2_CAL_ID:
-                message.type = "CO2_CAL";
-                break;
-            case CO2_CAL_REQ_ID:
-                message.type = "CO2_CAL_REQ";
-                break;
-            case BUS_MENU_OPEN_ID:
-                message.type = "BUS_MENU_OPEN";
-                break;
-            case BUS_INIT_ID:
-                /* Bus Init */
-                message.type = "BUS_INIT";
-                break;
-            case RMS_TEMP_ID:
-                message.type = "RMS_TEMP";
-                break;
-            case RMS_TEMP_ENABLED_ID:
-                message.type = "RMS_TEMP_ENABLED";
-                break;
-            case PPO2_SETPOINT_ID:
-                message.type = "PPO2_SETPOINT";
-                break;
-            case PPO2_STATUS_ID:
-                message.type = "PPO2_STATUS";
-                RespPPO2Status(&message, deviceSpec);
-                break;
-            case BUS_STATUS_ID:
-                message.type = "BUS_STATUS";
-                break;
-            case DIVING_ID:
-                message.type = "DIVING";
-                break;
-            case CAN_SERIAL_NUMBER_ID:
-                message.type = "CAN_SERIAL_NUMBER";
-                RespSerialNumber(&message, deviceSpec);
-                break;
-            default:
-                message.type = "UNKNOWN";
-                serial_printf("Unknown message 0x%x: [0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x]\n\r", message_id,
-                              message.data[0], message.data[1], message.data[2], message.data[3], message.data[4], message.data[5], message.data[6], message.data[7]);
+                RecordDiveCANCoalescedRx((CANCoalescedSlot_t)slot, &latest);
+                DispatchStampedMessage(&latest.message, deviceSpec, latest.rxCycles, latest.timestamp);
             }
         }
+
+        if (NULL != frame)
+        {
+            RecordDiveCANRx(&(frame->message), frame->timestamp);
+            DispatchStampedMessage(&(frame->message), deviceSpec, frame->rxCycles, frame->timestamp);
+            ReleaseLatestCAN();
+        }
         else
         {
             /* We didn't get a message, soldier forth */
         }
+
+        /* After dispatch, so a BUS_OFF_ID with CAN_EN already gone is acted on this pass */
+        if (serviceDue || ShutdownPending())
+        {
+            ServiceShutdown(osKernelGetTickCount());
+        }
     }
 }
 
@@ -197,43 +640,88 @@ void RespPPO2(const DiveCANMessage_t *const message, const DiveCANDevice_t *cons
     cell_values.C1 = message->data[1];
     cell_values.C2 = message->data[2];
     cell_values.C3 = message->data[3];
+    cell_values.rxCycles = *getDispatchRxCycles();
 
-    /* Send the values to the PPO2 processing queue */
-    osMessageQueueReset(PPO2QueueHandle);
-    osStatus_t enQueueStatus = osMessageQueuePut(PPO2QueueHandle, &cell_values, 0, 0);
-    if (enQueueStatus != osOK)
-    {
-        NON_FATAL_ERROR_DETAIL(QUEUEING_ERR, enQueueStatus);
-    }
+    /* Filed under its source, the selection policy decides whether the RGB task sees it next time it draws */
+    PublishCellValues(&cell_values, (DiveCANType_t)(message->id & DIVECAN_TYPE_MASK), *getDispatchRxTick());
 }
 
 void RespPPO2Status(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
 {
     (void)deviceSpec; /* Unused, but we need to match the function signature */
-    uint8_t status = message->data[0];
+    PublishCellStatus(message->data[0], *getDispatchRxTick());
+}
+
+/* The bus state handlers below decode in place and stamp the frame's arrival tick, any task can then ReadBusState */
 
-    /* Send the status to the Cell Status processing queue */
-    osMessageQueueReset(CellStatQueueHandle);
-    osStatus_t enQueueStatus = osMessageQueuePut(CellStatQueueHandle, &status, 0, 0);
-    if (enQueueStatus != osOK)
+void RespSetpoint(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    (void)deviceSpec; /* Unused, but we need to match the function signature */
+    BusState_t *const state = BeginBusStateUpdate();
+    state->setpoint = message->data[0];
+    EndBusStateUpdate(BUS_STATE_SETPOINT, *getDispatchRxTick());
+}
+
+/** @brief data[0] is 1 while a dive is under way, the dive number and start time after it aren't kept */
+void RespDiving(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    (void)deviceSpec; /* Unused, but we need to match the function signature */
+    BusState_t *const state = BeginBusStateUpdate();
+    state->diving = (1U == message->data[0]);
+    EndBusStateUpdate(BUS_STATE_DIVING, *getDispatchRxTick());
+}
+
+/** @brief Ambient pressure in mbar, big endian in data[2] and data[3] */
+void RespAtmos(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    (void)deviceSpec; /* Unused, but we need to match the function signature */
+    BusState_t *const state = BeginBusStateUpdate();
+    state->atmosPressure = (uint16_t)(((uint16_t)message->data[2] << BYTE_WIDTH) | message->data[3]);
+    EndBusStateUpdate(BUS_STATE_ATMOS, *getDispatchRxTick());
+}
+
+/** @brief Cell millivolts, a big endian pair of bytes per cell */
+void RespMillivolts(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    (void)deviceSpec; /* Unused, but we need to match the function signature */
+    BusState_t *const state = BeginBusStateUpdate();
+    for (uint8_t cell = 0; cell < BUS_STATE_CELL_COUNT; ++cell)
     {
-        NON_FATAL_ERROR_DETAIL(QUEUEING_ERR, enQueueStatus);
+        state->millivolts[cell] = (Millivolts_t)(((uint16_t)message->data[cell * 2U] << BYTE_WIDTH) | message->data[(cell * 2U) + 1U]);
     }
+    EndBusStateUpdate(BUS_STATE_MILLIS, *getDispatchRxTick());
+}
+
+/** @brief The frame layout isn't known yet, so decoding is deferred and the whole payload is kept raw with its rx tick */
+void RespTankPressure(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    (void)deviceSpec; /* Unused, but we need to match the function signature */
+    static_assert(BUS_STATE_TANK_PRESSURE_BYTES == sizeof(message->data), "Tank pressure keeps the whole payload");
+    const uint8_t length = (message->length > BUS_STATE_TANK_PRESSURE_BYTES) ? (uint8_t)BUS_STATE_TANK_PRESSURE_BYTES : message->length;
+    BusState_t *const state = BeginBusStateUpdate();
+    (void)memset(state->tankPressure, 0, BUS_STATE_TANK_PRESSURE_BYTES);
+    (void)memcpy(state->tankPressure, message->data, length);
+    state->tankPressureLength = length;
+    EndBusStateUpdate(BUS_STATE_TANK_PRESSURE, *getDispatchRxTick());
 }
 
+/** @brief The controller's status frame, battery voltage in data[0], setpoint in data[5] and error bits in data[7] */
+void RespBusStatus(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    (void)deviceSpec; /* Unused, but we need to match the function signature */
+    BusState_t *const state = BeginBusStateUpdate();
+    state->batteryVoltage = message->data[0];
+    state->statusSetpoint = message->data[5];
+    state->statusError = message->data[7];
+    EndBusStateUpdate(BUS_STATE_STATUS, *getDispatchRxTick());
+}
+
+/** @brief The controller is powering the bus down. The shutdown state machine waits for CAN_EN to drop, so CANTask
+ * keeps handling frames right up until standby
+ */
 void RespShutdown(const DiveCANMessage_t *, const DiveCANDevice_t *)
 {
-    const uint8_t SHUTDOWN_ATTEMPTS = 20;
-    for (uint8_t i = 0; i < SHUTDOWN_ATTEMPTS; ++i)
-    {
-        if (!getBusStatus())
-        {
-            serial_printf("Performing requested shutdown");
-            Shutdown();
-        }
-        (void)osDelay(TIMEOUT_100MS_TICKS);
-    }
-    serial_printf("Shutdown attempted but timed out due to missing en signal");
+    RequestBusShutdown(osKernelGetTickCount());
 }
 
 void RespSerialNumber(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
@@ -244,3 +732,94 @@ void RespSerialNumber(const DiveCANMessage_t *const message, const DiveCANDevice
     (void)memcpy(serial_number, message->data, sizeof(message->data));
     serial_printf("Received Serial Number of device %d: %s", origin, serial_number);
 }
+
+/** @brief Answer a reception statistics request, data[0] is the message type byte and data[1] the source nibble.
+ * Unlisted type bytes get the unknown row. Replies with RX_STATS_ID, see txRxStats
+ */
+void RespRxStats(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    const DiveCANDispatchSlot_t slot = (DiveCANDispatchSlot_t)dispatchIndex[message->data[0]];
+    const DiveCANRxStat_t *const stat = getRxStat(slot, message->data[1]);
+
+    const uint16_t count = (stat->count > UINT16_MAX) ? UINT16_MAX : (uint16_t)stat->count;
+    const uint32_t mean = (stat->meanInterval + (1UL << (DIVECAN_RX_STAT_MEAN_FRAC_BITS - 1U))) >> DIVECAN_RX_STAT_MEAN_FRAC_BITS;
+    txRxStats(deviceSpec->type, count, stat->minInterval, stat->maxInterval, (mean > UINT16_MAX) ? UINT16_MAX : (uint16_t)mean);
+}
+
+/** @brief Answer a latency histogram request, data[0] is the first of the 4 buckets wanted.
+ * Replies with LATENCY_HIST_ID, see txLatencyHistogram, buckets past the end read as 0
+ */
+void RespLatencyHistogram(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    const PPO2LatencyHistogram_t *const histogram = getLatencyHistogram();
+    uint16_t counts[4] = {0};
+    for (uint32_t i = 0; i < 4U; ++i)
+    {
+        const uint32_t bucket = (uint32_t)message->data[0] + i;
+        if (bucket < PPO2_LATENCY_BUCKET_COUNT)
+        {
+            counts[i] = (histogram->buckets[bucket] > UINT16_MAX) ? UINT16_MAX : (uint16_t)histogram->buckets[bucket];
+        }
+    }
+    txLatencyHistogram(deviceSpec->type, counts[0], counts[1], counts[2], counts[3]);
+}
+
+/* SNIFFER_REQ_ID commands, data[0] */
+#define SNIFFER_CMD_STOP 0U
+#define SNIFFER_CMD_START 1U
+#define SNIFFER_CMD_STATUS 2U
+
+/* Chunks a single read request can ask for, they all go out back to back on the diagnostic ring */
+#define SNIFFER_READ_MAX_CHUNKS 8U
+
+static uint16_t saturate16(const uint32_t value)
+{
+    return (value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+}
+
+/** @brief Start, stop or query the bus sniffer, data[0] is a SNIFFER_CMD_*.
+ * Replies with SNIFFER_STATUS_ID, see txSnifferStatus. A start gets no reply, we are listen-only by the time it would go out
+ */
+void RespSniffer(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    if (SNIFFER_CMD_START == message->data[0])
+    {
+        StartCANSniffer();
+    }
+    else if (SNIFFER_CMD_STOP == message->data[0])
+    {
+        StopCANSniffer();
+    }
+    else
+    {
+        /* Status only */
+    }
+
+    SnifferStats_t stats = {0};
+    GetCANSnifferStats(&stats);
+    txSnifferStatus(deviceSpec->type, stats.active, saturate16(stats.frames), saturate16(stats.dropped), saturate16(stats.blocks));
+}
+
+/** @brief Download part of the bus sniffer's flash ring, data[0..1] is the first SNIFFER_CHUNK_LEN byte chunk wanted and
+ * data[2] how many (at most SNIFFER_READ_MAX_CHUNKS). Replies with a SNIFFER_DATA_ID frame per chunk, see txSnifferData,
+ * the last chunk of the ring is short and anything past it is not sent. Nothing is sent while recording
+ */
+void RespSnifferRead(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec)
+{
+    const uint32_t firstChunk = ((uint32_t)message->data[0] << 8) | message->data[1];
+    const uint32_t chunkCount = (message->data[2] > SNIFFER_READ_MAX_CHUNKS) ? SNIFFER_READ_MAX_CHUNKS : message->data[2];
+
+    bool readable = true;
+    for (uint32_t chunk = firstChunk; readable && (chunk < (firstChunk + chunkCount)); ++chunk)
+    {
+        const uint32_t offset = chunk * SNIFFER_CHUNK_LEN;
+        const uint32_t remaining = (offset < GetCANSnifferFlashSize()) ? (GetCANSnifferFlashSize() - offset) : 0U;
+        const uint8_t length = (remaining > SNIFFER_CHUNK_LEN) ? (uint8_t)SNIFFER_CHUNK_LEN : (uint8_t)remaining;
+        uint8_t data[SNIFFER_CHUNK_LEN] = {0};
+        readable = (0U != length) && ReadCANSnifferFlash(offset, data, length);
+        if (readable)
+        {
+            txSnifferData(deviceSpec->type, (uint16_t)chunk, data, length);
+        }
+    }
+}
@@ -29,9 +29,85 @@ extern "C"
         int16_t C1;
         int16_t C2;
         int16_t C3;
+        /** @brief DWT cycle count at entry to the RX ISR that received these values */
+        uint32_t rxCycles;
     } CellValues_t;
 
+    /**
+     * @brief How often CANTask has seen a message type
+     */
+    typedef struct
+    {
+        /** @brief Messages handled (or recognised and deliberately ignored) */
+        uint32_t hits;
+        /** @brief Messages dropped because they came from a source we don't act on */
+        uint32_t filtered;
+    } DiveCANDispatchCount_t;
+
+/* Smoothing for DiveCANRxStat_t.meanInterval, each new interval moves the average 1/2^shift of the way */
+#define DIVECAN_RX_STAT_EWMA_SHIFT 3U
+/* DiveCANRxStat_t.meanInterval fractional bits */
+#define DIVECAN_RX_STAT_MEAN_FRAC_BITS 8U
+
+    /**
+     * @brief Reception statistics for one message type from one source, intervals in kernel ticks
+     */
+    typedef struct
+    {
+        /** @brief Frames seen */
+        uint32_t count;
+        /** @brief Frames replaced in their coalesced slot before CANTask read them, not in count. Put down to the source
+         * of the frame that replaced them, a slot is shared by all sources of its ID */
+        uint32_t overwritten;
+        /** @brief Tick the latest arrived on */
+        Timestamp_t lastTick;
+        /** @brief EWMA of the inter-arrival time, in ticks with DIVECAN_RX_STAT_MEAN_FRAC_BITS fractional bits */
+        uint32_t meanInterval;
+        /** @brief Shortest inter-arrival time, saturates at UINT16_MAX */
+        uint16_t minInterval;
+        /** @brief Longest inter-arrival time, saturates at UINT16_MAX */
+        uint16_t maxInterval;
+    } DiveCANRxStat_t;
+
+/* Buckets in the PPO2 frame to LED latency histogram, a multiple of the 4 the debug reply carries */
+#define PPO2_LATENCY_BUCKET_COUNT 28U
+
+    /**
+     * @brief Time from a PPO2 frame hitting the RX ISR to the LEDs first showing it, log2 buckets of microseconds
+     */
+    typedef struct
+    {
+        /** @brief Bucket 0 is under 1us, bucket n is [2^(n-1), 2^n) us, the last also takes everything longer */
+        uint32_t buckets[PPO2_LATENCY_BUCKET_COUNT];
+    } PPO2LatencyHistogram_t;
+
+/* Unknown IDs tracked individually, a power of two, anything past that is only counted */
+#define DIVECAN_UNKNOWN_ID_SLOTS 16U
+/* How often CANTask logs the unknown IDs that have been seen again since the last summary */
+#define DIVECAN_UNKNOWN_SUMMARY_MS 60000U
+
+    /**
+     * @brief An ID we don't handle, logged the first time it is seen and counted after that
+     */
+    typedef struct
+    {
+        /** @brief Full 29 bit ID, so the same unknown type from two devices is two entries */
+        uint32_t id;
+        uint32_t count;
+        Timestamp_t firstTick;
+        Timestamp_t lastTick;
+    } DiveCANUnknownId_t;
+
     void InitDiveCAN(const DiveCANDevice_t *const deviceSpec);
+    bool GetDiveCANDispatchCount(const uint32_t id, DiveCANDispatchCount_t *const count);
+    uint32_t GetDiveCANUnknownCount(void);
+    bool GetDiveCANUnknownId(const uint32_t id, DiveCANUnknownId_t *const unknown);
+    uint32_t GetDiveCANUnknownOverflow(void);
+    void ReportDiveCANUnknownIds(const Timestamp_t now);
+    const char *DiveCANMessageName(const uint32_t id);
+    bool GetDiveCANRxStat(const uint32_t id, DiveCANRxStat_t *const stat);
+    void RecordPPO2RenderLatency(const uint32_t rxCycles);
+    void GetPPO2LatencyHistogram(PPO2LatencyHistogram_t *const histogram);
 
 #ifdef TESTING
     /* Exposed for testing */
@@ -40,6 +116,14 @@ extern "C"
     void RespSerialNumber(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
     void RespPPO2(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
     void RespPPO2Status(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+    void DispatchMessage(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+    void ResetDiveCANDispatchCounts(void);
+    void RecordDiveCANRx(const DiveCANMessage_t *const message, const Timestamp_t arrivalTick);
+    void RecordDiveCANCoalescedRx(const CANCoalescedSlot_t slot, const CANCoalesced_t *const latest);
+    void RespRxStats(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+    void RespLatencyHistogram(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec);
+    void DispatchStampedMessage(const DiveCANMessage_t *const message, const DiveCANDevice_t *const deviceSpec, const uint32_t rxCycles, const Timestamp_t rxTick);
+    void ResetPPO2LatencyHistogram(void);
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,484 @@
+#include "Sniffer.h"
+#include "string.h"
+#include <assert.h>
+#include "cmsis_os.h"
+#include "main.h"
+#include "Transciever.h"
+#include "../errors.h"
+
+static_assert(SNIFFER_FLASH_PAGE_SIZE == FLASH_PAGE_SIZE, "Sniffer ring pages must match the flash erase unit");
+static_assert((SNIFFER_FLASH_PAGE_SIZE % SNIFFER_BLOCK_SIZE) == 0, "Blocks must not straddle a flash page");
+
+/* Set by the touch menu, CANTask picks it up */
+extern bool snifferToggleRequested;
+
+/* The RX ISRs fill one block image while CANTask programs the other, so an ISR never waits on flash */
+#define SNIFFER_BUFFER_COUNT 2U
+/* Neither buffer is open, frames are lost until CANTask frees one */
+#define SNIFFER_NO_BUFFER SNIFFER_BUFFER_COUNT
+
+/* One block as it will sit in flash, programmed a double word at a time */
+typedef union
+{
+    struct
+    {
+        SnifferBlockHeader_t header;
+        uint8_t records[SNIFFER_BLOCK_PAYLOAD];
+    } block;
+    uint64_t doubleWords[SNIFFER_BLOCK_SIZE / sizeof(uint64_t)];
+} SnifferBuffer_t;
+
+static_assert(sizeof(SnifferBuffer_t) == SNIFFER_BLOCK_SIZE, "Block image must be exactly one block");
+
+/* RX ISR -> CANTask recording state. Both RX ISRs produce (FIFO1 can preempt FIFO0), so they and CANTask only touch it
+ * inside a critical section, the sealed buffers excepted which belong to CANTask until it clears their bit */
+typedef struct
+{
+    SnifferBuffer_t buffers[SNIFFER_BUFFER_COUNT];
+    /* Buffer the ISRs are filling, or SNIFFER_NO_BUFFER */
+    uint32_t filling;
+    /* Bit per buffer sealed and waiting to be programmed */
+    uint32_t sealed;
+    uint32_t nextSequence;
+    /* Frames lost since the last block was opened, they go in the next one's header */
+    uint32_t pendingDropped;
+    /* Recording clock, DWT cycle count it was last advanced to and microseconds since the recording started */
+    uint32_t clockCycles;
+    uint32_t clockMicros;
+    uint32_t lastRecordMicros;
+    uint32_t frames;
+    uint32_t dropped;
+    /* CANTask only */
+    uint32_t blocks;
+    /* Blocks with a sequence below this have an erased slot waiting for them */
+    uint32_t erasedThrough;
+    bool active;
+} SnifferState_t;
+
+static SnifferState_t *getSnifferState(void)
+{
+    static SnifferState_t state = {0};
+    return &state;
+}
+
+#ifndef TESTING
+/* Page aligned ends of the ring, placed by STM32L431XX_FLASH.ld */
+extern const uint8_t _sniffer_start[];
+extern const uint8_t _sniffer_end[];
+#endif
+
+/** @brief Address of the start of the ring */
+static uint32_t snifferFlashBase(void)
+{
+#ifdef TESTING
+    return SNIFFER_TEST_FLASH_BASE;
+#else
+    return (uint32_t)_sniffer_start;
+#endif
+}
+
+/** @brief Whole flash pages in the ring */
+static uint32_t snifferFlashPages(void)
+{
+#ifdef TESTING
+    return SNIFFER_TEST_FLASH_PAGES;
+#else
+    return (uint32_t)(_sniffer_end - _sniffer_start) / SNIFFER_FLASH_PAGE_SIZE;
+#endif
+}
+
+/** @brief Block slots in the ring */
+static uint32_t snifferBlockCount(void)
+{
+    return snifferFlashPages() * SNIFFER_BLOCKS_PER_PAGE;
+}
+
+/** @brief Where the ring sits in (test: simulated) flash */
+static const uint8_t *snifferFlash(const uint32_t offset)
+{
+#ifdef TESTING
+    return MockFlash_Memory(snifferFlashBase() + offset);
+#else
+    return &_sniffer_start[offset];
+#endif
+}
+
+/** @brief !! ISR METHOD !! Bring the recording clock up to a DWT stamp, in whole microseconds so no remainder is lost.
+ * A stamp older than the clock (an ISR preempted between taking it and getting here) reads as now.
+ * Must be called at least once per half CYCCNT wrap, ServiceCANSniffer sees to that
+ * @param state Recording state, caller holds the critical section
+ * @param cycles DWT cycle count
+ * @return Microseconds since the recording started
+ */
+static uint32_t advanceClock(SnifferState_t *const state, const uint32_t cycles)
+{
+    const uint32_t elapsed = cycles - state->clockCycles;
+    if ((int32_t)elapsed > 0)
+    {
+        const uint32_t cyclesPerMicrosecond = SystemCoreClock / 1000000U;
+        const uint32_t micros = elapsed / cyclesPerMicrosecond;
+        state->clockCycles += micros * cyclesPerMicrosecond;
+        state->clockMicros += micros;
+    }
+    return state->clockMicros;
+}
+
+/** @brief !! ISR METHOD !! Make a buffer the one being filled
+ * @param state Recording state, caller holds the critical section
+ * @param buffer Index of a buffer that isn't sealed
+ */
+static void openBuffer(SnifferState_t *const state, const uint32_t buffer)
+{
+    SnifferBlockHeader_t *header = &(state->buffers[buffer].block.header);
+    (void)memset(header, 0, sizeof(*header));
+    header->magic = SNIFFER_BLOCK_MAGIC;
+    header->dropped = (state->pendingDropped > UINT16_MAX) ? UINT16_MAX : (uint16_t)state->pendingDropped;
+    state->pendingDropped = 0;
+    state->filling = buffer;
+}
+
+/** @brief !! ISR METHOD !! Hand the filling buffer to CANTask and move on to the other one if it is free
+ * @param state Recording state, caller holds the critical section and there is a filling buffer
+ */
+static void sealBuffer(SnifferState_t *const state)
+{
+    const uint32_t buffer = state->filling;
+    state->buffers[buffer].block.header.sequence = state->nextSequence;
+    ++state->nextSequence;
+    state->sealed |= 1UL << buffer;
+
+    const uint32_t other = (buffer + 1U) % SNIFFER_BUFFER_COUNT;
+    if (0U == (state->sealed & (1UL << other)))
+    {
+        openBuffer(state, other);
+    }
+    else
+    {
+        state->filling = SNIFFER_NO_BUFFER;
+    }
+}
+
+/** @brief !! ISR METHOD !! Count a frame that didn't make it into the recording
+ * @param state Recording state, caller holds the critical section
+ */
+static void loseFrame(SnifferState_t *const state)
+{
+    ++state->pendingDropped;
+    ++state->dropped;
+}
+
+/** @brief !! ISR METHOD !! Append one frame to the recording, called by rxFifoInterrupt for everything the controller
+ * hears while listen-only. Never blocks: when the open block fills it swaps to the other, and if CANTask hasn't written
+ * that one yet the frame is counted as dropped
+ * @param rir The FIFO mailbox's RIR, ID, IDE and RTR
+ * @param length DLC
+ * @param dataLow RDLR
+ * @param dataHigh RDHR
+ * @param rxCycles DWT cycle count the frame was taken at
+ */
+void snifferFrameInterrupt(const uint32_t rir, const uint8_t length, const uint32_t dataLow, const uint32_t dataHigh, const uint32_t rxCycles)
+{
+    SnifferRecord_t record = {0};
+    record.extended = 0U != (rir & CAN_RI0R_IDE);
+    record.remote = 0U != (rir & CAN_RI0R_RTR);
+    record.id = record.extended ? ((rir & (CAN_RI0R_STID | CAN_RI0R_EXID)) >> CAN_RI0R_EXID_Pos) : ((rir & CAN_RI0R_STID) >> CAN_RI0R_STID_Pos);
+    record.length = length;
+    (void)memcpy(record.data, &dataLow, sizeof(dataLow));
+    (void)memcpy(&record.data[sizeof(dataLow)], &dataHigh, sizeof(dataHigh));
+
+    const UBaseType_t interruptMask = taskENTER_CRITICAL_FROM_ISR();
+    SnifferState_t *state = getSnifferState();
+    const uint32_t now = advanceClock(state, rxCycles);
+
+    uint32_t written = 0;
+    if (SNIFFER_NO_BUFFER != state->filling)
+    {
+        SnifferBlockHeader_t *header = &(state->buffers[state->filling].block.header);
+        record.deltaMicros = (0U == header->length) ? 0U : (now - state->lastRecordMicros);
+        written = SnifferEncodeRecord(&record, &(state->buffers[state->filling].block.records[header->length]), SNIFFER_BLOCK_PAYLOAD - header->length);
+        if (0U == written)
+        {
+            sealBuffer(state);
+        }
+    }
+
+    if ((0U == written) && (SNIFFER_NO_BUFFER != state->filling))
+    {
+        /* Fresh block, the record can't fail to fit */
+        record.deltaMicros = 0;
+        written = SnifferEncodeRecord(&record, state->buffers[state->filling].block.records, SNIFFER_BLOCK_PAYLOAD);
+    }
+
+    if (0U != written)
+    {
+        SnifferBlockHeader_t *header = &(state->buffers[state->filling].block.header);
+        if (0U == header->length)
+        {
+            header->firstMicros = now;
+        }
+        header->length += (uint16_t)written;
+        state->lastRecordMicros = now;
+        ++state->frames;
+    }
+    else
+    {
+        loseFrame(state);
+    }
+    taskEXIT_CRITICAL_FROM_ISR(interruptMask);
+}
+
+/** @brief !! ISR METHOD !! Count a frame the controller itself dropped (RX FIFO overrun) while listen-only */
+void snifferLostInterrupt(void)
+{
+    const UBaseType_t interruptMask = taskENTER_CRITICAL_FROM_ISR();
+    loseFrame(getSnifferState());
+    taskEXIT_CRITICAL_FROM_ISR(interruptMask);
+}
+
+/** @brief Erase pages of the ring
+ * @param firstPage Page index within the ring
+ * @param pageCount Pages to erase
+ * @return HAL status
+ */
+static HAL_StatusTypeDef eraseSnifferPages(const uint32_t firstPage, const uint32_t pageCount)
+{
+    FLASH_EraseInitTypeDef erase = {0};
+    erase.TypeErase = FLASH_TYPEERASE_PAGES;
+    erase.Banks = FLASH_BANK_1;
+    erase.Page = ((snifferFlashBase() - FLASH_BASE) / FLASH_PAGE_SIZE) + firstPage;
+    erase.NbPages = pageCount;
+    uint32_t pageError = 0;
+    return HAL_FLASHEx_Erase(&erase, &pageError);
+}
+
+/** @brief Write a sealed block to its slot in the ring, the slot's page has already been erased by StartCANSniffer or
+ * eraseAhead
+ * @param buffer Sealed block image
+ */
+static void programBlock(const SnifferBuffer_t *const buffer)
+{
+    const uint32_t slot = buffer->block.header.sequence % snifferBlockCount();
+    HAL_StatusTypeDef err = HAL_FLASH_Unlock();
+
+    const uint32_t address = snifferFlashBase() + (slot * SNIFFER_BLOCK_SIZE);
+    for (uint32_t word = 0; (HAL_OK == err) && (word < (SNIFFER_BLOCK_SIZE / sizeof(uint64_t))); ++word)
+    {
+        err = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + (word * sizeof(uint64_t)), buffer->doubleWords[word]);
+    }
+    (void)HAL_FLASH_Lock();
+
+    if (HAL_OK != err)
+    {
+        NON_FATAL_ERROR_DETAIL(SNIFFER_FLASH_ERR, err);
+    }
+}
+
+/** @brief Once the ring moves onto a page, erase the one after it, so the oldest page goes a page ahead of the wrap
+ * rather than when a sealed block is waiting for its slot. The erase stalls the CPU on flash reads for ~20ms, the
+ * hardware FIFOs can overrun in that time, which is counted as dropped, but no block write is held up behind it
+ * @param state Recording state
+ * @param nextSequence Sequence of the next block to be written
+ */
+static void eraseAhead(SnifferState_t *const state, const uint32_t nextSequence)
+{
+    while ((nextSequence + SNIFFER_BLOCKS_PER_PAGE) > state->erasedThrough)
+    {
+        HAL_StatusTypeDef err = HAL_FLASH_Unlock();
+        if (HAL_OK == err)
+        {
+            err = eraseSnifferPages((state->erasedThrough % snifferBlockCount()) / SNIFFER_BLOCKS_PER_PAGE, 1);
+        }
+        (void)HAL_FLASH_Lock();
+        if (HAL_OK != err)
+        {
+            NON_FATAL_ERROR_DETAIL(SNIFFER_FLASH_ERR, err);
+        }
+        state->erasedThrough += SNIFFER_BLOCKS_PER_PAGE;
+    }
+}
+
+/** @brief Program every sealed buffer, oldest first, and give each back to the ISRs, then erase ahead of the ring
+ * @param state Recording state
+ */
+static void flushSealed(SnifferState_t *const state)
+{
+    taskENTER_CRITICAL();
+    uint32_t sealed = state->sealed;
+    taskEXIT_CRITICAL();
+    const bool programmed = (0U != sealed);
+    uint32_t nextSequence = 0;
+
+    while (0U != sealed)
+    {
+        /* Sealed buffers aren't touched by the ISRs, so reading them outside the critical section is safe */
+        uint32_t oldest = SNIFFER_NO_BUFFER;
+        for (uint32_t buffer = 0; buffer < SNIFFER_BUFFER_COUNT; ++buffer)
+        {
+            if ((0U != (sealed & (1UL << buffer))) &&
+                ((SNIFFER_NO_BUFFER == oldest) || (state->buffers[buffer].block.header.sequence < state->buffers[oldest].block.header.sequence)))
+            {
+                oldest = buffer;
+            }
+        }
+
+        programBlock(&(state->buffers[oldest]));
+        nextSequence = state->buffers[oldest].block.header.sequence + 1U;
+        ++state->blocks;
+        sealed &= ~(1UL << oldest);
+
+        taskENTER_CRITICAL();
+        state->sealed &= ~(1UL << oldest);
+        if (SNIFFER_NO_BUFFER == state->filling)
+        {
+            openBuffer(state, oldest);
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    if (programmed)
+    {
+        eraseAhead(state, nextSequence);
+    }
+}
+
+/** @brief Start a recording: erase the ring, then take the controller listen-only so every frame on the bus is recorded.
+ * The previous recording is lost. Does nothing if one is already running.
+ * Must be called from CANTask, erasing the ring stalls everything for ~20ms a page with the bus unwatched
+ */
+void StartCANSniffer(void)
+{
+    SnifferState_t *state = getSnifferState();
+    if (!state->active)
+    {
+        HAL_StatusTypeDef err = HAL_FLASH_Unlock();
+        if (HAL_OK == err)
+        {
+            err = eraseSnifferPages(0, snifferFlashPages());
+        }
+        (void)HAL_FLASH_Lock();
+        if (HAL_OK != err)
+        {
+            NON_FATAL_ERROR_DETAIL(SNIFFER_FLASH_ERR, err);
+        }
+
+        taskENTER_CRITICAL();
+        (void)memset(state, 0, sizeof(*state));
+        state->erasedThrough = snifferBlockCount();
+        state->clockCycles = DWT->CYCCNT;
+        openBuffer(state, 0);
+        state->active = true;
+        taskEXIT_CRITICAL();
+
+        SetCANListenOnly(true);
+    }
+}
+
+/** @brief End a recording: put the controller back on the bus and write out whatever is still in RAM.
+ * Does nothing if no recording is running. Must be called from CANTask
+ */
+void StopCANSniffer(void)
+{
+    SnifferState_t *state = getSnifferState();
+    if (state->active)
+    {
+        SetCANListenOnly(false);
+
+        taskENTER_CRITICAL();
+        if ((SNIFFER_NO_BUFFER != state->filling) && (0U != state->buffers[state->filling].block.header.length))
+        {
+            sealBuffer(state);
+        }
+        taskEXIT_CRITICAL();
+
+        flushSealed(state);
+        state->active = false;
+    }
+}
+
+/** @brief Recording housekeeping, must be called from CANTask at least once a tick while frames are arriving.
+ * Takes up the menu's start/stop request, writes full blocks to flash, and seals a part filled block once it is
+ * SNIFFER_FLUSH_MICROS old so a quiet bus still makes it to flash
+ */
+void ServiceCANSniffer(void)
+{
+    if (__atomic_exchange_n(&snifferToggleRequested, false, __ATOMIC_ACQ_REL))
+    {
+        if (getSnifferState()->active)
+        {
+            StopCANSniffer();
+        }
+        else
+        {
+            StartCANSniffer();
+        }
+    }
+
+    SnifferState_t *state = getSnifferState();
+    if (state->active)
+    {
+        taskENTER_CRITICAL();
+        const uint32_t now = advanceClock(state, DWT->CYCCNT);
+        if (SNIFFER_NO_BUFFER != state->filling)
+        {
+            const SnifferBlockHeader_t *header = &(state->buffers[state->filling].block.header);
+            if ((0U != header->length) && ((now - header->firstMicros) >= SNIFFER_FLUSH_MICROS))
+            {
+                sealBuffer(state);
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        flushSealed(state);
+    }
+}
+
+/** @brief Snapshot the recording counters
+ * @param stats Output
+ */
+void GetCANSnifferStats(SnifferStats_t *const stats)
+{
+    SnifferState_t *state = getSnifferState();
+    taskENTER_CRITICAL();
+    stats->active = state->active;
+    stats->frames = state->frames;
+    stats->dropped = state->dropped;
+    stats->blocks = state->blocks;
+    taskEXIT_CRITICAL();
+}
+
+/** @brief Size of the flash ring, which depends on how much room the image left for it
+ * @return Bytes
+ */
+uint32_t GetCANSnifferFlashSize(void)
+{
+    return snifferFlashPages() * SNIFFER_FLASH_PAGE_SIZE;
+}
+
+/** @brief Copy raw bytes out of the ring for download, the host decoder takes the whole ring image.
+ * Refused while recording, the ring is being rewritten under the reader
+ * @param offset Byte offset into the ring
+ * @param out Output
+ * @param length Bytes wanted
+ * @return True if the range is inside the ring and no recording is running
+ */
+bool ReadCANSnifferFlash(const uint32_t offset, uint8_t *const out, const uint32_t length)
+{
+    const bool valid = (!getSnifferState()->active) && (offset < GetCANSnifferFlashSize()) && (length <= (GetCANSnifferFlashSize() - offset));
+    if (valid)
+    {
+        (void)memcpy(out, snifferFlash(offset), length);
+    }
+    return valid;
+}
+
+#ifdef TESTING
+/** @brief Forget any recording and zero the counters, only valid while the ISRs can't fire
+ */
+void ResetCANSniffer(void)
+{
+    SnifferState_t *state = getSnifferState();
+    (void)memset(state, 0, sizeof(*state));
+    state->filling = SNIFFER_NO_BUFFER;
+    snifferToggleRequested = false;
+}
+#endif
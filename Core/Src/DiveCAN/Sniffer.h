@@ -0,0 +1,55 @@
+#pragma once
+#include "../common.h"
+#include "stdbool.h"
+#include "SnifferFormat.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Flash ring for recordings. STM32L431XX_FLASH.ld gives it every whole page left between the end of the image and the
+ * EEPROM emulation pages at 0x0801A000 (_sniffer_start/_sniffer_end), so it is sized by the link rather than a guess at
+ * the image size. The link fails if fewer than SNIFFER_FLASH_MIN_PAGES are left, keep both values in step with it */
+#define SNIFFER_FLASH_PAGE_SIZE 2048U
+#define SNIFFER_FLASH_MIN_PAGES 4U
+#define SNIFFER_BLOCKS_PER_PAGE (SNIFFER_FLASH_PAGE_SIZE / SNIFFER_BLOCK_SIZE)
+
+#ifdef TESTING
+/* No linker script on the host, the simulated ring is fixed */
+#define SNIFFER_TEST_FLASH_BASE 0x08016000U
+#define SNIFFER_TEST_FLASH_PAGES 8U
+#endif
+
+/* A part filled block is sealed and written after this long, so a quiet bus still lands in flash and the recording clock
+ * is advanced often enough that it never misses a DWT wrap */
+#define SNIFFER_FLUSH_MICROS 1000000U
+
+  typedef struct
+  {
+    /** @brief Recording in progress, the controller is listen-only */
+    bool active;
+    /** @brief Frames recorded since the recording started */
+    uint32_t frames;
+    /** @brief Frames lost since the recording started, both RAM blocks full or a hardware FIFO overrun */
+    uint32_t dropped;
+    /** @brief Blocks written to flash since the recording started, the ring keeps as many of the newest as fit */
+    uint32_t blocks;
+  } SnifferStats_t;
+
+  void StartCANSniffer(void);
+  void StopCANSniffer(void);
+  void ServiceCANSniffer(void);
+  void GetCANSnifferStats(SnifferStats_t *const stats);
+  uint32_t GetCANSnifferFlashSize(void);
+  bool ReadCANSnifferFlash(const uint32_t offset, uint8_t *const out, const uint32_t length);
+  void snifferFrameInterrupt(const uint32_t rir, const uint8_t length, const uint32_t dataLow, const uint32_t dataHigh, const uint32_t rxCycles);
+  void snifferLostInterrupt(void);
+
+#ifdef TESTING
+  void ResetCANSniffer(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
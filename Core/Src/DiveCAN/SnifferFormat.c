@@ -0,0 +1,191 @@
+#include "SnifferFormat.h"
+#include <assert.h>
+#include <string.h>
+
+static_assert(sizeof(SnifferBlockHeader_t) == SNIFFER_BLOCK_HEADER_SIZE, "Block header layout is part of the recording format");
+
+#define SNIFFER_DLC_MASK 0x0FU
+#define SNIFFER_FORM_SHIFT 4U
+#define SNIFFER_FORM_MASK 0x03U
+#define SNIFFER_RTR_BIT 0x40U
+#define SNIFFER_RESERVED_BIT 0x80U
+
+#define SNIFFER_VARINT_BITS 7U
+#define SNIFFER_VARINT_MORE 0x80U
+#define SNIFFER_VARINT_MAX_LEN 5U
+
+/* Bits that have to be clear for a DiveCAN/extension ID to pack, the rest is range, type byte and the two nibbles */
+#define SNIFFER_PACK_MASK 0x1F00F0F0U
+#define SNIFFER_DIVECAN_RANGE 0x0D000000U
+#define SNIFFER_EXTENSION_RANGE 0x0F000000U
+
+#define SNIFFER_EXTENDED_ID_MASK 0x1FFFFFFFU
+#define SNIFFER_STANDARD_ID_MASK 0x7FFU
+#define CAN_MAX_PAYLOAD 8U
+
+static uint8_t payloadLength(const SnifferRecord_t *const record)
+{
+    uint8_t length = 0;
+    if (!record->remote)
+    {
+        length = (record->length > CAN_MAX_PAYLOAD) ? CAN_MAX_PAYLOAD : record->length;
+    }
+    return length;
+}
+
+static SnifferIdForm_t idForm(const SnifferRecord_t *const record)
+{
+    SnifferIdForm_t form = SNIFFER_ID_EXTENDED;
+    if (!record->extended)
+    {
+        form = SNIFFER_ID_STANDARD;
+    }
+    else if ((record->id & SNIFFER_PACK_MASK) == SNIFFER_DIVECAN_RANGE)
+    {
+        form = SNIFFER_ID_DIVECAN;
+    }
+    else if ((record->id & SNIFFER_PACK_MASK) == SNIFFER_EXTENSION_RANGE)
+    {
+        form = SNIFFER_ID_EXTENSION;
+    }
+    else
+    {
+        /* Anything else goes out literally */
+    }
+    return form;
+}
+
+static uint32_t idLength(const SnifferIdForm_t form)
+{
+    return (SNIFFER_ID_EXTENDED == form) ? 4U : 2U;
+}
+
+static uint32_t varintLength(uint32_t value)
+{
+    uint32_t length = 1;
+    while (value >= SNIFFER_VARINT_MORE)
+    {
+        value >>= SNIFFER_VARINT_BITS;
+        ++length;
+    }
+    return length;
+}
+
+/** @brief Pack one frame into the recording format
+ * @param record Frame to pack
+ * @param out Where to write it
+ * @param room Bytes free at out
+ * @return Bytes written, 0 if the record doesn't fit in room
+ */
+uint32_t SnifferEncodeRecord(const SnifferRecord_t *const record, uint8_t *const out, const uint32_t room)
+{
+    const SnifferIdForm_t form = idForm(record);
+    const uint8_t payload = payloadLength(record);
+    const uint32_t total = 1U + varintLength(record->deltaMicros) + idLength(form) + payload;
+
+    uint32_t written = 0;
+    if (total <= room)
+    {
+        out[written++] = (uint8_t)((record->length & SNIFFER_DLC_MASK) | ((uint32_t)form << SNIFFER_FORM_SHIFT) | (record->remote ? SNIFFER_RTR_BIT : 0U));
+
+        uint32_t delta = record->deltaMicros;
+        while (delta >= SNIFFER_VARINT_MORE)
+        {
+            out[written++] = (uint8_t)(delta | SNIFFER_VARINT_MORE);
+            delta >>= SNIFFER_VARINT_BITS;
+        }
+        out[written++] = (uint8_t)delta;
+
+        if (SNIFFER_ID_EXTENDED == form)
+        {
+            const uint32_t id = record->id & SNIFFER_EXTENDED_ID_MASK;
+            out[written++] = (uint8_t)id;
+            out[written++] = (uint8_t)(id >> 8);
+            out[written++] = (uint8_t)(id >> 16);
+            out[written++] = (uint8_t)(id >> 24);
+        }
+        else if (SNIFFER_ID_STANDARD == form)
+        {
+            const uint32_t id = record->id & SNIFFER_STANDARD_ID_MASK;
+            out[written++] = (uint8_t)id;
+            out[written++] = (uint8_t)(id >> 8);
+        }
+        else
+        {
+            /* Type byte, then source/dest nibbles */
+            out[written++] = (uint8_t)(record->id >> 16);
+            out[written++] = (uint8_t)(((record->id >> 4) & 0xF0U) | (record->id & 0x0FU));
+        }
+
+        (void)memcpy(&out[written], record->data, payload);
+        written += payload;
+    }
+    return written;
+}
+
+/** @brief Unpack one frame from the recording format
+ * @param in Start of the record
+ * @param available Bytes readable at in
+ * @param record Output
+ * @return Bytes consumed, 0 if the record is malformed or runs past available
+ */
+uint32_t SnifferDecodeRecord(const uint8_t *const in, const uint32_t available, SnifferRecord_t *const record)
+{
+    uint32_t used = 0;
+    bool valid = (available > 0U) && (0U == (in[0] & SNIFFER_RESERVED_BIT));
+
+    if (valid)
+    {
+        (void)memset(record, 0, sizeof(*record));
+        const uint8_t header = in[used++];
+        const SnifferIdForm_t form = (SnifferIdForm_t)((header >> SNIFFER_FORM_SHIFT) & SNIFFER_FORM_MASK);
+        record->length = header & SNIFFER_DLC_MASK;
+        record->remote = 0U != (header & SNIFFER_RTR_BIT);
+        record->extended = SNIFFER_ID_STANDARD != form;
+
+        uint32_t shift = 0;
+        bool more = true;
+        while (valid && more)
+        {
+            valid = (used < available) && (shift < (SNIFFER_VARINT_MAX_LEN * SNIFFER_VARINT_BITS));
+            if (valid)
+            {
+                record->deltaMicros |= (uint32_t)(in[used] & ~SNIFFER_VARINT_MORE) << shift;
+                more = 0U != (in[used] & SNIFFER_VARINT_MORE);
+                shift += SNIFFER_VARINT_BITS;
+                ++used;
+            }
+        }
+
+        const uint32_t payload = payloadLength(record);
+        valid = valid && ((used + idLength(form) + payload) <= available);
+        if (valid)
+        {
+            if (SNIFFER_ID_EXTENDED == form)
+            {
+                record->id = ((uint32_t)in[used] | ((uint32_t)in[used + 1U] << 8) | ((uint32_t)in[used + 2U] << 16) | ((uint32_t)in[used + 3U] << 24)) & SNIFFER_EXTENDED_ID_MASK;
+            }
+            else if (SNIFFER_ID_STANDARD == form)
+            {
+                record->id = ((uint32_t)in[used] | ((uint32_t)in[used + 1U] << 8)) & SNIFFER_STANDARD_ID_MASK;
+            }
+            else
+            {
+                const uint32_t range = (SNIFFER_ID_DIVECAN == form) ? SNIFFER_DIVECAN_RANGE : SNIFFER_EXTENSION_RANGE;
+                record->id = range | ((uint32_t)in[used] << 16) | (((uint32_t)in[used + 1U] & 0xF0U) << 4) | (in[used + 1U] & 0x0FU);
+            }
+            used += idLength(form);
+            (void)memcpy(record->data, &in[used], payload);
+            used += payload;
+        }
+    }
+    return valid ? used : 0U;
+}
+
+/** @brief Whether a block header is one we wrote, rather than erased or foreign flash
+ * @param header Header to check
+ */
+bool SnifferBlockValid(const SnifferBlockHeader_t *const header)
+{
+    return (SNIFFER_BLOCK_MAGIC == header->magic) && (header->length <= SNIFFER_BLOCK_PAYLOAD);
+}
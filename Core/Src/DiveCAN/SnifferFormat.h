@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Layout of a bus sniffer recording, shared by the firmware and the host decoder (Tests/tools/sniff2candump.cpp) so it
+ * has no HAL dependencies. Everything is little endian.
+ *
+ * A recording is a run of fixed size blocks, a SnifferBlockHeader_t then back to back records:
+ *   header byte  DLC[3:0] ID form[5:4] RTR[6], bit 7 reserved 0
+ *   delta        microseconds since the previous record in the block, LEB128 varint, 0 for the first
+ *   ID           SNIFFER_ID_* form below
+ *   payload      min(DLC, 8) bytes, none for a remote frame
+ * DiveCAN IDs are type byte, then two nibbles of routing (0xTT0S0D), so those pack to 2 bytes */
+#define SNIFFER_BLOCK_SIZE 256U
+#define SNIFFER_BLOCK_HEADER_SIZE 16U
+#define SNIFFER_BLOCK_PAYLOAD (SNIFFER_BLOCK_SIZE - SNIFFER_BLOCK_HEADER_SIZE)
+/* "SNIF" in memory, erased flash (0xFFFFFFFF) never matches */
+#define SNIFFER_BLOCK_MAGIC 0x46494E53U
+
+/* Header byte, then the longest varint, a literal extended ID and a full payload */
+#define SNIFFER_RECORD_MAX_LEN (1U + 5U + 4U + 8U)
+
+  typedef enum
+  {
+    /** @brief 0xD... DiveCAN ID: type byte, then (bits 11:8) << 4 | bits 3:0 */
+    SNIFFER_ID_DIVECAN = 0,
+    /** @brief 0xF... extension ID, packed like SNIFFER_ID_DIVECAN */
+    SNIFFER_ID_EXTENSION = 1,
+    /** @brief Any other 29 bit ID, 4 bytes */
+    SNIFFER_ID_EXTENDED = 2,
+    /** @brief 11 bit standard ID, 2 bytes */
+    SNIFFER_ID_STANDARD = 3
+  } SnifferIdForm_t;
+
+  typedef struct
+  {
+    /** @brief SNIFFER_BLOCK_MAGIC, anything else (erased flash included) is not a block */
+    uint32_t magic;
+    /** @brief Blocks sealed before this one since the recording started, orders the ring when it has wrapped */
+    uint32_t sequence;
+    /** @brief Recording clock at the block's first record, microseconds since the recording started, wraps after ~71 minutes */
+    uint32_t firstMicros;
+    /** @brief Record bytes after the header */
+    uint16_t length;
+    /** @brief Frames lost just before this block's first record, saturating */
+    uint16_t dropped;
+  } SnifferBlockHeader_t;
+
+  typedef struct
+  {
+    uint32_t deltaMicros;
+    /** @brief 29 bit ID if extended, 11 bit otherwise */
+    uint32_t id;
+    bool extended;
+    bool remote;
+    /** @brief DLC as received, classic CAN treats 9-15 as 8 bytes */
+    uint8_t length;
+    uint8_t data[8];
+  } SnifferRecord_t;
+
+  uint32_t SnifferEncodeRecord(const SnifferRecord_t *const record, uint8_t *const out, const uint32_t room);
+  uint32_t SnifferDecodeRecord(const uint8_t *const in, const uint32_t available, SnifferRecord_t *const record);
+  bool SnifferBlockValid(const SnifferBlockHeader_t *const header);
+
+#ifdef __cplusplus
+}
+#endif
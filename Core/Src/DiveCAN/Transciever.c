@@ -1,10 +1,11 @@
 #include "Transciever.h"
 #include "string.h"
+#include <assert.h>
 #include "cmsis_os.h"
-#include "queue.h"
 #include "main.h"
 #include "../errors.h"
 #include "../Hardware/printer.h"
+#include "Sniffer.h"
 
 #define BUS_NAME_LEN 8
 
@@ -15,142 +16,1815 @@
 #define MENU_SAVE_ACK_LEN 3
 #define MENU_SAVE_FIELD_ACK_LEN 5
 
-#define TX_WAIT_DELAY 10
+/* How long sendCANMessage will wait for room in the TX ring, 100ms is ~60 worst case frames at 125kbit/s so a full
+ * ring that doesn't move in that time means we're not getting on the bus */
+#define TX_WAIT_TIMEOUT 10
 
 extern CAN_HandleTypeDef hcan1;
 
-#define CAN_QUEUE_LEN 10
+/* Every frame buffer and the pass-by-value TX API use this, 16 bytes fits AAPCS's 4 argument registers */
+static_assert(sizeof(DiveCANMessage_t) == 16, "DiveCANMessage_t should be the 13 byte frame plus alignment only");
 
-static QueueHandle_t *getInboundQueue(void)
+/* Frames a bxCAN RX FIFO holds in hardware */
+#define CAN_RX_HW_FIFO_DEPTH 3U
+
+/* Must be a power of two so the free running indices can be masked rather than wrapped */
+#define CAN_RX_RING_LEN 16U
+#define CAN_RX_RING_MASK (CAN_RX_RING_LEN - 1U)
+static_assert((CAN_RX_RING_LEN & CAN_RX_RING_MASK) == 0, "CAN_RX_RING_LEN must be a power of two");
+
+/* Single producer (rxFifoInterrupt), single consumer (CANTask) ring, one per hardware FIFO.
+ * The FIFOs have separate ISRs at different priorities, so the ring is picked by the ID's FIFO routing
+ * (DIVECAN_RX_FIFO) to keep exactly one producer per ring.
+ * head is only written by the ISR and tail is only written by the task, so no critical sections are needed,
+ * the acquire/release pairs make sure a slot's contents are visible before the index that publishes it.
+ * Indices are free running, head - tail is the fill level. */
+typedef struct
+{
+    CANRxFrame_t frames[CAN_RX_RING_LEN];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t overflows;
+    uint32_t highWater;
+    uint32_t hwOverruns;
+} CANRxRing_t;
+
+static CANRxRing_t *getRxRing(const uint32_t fifo)
+{
+    static CANRxRing_t rxRings[CAN_RX_FIFO_COUNT] = {0};
+    return &(rxRings[fifo]);
+}
+
+/* Frames each TX class can queue on top of the 3 hardware mailboxes, enough for a full menu reply burst.
+ * Must be a power of two so the free running indices can be masked rather than wrapped */
+#define CAN_TX_RING_LEN 16U
+#define CAN_TX_RING_MASK (CAN_TX_RING_LEN - 1U)
+static_assert((CAN_TX_RING_LEN & CAN_TX_RING_MASK) == 0, "CAN_TX_RING_LEN must be a power of two");
+
+/* The HAL names mailboxes by bit, CAN_TX_MAILBOX0/1/2 are 1/2/4 */
+#define CAN_TX_MAILBOX_COUNT 3U
+/* Mailboxes that status and diagnostic frames have to leave free, so a protocol reply never waits behind them */
+#define CAN_TX_CRITICAL_RESERVE 1U
+static_assert(CAN_TX_CRITICAL_RESERVE < CAN_TX_MAILBOX_COUNT, "Lower classes need at least one mailbox");
+
+/* AutoRetransmission is off so the controller makes exactly one attempt per request, this is how many more a frame of
+ * each class gets after losing arbitration or an error. Only protocol replies are worth the bus time */
+static const uint8_t txRetryLimit[CAN_TX_CLASS_COUNT] = {
+    [CAN_TX_CLASS_CRITICAL] = 3,
+    [CAN_TX_CLASS_STATUS] = 0,
+    [CAN_TX_CLASS_DIAGNOSTIC] = 0};
+
+#define CAN_TSR_RQCP_ALL (CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2)
+/* RQCP/TXOK/ALST/TERR repeat every 8 bits of TSR, one byte per mailbox */
+#define CAN_TSR_MAILBOX_SHIFT 8U
+
+/* Extension ID traffic is capped at 10% of the 125kbit/s bus by default, and can burst a full ring of 8 byte (160 bit)
+ * frames so a debug dump goes out in one go if the bus has been quiet */
+#define CAN_TX_THROTTLE_DEFAULT_CONFIG {12500U, CAN_TX_RING_LEN * 160U, CAN_TX_THROTTLE_DEFER}
+
+/* A queued frame, the attempts it has already had and when it was first queued */
+typedef struct
+{
+    DiveCANMessage_t message;
+    uint32_t queuedCycles;
+    uint8_t attempts;
+    /* Held back by the bandwidth cap at least once, so it is only counted once */
+    bool throttled;
+} CANTxEntry_t;
+
+/* Any task -> TX mailbox ISR frame ring, one per class. There are several producers and the task side also drains it
+ * when the controller is idle, so unlike the RX rings it is only touched by tasks inside a critical section (which masks
+ * the TX ISR) and by the ISR itself. Indices are free running, head - tail is the fill level. */
+typedef struct
+{
+    CANTxEntry_t entries[CAN_TX_RING_LEN];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t highWater;
+    uint32_t rejected;
+    uint32_t outcomes[CAN_TX_OUTCOME_COUNT];
+    uint32_t retries;
+    uint32_t requeued;
+    uint32_t abandoned;
+    CANTxLatency_t latency;
+} CANTxRing_t;
+
+/* What went into a mailbox, kept until its outcome is known so it can be retried */
+typedef struct
+{
+    CANTxEntry_t entry;
+    CANTxClass_t txClass;
+} CANTxMailbox_t;
+
+/* Token bucket state for the extension ID bandwidth cap. Tokens are held as bits * SystemCoreClock so a refill is a
+ * single multiply of elapsed cycles by bits per second with no remainder to carry. Kept as debt below a full bucket,
+ * so a zeroed scheduler starts with the whole burst available */
+typedef struct
+{
+    uint64_t debt;
+    /* Tokens the cheapest frame held back by the last drain needs, 0 if it held nothing */
+    uint64_t heldCost;
+    /* DWT cycle count the bucket was last refilled at, CANTask's housekeeping drains at least once a second so this
+     * never falls a whole CYCCNT wrap behind */
+    uint32_t lastCycles;
+    uint32_t passed;
+    uint32_t deferred;
+    uint32_t dropped;
+} CANTxThrottle_t;
+
+typedef struct
+{
+    CANTxRing_t rings[CAN_TX_CLASS_COUNT];
+    CANTxMailbox_t mailboxes[CAN_TX_MAILBOX_COUNT];
+    /* Mailboxes (CAN_TX_MAILBOXn bits) loaded whose outcome we haven't collected */
+    uint32_t inFlight;
+    /* Mailboxes we've asked to abort that haven't completed yet */
+    uint32_t abortMask;
+    /* Of those, the ones aborted to make way for a critical frame, which go back in their ring rather than away */
+    uint32_t requeueMask;
+    /* Frames and payload bytes sent since boot, all classes */
+    uint32_t sentFrames;
+    uint32_t sentBytes;
+    CANTxThrottle_t throttle;
+} CANTxScheduler_t;
+
+static CANTxScheduler_t *getTxScheduler(void)
+{
+    static CANTxScheduler_t scheduler = {0};
+    return &scheduler;
+}
+
+/* Rates are averaged over at least this long */
+#define CAN_TX_RATE_WINDOW_TICKS pdMS_TO_TICKS(1000U)
+
+/* Only touched by CANTask (UpdateCANTxThroughput) */
+typedef struct
+{
+    Timestamp_t windowStart;
+    uint32_t windowFrames;
+    uint32_t windowBytes;
+    uint32_t framesPerSecond;
+    uint32_t bytesPerSecond;
+} CANTxRate_t;
+
+static CANTxRate_t *getTxRate(void)
+{
+    static CANTxRate_t txRate = {0};
+    return &txRate;
+}
+
+/* Written by SetCANTxThrottle inside a critical section, read by the drain */
+static CANTxThrottleConfig_t *getTxThrottleConfig(void)
+{
+    static CANTxThrottleConfig_t config = CAN_TX_THROTTLE_DEFAULT_CONFIG;
+    return &config;
+}
+
+/* What the bandwidth cap makes of the frame at the head of a ring */
+typedef enum
+{
+    CAN_TX_THROTTLE_PASS = 0,
+    CAN_TX_THROTTLE_HOLD,
+    CAN_TX_THROTTLE_DISCARD
+} CANTxThrottleVerdict_t;
+
+/* Which ring the message handed out by GetLatestCAN came from, CAN_RX_FIFO_COUNT if none. Task side only */
+static uint32_t *getHeldFifo(void)
+{
+    static uint32_t heldFifo = CAN_RX_FIFO_COUNT;
+    return &heldFifo;
+}
+
+static_assert(CAN_FILTER_FIFO1 < CAN_RX_FIFO_COUNT, "FIFO index out of range");
+static_assert(DIVECAN_RX_FIFO(PPO2_PPO2_ID) == CAN_FILTER_FIFO1, "PPO2 must use the priority FIFO");
+static_assert(DIVECAN_RX_FIFO(PPO2_STATUS_ID) == CAN_FILTER_FIFO1, "Cell status must use the priority FIFO");
+static_assert(DIVECAN_RX_FIFO(BUS_OFF_ID) == CAN_FILTER_FIFO1, "Shutdown must use the priority FIFO");
+
+typedef struct
+{
+    CANCoalesced_t slots[CAN_COALESCED_SLOT_COUNT];
+    uint32_t dirty; /* Bit per slot, set by the ISR, cleared when CANTask takes them */
+} CANCoalescedTable_t;
+
+static_assert(CAN_COALESCED_SLOT_COUNT <= 32, "Coalesced dirty mask is 32 bits wide");
+#define CAN_COALESCED_FILTER_CHECK(listId, arg) static_assert(DIVECAN_RX_ACCEPTED(listId), #listId " is coalesced but filtered out");
+DIVECAN_RX_COALESCED_LIST(CAN_COALESCED_FILTER_CHECK, 0)
+#undef CAN_COALESCED_FILTER_CHECK
+
+static CANCoalescedTable_t *getCoalescedTable(void)
+{
+    static CANCoalescedTable_t coalesced = {0};
+    return &coalesced;
+}
+
+/* The task blocked in GetLatestCAN, woken with a direct-to-task notification once per RX ISR burst.
+ * NULL until the consumer first waits, the ISR skips the wake until then (the consumer re-checks the rings before blocking) */
+static TaskHandle_t *getRxTask(void)
+{
+    static TaskHandle_t rxTask = NULL;
+    return &rxTask;
+}
+
+/* ISR entry to CANTask pickup probe. Each FIFO ISR stamps its own entry slot, so every slot has one writer,
+ * a stamp is only taken while the slot is free so the oldest waiting burst is the one measured.
+ * The stats are only touched by the task, isrCost[fifo] only by that FIFO's ISR */
+typedef struct
+{
+    uint32_t entryCycles[CAN_RX_FIFO_COUNT];
+    uint32_t entryPending[CAN_RX_FIFO_COUNT];
+    CANRxLatency_t stats;
+    CANRxIsrCost_t isrCost[CAN_RX_FIFO_COUNT];
+} CANRxProbe_t;
+
+static CANRxProbe_t *getRxProbe(void)
+{
+    static CANRxProbe_t probe = {0};
+    return &probe;
+}
+
+/* Worst case stuffed extended data frame: 54 stuffable header/CRC bits + 8 per data byte, a stuff bit for every 4 after the first,
+ * plus 13 bits of CRC delimiter, ACK, EOF and interframe space that are never stuffed */
+#define CAN_EXT_FRAME_STUFFABLE_BITS 54U
+#define CAN_FRAME_FIXED_BITS 13U
+#define CAN_BITS_PER_BYTE 8U
+#define CAN_STUFF_RUN 4U
+
+#define CAN_BUS_LOAD_SLOT_TICKS pdMS_TO_TICKS(CAN_BUS_LOAD_SLOT_MS)
+static_assert(CAN_BUS_LOAD_SLOT_TICKS > 0, "Bus load slot shorter than a tick");
+
+/* Each slot packs the low 16 bits of the period it covers above its bit count, so the RX ISRs (which preempt each other)
+ * and the TX path can all add to it with one CAS, and a slot left over from an older period reads as empty */
+#define CAN_BUS_LOAD_PERIOD_SHIFT 16U
+#define CAN_BUS_LOAD_BITS_MASK 0xFFFFU
+#define PERMILLE 1000U
+#define MS_PER_SECOND 1000U
+
+/* slots is shared by every context, the rest is only written by CANTask (UpdateCANBusLoad) */
+typedef struct
+{
+    uint32_t slots[CAN_BUS_LOAD_SLOT_COUNT];
+    uint32_t bitsPerSecond;
+    uint32_t lastPeriod;
+    CANBusLoad_t load;
+} CANBusLoadState_t;
+
+static CANBusLoadState_t *getBusLoad(void)
+{
+    static CANBusLoadState_t busLoad = {0};
+    return &busLoad;
+}
+
+/* ABOM brings the controller back after 128 runs of 11 recessive bits, ~11ms on an idle 125kbit/s bus and every frame's
+ * ACK delimiter, EOF and interframe space counts as one run on a busy one. Past this the controller is restarted */
+#define CAN_BUS_OFF_RESTART_MS 100U
+#define CAN_BUS_OFF_RESTART_TICKS pdMS_TO_TICKS(CAN_BUS_OFF_RESTART_MS)
+/* LEC 7 is left by software so a fresh error can be told apart, we clear to 0 instead so it's never counted */
+#define CAN_LEC_SOFTWARE 7U
+#define CAN_ESR_STATE_FLAGS (CAN_ESR_EWGF | CAN_ESR_EPVF | CAN_ESR_BOFF)
+
+/* The first block is only written by canErrorInterrupt, the second only by CANTask (ServiceCANErrorState) */
+typedef struct
+{
+    uint32_t lastEsr;
+    uint32_t lastErrorCode;
+    uint32_t errorCodeCounts[CAN_LEC_COUNT];
+    uint32_t warningCount;
+    uint32_t passiveCount;
+    uint32_t busOffCount;
+    Timestamp_t busOffTick;
+
+    CANErrorState_t state;
+    uint32_t esr;
+    Timestamp_t restartTick;
+    uint32_t forcedRestarts;
+    Timestamp_t lastRecoveryTicks;
+    Timestamp_t maxRecoveryTicks;
+} CANErrorTracker_t;
+
+static CANErrorTracker_t *getErrorTracker(void)
+{
+    static CANErrorTracker_t tracker = {0};
+    return &tracker;
+}
+
+/* Set while the bus sniffer has the controller in silent mode, read by the RX ISRs */
+static bool *getListenOnly(void)
+{
+    static bool listenOnly = false;
+    return &listenOnly;
+}
+
+static_assert(DIVECAN_RX_ID_COUNT <= CAN_FILTER_BANK_COUNT, "More consumed CAN IDs than bxCAN filter banks");
+
+/* The bank after the DIVECAN_RX_ID_LIST ones passes everything to FIFO0 while listen-only. A frame matching several
+ * banks goes by the lowest numbered, so the consumed IDs still reach their own FIFO */
+#define CAN_CATCH_ALL_FILTER_BANK DIVECAN_RX_ID_COUNT
+static_assert(CAN_CATCH_ALL_FILTER_BANK < CAN_FILTER_BANK_COUNT, "No filter bank left for the bus sniffer");
+
+/* bxCAN 32 bit filter register layout: STID/EXID[31:3] IDE[2] RTR[1] 0 */
+#define CAN_FILTER_ID_SHIFT 3
+#define CAN_FILTER_HIGH_SHIFT 16
+#define CAN_FILTER_HALF_MASK 0xFFFFU
+
+/** @brief Load one 32 bit mask filter bank per DIVECAN_RX_ID_LIST entry, so that
+ * the hardware drops everything we would otherwise just throw away in CANTask, and routes each ID to its FIFO.
+ * The mask ignores the source/dest nibbles and the entry's wildcard bits, requires an extended ID, and rejects remote
+ * frames.
+ * @param hcan CAN handle to configure, must be called before HAL_CAN_Start
+ */
+void InitCANFilters(CAN_HandleTypeDef *hcan)
+{
+    static const uint32_t rxIds[] = {
+#define DIVECAN_RX_ID_ENTRY(listId, wildcard, fifo, arg) (listId),
+        DIVECAN_RX_ID_LIST(DIVECAN_RX_ID_ENTRY, 0)
+#undef DIVECAN_RX_ID_ENTRY
+    };
+    static const uint32_t rxWildcards[] = {
+#define DIVECAN_RX_WILDCARD_ENTRY(listId, wildcard, fifo, arg) (wildcard),
+        DIVECAN_RX_ID_LIST(DIVECAN_RX_WILDCARD_ENTRY, 0)
+#undef DIVECAN_RX_WILDCARD_ENTRY
+    };
+    static const uint32_t rxFifos[] = {
+#define DIVECAN_RX_FIFO_ENTRY(listId, wildcard, fifo, arg) (fifo),
+        DIVECAN_RX_ID_LIST(DIVECAN_RX_FIFO_ENTRY, 0)
+#undef DIVECAN_RX_FIFO_ENTRY
+    };
+
+    for (uint32_t bank = 0; bank < DIVECAN_RX_ID_COUNT; ++bank)
+    {
+        const uint32_t idMask = ID_MASK & ~rxWildcards[bank];
+        const uint32_t filterId = ((rxIds[bank] & idMask) << CAN_FILTER_ID_SHIFT) | CAN_ID_EXT | CAN_RTR_DATA;
+        const uint32_t filterMask = (idMask << CAN_FILTER_ID_SHIFT) | CAN_ID_EXT | CAN_RTR_REMOTE;
+
+        CAN_FilterTypeDef sFilterConfig = {0};
+        sFilterConfig.FilterBank = bank;
+        sFilterConfig.FilterMode = CAN_FILTERMODE_IDMASK;
+        sFilterConfig.FilterScale = CAN_FILTERSCALE_32BIT;
+        sFilterConfig.FilterIdHigh = (filterId >> CAN_FILTER_HIGH_SHIFT) & CAN_FILTER_HALF_MASK;
+        sFilterConfig.FilterIdLow = filterId & CAN_FILTER_HALF_MASK;
+        sFilterConfig.FilterMaskIdHigh = (filterMask >> CAN_FILTER_HIGH_SHIFT) & CAN_FILTER_HALF_MASK;
+        sFilterConfig.FilterMaskIdLow = filterMask & CAN_FILTER_HALF_MASK;
+        sFilterConfig.FilterFIFOAssignment = rxFifos[bank];
+        sFilterConfig.FilterActivation = CAN_FILTER_ENABLE;
+        sFilterConfig.SlaveStartFilterBank = CAN_FILTER_BANK_COUNT;
+
+        HAL_StatusTypeDef err = HAL_CAN_ConfigFilter(hcan, &sFilterConfig);
+        if (HAL_OK != err)
+        {
+            NON_FATAL_ERROR_DETAIL(CAN_CONFIG_ERR, err);
+        }
+    }
+}
+
+/** @brief Switch the listen-only catch-all filter bank on or off, an all zero mask matches every frame
+ * @param hcan CAN handle
+ * @param enable Pass everything to FIFO0
+ * @return HAL status
+ */
+static HAL_StatusTypeDef configCatchAllFilter(CAN_HandleTypeDef *hcan, const bool enable)
+{
+    CAN_FilterTypeDef sFilterConfig = {0};
+    sFilterConfig.FilterBank = CAN_CATCH_ALL_FILTER_BANK;
+    sFilterConfig.FilterMode = CAN_FILTERMODE_IDMASK;
+    sFilterConfig.FilterScale = CAN_FILTERSCALE_32BIT;
+    sFilterConfig.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+    sFilterConfig.FilterActivation = enable ? CAN_FILTER_ENABLE : CAN_FILTER_DISABLE;
+    sFilterConfig.SlaveStartFilterBank = CAN_FILTER_BANK_COUNT;
+    return HAL_CAN_ConfigFilter(hcan, &sFilterConfig);
+}
+
+static bool ringPending(const uint32_t fifo)
+{
+    const CANRxRing_t *const ring = getRxRing(fifo);
+    return ring->tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+/** @brief Close out the probe for any burst the ISRs have stamped since we last looked */
+static void recordRxLatency(void)
+{
+    CANRxProbe_t *probe = getRxProbe();
+    for (uint32_t fifo = 0; fifo < CAN_RX_FIFO_COUNT; ++fifo)
+    {
+        if (0U != __atomic_load_n(&probe->entryPending[fifo], __ATOMIC_ACQUIRE))
+        {
+            const uint32_t cycles = DWT->CYCCNT - probe->entryCycles[fifo];
+            __atomic_store_n(&probe->entryPending[fifo], 0U, __ATOMIC_RELEASE);
+
+            CANRxLatency_t *stats = &(probe->stats);
+            if ((0U == stats->samples) || (cycles < stats->minCycles))
+            {
+                stats->minCycles = cycles;
+            }
+            if (cycles > stats->maxCycles)
+            {
+                stats->maxCycles = cycles;
+            }
+            stats->lastCycles = cycles;
+            ++stats->samples;
+        }
+    }
+}
+
+/** @brief Anything in either ring, or any coalesced slot waiting to be taken */
+static bool rxPending(void)
+{
+    return ringPending(CAN_FILTER_FIFO1) || ringPending(CAN_FILTER_FIFO0) ||
+           (0 != __atomic_load_n(&getCoalescedTable()->dirty, __ATOMIC_ACQUIRE));
+}
+
+/** @brief Get the oldest unread inbound message, waiting up to blockTime for either it or a coalesced frame to arrive.
+ * The priority (FIFO1) ring is drained before the bulk (FIFO0) ring.
+ * The message is handed out in place, it stays valid (and may be modified) until ReleaseLatestCAN is called,
+ * calling again before then returns the same message.
+ * @param blockTime Maximum ticks to wait if nothing is pending
+ * @return Pointer to the message and its arrival stamps, or NULL if the ring is empty (we timed out, or only coalesced
+ * frames are waiting)
+ */
+CANRxFrame_t *GetLatestCAN(const Timestamp_t blockTime)
+{
+    uint32_t *heldFifo = getHeldFifo();
+
+    if ((CAN_RX_FIFO_COUNT == *heldFifo) && (!rxPending()))
+    {
+        /* Register, then clear any stale wakeup before the re-check so a burst landing in between still wakes us */
+        __atomic_store_n(getRxTask(), xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+        (void)ulTaskNotifyTake(pdTRUE, 0);
+        if ((blockTime > 0) && (!rxPending()))
+        {
+            (void)ulTaskNotifyTake(pdTRUE, blockTime);
+        }
+    }
+
+    recordRxLatency();
+
+    if (CAN_RX_FIFO_COUNT == *heldFifo)
+    {
+        if (ringPending(CAN_FILTER_FIFO1))
+        {
+            *heldFifo = CAN_FILTER_FIFO1;
+        }
+        else if (ringPending(CAN_FILTER_FIFO0))
+        {
+            *heldFifo = CAN_FILTER_FIFO0;
+        }
+        else
+        {
+            /* Nothing in the rings */
+        }
+    }
+
+    CANRxFrame_t *frame = NULL;
+    if (CAN_RX_FIFO_COUNT != *heldFifo)
+    {
+        CANRxRing_t *ring = getRxRing(*heldFifo);
+        frame = &(ring->frames[ring->tail & CAN_RX_RING_MASK]);
+    }
+    return frame;
+}
+
+/** @brief Hand the slot returned by GetLatestCAN back to the ISR
+ */
+void ReleaseLatestCAN(void)
+{
+    uint32_t *heldFifo = getHeldFifo();
+    if (CAN_RX_FIFO_COUNT != *heldFifo)
+    {
+        CANRxRing_t *ring = getRxRing(*heldFifo);
+        __atomic_store_n(&ring->tail, ring->tail + 1U, __ATOMIC_RELEASE);
+        *heldFifo = CAN_RX_FIFO_COUNT;
+    }
+    else
+    {
+        NON_FATAL_ERROR(UNREACHABLE_ERR);
+    }
+}
+
+/** @brief Snapshot the inbound counters for one FIFO
+ * @param fifo CAN_FILTER_FIFO0 or CAN_FILTER_FIFO1
+ * @param stats Output, ring drops, deepest ring fill and hardware FIFO overruns
+ */
+void GetCANRxRingStats(const uint32_t fifo, CANRxRingStats_t *const stats)
+{
+    if (fifo < CAN_RX_FIFO_COUNT)
+    {
+        const CANRxRing_t *const ring = getRxRing(fifo);
+        stats->overflows = __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED);
+        stats->highWater = __atomic_load_n(&ring->highWater, __ATOMIC_RELAXED);
+        stats->hwOverruns = __atomic_load_n(&ring->hwOverruns, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        NON_FATAL_ERROR_DETAIL(UNREACHABLE_ERR, fifo);
+    }
+}
+
+/** @brief Start the DWT cycle counter the RX latency probe runs off
+ */
+void InitCANRxLatencyProbe(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/** @brief Snapshot the ISR entry to CANTask pickup latency, must be called from CANTask
+ * @param latency Output, in DWT cycles
+ */
+void GetCANRxLatency(CANRxLatency_t *const latency)
+{
+    *latency = getRxProbe()->stats;
+}
+
+/** @brief Snapshot how long a FIFO's RX ISR has spent per frame, for debug only (the ISR may update it mid copy)
+ * @param fifo CAN_RX_FIFO0 or CAN_RX_FIFO1
+ * @param cost Output, in DWT cycles, zeroed if the FIFO is out of range
+ */
+void GetCANRxIsrCost(const uint32_t fifo, CANRxIsrCost_t *const cost)
+{
+    CANRxIsrCost_t snapshot = {0};
+    if (fifo < CAN_RX_FIFO_COUNT)
+    {
+        snapshot = getRxProbe()->isrCost[fifo];
+    }
+    *cost = snapshot;
+}
+
+/** @brief Worst case bits an extended data frame holds the bus for, including stuffing and interframe space
+ * @param length DLC, clamped to 8
+ * @return Bit times, 80 for an empty frame up to 160 for 8 bytes
+ */
+uint32_t CANFrameBits(const uint8_t length)
+{
+    const uint32_t bytes = (length > MAX_CAN_RX_LENGTH) ? MAX_CAN_RX_LENGTH : length;
+    const uint32_t stuffable = CAN_EXT_FRAME_STUFFABLE_BITS + (bytes * CAN_BITS_PER_BYTE);
+    return stuffable + ((stuffable - 1U) / CAN_STUFF_RUN) + CAN_FRAME_FIXED_BITS;
+}
+
+/** @brief Bus load period a tick falls in */
+static uint32_t busLoadPeriod(const Timestamp_t tick)
+{
+    return tick / CAN_BUS_LOAD_SLOT_TICKS;
+}
+
+/** @brief Slot word tag for a period, the low 16 bits of the period */
+static uint32_t busLoadTag(const uint32_t period)
+{
+    return period << CAN_BUS_LOAD_PERIOD_SHIFT;
+}
+
+/** @brief !! ISR METHOD !! Charge a frame to the bus load slot for the current period, safe from any context
+ * @param frameBits Bit times from CANFrameBits
+ */
+static void addBusLoadBits(const uint32_t frameBits)
+{
+    const uint32_t period = busLoadPeriod(osKernelGetTickCount());
+    const uint32_t tag = busLoadTag(period);
+    uint32_t *const slot = &(getBusLoad()->slots[period % CAN_BUS_LOAD_SLOT_COUNT]);
+
+    uint32_t expected = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    uint32_t desired = 0;
+    do
+    {
+        /* A stale tag means this is the first frame of a new period, start it from zero */
+        uint32_t bits = ((expected & ~CAN_BUS_LOAD_BITS_MASK) == tag) ? (expected & CAN_BUS_LOAD_BITS_MASK) : 0U;
+        bits += frameBits;
+        if (bits > CAN_BUS_LOAD_BITS_MASK)
+        {
+            bits = CAN_BUS_LOAD_BITS_MASK;
+        }
+        desired = tag | bits;
+    } while (!__atomic_compare_exchange_n(slot, &expected, desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/** @brief Bits charged to a period, 0 if its slot has since been reused */
+static uint32_t busLoadSlotBits(const CANBusLoadState_t *const state, const uint32_t period)
+{
+    const uint32_t slot = __atomic_load_n(&(state->slots[period % CAN_BUS_LOAD_SLOT_COUNT]), __ATOMIC_RELAXED);
+    return ((slot & ~CAN_BUS_LOAD_BITS_MASK) == busLoadTag(period)) ? (slot & CAN_BUS_LOAD_BITS_MASK) : 0U;
+}
+
+/** @brief Bits as permille of what the bus can carry over a number of slots, capped at 100% */
+static uint16_t busLoadPermille(const CANBusLoadState_t *const state, const uint32_t bits, const uint32_t slotCount)
+{
+    const uint32_t capacity = (state->bitsPerSecond * CAN_BUS_LOAD_SLOT_MS * slotCount) / MS_PER_SECOND;
+    uint32_t permille = 0;
+    if (capacity > 0U)
+    {
+        permille = (uint32_t)(((uint64_t)bits * PERMILLE) / capacity);
+    }
+    return (uint16_t)((permille > PERMILLE) ? PERMILLE : permille);
+}
+
+/** @brief Work out the bit rate the bus load is measured against from the bit timing MX_CAN1_Init loaded,
+ * must be called after HAL_CAN_Init
+ * @param hcan CAN handle
+ */
+void InitCANBusLoad(const CAN_HandleTypeDef *const hcan)
+{
+    const uint32_t btr = hcan->Instance->BTR;
+    const uint32_t prescaler = ((btr & CAN_BTR_BRP) >> CAN_BTR_BRP_Pos) + 1U;
+    /* Sync segment is always one time quantum */
+    const uint32_t quantaPerBit = 1U + (((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) + 1U) + (((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos) + 1U);
+
+    CANBusLoadState_t *state = getBusLoad();
+    state->bitsPerSecond = HAL_RCC_GetPCLK1Freq() / (prescaler * quantaPerBit);
+    state->lastPeriod = busLoadPeriod(osKernelGetTickCount());
+}
+
+/** @brief Fold the slots completed since the last call into the current and peak figures, must be called from CANTask
+ * at least once per window (CANTask wakes at least once a second) for the slot peak to see every slot
+ */
+void UpdateCANBusLoad(void)
+{
+    CANBusLoadState_t *state = getBusLoad();
+    const uint32_t current = busLoadPeriod(osKernelGetTickCount());
+
+    if (current != state->lastPeriod)
+    {
+        /* Slots older than the window have been reused, only the newest CAN_BUS_LOAD_SLOT_COUNT are still there */
+        uint32_t period = state->lastPeriod;
+        if ((current - period) > CAN_BUS_LOAD_SLOT_COUNT)
+        {
+            period = current - CAN_BUS_LOAD_SLOT_COUNT;
+        }
+        for (; period != current; ++period)
+        {
+            state->load.slotPermille = busLoadPermille(state, busLoadSlotBits(state, period), 1U);
+            if (state->load.slotPermille > state->load.peakSlotPermille)
+            {
+                state->load.peakSlotPermille = state->load.slotPermille;
+            }
+        }
+
+        uint32_t windowBits = 0;
+        for (uint32_t back = 1; back <= CAN_BUS_LOAD_SLOT_COUNT; ++back)
+        {
+            windowBits += busLoadSlotBits(state, current - back);
+        }
+        state->load.windowPermille = busLoadPermille(state, windowBits, CAN_BUS_LOAD_SLOT_COUNT);
+        if (state->load.windowPermille > state->load.peakWindowPermille)
+        {
+            state->load.peakWindowPermille = state->load.windowPermille;
+        }
+        state->lastPeriod = current;
+    }
+}
+
+/** @brief Snapshot the bus load as of the last UpdateCANBusLoad, must be called from CANTask
+ * @param load Output
+ */
+void GetCANBusLoad(CANBusLoad_t *const load)
+{
+    *load = getBusLoad()->load;
+}
+
+/** @brief Take (and clear) the set of coalesced slots that have been written since the last call
+ * @return Bitmask, bit n set means slot n (CANCoalescedSlot_t) has a new value
+ */
+uint32_t TakeCoalescedCAN(void)
+{
+    return __atomic_exchange_n(&getCoalescedTable()->dirty, 0U, __ATOMIC_ACQUIRE);
+}
+
+/** @brief Copy out the newest frame for a coalesced ID.
+ * The ISR can overwrite the slot at any time, so the copy is retried until the sequence number holds still across it.
+ * @param slot Which coalesced ID to read
+ * @param latest Output
+ * @return false if the slot is out of range or has never been written
+ */
+bool ReadCoalescedCAN(const CANCoalescedSlot_t slot, CANCoalesced_t *const latest)
+{
+    bool valid = false;
+    if (slot < CAN_COALESCED_SLOT_COUNT)
+    {
+        const CANCoalesced_t *const src = &(getCoalescedTable()->slots[slot]);
+        uint32_t sequence = 0;
+        do
+        {
+            sequence = __atomic_load_n(&src->sequence, __ATOMIC_ACQUIRE);
+            *latest = *src;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while (sequence != __atomic_load_n(&src->sequence, __ATOMIC_RELAXED));
+
+        valid = (0 != sequence);
+    }
+    return valid;
+}
+
+#ifdef TESTING
+/** @brief Empty the ring and coalesced slots and zero the counters, only valid while the ISR can't fire
+ */
+void ResetCANRxRing(void)
+{
+    for (uint32_t fifo = 0; fifo < CAN_RX_FIFO_COUNT; ++fifo)
+    {
+        CANRxRing_t *ring = getRxRing(fifo);
+        (void)memset(ring, 0, sizeof(*ring));
+    }
+    *getHeldFifo() = CAN_RX_FIFO_COUNT;
+    *getRxTask() = NULL;
+    *getListenOnly() = false;
+    CANRxProbe_t *probe = getRxProbe();
+    (void)memset(probe, 0, sizeof(*probe));
+    CANCoalescedTable_t *coalesced = getCoalescedTable();
+    (void)memset(coalesced, 0, sizeof(*coalesced));
+    CANBusLoadState_t *busLoad = getBusLoad();
+    (void)memset(busLoad, 0, sizeof(*busLoad));
+    CANErrorTracker_t *tracker = getErrorTracker();
+    (void)memset(tracker, 0, sizeof(*tracker));
+}
+
+/** @brief Drop anything queued for transmission and zero the counters, only valid while the ISR can't fire
+ */
+void ResetCANTxRing(void)
+{
+    CANTxScheduler_t *scheduler = getTxScheduler();
+    (void)memset(scheduler, 0, sizeof(*scheduler));
+    CANTxRate_t *txRate = getTxRate();
+    (void)memset(txRate, 0, sizeof(*txRate));
+    const CANTxThrottleConfig_t defaultConfig = CAN_TX_THROTTLE_DEFAULT_CONFIG;
+    *getTxThrottleConfig() = defaultConfig;
+}
+#endif
+
+/** @brief Payload bytes of one mailbox data word (RDLR/RDHR) that are inside the DLC */
+static uint32_t rxWordMask(const uint8_t bytesInWord)
+{
+    uint32_t mask = UINT32_MAX;
+    if (bytesInWord < sizeof(uint32_t))
+    {
+        mask = (1UL << (bytesInWord * 8U)) - 1U;
+    }
+    return mask;
+}
+
+/** @brief Copy a received frame into its destination, zero padded.
+ * The payload comes in as the two little endian mailbox data words so the ISR can store them whole
+ */
+static void fillMessage(DiveCANMessage_t *const message, const uint32_t id, const uint8_t length, const uint32_t dataLow, const uint32_t dataHigh)
+{
+    message->id = id;
+    message->length = length;
+
+    uint32_t words[2] = {0};
+    if (length > MAX_CAN_RX_LENGTH)
+    {
+        NON_FATAL_ERROR_ISR_DETAIL(CAN_OVERFLOW_ERR, length);
+    }
+    else
+    {
+        const uint8_t wordBytes = (uint8_t)sizeof(uint32_t);
+        words[0] = dataLow & rxWordMask(length);
+        words[1] = (length > wordBytes) ? (dataHigh & rxWordMask(length - wordBytes)) : 0U;
+    }
+    (void)memcpy(message->data, words, MAX_CAN_RX_LENGTH);
+}
+
+/** @brief Coalesced slot for an ID, or CAN_COALESCED_SLOT_COUNT if it uses the ring */
+static uint32_t coalescedSlot(const uint32_t id)
+{
+    static const uint32_t coalescedIds[CAN_COALESCED_SLOT_COUNT] = {
+#define CAN_COALESCED_ID_ENTRY(listId, arg) (listId),
+        DIVECAN_RX_COALESCED_LIST(CAN_COALESCED_ID_ENTRY, 0)
+#undef CAN_COALESCED_ID_ENTRY
+    };
+
+    uint32_t slot = 0;
+    while ((slot < CAN_COALESCED_SLOT_COUNT) && (coalescedIds[slot] != (id & ID_MASK)))
+    {
+        ++slot;
+    }
+    return slot;
+}
+
+/** @brief !! ISR METHOD !! Overwrite a coalesced slot and mark it dirty
+ */
+static void storeCoalesced(const uint32_t slot, const uint32_t id, const uint8_t length, const uint32_t dataLow, const uint32_t dataHigh, const uint32_t rxCycles)
+{
+    CANCoalescedTable_t *coalesced = getCoalescedTable();
+    CANCoalesced_t *latest = &(coalesced->slots[slot]);
+
+    fillMessage(&(latest->message), id, length, dataLow, dataHigh);
+    latest->timestamp = osKernelGetTickCount();
+    latest->rxCycles = rxCycles;
+    __atomic_store_n(&latest->sequence, latest->sequence + 1U, __ATOMIC_RELEASE);
+    (void)__atomic_fetch_or(&coalesced->dirty, 1UL << slot, __ATOMIC_RELEASE);
+}
+
+/** @brief !! ISR METHOD !! Append to the RX ring stamped with when it arrived, or count the drop if CANTask has fallen
+ * behind
+ */
+static void pushRing(const uint32_t fifo, const uint32_t id, const uint8_t length, const uint32_t dataLow, const uint32_t dataHigh, const uint32_t rxCycles)
+{
+    CANRxRing_t *ring = getRxRing(fifo);
+    const uint32_t head = ring->head;
+    const uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if ((head - tail) >= CAN_RX_RING_LEN)
+    {
+        /* Drop the newest rather than clobbering a slot CANTask may be reading */
+        __atomic_store_n(&ring->overflows, ring->overflows + 1U, __ATOMIC_RELAXED);
+        NON_FATAL_ERROR_ISR(QUEUEING_ERR);
+    }
+    else
+    {
+        CANRxFrame_t *frame = &(ring->frames[head & CAN_RX_RING_MASK]);
+        fillMessage(&(frame->message), id, length, dataLow, dataHigh);
+        frame->timestamp = osKernelGetTickCount();
+        frame->rxCycles = rxCycles;
+        __atomic_store_n(&ring->head, head + 1U, __ATOMIC_RELEASE);
+
+        const uint32_t depth = (head + 1U) - tail;
+        if (depth > ring->highWater)
+        {
+            __atomic_store_n(&ring->highWater, depth, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/** @brief !! ISR METHOD !! File a received frame into its coalesced slot or its FIFO's ring
+ * @param rxCycles DWT cycle count at ISR entry, kept with the frame
+ */
+static void fileRxFrame(const uint32_t id, const uint8_t length, const uint32_t dataLow, const uint32_t dataHigh, const uint32_t rxCycles)
+{
+    addBusLoadBits(CANFrameBits(length));
+
+    const uint32_t slot = coalescedSlot(id);
+    if (slot < CAN_COALESCED_SLOT_COUNT)
+    {
+        storeCoalesced(slot, id, length, dataLow, dataHigh, rxCycles);
+    }
+    else
+    {
+        pushRing(DIVECAN_RX_FIFO(id), id, length, dataLow, dataHigh, rxCycles);
+    }
+}
+
+/* RF0R and RF1R share a bit layout, so the FIFO0 masks serve both */
+static_assert((CAN_RF0R_FMP0 == CAN_RF1R_FMP1) && (CAN_RF0R_FOVR0 == CAN_RF1R_FOVR1) && (CAN_RF0R_RFOM0 == CAN_RF1R_RFOM1),
+              "bxCAN RX FIFO registers differ");
+
+/** @brief !! ISR METHOD !! The RFxR register of a FIFO */
+static volatile uint32_t *rxFifoReg(CAN_TypeDef *const can, const uint32_t fifo)
+{
+    return (CAN_RX_FIFO1 == fifo) ? &(can->RF1R) : &(can->RF0R);
+}
+
+/** @brief !! ISR METHOD !! Set the rs/rc_w1 bits of a FIFO's RFxR.
+ * The host register mock can't see a bare store, so test builds hand the write to it to model the hardware side effects
+ */
+static void writeRxFifoReg(CAN_TypeDef *const can, const uint32_t fifo, const uint32_t bits)
+{
+#ifdef TESTING
+    MockCAN_WriteRxFifoReg(can, fifo, bits);
+#else
+    *rxFifoReg(can, fifo) = bits;
+#endif
+}
+
+/** @brief !! ISR METHOD !! Called when a bxCAN RX FIFO has frames pending or has overrun.
+ * Reads the FIFO output mailbox registers straight into the ring/coalesced slot and releases the mailbox,
+ * skipping HAL_CAN_IRQHandler's walk over the TX, wake-up, sleep and error flags and HAL_CAN_GetRxMessage's header unpacking.
+ * Drains everything the FIFO holds in this one entry, then wakes CANTask once for the whole burst,
+ * so the PPO2/millivolt/status frames the controller sends back to back cost one interrupt and one context switch.
+ * Bounded by the hardware depth, anything that lands after that raises the interrupt again.
+ * Bus errors are left to canErrorInterrupt on the lower priority SCE vector.
+ * @param hcan CAN handle
+ * @param fifo CAN_RX_FIFO0 or CAN_RX_FIFO1
+ */
+void rxFifoInterrupt(CAN_HandleTypeDef *hcan, const uint32_t fifo)
+{
+    const uint32_t entryCycles = DWT->CYCCNT;
+    CAN_TypeDef *const can = hcan->Instance;
+    const volatile uint32_t *const rfr = rxFifoReg(can, fifo);
+    const CAN_FIFOMailBox_TypeDef *const mailbox = &(can->sFIFOMailBox[(CAN_RX_FIFO1 == fifo) ? 1U : 0U]);
+    const bool listenOnly = __atomic_load_n(getListenOnly(), __ATOMIC_ACQUIRE);
+
+    uint32_t received = 0;
+    while ((received < CAN_RX_HW_FIFO_DEPTH) && (0U != (*rfr & CAN_RF0R_FMP0)))
+    {
+        /* 29 bit ID is STID:EXID, the filters only pass extended data frames unless the catch-all bank is on */
+        const uint32_t rir = mailbox->RIR;
+        const uint32_t id = (rir & (CAN_RI0R_STID | CAN_RI0R_EXID)) >> CAN_RI0R_EXID_Pos;
+        const uint8_t length = (uint8_t)((mailbox->RDTR & CAN_RDT0R_DLC) >> CAN_RDT0R_DLC_Pos);
+        if (listenOnly)
+        {
+            snifferFrameInterrupt(rir, length, mailbox->RDLR, mailbox->RDHR, entryCycles);
+        }
+        if ((!listenOnly) || ((CAN_RI0R_IDE == (rir & (CAN_RI0R_IDE | CAN_RI0R_RTR))) && DIVECAN_RX_ACCEPTED(id)))
+        {
+            fileRxFrame(id, length, mailbox->RDLR, mailbox->RDHR, entryCycles);
+        }
+        writeRxFifoReg(can, fifo, CAN_RF0R_RFOM0);
+        ++received;
+    }
+
+    if (0U != (*rfr & CAN_RF0R_FOVR0))
+    {
+        writeRxFifoReg(can, fifo, CAN_RF0R_FOVR0);
+        rxOverrunInterrupt(fifo);
+    }
+
+    CANRxProbe_t *probe = getRxProbe();
+    if ((received > 0U) && (fifo < CAN_RX_FIFO_COUNT) && (0U == __atomic_load_n(&probe->entryPending[fifo], __ATOMIC_ACQUIRE)))
+    {
+        probe->entryCycles[fifo] = entryCycles;
+        __atomic_store_n(&probe->entryPending[fifo], 1U, __ATOMIC_RELEASE);
+    }
+
+    /* Switch straight to CANTask on the way out rather than waiting up to a tick for the scheduler */
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    const TaskHandle_t rxTask = __atomic_load_n(getRxTask(), __ATOMIC_ACQUIRE);
+    if ((received > 0U) && (NULL != rxTask))
+    {
+        vTaskNotifyGiveFromISR(rxTask, &higherPriorityTaskWoken);
+    }
+
+    if (fifo < CAN_RX_FIFO_COUNT)
+    {
+        CANRxIsrCost_t *cost = &(probe->isrCost[fifo]);
+        const uint32_t cycles = DWT->CYCCNT - entryCycles;
+        cost->frames += received;
+        cost->cycles += cycles;
+        if (cycles > cost->maxCycles)
+        {
+            cost->maxCycles = cycles;
+        }
+    }
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+#ifdef TESTING
+/** @brief Stand in for the bus: put a frame through the mocked filter banks into its FIFO and take that FIFO's
+ * interrupt, so tests see exactly what rxFifoInterrupt would. A frame the filters reject never gets that far.
+ * @param id message extended ID
+ * @param length length of data
+ * @param data data pointer
+ */
+void rxInterrupt(const uint32_t id, const uint8_t length, const uint8_t *const data)
+{
+    const int32_t fifo = MockCAN_FilterFifo(id);
+    if (fifo >= 0)
+    {
+        (void)MockCAN_DeliverRxMessage(id, length, data);
+        rxFifoInterrupt(&hcan1, (uint32_t)fifo);
+    }
+}
+#endif
+
+/** @brief !! ISR METHOD !! Called when a bxCAN RX FIFO overruns, i.e. a frame arrived with all 3 hardware slots full
+ * @param fifo FIFO that overran
+ */
+void rxOverrunInterrupt(const uint32_t fifo)
+{
+    if (fifo < CAN_RX_FIFO_COUNT)
+    {
+        CANRxRing_t *ring = getRxRing(fifo);
+        __atomic_store_n(&ring->hwOverruns, ring->hwOverruns + 1U, __ATOMIC_RELAXED);
+    }
+    if (__atomic_load_n(getListenOnly(), __ATOMIC_ACQUIRE))
+    {
+        snifferLostInterrupt();
+    }
+    NON_FATAL_ERROR_ISR_DETAIL(CAN_RX_OVERRUN_ERR, fifo);
+}
+
+/** @brief !! ISR METHOD !! Clear the last error code, the only writable ESR field.
+ * The host register mock can't see a bare store, so test builds hand the write to it to keep the read only fields
+ */
+static void clearLastErrorCode(CAN_TypeDef *const can)
+{
+#ifdef TESTING
+    MockCAN_WriteESR(can, 0);
+#else
+    can->ESR = 0;
+#endif
+}
+
+/** @brief !! ISR METHOD !! Get CANTask out of GetLatestCAN early for something other than a frame, it comes back with
+ * NULL and runs its service calls
+ */
+void WakeCANTaskFromISR(void)
+{
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    const TaskHandle_t rxTask = __atomic_load_n(getRxTask(), __ATOMIC_ACQUIRE);
+    if (NULL != rxTask)
+    {
+        vTaskNotifyGiveFromISR(rxTask, &higherPriorityTaskWoken);
+    }
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/** @brief !! ISR METHOD !! CAN1 status change/error interrupt, below both RX FIFOs in priority so bus error bookkeeping never delays a frame.
+ * Fires on every protocol error and on entering error warning, error passive and bus-off. Counts the error code and the
+ * state entries, reports going error passive or bus off, then wakes CANTask to run ServiceCANErrorState.
+ * There is no interrupt for leaving bus-off, ServiceCANErrorState polls for that.
+ * @param hcan CAN handle
+ */
+void canErrorInterrupt(CAN_HandleTypeDef *hcan)
 {
-    static QueueHandle_t QInboundCAN = NULL;
-    return &QInboundCAN;
+    CAN_TypeDef *const can = hcan->Instance;
+    const uint32_t esr = can->ESR;
+    CANErrorTracker_t *tracker = getErrorTracker();
+
+    const uint32_t lec = (esr & CAN_ESR_LEC) >> CAN_ESR_LEC_Pos;
+    if ((0U != lec) && (CAN_LEC_SOFTWARE != lec))
+    {
+        ++tracker->errorCodeCounts[lec];
+        tracker->lastErrorCode = lec;
+    }
+
+    /* Each state is counted on the way in, the controller can't leave bus-off and go back without protocol errors
+     * in between, which land here and refresh lastEsr */
+    const uint32_t entered = esr & ~(tracker->lastEsr) & CAN_ESR_STATE_FLAGS;
+    if (0U != (entered & CAN_ESR_EWGF))
+    {
+        ++tracker->warningCount;
+    }
+    if (0U != (entered & CAN_ESR_EPVF))
+    {
+        ++tracker->passiveCount;
+    }
+    if (0U != (entered & CAN_ESR_BOFF))
+    {
+        ++tracker->busOffCount;
+        __atomic_store_n(&tracker->busOffTick, osKernelGetTickCount(), __ATOMIC_RELAXED);
+    }
+    if (0U != (entered & (CAN_ESR_EPVF | CAN_ESR_BOFF)))
+    {
+        NON_FATAL_ERROR_ISR_DETAIL(CAN_BUS_ERR, esr);
+    }
+    __atomic_store_n(&tracker->lastEsr, esr, __ATOMIC_RELEASE);
+
+    /* ERRI is rc_w1 */
+    clearLastErrorCode(can);
+    can->MSR = CAN_MSR_ERRI;
+
+    /* Let CANTask see a state change straight away rather than on its next frame */
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    const TaskHandle_t rxTask = __atomic_load_n(getRxTask(), __ATOMIC_ACQUIRE);
+    if ((0U != entered) && (NULL != rxTask))
+    {
+        vTaskNotifyGiveFromISR(rxTask, &higherPriorityTaskWoken);
+    }
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/** @brief Fault confinement state from an ESR value */
+static CANErrorState_t errorStateFromEsr(const uint32_t esr)
+{
+    CANErrorState_t state = CAN_ERROR_ACTIVE;
+    if (0U != (esr & CAN_ESR_BOFF))
+    {
+        state = CAN_ERROR_BUS_OFF;
+    }
+    else if (0U != (esr & CAN_ESR_EPVF))
+    {
+        state = CAN_ERROR_PASSIVE;
+    }
+    else if (0U != (esr & CAN_ESR_EWGF))
+    {
+        state = CAN_ERROR_WARNING;
+    }
+    else
+    {
+        /* Error active */
+    }
+    return state;
 }
 
-static QueueHandle_t *getDataAvailQueue(void)
+/** @brief Take the controller through initialisation mode and back, which restarts the bus-off recovery sequence.
+ * Filters and interrupt enables survive, only the error counters and pending mailboxes are reset
+ */
+static void restartCAN(void)
 {
-    static QueueHandle_t QDataAvail = NULL;
-    return &QDataAvail;
+    HAL_StatusTypeDef err = HAL_CAN_Stop(&hcan1);
+    if (HAL_OK == err)
+    {
+        err = HAL_CAN_Start(&hcan1);
+    }
+    if (HAL_OK != err)
+    {
+        NON_FATAL_ERROR_DETAIL(CAN_CONFIG_ERR, err);
+    }
 }
 
-void InitRXQueue(void)
+/** @brief Run the CAN error state machine, must be called from CANTask, every few ms while CANBusRecovering.
+ * Hardware (ABOM) does the bus-off recovery, this times it, restarts the controller if it outlasts CAN_BUS_OFF_RESTART_MS,
+ * and reports when we are back so the caller can re-announce us to the bus.
+ * @return True on the first call after leaving bus-off
+ */
+bool ServiceCANErrorState(void)
 {
-    QueueHandle_t *inbound = getInboundQueue();
-    QueueHandle_t *dataAvail = getDataAvailQueue();
+    CANErrorTracker_t *tracker = getErrorTracker();
+    const uint32_t esr = hcan1.Instance->ESR;
+    const CANErrorState_t state = errorStateFromEsr(esr);
+    const Timestamp_t now = osKernelGetTickCount();
+    bool rejoined = false;
 
-    if ((NULL == *inbound) && (NULL == *dataAvail))
+    if (CAN_ERROR_BUS_OFF == state)
+    {
+        if (CAN_ERROR_BUS_OFF != tracker->state)
+        {
+            /* The restart deadline runs from when the ISR saw us go, falling back to now if it didn't */
+            const Timestamp_t busOffTick = __atomic_load_n(&tracker->busOffTick, __ATOMIC_RELAXED);
+            tracker->restartTick = (0U != (__atomic_load_n(&tracker->lastEsr, __ATOMIC_ACQUIRE) & CAN_ESR_BOFF)) ? busOffTick : now;
+        }
+        else if ((now - tracker->restartTick) >= CAN_BUS_OFF_RESTART_TICKS)
+        {
+            restartCAN();
+            ++tracker->forcedRestarts;
+            tracker->restartTick = now;
+        }
+        else
+        {
+            /* Still within the hardware's recovery time */
+        }
+    }
+    else if (CAN_ERROR_BUS_OFF == tracker->state)
+    {
+        const Timestamp_t recovery = now - __atomic_load_n(&tracker->busOffTick, __ATOMIC_RELAXED);
+        tracker->lastRecoveryTicks = recovery;
+        if (recovery > tracker->maxRecoveryTicks)
+        {
+            tracker->maxRecoveryTicks = recovery;
+        }
+        rejoined = true;
+    }
+    else
     {
-        static StaticQueue_t QInboundCAN_QueueStruct = {0};
-        static uint8_t QInboundCAN_Storage[CAN_QUEUE_LEN * sizeof(DiveCANMessage_t)];
+        /* On the bus either way, nothing to manage */
+    }
 
-        *inbound = xQueueCreateStatic(CAN_QUEUE_LEN, sizeof(DiveCANMessage_t), QInboundCAN_Storage, &QInboundCAN_QueueStruct);
+    tracker->state = state;
+    tracker->esr = esr;
+    return rejoined;
+}
 
-        static StaticQueue_t QDataAvail_QueueStruct = {0};
-        static uint8_t QDataAvail_Storage[sizeof(bool)];
+/** @brief Whether the controller is off the bus, in which case CANTask should call ServiceCANErrorState every few ms
+ * rather than waiting on frames that won't come
+ */
+bool CANBusRecovering(void)
+{
+    return CAN_ERROR_BUS_OFF == getErrorTracker()->state;
+}
 
-        *dataAvail = xQueueCreateStatic(1, sizeof(bool), QDataAvail_Storage, &QDataAvail_QueueStruct);
-    }
+/** @brief Snapshot the CAN error metrics, the ISR maintained counters may be mid update, debug only
+ * @param stats Output
+ */
+void GetCANErrorStats(CANErrorStats_t *const stats)
+{
+    const CANErrorTracker_t *const tracker = getErrorTracker();
+    stats->state = tracker->state;
+    stats->tec = (uint8_t)((tracker->esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos);
+    stats->rec = (uint8_t)((tracker->esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos);
+    stats->lastErrorCode = (uint8_t)tracker->lastErrorCode;
+    (void)memcpy(stats->errorCodeCounts, tracker->errorCodeCounts, sizeof(stats->errorCodeCounts));
+    stats->warningCount = tracker->warningCount;
+    stats->passiveCount = tracker->passiveCount;
+    stats->busOffCount = tracker->busOffCount;
+    stats->forcedRestarts = tracker->forcedRestarts;
+    stats->lastRecoveryTicks = tracker->lastRecoveryTicks;
+    stats->maxRecoveryTicks = tracker->maxRecoveryTicks;
 }
 
-void BlockForCAN(void)
+/*-----------------------------------------------------------------------------------*/
+/* Transmit */
+
+/** @brief !! ISR METHOD !! Hand one frame to a free TX mailbox
+ * @param hcan CAN handle
+ * @param entry Frame to send, copied into the mailbox's record so it can be retried
+ * @param txClass Class the frame was queued under
+ * @return HAL status, the frame is gone either way
+ */
+static HAL_StatusTypeDef loadTxMailbox(CAN_HandleTypeDef *hcan, const CANTxEntry_t *const entry, const CANTxClass_t txClass)
 {
-    QueueHandle_t *dataAvail = getDataAvailQueue();
-    if (xQueueReset(*dataAvail)) /* reset always returns pdPASS, so this should always evaluate to true */
+    CAN_TxHeaderTypeDef header = {0};
+    header.StdId = 0x0;
+    header.ExtId = entry->message.id;
+    header.RTR = CAN_RTR_DATA;
+    header.IDE = CAN_ID_EXT;
+    header.DLC = entry->message.length;
+    header.TransmitGlobalTime = DISABLE;
+
+    uint32_t mailboxNumber = 0;
+
+    HAL_StatusTypeDef err = HAL_CAN_AddTxMessage(hcan, &header, entry->message.data, &mailboxNumber);
+    if (HAL_OK == err)
     {
-        bool data = false;
-        bool msgAvailable = xQueuePeek(*dataAvail, &data, TIMEOUT_1S_TICKS);
+        /* Our own frames are on the bus too, charge them as they're queued */
+        addBusLoadBits(CANFrameBits(entry->message.length));
 
-        if (!msgAvailable)
+        CANTxScheduler_t *scheduler = getTxScheduler();
+        /* 1/2/4 -> 0/1/2 */
+        CANTxMailbox_t *mailbox = &(scheduler->mailboxes[mailboxNumber >> 1U]);
+        mailbox->entry = *entry;
+        ++mailbox->entry.attempts;
+        mailbox->txClass = txClass;
+        scheduler->inFlight |= mailboxNumber;
+    }
+    return err;
+}
+
+/** @brief !! ISR METHOD !! Ask the controller to give up on one diagnostic frame still waiting in a mailbox, so the
+ * critical frame behind it gets the mailbox on the next TX interrupt. One at a time, each completion re-evaluates.
+ * @param hcan CAN handle
+ */
+static void abortDiagnosticTx(CAN_HandleTypeDef *hcan)
+{
+    CANTxScheduler_t *scheduler = getTxScheduler();
+    uint32_t abort = 0;
+    for (uint32_t mailbox = 0; (mailbox < CAN_TX_MAILBOX_COUNT) && (0U == abort); ++mailbox)
+    {
+        const uint32_t bit = 1UL << mailbox;
+        if ((0U != (scheduler->inFlight & bit)) && (CAN_TX_CLASS_DIAGNOSTIC == scheduler->mailboxes[mailbox].txClass))
         {
-            /** Data is not available, but the later code is able to handle that,
-             * This method mainly exists to rest for a convenient, event-based amount
-             */
-            NON_FATAL_ERROR(TIMEOUT_ERR);
+            abort = bit;
         }
     }
-    else
+
+    if (0U != abort)
     {
-        NON_FATAL_ERROR(UNREACHABLE_ERR);
+        (void)HAL_CAN_AbortTxRequest(hcan, abort);
+        scheduler->abortMask = abort;
+        scheduler->requeueMask = abort;
     }
 }
 
-BaseType_t GetLatestCAN(const Timestamp_t blockTime, DiveCANMessage_t *message)
+/** @brief !! ISR METHOD !! Decode how a completed mailbox's request ended
+ * @param flags The mailbox's TSR byte, shifted down to mailbox 0's positions
+ * @param aborted Whether we had asked for it to be aborted
+ */
+static CANTxOutcome_t txOutcome(const uint32_t flags, const bool aborted)
 {
-    QueueHandle_t *inbound = getInboundQueue();
-    return xQueueReceive(*inbound, message, blockTime);
+    CANTxOutcome_t outcome = CAN_TX_OUTCOME_ERROR;
+    /* A frame already on the wire when the abort landed still finishes */
+    if (0U != (flags & CAN_TSR_TXOK0))
+    {
+        outcome = CAN_TX_OUTCOME_SENT;
+    }
+    else if (aborted)
+    {
+        outcome = CAN_TX_OUTCOME_ABORTED;
+    }
+    else if (0U != (flags & CAN_TSR_ALST0))
+    {
+        outcome = CAN_TX_OUTCOME_ARBITRATION_LOST;
+    }
+    else
+    {
+        /* TERR, or no reason given, either way it didn't go */
+    }
+    return outcome;
 }
 
-/** @brief !! ISR METHOD !! Called when CAN mailbox receives message
- * @param id message extended ID
- * @param length length of data
- * @param data data pointer
+/** @brief !! ISR METHOD !! Give a frame that didn't make it another attempt if its class allows, at the front of its ring so
+ * it keeps its place
+ * @param scheduler TX state
+ * @param mailbox The mailbox record of the failed frame
  */
-void rxInterrupt(const uint32_t id, const uint8_t length, const uint8_t *const data)
+static void retryTx(CANTxScheduler_t *const scheduler, const CANTxMailbox_t *const mailbox)
 {
-    DiveCANMessage_t message = {
-        .id = id,
-        .length = length,
-        .data = {0, 0, 0, 0, 0, 0, 0, 0},
-        .type = NULL};
+    CANTxRing_t *ring = &(scheduler->rings[mailbox->txClass]);
+    if ((mailbox->entry.attempts <= txRetryLimit[mailbox->txClass]) && ((ring->head - ring->tail) < CAN_TX_RING_LEN))
+    {
+        --ring->tail;
+        ring->entries[ring->tail & CAN_TX_RING_MASK] = mailbox->entry;
+        ++ring->retries;
+    }
+    else
+    {
+        ++ring->abandoned;
+    }
+}
 
-    if (length > MAX_CAN_RX_LENGTH)
+/** @brief !! ISR METHOD !! Put a frame pulled out of its mailbox back at the front of its ring, so it goes again once
+ * the critical frame it made way for is out. The abort wasn't a failed attempt, so it doesn't use up a retry
+ * @param scheduler TX state
+ * @param mailbox The mailbox record of the aborted frame
+ */
+static void requeueAbortedTx(CANTxScheduler_t *const scheduler, const CANTxMailbox_t *const mailbox)
+{
+    CANTxRing_t *ring = &(scheduler->rings[mailbox->txClass]);
+    if ((ring->head - ring->tail) < CAN_TX_RING_LEN)
     {
-        NON_FATAL_ERROR_ISR_DETAIL(CAN_OVERFLOW_ERR, length);
+        --ring->tail;
+        ring->entries[ring->tail & CAN_TX_RING_MASK] = mailbox->entry;
+        --ring->entries[ring->tail & CAN_TX_RING_MASK].attempts;
+        ++ring->requeued;
     }
     else
     {
-        (void)memcpy(message.data, data, length);
+        ++ring->abandoned;
+    }
+}
+
+/** @brief !! ISR METHOD !! Account a frame that made it onto the bus: time from first being queued (so including any
+ * retries) to its completion being collected, and the throughput totals
+ * @param scheduler TX state
+ * @param mailbox The mailbox record of the sent frame
+ * @param nowCycles DWT cycle count at collection
+ */
+static void recordTxSent(CANTxScheduler_t *const scheduler, const CANTxMailbox_t *const mailbox, const uint32_t nowCycles)
+{
+    const uint32_t cyclesPerMicrosecond = SystemCoreClock / 1000000U;
+    const uint32_t micros = (nowCycles - mailbox->entry.queuedCycles) / ((0U == cyclesPerMicrosecond) ? 1U : cyclesPerMicrosecond);
+
+    /* Bucket is the bit length of the latency in microseconds */
+    uint32_t bucket = 0;
+    uint32_t remaining = micros;
+    while ((remaining > 0U) && (bucket < (CAN_TX_LATENCY_BUCKET_COUNT - 1U)))
+    {
+        remaining >>= 1U;
+        ++bucket;
+    }
+
+    CANTxLatency_t *latency = &(scheduler->rings[mailbox->txClass].latency);
+    ++latency->buckets[bucket];
+    ++latency->samples;
+    if (micros > latency->maxMicros)
+    {
+        latency->maxMicros = micros;
     }
 
-    QueueHandle_t *inbound = getInboundQueue();
-    QueueHandle_t *dataAvail = getDataAvailQueue();
-    if ((NULL != *inbound) && (NULL != *dataAvail))
+    ++scheduler->sentFrames;
+    scheduler->sentBytes += mailbox->entry.message.length;
+}
+
+/** @brief !! ISR METHOD !! Collect the outcome of every loaded mailbox that has completed, count it against the frame's
+ * class, queue any retry and acknowledge the completion (RQCPx, write 1 to clear, also clears TXOK/ALST/TERR).
+ * Runs before every drain, as a mailbox the task side reloads would otherwise lose its result before the ISR saw it.
+ * @param can CAN registers
+ */
+static void collectTxOutcomes(CAN_TypeDef *const can)
+{
+    CANTxScheduler_t *scheduler = getTxScheduler();
+    const uint32_t tsr = can->TSR;
+    const uint32_t nowCycles = DWT->CYCCNT;
+    for (uint32_t mailbox = 0; mailbox < CAN_TX_MAILBOX_COUNT; ++mailbox)
     {
-        bool dataReady = true;
-        BaseType_t err = xQueueOverwriteFromISR(*dataAvail, &dataReady, NULL);
-        if (pdPASS != err)
+        const uint32_t flags = tsr >> (mailbox * CAN_TSR_MAILBOX_SHIFT);
+        const uint32_t bit = 1UL << mailbox;
+        if ((0U != (scheduler->inFlight & bit)) && (0U != (flags & CAN_TSR_RQCP0)))
         {
-            NON_FATAL_ERROR_ISR_DETAIL(QUEUEING_ERR, err);
+            const CANTxMailbox_t *record = &(scheduler->mailboxes[mailbox]);
+            const CANTxOutcome_t outcome = txOutcome(flags, 0U != (scheduler->abortMask & bit));
+            ++scheduler->rings[record->txClass].outcomes[outcome];
+            if (CAN_TX_OUTCOME_SENT == outcome)
+            {
+                recordTxSent(scheduler, record, nowCycles);
+            }
+            else if ((CAN_TX_OUTCOME_ARBITRATION_LOST == outcome) || (CAN_TX_OUTCOME_ERROR == outcome))
+            {
+                retryTx(scheduler, record);
+            }
+            else if (0U != (scheduler->requeueMask & bit))
+            {
+                /* Made way for a critical frame on purpose, it goes again after it */
+                requeueAbortedTx(scheduler, record);
+            }
+            else
+            {
+                /* Aborted going listen-only, it would be stale by the time we are back on the bus */
+            }
+            scheduler->inFlight &= ~bit;
+            scheduler->abortMask &= ~bit;
+            scheduler->requeueMask &= ~bit;
         }
+    }
+
+#ifdef TESTING
+    MockCAN_WriteTSR(can, tsr & CAN_TSR_RQCP_ALL);
+#else
+    can->TSR = tsr & CAN_TSR_RQCP_ALL;
+#endif
+}
+
+/** @brief !! ISR METHOD !! Top the bandwidth cap's bucket up for the time since the last refill
+ * @param throttle Bucket state
+ * @param config Cap settings
+ * @param nowCycles DWT cycle count now
+ */
+static void refillTxThrottle(CANTxThrottle_t *const throttle, const CANTxThrottleConfig_t *const config, const uint32_t nowCycles)
+{
+    const uint64_t refill = (uint64_t)(nowCycles - throttle->lastCycles) * config->bitsPerSecond;
+    throttle->debt = (refill < throttle->debt) ? (throttle->debt - refill) : 0U;
+    throttle->lastCycles = nowCycles;
+}
 
-        err = xQueueSendToBackFromISR(*inbound, &message, NULL);
-        if (pdPASS != err)
+/** @brief !! ISR METHOD !! Charge an extension ID frame to the bandwidth cap's bucket if it can cover it, otherwise
+ * apply the configured policy. Anything else goes straight through.
+ * @param throttle Bucket state, refilled by the caller
+ * @param entry Frame at the head of its ring
+ * @return Whether to load, hold or discard the frame
+ */
+static CANTxThrottleVerdict_t throttleTx(CANTxThrottle_t *const throttle, CANTxEntry_t *const entry)
+{
+    const CANTxThrottleConfig_t *const config = getTxThrottleConfig();
+    CANTxThrottleVerdict_t verdict = CAN_TX_THROTTLE_PASS;
+    if ((0U != config->bitsPerSecond) && DIVECAN_IS_EXTENSION_ID(entry->message.id))
+    {
+        const uint64_t cost = (uint64_t)CANFrameBits(entry->message.length) * SystemCoreClock;
+        const uint64_t capacity = (uint64_t)config->burstBits * SystemCoreClock;
+        if ((throttle->debt + cost) <= capacity)
+        {
+            throttle->debt += cost;
+            ++throttle->passed;
+        }
+        else if (CAN_TX_THROTTLE_DROP == config->policy)
         {
-            /* err can only ever be 0 if we get here, means we couldn't enqueue*/
-            NON_FATAL_ERROR_ISR(QUEUEING_ERR);
+            verdict = CAN_TX_THROTTLE_DISCARD;
+            ++throttle->dropped;
         }
+        else
+        {
+            verdict = CAN_TX_THROTTLE_HOLD;
+            if ((0U == throttle->heldCost) || (cost < throttle->heldCost))
+            {
+                throttle->heldCost = cost;
+            }
+            if (!entry->throttled)
+            {
+                entry->throttled = true;
+                ++throttle->deferred;
+            }
+        }
+    }
+    else
+    {
+        /* Protocol traffic, or the cap is lifted */
     }
+    return verdict;
 }
 
-/** @brief Add message to the next free mailbox, waits until the next mailbox is available.
- * @param Id Message ID (extended)
- * @param data Pointer to the data to send, must be size dataLength
- * @param dataLength Size of the data to send */
-void sendCANMessage(const DiveCANMessage_t message)
+/** @brief !! ISR METHOD !! Move frames from the TX rings into the hardware mailboxes, critical first.
+ * Status and diagnostic frames leave CAN_TX_CRITICAL_RESERVE mailboxes free, and if a critical frame still can't get a
+ * mailbox a pending diagnostic frame is aborted to make room. Extension ID frames also have to get past the bandwidth
+ * cap, a deferred one stops its ring until a later drain finds the bucket refilled.
+ * Must be called from the TX ISR or with it masked, it is the rings' only consumer.
+ * A frame the HAL refuses is dropped rather than retried, so a wedged controller can't stall the ring.
+ * @param hcan CAN handle
+ * @return HAL_OK, or the last error the HAL gave for a dropped frame
+ */
+static HAL_StatusTypeDef drainTxRing(CAN_HandleTypeDef *hcan)
 {
-    /* This isn't super time critical so if we're still waiting on stuff to tx then we can quite happily just wait */
-    while (0 == HAL_CAN_GetTxMailboxesFreeLevel(&hcan1))
+    CANTxScheduler_t *scheduler = getTxScheduler();
+    HAL_StatusTypeDef result = HAL_OK;
+
+    collectTxOutcomes(hcan->Instance);
+    refillTxThrottle(&(scheduler->throttle), getTxThrottleConfig(), DWT->CYCCNT);
+    scheduler->throttle.heldCost = 0;
+    const bool listenOnly = __atomic_load_n(getListenOnly(), __ATOMIC_ACQUIRE);
+
+    for (uint32_t txClass = 0; txClass < CAN_TX_CLASS_COUNT; ++txClass)
     {
-        (void)osDelay(TX_WAIT_DELAY);
+        CANTxRing_t *ring = &(scheduler->rings[txClass]);
+        const uint32_t reserve = (CAN_TX_CLASS_CRITICAL == txClass) ? 0U : CAN_TX_CRITICAL_RESERVE;
+        if (listenOnly)
+        {
+            /* Nothing goes out while silent, anything queued or handed back for a retry would be stale by the end */
+            ring->tail = ring->head;
+        }
+        bool held = false;
+        while ((!held) && (ring->tail != ring->head) && (HAL_CAN_GetTxMailboxesFreeLevel(hcan) > reserve))
+        {
+            CANTxEntry_t *entry = &(ring->entries[ring->tail & CAN_TX_RING_MASK]);
+            const CANTxThrottleVerdict_t verdict = throttleTx(&(scheduler->throttle), entry);
+            if (CAN_TX_THROTTLE_PASS == verdict)
+            {
+                const HAL_StatusTypeDef err = loadTxMailbox(hcan, entry, (CANTxClass_t)txClass);
+                if (HAL_OK != err)
+                {
+                    result = err;
+                }
+                ++ring->tail;
+            }
+            else if (CAN_TX_THROTTLE_DISCARD == verdict)
+            {
+                ++ring->tail;
+            }
+            else
+            {
+                held = true;
+            }
+        }
     }
 
-    CAN_TxHeaderTypeDef header = {0};
-    header.StdId = 0x0;
-    header.ExtId = message.id;
-    header.RTR = CAN_RTR_DATA;
-    header.IDE = CAN_ID_EXT;
-    header.DLC = message.length;
-    header.TransmitGlobalTime = DISABLE;
+    const CANTxRing_t *const critical = &(scheduler->rings[CAN_TX_CLASS_CRITICAL]);
+    if ((critical->tail != critical->head) && (0U == scheduler->abortMask))
+    {
+        abortDiagnosticTx(hcan);
+    }
+    return result;
+}
 
-    uint32_t mailboxNumber = 0;
+/** @brief !! ISR METHOD !! CAN1 TX mailbox empty interrupt, collects the outcome of finished frames and refills the
+ * mailboxes from the TX rings.
+ * Called straight from CAN1_TX_IRQHandler rather than going through HAL_CAN_IRQHandler, which would also consume the
+ * error flags canErrorInterrupt relies on.
+ * @param hcan CAN handle
+ */
+void txMailboxInterrupt(CAN_HandleTypeDef *hcan)
+{
+    const HAL_StatusTypeDef err = drainTxRing(hcan);
+    if (HAL_OK != err)
+    {
+        NON_FATAL_ERROR_ISR_DETAIL(CAN_TX_ERR, err);
+    }
+}
+
+/** @brief Queue a frame for transmission without blocking
+ * @param message Frame to send
+ * @param txClass Scheduling class, critical frames go first and can displace diagnostic ones
+ * @return CAN_TX_OK if it is queued or already in a mailbox, CAN_TX_FULL if the class's ring has no room,
+ * CAN_TX_SILENT if the controller is listen-only
+ */
+CANTxStatus_t TrySendCANMessage(const DiveCANMessage_t message, const CANTxClass_t txClass)
+{
+    CANTxRing_t *ring = &(getTxScheduler()->rings[txClass]);
+    CANTxStatus_t status = CAN_TX_OK;
+
+    /* Any task may send, and the drain below races the TX ISR, masking it keeps us to one consumer */
+    taskENTER_CRITICAL();
+    if (__atomic_load_n(getListenOnly(), __ATOMIC_ACQUIRE))
+    {
+        status = CAN_TX_SILENT;
+    }
+    else if ((ring->head - ring->tail) >= CAN_TX_RING_LEN)
+    {
+        ++ring->rejected;
+        status = CAN_TX_FULL;
+    }
+    else
+    {
+        CANTxEntry_t *entry = &(ring->entries[ring->head & CAN_TX_RING_MASK]);
+        entry->message = message;
+        entry->queuedCycles = DWT->CYCCNT;
+        entry->attempts = 0;
+        entry->throttled = false;
+        ++ring->head;
+    }
+
+    /* The ISR only runs as mailboxes complete, so an idle controller needs its first frames loaded from here */
+    const HAL_StatusTypeDef err = drainTxRing(&hcan1);
+
+    const uint32_t waiting = ring->head - ring->tail;
+    if (waiting > ring->highWater)
+    {
+        ring->highWater = waiting;
+    }
+    taskEXIT_CRITICAL();
+
+    if (HAL_OK != err)
+    {
+        NON_FATAL_ERROR_DETAIL(CAN_TX_ERR, err);
+    }
+    return status;
+}
+
+/** @brief Queue a frame for transmission, waiting up to timeout ticks for room in the ring
+ * @param message Frame to send
+ * @param txClass Scheduling class
+ * @param timeout Ticks to wait for room, 0 behaves like TrySendCANMessage
+ * @return CAN_TX_OK if it is queued, CAN_TX_FULL if the ring stayed full for the whole timeout
+ */
+CANTxStatus_t SendCANMessageTimeout(const DiveCANMessage_t message, const CANTxClass_t txClass, const Timestamp_t timeout)
+{
+    CANTxStatus_t status = TrySendCANMessage(message, txClass);
+    Timestamp_t waited = 0;
+    while ((CAN_TX_FULL == status) && (waited < timeout))
+    {
+        (void)osDelay(1);
+        ++waited;
+        status = TrySendCANMessage(message, txClass);
+    }
+    return status;
+}
+
+/** @brief Snapshot one class's TX ring counters, debug only
+ * @param txClass Class to read
+ * @param stats Output
+ */
+void GetCANTxRingStats(const CANTxClass_t txClass, CANTxRingStats_t *const stats)
+{
+    taskENTER_CRITICAL();
+    const CANTxRing_t *const ring = &(getTxScheduler()->rings[txClass]);
+    stats->highWater = ring->highWater;
+    stats->rejected = ring->rejected;
+    (void)memcpy(stats->outcomes, ring->outcomes, sizeof(stats->outcomes));
+    stats->retries = ring->retries;
+    stats->requeued = ring->requeued;
+    stats->abandoned = ring->abandoned;
+    taskEXIT_CRITICAL();
+}
+
+/** @brief Snapshot one class's enqueue to completion latency histogram, debug only
+ * @param txClass Class to read
+ * @param latency Output
+ */
+void GetCANTxLatency(const CANTxClass_t txClass, CANTxLatency_t *const latency)
+{
+    taskENTER_CRITICAL();
+    *latency = getTxScheduler()->rings[txClass].latency;
+    taskEXIT_CRITICAL();
+}
+
+/** @brief Roll the TX rates over once CAN_TX_RATE_WINDOW_TICKS has passed, call from CANTask's housekeeping
+ */
+void UpdateCANTxThroughput(void)
+{
+    CANTxRate_t *txRate = getTxRate();
+    const Timestamp_t elapsed = osKernelGetTickCount() - txRate->windowStart;
+    if (elapsed >= CAN_TX_RATE_WINDOW_TICKS)
+    {
+        taskENTER_CRITICAL();
+        const uint32_t frames = getTxScheduler()->sentFrames;
+        const uint32_t bytes = getTxScheduler()->sentBytes;
+        taskEXIT_CRITICAL();
+
+        /* The loop can run late, scale to a whole second rather than assume the window was exact */
+        txRate->framesPerSecond = (uint32_t)(((uint64_t)(frames - txRate->windowFrames) * pdMS_TO_TICKS(1000U)) / elapsed);
+        txRate->bytesPerSecond = (uint32_t)(((uint64_t)(bytes - txRate->windowBytes) * pdMS_TO_TICKS(1000U)) / elapsed);
+        txRate->windowStart += elapsed;
+        txRate->windowFrames = frames;
+        txRate->windowBytes = bytes;
+    }
+}
+
+/** @brief Snapshot the TX throughput, rates are as of the last complete window
+ * @param throughput Output
+ */
+void GetCANTxThroughput(CANTxThroughput_t *const throughput)
+{
+    taskENTER_CRITICAL();
+    throughput->frames = getTxScheduler()->sentFrames;
+    throughput->bytes = getTxScheduler()->sentBytes;
+    taskEXIT_CRITICAL();
+    throughput->framesPerSecond = getTxRate()->framesPerSecond;
+    throughput->bytesPerSecond = getTxRate()->bytesPerSecond;
+}
+
+/** @brief Replace the extension ID bandwidth cap's settings, the bucket starts full again
+ * @param config New settings, burstBits is raised to one 8 byte frame if smaller
+ */
+void SetCANTxThrottle(const CANTxThrottleConfig_t *const config)
+{
+    CANTxThrottleConfig_t applied = *config;
+    const uint32_t minBurst = CANFrameBits(MAX_CAN_RX_LENGTH);
+    if (applied.burstBits < minBurst)
+    {
+        applied.burstBits = minBurst;
+    }
+
+    taskENTER_CRITICAL();
+    *getTxThrottleConfig() = applied;
+    getTxScheduler()->throttle.debt = 0;
+    taskEXIT_CRITICAL();
+}
+
+/** @brief Read back the extension ID bandwidth cap's settings, as applied
+ * @param config Output
+ */
+void GetCANTxThrottle(CANTxThrottleConfig_t *const config)
+{
+    taskENTER_CRITICAL();
+    *config = *getTxThrottleConfig();
+    taskEXIT_CRITICAL();
+}
+
+/** @brief Snapshot the extension ID bandwidth cap's counters and bucket level
+ * @param stats Output
+ */
+void GetCANTxThrottleStats(CANTxThrottleStats_t *const stats)
+{
+    taskENTER_CRITICAL();
+    CANTxThrottle_t *throttle = &(getTxScheduler()->throttle);
+    const CANTxThrottleConfig_t *const config = getTxThrottleConfig();
+    refillTxThrottle(throttle, config, DWT->CYCCNT);
+    stats->passed = throttle->passed;
+    stats->deferred = throttle->deferred;
+    stats->dropped = throttle->dropped;
+    const uint64_t capacity = (uint64_t)config->burstBits * SystemCoreClock;
+    stats->availableBits = (uint32_t)((capacity - throttle->debt) / ((0U == SystemCoreClock) ? 1U : SystemCoreClock));
+    taskEXIT_CRITICAL();
+}
+
+/** @brief Load any extension ID frames the bandwidth cap has been deferring now the bucket has refilled, call from
+ * CANTask's housekeeping, it blocks no longer than CANTxThrottleBlockTime. Sends and TX interrupts drain too, this covers
+ * a bus with nothing else going on.
+ */
+void ServiceCANTxThrottle(void)
+{
+    taskENTER_CRITICAL();
+    const HAL_StatusTypeDef err = drainTxRing(&hcan1);
+    taskEXIT_CRITICAL();
 
-    HAL_StatusTypeDef err = HAL_CAN_AddTxMessage(&hcan1, &header, message.data, &mailboxNumber);
     if (HAL_OK != err)
     {
         NON_FATAL_ERROR_DETAIL(CAN_TX_ERR, err);
     }
 }
 
+/** @brief How long CANTask can block before a frame the bandwidth cap is deferring can go, so it wakes to load it as
+ * soon as the bucket covers it rather than on its idle timeout. Call from CANTask after ServiceCANTxThrottle
+ * @param idle What CANTask would block for otherwise
+ * @return Ticks until the bucket has refilled enough, at least one, capped at idle. Idle if nothing is deferred
+ */
+Timestamp_t CANTxThrottleBlockTime(const Timestamp_t idle)
+{
+    const CANTxThrottleConfig_t *const config = getTxThrottleConfig();
+    CANTxThrottle_t *throttle = &(getTxScheduler()->throttle);
+
+    taskENTER_CRITICAL();
+    refillTxThrottle(throttle, config, DWT->CYCCNT);
+    const uint64_t heldCost = throttle->heldCost;
+    const uint64_t needed = throttle->debt + heldCost;
+    taskEXIT_CRITICAL();
+
+    const uint64_t capacity = (uint64_t)config->burstBits * SystemCoreClock;
+    const uint64_t shortfall = (needed > capacity) ? (needed - capacity) : 0U;
+    Timestamp_t blockTime = idle;
+    if ((0U != heldCost) && (0U != config->bitsPerSecond))
+    {
+        /* A tick's worth of cycles refills bitsPerSecond tokens each */
+        const uint64_t perTick = ((uint64_t)config->bitsPerSecond * SystemCoreClock) / pdMS_TO_TICKS(1000U);
+        const uint64_t ticks = (0U == perTick) ? idle : ((shortfall + perTick) - 1U) / perTick;
+        if (ticks < idle)
+        {
+            blockTime = (0U == ticks) ? 1U : (Timestamp_t)ticks;
+        }
+    }
+    return blockTime;
+}
+
+/** @brief Take the controller in or out of silent mode for the bus sniffer. Silent, bxCAN takes every frame off the bus
+ * but only ever drives recessive bits, not even an ACK, so recording can't disturb the bus being diagnosed.
+ * Going silent drops everything queued and aborts what is still in a mailbox, TrySendCANMessage then refuses frames
+ * until we are back. The catch-all filter bank passes every frame while silent, the ones on DIVECAN_RX_ID_LIST still
+ * go to CANTask so the HUD keeps showing PPO2.
+ * Must be called from CANTask, it restarts the controller
+ * @param listenOnly True to go silent, false to rejoin the bus
+ */
+void SetCANListenOnly(const bool listenOnly)
+{
+    CANTxScheduler_t *scheduler = getTxScheduler();
+
+    taskENTER_CRITICAL();
+    __atomic_store_n(getListenOnly(), listenOnly, __ATOMIC_RELEASE);
+    (void)drainTxRing(&hcan1);
+    const uint32_t inFlight = scheduler->inFlight & ~scheduler->abortMask;
+    if (listenOnly && (0U != inFlight))
+    {
+        (void)HAL_CAN_AbortTxRequest(&hcan1, inFlight);
+        scheduler->abortMask |= inFlight;
+        scheduler->requeueMask = 0;
+    }
+    taskEXIT_CRITICAL();
+
+    /* SILM can only be changed in initialisation mode */
+    HAL_StatusTypeDef err = HAL_CAN_Stop(&hcan1);
+    if (HAL_OK == err)
+    {
+        if (listenOnly)
+        {
+            hcan1.Instance->BTR |= CAN_BTR_SILM;
+        }
+        else
+        {
+            hcan1.Instance->BTR &= ~CAN_BTR_SILM;
+        }
+        err = configCatchAllFilter(&hcan1, listenOnly);
+    }
+    if (HAL_OK == err)
+    {
+        err = HAL_CAN_Start(&hcan1);
+    }
+    if (HAL_OK != err)
+    {
+        NON_FATAL_ERROR_DETAIL(CAN_CONFIG_ERR, err);
+    }
+}
+
+/** @brief Whether the controller is silent for the bus sniffer */
+bool CANListenOnly(void)
+{
+    return __atomic_load_n(getListenOnly(), __ATOMIC_ACQUIRE);
+}
+
+/** @brief Queue a frame for transmission, waiting a short while if the TX ring is full.
+ * @param message Frame to send
+ * @param txClass Scheduling class */
+void sendCANMessage(const DiveCANMessage_t message, const CANTxClass_t txClass)
+{
+    /* This isn't super time critical so if the ring is backed up we can quite happily wait for the TX ISR to drain it */
+    const CANTxStatus_t status = SendCANMessageTimeout(message, txClass, TX_WAIT_TIMEOUT);
+    /* Listen-only is asked for, not a fault */
+    if ((CAN_TX_OK != status) && (CAN_TX_SILENT != status))
+    {
+        NON_FATAL_ERROR_DETAIL(CAN_TX_ERR, status);
+    }
+}
+
 /*-----------------------------------------------------------------------------------*/
 /* Device Metadata */
 
@@ -162,9 +1836,8 @@ void txStartDevice(const DiveCANType_t targetDeviceType, const DiveCANType_t dev
     const DiveCANMessage_t message = {
         .id = BUS_INIT_ID | (deviceType << 8) | targetDeviceType,
         .data = {0x8a, 0xf3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        .length = 3,
-        .type = "BUS_INIT"};
-    sendCANMessage(message);
+        .length = 3};
+    sendCANMessage(message, CAN_TX_CLASS_CRITICAL);
 }
 
 /** @brief Transmit the id of this device
@@ -177,9 +1850,8 @@ void txID(const DiveCANType_t deviceType, const DiveCANManufacturer_t manufactur
     const DiveCANMessage_t message = {
         .id = BUS_ID_ID | deviceType,
         .data = {(uint8_t)manufacturerID, 0x00, firmwareVersion, 0x00, 0x00, 0x00, 0x00, 0x00},
-        .length = 3,
-        .type = "BUS_ID"};
-    sendCANMessage(message);
+        .length = 3};
+    sendCANMessage(message, CAN_TX_CLASS_CRITICAL);
 }
 
 /** @brief Transmit the name of this device
@@ -199,9 +1871,86 @@ void txName(const DiveCANType_t deviceType, const char *const name)
         DiveCANMessage_t message = {
             .id = BUS_NAME_ID | deviceType,
             .data = {0},
-            .length = 8,
-            .type = "BUS_NAME"};
+            .length = 8};
         (void)memcpy(message.data, data, BUS_NAME_LEN);
-        sendCANMessage(message);
+        sendCANMessage(message, CAN_TX_CLASS_CRITICAL);
     }
 }
+
+/*-----------------------------------------------------------------------------------*/
+/* Non-standard messages for diagnoses and debug */
+
+/** @brief Transmit one cell of the reception statistics table, big endian, all in kernel ticks
+ *@param deviceType the device type of this device
+ *@param count Frames seen, saturating
+ *@param minInterval Shortest inter-arrival time
+ *@param maxInterval Longest inter-arrival time
+ *@param meanInterval Smoothed (EWMA) inter-arrival time
+ */
+void txRxStats(const DiveCANType_t deviceType, const uint16_t count, const uint16_t minInterval, const uint16_t maxInterval, const uint16_t meanInterval)
+{
+    const DiveCANMessage_t message = {
+        .id = RX_STATS_ID | deviceType,
+        .data = {(uint8_t)(count >> 8), (uint8_t)count,
+                 (uint8_t)(minInterval >> 8), (uint8_t)minInterval,
+                 (uint8_t)(maxInterval >> 8), (uint8_t)maxInterval,
+                 (uint8_t)(meanInterval >> 8), (uint8_t)meanInterval},
+        .length = 8};
+    sendCANMessage(message, CAN_TX_CLASS_DIAGNOSTIC);
+}
+
+/** @brief Transmit 4 consecutive buckets of the PPO2 frame to LED latency histogram, big endian
+ *@param deviceType the device type of this device
+ *@param bucket0 Count in the first requested bucket, saturating
+ *@param bucket1 Count in the next bucket
+ *@param bucket2 Count in the one after
+ *@param bucket3 Count in the last
+ */
+void txLatencyHistogram(const DiveCANType_t deviceType, const uint16_t bucket0, const uint16_t bucket1, const uint16_t bucket2, const uint16_t bucket3)
+{
+    const DiveCANMessage_t message = {
+        .id = LATENCY_HIST_ID | deviceType,
+        .data = {(uint8_t)(bucket0 >> 8), (uint8_t)bucket0,
+                 (uint8_t)(bucket1 >> 8), (uint8_t)bucket1,
+                 (uint8_t)(bucket2 >> 8), (uint8_t)bucket2,
+                 (uint8_t)(bucket3 >> 8), (uint8_t)bucket3},
+        .length = 8};
+    sendCANMessage(message, CAN_TX_CLASS_DIAGNOSTIC);
+}
+
+/** @brief Transmit the bus sniffer's recording counters, saturating at 16 bits
+ * @param deviceType the device type of this device
+ * @param active Recording in progress
+ * @param frames Frames recorded
+ * @param dropped Frames lost
+ * @param blocks Blocks written to flash
+ */
+void txSnifferStatus(const DiveCANType_t deviceType, const bool active, const uint16_t frames, const uint16_t dropped, const uint16_t blocks)
+{
+    const DiveCANMessage_t message = {
+        .id = SNIFFER_STATUS_ID | deviceType,
+        .data = {active ? 1U : 0U,
+                 (uint8_t)(frames >> 8), (uint8_t)frames,
+                 (uint8_t)(dropped >> 8), (uint8_t)dropped,
+                 (uint8_t)(blocks >> 8), (uint8_t)blocks},
+        .length = 7};
+    sendCANMessage(message, CAN_TX_CLASS_DIAGNOSTIC);
+}
+
+/** @brief Transmit one chunk of the bus sniffer's flash ring
+ * @param deviceType the device type of this device
+ * @param chunk Chunk index, the chunk starts chunk * SNIFFER_CHUNK_LEN bytes into the ring
+ * @param data Chunk bytes
+ * @param length Bytes in the chunk, at most SNIFFER_CHUNK_LEN
+ */
+void txSnifferData(const DiveCANType_t deviceType, const uint16_t chunk, const uint8_t *const data, const uint8_t length)
+{
+    DiveCANMessage_t message = {
+        .id = SNIFFER_DATA_ID | deviceType,
+        .data = {(uint8_t)(chunk >> 8), (uint8_t)chunk},
+        .length = 2};
+    const uint8_t chunkLength = (length > SNIFFER_CHUNK_LEN) ? (uint8_t)SNIFFER_CHUNK_LEN : length;
+    (void)memcpy(&message.data[2], data, chunkLength);
+    message.length += chunkLength;
+    sendCANMessage(message, CAN_TX_CLASS_DIAGNOSTIC);
+}
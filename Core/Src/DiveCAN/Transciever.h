@@ -3,6 +3,7 @@
 #include "stdbool.h"
 
 #include "cmsis_os.h"
+#include "main.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -11,6 +12,10 @@ extern "C"
 
 #define ID_MASK 0x1FFFF000
 
+/* Message type byte of an ID, unique within the 0xD... range but not across ranges (BUS_ID vs LOG_TEXT) */
+#define DIVECAN_ID_TYPE(id) (((id) >> 16) & 0xFFU)
+#define DIVECAN_ID_TYPE_COUNT 256U
+
 #define BUS_ID_ID 0xD000000
 #define BUS_NAME_ID 0xD010000
 #define CAN_UNKNOWN_0 0xD020000
@@ -49,6 +54,8 @@ extern "C"
 
 /* Extensions, these are not part of the standard but we use it for debugging, and adv features the shearwater doesn't natively support */
 /* We're using higher IDs here so they get arbitrated away if other things are happening */
+#define EXTENSION_ID_RANGE 0xF000000
+#define DIVECAN_IS_EXTENSION_ID(id) (((id) & 0x1F000000U) == EXTENSION_ID_RANGE)
 #define LOG_TEXT_ID 0xF000000
 
 /* PID internal state */
@@ -65,18 +72,98 @@ extern "C"
 #define PRECISION_CELL_2_ID 0xF210000
 #define PRECISION_CELL_3_ID 0xF220000
 
+/* Reception statistics, the request names a message type byte and source nibble, the reply carries that table cell */
+#define RX_STATS_REQ_ID 0xF400000
+#define RX_STATS_ID 0xF410000
+
+/* PPO2 frame to LED latency histogram, the request names the first of 4 buckets, the reply carries their counts */
+#define LATENCY_HIST_REQ_ID 0xF420000
+#define LATENCY_HIST_ID 0xF430000
+
+/* Bus sniffer, the request's data[0] is a SNIFFER_CMD_*, the status reply carries the recording counters.
+ * A read request names the first 6 byte chunk of the flash ring and how many, each comes back as a data frame */
+#define SNIFFER_REQ_ID 0xF440000
+#define SNIFFER_STATUS_ID 0xF450000
+#define SNIFFER_READ_REQ_ID 0xF460000
+#define SNIFFER_DATA_ID 0xF470000
+#define SNIFFER_CHUNK_LEN 6U
+
+/* Inbound message IDs that make it through the bxCAN acceptance filters, everything else is
+ * dropped in hardware before it can cost us an interrupt or a queue slot. Source/dest nibbles are
+ * masked off so we hear these from any device on the bus.
+ * Anything CANTask acts on has to be on this list (it is checked at compile time), add new consumers here.
+ * Safety critical frames (PPO2, cell status, shutdown) are routed to FIFO1, which has its own three hardware
+ * slots and a higher NVIC priority, so bulk traffic on FIFO0 can't overrun them.
+ * X(ID, wildcard bits, FIFO, arg), each entry is one filter bank. The wildcard bits are ignored on top of the
+ * source/dest nibbles so one bank can take a group of IDs. There aren't enough banks to give each extension request its
+ * own, so RX_STATS_REQ_ID, LATENCY_HIST_REQ_ID, SNIFFER_REQ_ID and SNIFFER_READ_REQ_ID (0xF40 to 0xF46, even) share
+ * the RX_STATS_REQ_ID bank, their odd numbered replies still don't get through */
+#define DIVECAN_RX_EXTENSION_REQ_WILDCARD 0x60000U
+#define DIVECAN_RX_ID_LIST(X, arg)                                        \
+    X(BUS_ID_ID, 0U, CAN_FILTER_FIFO0, arg)                               \
+    X(BUS_OFF_ID, 0U, CAN_FILTER_FIFO1, arg)                              \
+    X(PPO2_PPO2_ID, 0U, CAN_FILTER_FIFO1, arg)                            \
+    X(PPO2_STATUS_ID, 0U, CAN_FILTER_FIFO1, arg)                          \
+    X(PPO2_SETPOINT_ID, 0U, CAN_FILTER_FIFO0, arg)                        \
+    X(PPO2_ATMOS_ID, 0U, CAN_FILTER_FIFO0, arg)                           \
+    X(PPO2_MILLIS_ID, 0U, CAN_FILTER_FIFO0, arg)                          \
+    X(TANK_PRESSURE_ID, 0U, CAN_FILTER_FIFO0, arg)                        \
+    X(BUS_STATUS_ID, 0U, CAN_FILTER_FIFO0, arg)                           \
+    X(DIVING_ID, 0U, CAN_FILTER_FIFO0, arg)                               \
+    X(CAN_SERIAL_NUMBER_ID, 0U, CAN_FILTER_FIFO0, arg)                    \
+    X(RX_STATS_REQ_ID, DIVECAN_RX_EXTENSION_REQ_WILDCARD, CAN_FILTER_FIFO0, arg)
+
+#define CAN_RX_FIFO_COUNT 2
+
+/* State-like inbound IDs where only the newest value matters. These skip the RX ring, the ISR overwrites
+ * a slot per ID instead so a burst of other traffic can neither push them out nor queue stale copies */
+#define DIVECAN_RX_COALESCED_LIST(X, arg) \
+    X(PPO2_PPO2_ID, arg)                  \
+    X(PPO2_STATUS_ID, arg)                \
+    X(PPO2_SETPOINT_ID, arg)              \
+    X(PPO2_ATMOS_ID, arg)                 \
+    X(PPO2_MILLIS_ID, arg)                \
+    X(TANK_PRESSURE_ID, arg)              \
+    X(BUS_STATUS_ID, arg)                 \
+    X(DIVING_ID, arg)
+
+#define DIVECAN_RX_ID_IN_BANK(listId, wildcard, id) (((listId) & ~(wildcard)) == ((id) & ID_MASK & ~(wildcard)))
+#define DIVECAN_RX_ID_MATCH(listId, wildcard, fifo, id) || DIVECAN_RX_ID_IN_BANK(listId, wildcard, id)
+#define DIVECAN_RX_ID_FIFO_MATCH(listId, wildcard, fifo, id) | (DIVECAN_RX_ID_IN_BANK(listId, wildcard, id) ? (fifo) : 0U)
+#define DIVECAN_RX_ID_COUNT_ONE(listId, wildcard, fifo, arg) +1
+
+/* Compile time constant expressions, usable in static_assert */
+#define DIVECAN_RX_ACCEPTED(id) (false DIVECAN_RX_ID_LIST(DIVECAN_RX_ID_MATCH, id))
+#define DIVECAN_RX_FIFO(id) (0U DIVECAN_RX_ID_LIST(DIVECAN_RX_ID_FIFO_MATCH, id))
+#define DIVECAN_RX_ID_COUNT (0 DIVECAN_RX_ID_LIST(DIVECAN_RX_ID_COUNT_ONE, 0))
+
+/* bxCAN has 14 filter banks when running as a single CAN instance, we use one 32 bit mask bank per ID */
+#define CAN_FILTER_BANK_COUNT 14
+
 #define MAX_CAN_RX_LENGTH 8
 
+/* Bus load is binned into 100ms slots, the long window is the last 10 of them */
+#define CAN_BUS_LOAD_SLOT_MS 100U
+#define CAN_BUS_LOAD_SLOT_COUNT 10U
+
+/* bxCAN last error codes, 0 is no error and 7 is only ever written by software */
+#define CAN_LEC_COUNT 8U
+
+/* Buckets in each class's TX latency histogram, the last starts at 2^18us (~260ms), past the longest sendCANMessage wait */
+#define CAN_TX_LATENCY_BUCKET_COUNT 20U
+
   /**
    * @struct DiveCANMessage_s
-   * @brief Struct to represent a DiveCAN message.
+   * @brief Struct to represent a DiveCAN message, exactly what goes over the wire and nothing else.
+   * Labels for logging come from DiveCANMessageName(id).
    */
   typedef struct
   {
+    /** @brief 29 bit extended ID */
     uint32_t id;
+    /** @brief DLC, 0-8 */
     uint8_t length;
     uint8_t data[MAX_CAN_RX_LENGTH];
-    const char *type;
   } DiveCANMessage_t;
 
   /**
@@ -171,9 +258,297 @@ extern "C"
     DIVECAN_MANUFACTURER_GEN = 0x02
   } DiveCANManufacturer_t;
 
-  void InitRXQueue(void);
-  BaseType_t GetLatestCAN(const Timestamp_t blockTime, DiveCANMessage_t *message);
-  void rxInterrupt(const uint32_t id, const uint8_t length, const uint8_t *const data);
+  /**
+   * @brief Counters for one RX FIFO and its ISR -> CANTask frame ring
+   */
+  typedef struct
+  {
+    /** @brief Frames dropped because the ring was full */
+    uint32_t overflows;
+    /** @brief Deepest the ring has been since boot */
+    uint32_t highWater;
+    /** @brief Frames lost in the bxCAN FIFO itself (all 3 hardware slots full) */
+    uint32_t hwOverruns;
+  } CANRxRingStats_t;
+
+  /**
+   * @brief Time from RX ISR entry to CANTask picking the burst up, in DWT cycles (SystemCoreClock per second)
+   */
+  typedef struct
+  {
+    /** @brief Bursts measured since boot */
+    uint32_t samples;
+    /** @brief Most recent burst */
+    uint32_t lastCycles;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+  } CANRxLatency_t;
+
+  /**
+   * @brief Time spent inside one FIFO's RX ISR, in DWT cycles, for comparing RX handler implementations on hardware
+   */
+  typedef struct
+  {
+    /** @brief Frames copied out of the FIFO since boot */
+    uint32_t frames;
+    /** @brief ISR cycles summed over those frames (wraps), cycles / frames is the cost per frame */
+    uint32_t cycles;
+    /** @brief Longest single ISR entry */
+    uint32_t maxCycles;
+  } CANRxIsrCost_t;
+
+  /**
+   * @brief Bus utilisation in permille of the configured bit rate, from the worst case stuffed length of every frame
+   * we receive or send. Only frames that pass the acceptance filters are seen, so this is a floor on the true load.
+   */
+  typedef struct
+  {
+    /** @brief Last complete CAN_BUS_LOAD_SLOT_MS slot */
+    uint16_t slotPermille;
+    /** @brief Last CAN_BUS_LOAD_SLOT_COUNT complete slots */
+    uint16_t windowPermille;
+    /** @brief Busiest single slot since boot */
+    uint16_t peakSlotPermille;
+    /** @brief Busiest window since boot, sampled when UpdateCANBusLoad runs */
+    uint16_t peakWindowPermille;
+  } CANBusLoad_t;
+
+  /**
+   * @brief Fault confinement state of the CAN controller, from ESR
+   */
+  typedef enum
+  {
+    CAN_ERROR_ACTIVE = 0,
+    /** @brief TEC or REC at 96 or above, still error active */
+    CAN_ERROR_WARNING,
+    /** @brief TEC or REC above 127, we only send passive error flags */
+    CAN_ERROR_PASSIVE,
+    /** @brief TEC above 255, off the bus until the recovery sequence completes */
+    CAN_ERROR_BUS_OFF
+  } CANErrorState_t;
+
+  /**
+   * @brief CAN error counters and bus-off recovery metrics
+   */
+  typedef struct
+  {
+    /** @brief State as of the last ServiceCANErrorState */
+    CANErrorState_t state;
+    /** @brief Transmit and receive error counters as of the last ServiceCANErrorState */
+    uint8_t tec;
+    uint8_t rec;
+    /** @brief Code of the most recent protocol error (stuff, form, ack, bit recessive, bit dominant, CRC), 0 if none yet */
+    uint8_t lastErrorCode;
+    /** @brief Protocol errors seen since boot, indexed by error code */
+    uint32_t errorCodeCounts[CAN_LEC_COUNT];
+    /** @brief Times the controller entered each state since boot */
+    uint32_t warningCount;
+    uint32_t passiveCount;
+    uint32_t busOffCount;
+    /** @brief Times bus-off outlasted the hardware recovery deadline and the controller was restarted */
+    uint32_t forcedRestarts;
+    /** @brief Ticks from going bus-off to being back on the bus, last and worst since boot */
+    Timestamp_t lastRecoveryTicks;
+    Timestamp_t maxRecoveryTicks;
+  } CANErrorStats_t;
+
+  /**
+   * @brief Result of queueing a frame for transmission
+   */
+  typedef enum
+  {
+    /** @brief Frame is in the TX ring or a hardware mailbox */
+    CAN_TX_OK = 0,
+    /** @brief TX ring had no room, the frame was not queued */
+    CAN_TX_FULL,
+    /** @brief The controller is listen-only (bus sniffer), nothing is sent until it is back on the bus */
+    CAN_TX_SILENT
+  } CANTxStatus_t;
+
+  /**
+   * @brief Outbound traffic classes, in the order the TX mailboxes are offered to them
+   */
+  typedef enum
+  {
+    /** @brief Protocol replies the controller is waiting on (ID, name, bus init), always has a mailbox reserved */
+    CAN_TX_CLASS_CRITICAL = 0,
+    /** @brief Periodic status */
+    CAN_TX_CLASS_STATUS,
+    /** @brief Debug and diagnostic frames, aborted in the mailbox if a critical frame needs the room */
+    CAN_TX_CLASS_DIAGNOSTIC,
+    CAN_TX_CLASS_COUNT
+  } CANTxClass_t;
+
+  /**
+   * @brief How a transmit request left its mailbox, from TSR
+   */
+  typedef enum
+  {
+    CAN_TX_OUTCOME_SENT = 0,
+    /** @brief Lost arbitration to a higher priority frame, automatic retransmission is off so it wasn't retried */
+    CAN_TX_OUTCOME_ARBITRATION_LOST,
+    /** @brief Bus error during transmission */
+    CAN_TX_OUTCOME_ERROR,
+    /** @brief Pulled back out of the mailbox to make room for a critical frame, it is requeued to go after it */
+    CAN_TX_OUTCOME_ABORTED,
+    CAN_TX_OUTCOME_COUNT
+  } CANTxOutcome_t;
+
+  /**
+   * @brief Time from a frame being queued to its mailbox completing successfully, log2 buckets of microseconds.
+   * Covers waiting in the ring, waiting in the mailbox for the bus, time on the wire and any retries.
+   */
+  typedef struct
+  {
+    /** @brief Bucket 0 is under 1us, bucket n is [2^(n-1), 2^n) us, the last also takes everything longer */
+    uint32_t buckets[CAN_TX_LATENCY_BUCKET_COUNT];
+    /** @brief Frames measured since boot */
+    uint32_t samples;
+    /** @brief Worst since boot */
+    uint32_t maxMicros;
+  } CANTxLatency_t;
+
+  /**
+   * @brief Frames and payload we've successfully put on the bus
+   */
+  typedef struct
+  {
+    /** @brief Since boot, wrapping */
+    uint32_t frames;
+    uint32_t bytes;
+    /** @brief Over the last complete UpdateCANTxThroughput window */
+    uint32_t framesPerSecond;
+    uint32_t bytesPerSecond;
+  } CANTxThroughput_t;
+
+  /**
+   * @brief Counters for one class's task -> TX ISR frame ring
+   */
+  typedef struct
+  {
+    /** @brief Most frames waiting for a mailbox at once since boot */
+    uint32_t highWater;
+    /** @brief Frames turned away because the ring was full */
+    uint32_t rejected;
+    /** @brief Mailbox requests completed since boot, by outcome. Retries count again */
+    uint32_t outcomes[CAN_TX_OUTCOME_COUNT];
+    /** @brief Failed attempts that were queued again */
+    uint32_t retries;
+    /** @brief Frames aborted to make way for a critical frame and queued again, not counted as retries */
+    uint32_t requeued;
+    /** @brief Failed attempts that were given up on, out of retries or no room to requeue */
+    uint32_t abandoned;
+  } CANTxRingStats_t;
+
+  /**
+   * @brief What the bandwidth cap does with an extension ID frame when the bucket can't cover it
+   */
+  typedef enum
+  {
+    /** @brief Leave it at the head of its ring until the bucket has refilled, the rest of that ring waits behind it */
+    CAN_TX_THROTTLE_DEFER = 0,
+    /** @brief Discard it and carry on with the ring */
+    CAN_TX_THROTTLE_DROP
+  } CANTxThrottlePolicy_t;
+
+  /**
+   * @brief Token bucket over all extension ID (DIVECAN_IS_EXTENSION_ID) transmissions, charged CANFrameBits per frame
+   */
+  typedef struct
+  {
+    /** @brief Sustained rate the bucket refills at, 0 lifts the cap */
+    uint32_t bitsPerSecond;
+    /** @brief Bucket size, raised to one full 8 byte frame if smaller so a deferred frame can always go eventually */
+    uint32_t burstBits;
+    CANTxThrottlePolicy_t policy;
+  } CANTxThrottleConfig_t;
+
+  /**
+   * @brief Bandwidth cap counters, since boot
+   */
+  typedef struct
+  {
+    /** @brief Extension frames charged to the bucket and loaded, retries count again */
+    uint32_t passed;
+    /** @brief Frames held back at least once by CAN_TX_THROTTLE_DEFER, counted once each */
+    uint32_t deferred;
+    /** @brief Frames discarded by CAN_TX_THROTTLE_DROP */
+    uint32_t dropped;
+    /** @brief Bits left in the bucket as of the snapshot */
+    uint32_t availableBits;
+  } CANTxThrottleStats_t;
+
+  /**
+   * @brief Slot indices for DIVECAN_RX_COALESCED_LIST, CAN_COALESCED_<ID name>
+   */
+  typedef enum
+  {
+#define CAN_COALESCED_ENUM_ENTRY(listId, arg) CAN_COALESCED_##listId,
+    DIVECAN_RX_COALESCED_LIST(CAN_COALESCED_ENUM_ENTRY, 0)
+#undef CAN_COALESCED_ENUM_ENTRY
+        CAN_COALESCED_SLOT_COUNT
+  } CANCoalescedSlot_t;
+
+  /**
+   * @brief A frame from the RX ring, stamped by the ISR that filed it
+   */
+  typedef struct
+  {
+    DiveCANMessage_t message;
+    /** @brief Kernel tick the frame arrived on */
+    Timestamp_t timestamp;
+    /** @brief DWT cycle count at entry to the RX ISR that read it off the bus */
+    uint32_t rxCycles;
+  } CANRxFrame_t;
+
+  /**
+   * @brief Newest frame seen for a coalesced ID
+   */
+  typedef struct
+  {
+    DiveCANMessage_t message;
+    /** @brief Kernel tick the frame arrived on */
+    Timestamp_t timestamp;
+    /** @brief DWT cycle count at entry to the RX ISR that read it off the bus */
+    uint32_t rxCycles;
+    /** @brief Bumped on every frame, a jump of more than one means older values were coalesced away */
+    uint32_t sequence;
+  } CANCoalesced_t;
+
+  void InitCANFilters(CAN_HandleTypeDef *hcan);
+  CANRxFrame_t *GetLatestCAN(const Timestamp_t blockTime);
+  void ReleaseLatestCAN(void);
+  void GetCANRxRingStats(const uint32_t fifo, CANRxRingStats_t *const stats);
+  void InitCANRxLatencyProbe(void);
+  void GetCANRxLatency(CANRxLatency_t *const latency);
+  void GetCANRxIsrCost(const uint32_t fifo, CANRxIsrCost_t *const cost);
+  uint32_t CANFrameBits(const uint8_t length);
+  void InitCANBusLoad(const CAN_HandleTypeDef *const hcan);
+  void UpdateCANBusLoad(void);
+  void GetCANBusLoad(CANBusLoad_t *const load);
+  uint32_t TakeCoalescedCAN(void);
+  bool ReadCoalescedCAN(const CANCoalescedSlot_t slot, CANCoalesced_t *const latest);
+  void rxFifoInterrupt(CAN_HandleTypeDef *hcan, const uint32_t fifo);
+  void rxOverrunInterrupt(const uint32_t fifo);
+  void canErrorInterrupt(CAN_HandleTypeDef *hcan);
+  void WakeCANTaskFromISR(void);
+  bool ServiceCANErrorState(void);
+  bool CANBusRecovering(void);
+  void GetCANErrorStats(CANErrorStats_t *const stats);
+  CANTxStatus_t TrySendCANMessage(const DiveCANMessage_t message, const CANTxClass_t txClass);
+  CANTxStatus_t SendCANMessageTimeout(const DiveCANMessage_t message, const CANTxClass_t txClass, const Timestamp_t timeout);
+  void GetCANTxRingStats(const CANTxClass_t txClass, CANTxRingStats_t *const stats);
+  void GetCANTxLatency(const CANTxClass_t txClass, CANTxLatency_t *const latency);
+  void UpdateCANTxThroughput(void);
+  void GetCANTxThroughput(CANTxThroughput_t *const throughput);
+  void SetCANTxThrottle(const CANTxThrottleConfig_t *const config);
+  void GetCANTxThrottle(CANTxThrottleConfig_t *const config);
+  void GetCANTxThrottleStats(CANTxThrottleStats_t *const stats);
+  void ServiceCANTxThrottle(void);
+  Timestamp_t CANTxThrottleBlockTime(const Timestamp_t idle);
+  void SetCANListenOnly(const bool listenOnly);
+  bool CANListenOnly(void);
+  void txMailboxInterrupt(CAN_HandleTypeDef *hcan);
 
   /* Device Metadata */
   void txStartDevice(const DiveCANType_t targetDeviceType, const DiveCANType_t deviceType);
@@ -246,6 +621,10 @@ extern "C"
   void txLogText(const DiveCANType_t deviceType, const char *msg, uint16_t length);
   void txPIDState(const DiveCANType_t deviceType, PIDNumeric_t proportional_gain, PIDNumeric_t integral_gain, PIDNumeric_t derivative_gain, PIDNumeric_t integral_state, PIDNumeric_t derivative_state, PIDNumeric_t duty_cycle, PIDNumeric_t precisionConsensus);
   void txPrecisionCells(const DiveCANType_t deviceType, OxygenCell_t c1, OxygenCell_t c2, OxygenCell_t c3);
+  void txRxStats(const DiveCANType_t deviceType, const uint16_t count, const uint16_t minInterval, const uint16_t maxInterval, const uint16_t meanInterval);
+  void txLatencyHistogram(const DiveCANType_t deviceType, const uint16_t bucket0, const uint16_t bucket1, const uint16_t bucket2, const uint16_t bucket3);
+  void txSnifferStatus(const DiveCANType_t deviceType, const bool active, const uint16_t frames, const uint16_t dropped, const uint16_t blocks);
+  void txSnifferData(const DiveCANType_t deviceType, const uint16_t chunk, const uint8_t *const data, const uint8_t length);
 #ifdef __cplusplus
 }
 #endif
@@ -8,20 +8,15 @@ extern const uint8_t ADC2_ADDR;
 
 const uint8_t BOOTLOADER_MSG = 0x79;
 
-void HAL_CAN_RxMsgPendingCallback(CAN_HandleTypeDef *hcan)
+/**
+ * @brief !! ISR METHOD !! EXTI edge, CAN_EN rises when the controller powers the bus down. CANTask checks it against
+ * any pending shutdown, see ServiceShutdown
+ * @param GPIO_Pin Pin that fired
+ */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
-    CAN_RxHeaderTypeDef pRxHeader = {0};
-    uint8_t pData[64] = {0};
-    (void)HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &pRxHeader, pData);
-    rxInterrupt(pRxHeader.ExtId, (uint8_t)pRxHeader.DLC, pData);
-}
-
-void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
-{
-    HAL_CAN_RxMsgPendingCallback(hcan);
-}
-
-void HAL_CAN_RxFifo1MsgPendingCallbackxFifo1(CAN_HandleTypeDef *hcan)
-{
-    HAL_CAN_RxMsgPendingCallback(hcan);
+    if (CAN_EN_Pin == GPIO_Pin)
+    {
+        WakeCANTaskFromISR();
+    }
 }
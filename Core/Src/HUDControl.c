@@ -5,14 +5,85 @@
 #include "common.h"
 #include "menu_state_machine.h"
 #include "DiveCAN/DiveCAN.h"
-#include "Hardware/pwr_management.h"
+#include "shutdown_state_machine.h"
 #include <assert.h>
-
-extern osMessageQueueId_t PPO2QueueHandle;
-extern osMessageQueueId_t CellStatQueueHandle;
+#include <string.h>
 
 extern bool inShutdown;
 
+/* Default age limits. Aging after a few missed PPO2 frames, stale a good while later. Both are measured from when the
+ * reading arrived rather than from the last blink, so the display and the controller's send rate can't beat */
+#define CELL_AGE_DEFAULT_LIMITS {TIMEOUT_2S_TICKS, TIMEOUT_5S_TICKS}
+
+/* Written by SetCellAgeLimits from any task, the RGB task reads it a field at a time */
+static CellAgeLimits_t *getCellAgeLimits(void)
+{
+    static CellAgeLimits_t limits = CELL_AGE_DEFAULT_LIMITS;
+    return &limits;
+}
+
+/* Entries into each age state, written by the RGB task, read from anywhere */
+static CellAgeCounts_t *getCellAgeCounts(void)
+{
+    static CellAgeCounts_t counts = {0};
+    return &counts;
+}
+
+/* Age state the last reading was drawn in, CELL_DATA_AGE_COUNT before the first. RGB task only */
+static CellDataAge_t *getDisplayedAge(void)
+{
+    static CellDataAge_t displayedAge = CELL_DATA_AGE_COUNT;
+    return &displayedAge;
+}
+
+/* Sequence number of the last reading drawn, a repeat of it isn't a new render. RGB task only */
+static uint32_t *getRenderedSequence(void)
+{
+    static uint32_t renderedSequence = 0;
+    return &renderedSequence;
+}
+
+/**
+ * @brief How old a cell reading is against the current limits
+ * @param snapshot Latest cell readings
+ * @param now Current tick
+ * @return Stale if nothing has been published
+ */
+CellDataAge_t ClassifyCellAge(const CellSnapshot_t *const snapshot, const Timestamp_t now)
+{
+    assert(snapshot != NULL);
+    const CellAgeLimits_t *const limits = getCellAgeLimits();
+    const Timestamp_t staleTicks = __atomic_load_n(&limits->staleTicks, __ATOMIC_RELAXED);
+    const Timestamp_t agingTicks = __atomic_load_n(&limits->agingTicks, __ATOMIC_RELAXED);
+    const Timestamp_t age = now - snapshot->rxTick;
+
+    CellDataAge_t result = CELL_DATA_FRESH;
+    if ((0 == snapshot->sequence) || (age >= staleTicks))
+    {
+        result = CELL_DATA_STALE;
+    }
+    else if (age >= agingTicks)
+    {
+        result = CELL_DATA_AGING;
+    }
+    else
+    {
+        /* Fresh */
+    }
+    return result;
+}
+
+/** @brief Count an entry into an age state, drawing the same state again doesn't count */
+static void recordDisplayedAge(const CellDataAge_t age)
+{
+    assert(age < CELL_DATA_AGE_COUNT);
+    if (age != *getDisplayedAge())
+    {
+        *getDisplayedAge() = age;
+        (void)__atomic_fetch_add(&(getCellAgeCounts()->entries[age]), 1U, __ATOMIC_RELAXED);
+    }
+}
+
 inline int16_t div10_round(int16_t x)
 {
     /* rounds x/10 to nearest integer, handles negatives safely via int64_t */
@@ -42,8 +113,8 @@ inline bool cell_alert(uint8_t cellVal)
 }
 
 /**
- * @brief Process PPO2 data from the queue and control LED blinking accordingly
- * @param cellValues Pointer to CellValues_t structure to store dequeued values, initialized by caller with sensible default values if the queue is empty
+ * @brief Show the latest PPO2 data from the bus and control LED blinking accordingly
+ * @param cellValues Pointer to CellValues_t structure to store the latest values, initialized by caller with sensible default values for before the first reading
  * @param alerting Pointer to a boolean flag indicating if an alert is active
  */
 void PPO2Blink(CellValues_t *cellValues, bool *alerting)
@@ -52,13 +123,29 @@ void PPO2Blink(CellValues_t *cellValues, bool *alerting)
     assert(cellValues != NULL);
     assert(alerting != NULL);
 
-    // Assertion 2: Verify queue handle is valid
-    assert(PPO2QueueHandle != NULL);
+    // Assertion 2: Verify stale limit is valid
+    assert(__atomic_load_n(&getCellAgeLimits()->staleTicks, __ATOMIC_RELAXED) > 0);
 
     const uint8_t centerValue = 100;
-    /* Dequeue the latest PPO2 information */
-    osStatus_t osStat = osMessageQueueGet(PPO2QueueHandle, cellValues, NULL, 0);
-    if (osStat != osOK)
+    /* Copy of the latest PPO2 information, nothing is consumed so a repeat read shows the same reading */
+    CellSnapshot_t snapshot = {0};
+    ReadCellSnapshot(&snapshot);
+    const Timestamp_t now = osKernelGetTickCount();
+    if (0 != snapshot.sequence)
+    {
+        *cellValues = snapshot.values;
+    }
+    const CellDataAge_t age = ClassifyCellAge(&snapshot, now);
+    recordDisplayedAge(age);
+    const bool usablePPO2 = (CELL_DATA_STALE != age);
+
+    if (CELL_DATA_AGING == age)
+    {
+        /* Still worth showing and alarming on, but the diver should know it is getting old */
+        blinkAging();
+    }
+
+    if (!usablePPO2)
     {
         blinkNoData();
     }
@@ -85,13 +172,18 @@ void PPO2Blink(CellValues_t *cellValues, bool *alerting)
                        ((cellValues->C2 == 0xFF ? 0 : 1) << 1) |
                        ((cellValues->C3 == 0xFF ? 0 : 1) << 2);
 
-    uint8_t statusMask = 0b111;
-    osStat = osMessageQueueGet(CellStatQueueHandle, &statusMask, NULL, 0);
-    if (osStat != osOK)
+    uint8_t statusMask = 0b111; // Default to all good if no recent status available
+    if ((0 != snapshot.statusSequence) && ((now - snapshot.statusTick) < __atomic_load_n(&getCellAgeLimits()->staleTicks, __ATOMIC_RELAXED)))
     {
-        statusMask = 0b111; // Default to all good if no status available
+        statusMask = snapshot.statusMask;
     }
 
+    /* Latency is to the first render of a value, repeats of the same reading don't count */
+    if (usablePPO2 && (snapshot.sequence != *getRenderedSequence()))
+    {
+        *getRenderedSequence() = snapshot.sequence;
+        RecordPPO2RenderLatency(cellValues->rxCycles);
+    }
     blinkCode((int8_t)c1, (int8_t)c2, (int8_t)c3, statusMask, failMask, &inShutdown);
 }
 
@@ -103,6 +195,7 @@ void ShutdownFadeout()
     // Assertion 2: Verify TIMEOUT constant is reasonable
     assert(TIMEOUT_500MS_TICKS > 0);
 
+    StartShutdownFade();
     for (uint8_t brightness = 10; brightness > 0; brightness--)
     {
         // Assertion 3: Verify brightness is in valid LED range
@@ -120,9 +213,8 @@ void ShutdownFadeout()
             /* We'll zip through the rest of the loop and end */
         }
     }
-    if(inShutdown){
-        Shutdown();
-    }
+    /* Still held after the whole fade, the shutdown state machine takes us to standby */
+    EndShutdownFade(inShutdown);
 }
 
 bool alerting = false;
@@ -155,6 +247,67 @@ void RGBBlinkControl()
     }
 }
 
+/**
+ * @brief Change the displayed reading's age limits, from any task. Takes effect from the next blink cycle
+ * @param limits New limits, staleTicks must be non-zero
+ */
+void SetCellAgeLimits(const CellAgeLimits_t *const limits)
+{
+    assert(limits != NULL);
+    assert(limits->staleTicks > 0);
+    Timestamp_t agingTicks = limits->agingTicks;
+    if (agingTicks > limits->staleTicks)
+    {
+        agingTicks = limits->staleTicks;
+    }
+
+    /* Stale is read first and aging is only looked at under it, so a blink cycle that catches half an update still
+     * gets a sensible answer */
+    CellAgeLimits_t *const current = getCellAgeLimits();
+    __atomic_store_n(&current->staleTicks, limits->staleTicks, __ATOMIC_RELAXED);
+    __atomic_store_n(&current->agingTicks, agingTicks, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Read back the displayed reading's age limits, as applied
+ * @param limits Output
+ */
+void GetCellAgeLimits(CellAgeLimits_t *const limits)
+{
+    assert(limits != NULL);
+    const CellAgeLimits_t *const current = getCellAgeLimits();
+    limits->agingTicks = __atomic_load_n(&current->agingTicks, __ATOMIC_RELAXED);
+    limits->staleTicks = __atomic_load_n(&current->staleTicks, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief How many times the display has gone into each age state since boot
+ * @param counts Output
+ */
+void GetCellAgeCounts(CellAgeCounts_t *const counts)
+{
+    assert(counts != NULL);
+    for (uint32_t age = 0; age < CELL_DATA_AGE_COUNT; ++age)
+    {
+        counts->entries[age] = __atomic_load_n(&(getCellAgeCounts()->entries[age]), __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef TESTING
+/**
+ * @brief Forget which reading was last drawn and in what state, and go back to the default age limits. To go with
+ * ResetCellSnapshot
+ */
+void ResetPPO2Blink(void)
+{
+    const CellAgeLimits_t defaults = CELL_AGE_DEFAULT_LIMITS;
+    *getCellAgeLimits() = defaults;
+    (void)memset(getCellAgeCounts(), 0, sizeof(CellAgeCounts_t));
+    *getDisplayedAge() = CELL_DATA_AGE_COUNT;
+    *getRenderedSequence() = 0;
+}
+#endif
+
 void EndBlinkControl()
 {
     // Assertion 1: Verify GPIO port pointers are valid
@@ -3,12 +3,46 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "DiveCAN/DiveCAN.h"
+#include "DiveCAN/CellSnapshot.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    /**
+     * @brief How old the displayed cell reading is, each is shown differently
+     */
+    typedef enum
+    {
+        /** @brief Shown as is */
+        CELL_DATA_FRESH = 0,
+        /** @brief Still shown and alarmed on, preceded by a single dim blue blink */
+        CELL_DATA_AGING,
+        /** @brief No reading, or too old to trust: blue no data blinks and no alarm */
+        CELL_DATA_STALE,
+        CELL_DATA_AGE_COUNT
+    } CellDataAge_t;
+
+    /**
+     * @brief Age limits for the displayed cell reading, in kernel ticks since it arrived
+     */
+    typedef struct
+    {
+        /** @brief A reading this old or older is aging */
+        Timestamp_t agingTicks;
+        /** @brief A reading this old or older is stale, as is the status mask. Aging is pulled down to this if above it */
+        Timestamp_t staleTicks;
+    } CellAgeLimits_t;
+
+    /**
+     * @brief How many times the display has gone into each age state
+     */
+    typedef struct
+    {
+        uint32_t entries[CELL_DATA_AGE_COUNT];
+    } CellAgeCounts_t;
+
     /* Main task functions */
     void RGBBlinkControl();
     void EndBlinkControl();
@@ -17,6 +51,15 @@ extern "C"
     int16_t div10_round(int16_t x);
     bool cell_alert(uint8_t cellVal);
     void PPO2Blink(CellValues_t *cellValues, bool *alerting);
+    CellDataAge_t ClassifyCellAge(const CellSnapshot_t *const snapshot, const Timestamp_t now);
+
+    void SetCellAgeLimits(const CellAgeLimits_t *const limits);
+    void GetCellAgeLimits(CellAgeLimits_t *const limits);
+    void GetCellAgeCounts(CellAgeCounts_t *const counts);
+
+#ifdef TESTING
+    void ResetPPO2Blink(void);
+#endif
 
 #ifdef __cplusplus
 }
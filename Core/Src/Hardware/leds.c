@@ -249,6 +249,31 @@ void blinkNoData(void)
     osDelay(BLINK_PERIOD * 2); // Extra delay at the end
 }
 
+/**
+ * @brief Do a single blue blink to indicate that the data about to be shown is getting old, less insistent than blinkNoData
+ */
+void blinkAging(void)
+{
+    // Assertion 1: Verify LED brightness constant is valid
+    assert(LED_MIN_BRIGHTNESS <= LED_MAX_BRIGHTNESS);
+
+    // Assertion 2: Verify blink period is valid
+    assert(BLINK_PERIOD > 0);
+
+    for (uint8_t channel = 0; channel < 3; channel++)
+    {
+        assert(channel < 3);
+        setRGB(channel, 0, 0, LED_MIN_BRIGHTNESS); // Dim blue
+    }
+    osDelay(BLINK_PERIOD);
+    for (uint8_t channel = 0; channel < 3; channel++)
+    {
+        assert(channel < 3);
+        setRGB(channel, 0, 0, 0); // Off
+    }
+    osDelay(BLINK_PERIOD);
+}
+
 void blinkAlarm()
 {
     // Assertion 1: Verify LED max brightness is valid
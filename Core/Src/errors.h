@@ -119,8 +119,20 @@ extern "C"
         /** @brief Touch sensing controller error */
         TSC_ERR = 31,
 
+        /** @brief We couldn't configure the CAN peripheral (filters, notifications, etc) **/
+        CAN_CONFIG_ERR = 32,
+
+        /** @brief A bxCAN RX FIFO overran, the hardware dropped an inbound frame **/
+        CAN_RX_OVERRUN_ERR = 33,
+
+        /** @brief The CAN controller went error passive or bus off, detail is the ESR register **/
+        CAN_BUS_ERR = 34,
+
+        /** @brief Erasing or programming the bus sniffer's flash ring failed, detail is the HAL status **/
+        SNIFFER_FLASH_ERR = 35,
+
         /** @brief The largest nonfatal error code in use, we use this to manage the flash storage of the errors **/
-        MAX_ERR = TSC_ERR
+        MAX_ERR = SNIFFER_FLASH_ERR
     } NonFatalError_t;
 
     void NonFatalError_Detail(NonFatalError_t error, uint32_t additionalInfo, uint32_t lineNumber, const char *fileName);
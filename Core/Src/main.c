@@ -96,26 +96,6 @@ const osThreadAttr_t AlertTask_attributes = {
     .stack_size = sizeof(AlertTaskBuffer),
     .priority = (osPriority_t)osPriorityNormal,
 };
-/* Definitions for PPO2Queue */
-osMessageQueueId_t PPO2QueueHandle;
-uint8_t PPO2QueueBuffer[1 * sizeof(CellValues_t)];
-osStaticMessageQDef_t PPO2QueueControlBlock;
-const osMessageQueueAttr_t PPO2Queue_attributes = {
-    .name = "PPO2Queue",
-    .cb_mem = &PPO2QueueControlBlock,
-    .cb_size = sizeof(PPO2QueueControlBlock),
-    .mq_mem = &PPO2QueueBuffer,
-    .mq_size = sizeof(PPO2QueueBuffer)};
-/* Definitions for CellStatQueue */
-osMessageQueueId_t CellStatQueueHandle;
-uint8_t CellStatBuffer[1 * sizeof(uint8_t)];
-osStaticMessageQDef_t CellStatControlBlock;
-const osMessageQueueAttr_t CellStatQueue_attributes = {
-    .name = "CellStatQueue",
-    .cb_mem = &CellStatControlBlock,
-    .cb_size = sizeof(CellStatControlBlock),
-    .mq_mem = &CellStatBuffer,
-    .mq_size = sizeof(CellStatBuffer)};
 /* USER CODE BEGIN PV */
 /* USER CODE END PV */
 
@@ -270,13 +250,6 @@ int main(void)
   /* start timers, add new ones, ... */
   /* USER CODE END RTOS_TIMERS */
 
-  /* Create the queue(s) */
-  /* creation of PPO2Queue */
-  PPO2QueueHandle = osMessageQueueNew(1, sizeof(CellValues_t), &PPO2Queue_attributes);
-
-  /* creation of CellStatQueue */
-  CellStatQueueHandle = osMessageQueueNew(1, sizeof(uint8_t), &CellStatQueue_attributes);
-
   /* USER CODE BEGIN RTOS_QUEUES */
   /* add queues, ... */
   /* USER CODE END RTOS_QUEUES */
@@ -369,11 +342,17 @@ static void MX_NVIC_Init(void)
   HAL_NVIC_SetPriority(EXTI15_10_IRQn, 5, 0);
   HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
   /* CAN1_RX0_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(CAN1_RX0_IRQn, 5, 0);
+  HAL_NVIC_SetPriority(CAN1_RX0_IRQn, 6, 0);
   HAL_NVIC_EnableIRQ(CAN1_RX0_IRQn);
   /* CAN1_RX1_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(CAN1_RX1_IRQn, 5, 0);
   HAL_NVIC_EnableIRQ(CAN1_RX1_IRQn);
+  /* CAN1_SCE_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(CAN1_SCE_IRQn, 7, 0);
+  HAL_NVIC_EnableIRQ(CAN1_SCE_IRQn);
+  /* CAN1_TX_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(CAN1_TX_IRQn, 7, 0);
+  HAL_NVIC_EnableIRQ(CAN1_TX_IRQn);
 }
 
 /**
@@ -408,17 +387,21 @@ static void MX_CAN1_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN CAN1_Init 2 */
-  CAN_FilterTypeDef sFilterConfig = {0};
-  sFilterConfig.FilterFIFOAssignment = CAN_FILTER_FIFO0; /* set fifo assignment */
-  sFilterConfig.FilterIdHigh = 0;
-  sFilterConfig.FilterIdLow = 0;
-  sFilterConfig.FilterMaskIdHigh = 0;
-  sFilterConfig.FilterMaskIdLow = 0;
-  sFilterConfig.FilterScale = CAN_FILTERSCALE_32BIT; /* set filter scale */
-  sFilterConfig.FilterActivation = ENABLE;
-  (void)HAL_CAN_ConfigFilter(&hcan1, &sFilterConfig);
+  InitCANFilters(&hcan1);                                                  /* only accept the IDs we consume */
+  InitCANRxLatencyProbe();                                                 /* ISR entry to CANTask latency */
+  InitCANBusLoad(&hcan1);                                                  /* bit rate the bus load is measured against */
   (void)HAL_CAN_Start(&hcan1);                                             /* start CAN */
-  (void)HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING); /* enable interrupts */
+  /* FIFO1 carries PPO2/status/shutdown at a higher NVIC priority, count overruns on both.
+   * Every protocol error and error state change goes to the SCE vector for ServiceCANErrorState.
+   * Mailbox empty refills the TX mailboxes from the TX ring */
+  if (HAL_OK != HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING |
+                                                          CAN_IT_RX_FIFO0_OVERRUN | CAN_IT_RX_FIFO1_OVERRUN |
+                                                          CAN_IT_TX_MAILBOX_EMPTY |
+                                                          CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF |
+                                                          CAN_IT_LAST_ERROR_CODE | CAN_IT_ERROR))
+  {
+    NON_FATAL_ERROR(CAN_CONFIG_ERR);
+  }
   /* USER CODE END CAN1_Init 2 */
 }
 
@@ -6,6 +6,7 @@
 /* The gist of the menu system is as follows:
  *  Pressing the button 4 times, and holding on the 4th time will trigger the hud to shut down
  *  Pressing the button 8 times, holding on the 4th time, will trigger calibration mode
+ *  Pressing the button 6 times, holding on the 6th time, will start or stop the CAN bus sniffer
  *  Any other number of presses will just exit the menu back to normal operation
  *  As the number of buttons is pressed we light each of the end LEDS in sequence to indicate how many presses have been registered
  *  First 4 presses count up the LEDS, second 4 count down
@@ -22,7 +23,8 @@ typedef enum
     MENU_STATE_5PRESS,
     MENU_STATE_6PRESS,
     MENU_STATE_7PRESS,
-    MENU_STATE_CALIBRATE
+    MENU_STATE_CALIBRATE,
+    MENU_STATE_SNIFFER
 } MenuState_t;
 
 typedef enum
@@ -48,13 +50,16 @@ const uint32_t MENU_MODE_TIMEOUT_MS = TIMEOUT_10S_TICKS;
 bool menuActive()
 {
     // Assertion: Verify current state is valid
-    assert(currentMenuState <= MENU_STATE_CALIBRATE);
+    assert(currentMenuState <= MENU_STATE_SNIFFER);
 
     return currentMenuState != MENU_STATE_IDLE;
 }
 
 bool inShutdown = false;
 
+/* Set on entering MENU_STATE_SNIFFER, CANTask takes it and starts or stops the bus sniffer */
+bool snifferToggleRequested = false;
+
 void onButtonPress()
 {
     // Assertion 1: Verify HAL_GetTick() returns reasonable value
@@ -84,7 +89,7 @@ bool incrementState(ButtonState_t button_state)
     assert(button_state <= HOLD);
 
     // Assertion 2: Verify current menu state is valid before transition
-    assert(currentMenuState <= MENU_STATE_CALIBRATE);
+    assert(currentMenuState <= MENU_STATE_SNIFFER);
 
     MenuState_t previousState = currentMenuState;
     switch (currentMenuState)
@@ -138,7 +143,11 @@ bool incrementState(ButtonState_t button_state)
         }
         break;
     case MENU_STATE_6PRESS:
-        if (button_state == PRESS)
+        if (button_state == HOLD)
+        {
+            currentMenuState = MENU_STATE_SNIFFER;
+        }
+        else if (button_state == PRESS)
         {
             currentMenuState = MENU_STATE_7PRESS;
         }
@@ -156,13 +165,20 @@ bool incrementState(ButtonState_t button_state)
     case MENU_STATE_CALIBRATE:
         currentMenuState = MENU_STATE_IDLE;
         break;
+    case MENU_STATE_SNIFFER:
+        if (button_state == NONE)
+        {
+            // Go back to idle once button is released
+            currentMenuState = MENU_STATE_IDLE;
+        }
+        break;
     default:
         currentMenuState = MENU_STATE_IDLE;
         break;
     }
 
     // Assertion 3: Verify new state is valid after transition
-    assert(currentMenuState <= MENU_STATE_CALIBRATE);
+    assert(currentMenuState <= MENU_STATE_SNIFFER);
 
     return previousState != currentMenuState;
 }
@@ -182,7 +198,7 @@ void resetMenuStateMachine()
 void displayLEDsForState()
 {
     // Assertion 1: Verify current state is valid
-    assert(currentMenuState <= MENU_STATE_CALIBRATE);
+    assert(currentMenuState <= MENU_STATE_SNIFFER);
 
     // Assertion 2: Verify GPIO ports are valid
     assert(LED_0_GPIO_Port != NULL);
@@ -258,6 +274,13 @@ void displayLEDsForState()
     case MENU_STATE_CALIBRATE:
         // Flash all LEDs to indicate calibration mode
         break;
+    case MENU_STATE_SNIFFER:
+        // Light the outer LEDs to acknowledge the sniffer toggle
+        HAL_GPIO_WritePin(LED_0_GPIO_Port, LED_0_Pin, GPIO_PIN_SET);
+        HAL_GPIO_WritePin(LED_1_GPIO_Port, LED_1_Pin, GPIO_PIN_RESET);
+        HAL_GPIO_WritePin(LED_2_GPIO_Port, LED_2_Pin, GPIO_PIN_RESET);
+        HAL_GPIO_WritePin(LED_3_GPIO_Port, LED_3_Pin, GPIO_PIN_SET);
+        break;
     default:
         // Turn off all LEDs
         break;
@@ -298,6 +321,10 @@ void menuStateMachineTick()
         {
             button_state = PRESSED;
         }
+        if (currentMenuState == MENU_STATE_SNIFFER)
+        {
+            __atomic_store_n(&snifferToggleRequested, true, __ATOMIC_RELEASE);
+        }
     }
 
     inShutdown = currentMenuState == MENU_STATE_SHUTDOWN;
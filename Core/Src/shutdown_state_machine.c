@@ -0,0 +1,170 @@
+#include "shutdown_state_machine.h"
+#include "Hardware/pwr_management.h"
+#include "Hardware/printer.h"
+#include <assert.h>
+
+/* The gist of the shutdown system is as follows:
+ *  The controller sends BUS_OFF_ID and then drops CAN_EN, CANTask hands the request over here and carries on handling
+ *  frames. Each CANTask pass (woken early by the CAN_EN EXTI edge) checks CAN_EN and enters standby once it is off,
+ *  or gives up if it is still on SHUTDOWN_BUS_OFF_TIMEOUT later
+ *  Holding the menu shutdown fades the LEDs out from the RGB task, which enters standby itself if the hold lasts the fade.
+ *  The fade is tracked apart from the state, so a diver's completed hold still shuts us down if a bus shutdown took the
+ *  state over meanwhile and then timed out
+ *  Whichever task commits does the Shutdown() call, the STANDBY state stops the other one from starting anything else
+ */
+
+/* How long the controller gets to drop CAN_EN after BUS_OFF_ID, same as the old 20 x 100ms poll */
+static const Timestamp_t SHUTDOWN_BUS_OFF_TIMEOUT = TIMEOUT_2S_TICKS;
+
+/* CANTask and the RGB task both move the state, every transition is a compare and swap from the state it expects */
+static ShutdownState_t *getShutdownState(void)
+{
+    static ShutdownState_t state = SHUTDOWN_STATE_IDLE;
+    return &state;
+}
+
+/* Tick the pending bus shutdown was asked for, CANTask only */
+static Timestamp_t *getRequestTick(void)
+{
+    static Timestamp_t requestTick = 0;
+    return &requestTick;
+}
+
+/* Set while the RGB task is fading the LEDs out, whatever the state is doing */
+static bool *getFadeActive(void)
+{
+    static bool fadeActive = false;
+    return &fadeActive;
+}
+
+/** @brief Move from one state to another if nobody else has moved it first
+ * @return True if we made the transition
+ */
+static bool transition(ShutdownState_t expected, const ShutdownState_t next)
+{
+    return __atomic_compare_exchange_n(getShutdownState(), &expected, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/** @brief Commit to standby from any state but STANDBY, then go. Only returns in testing, or if the other task got
+ * there first
+ */
+static void enterStandby(void)
+{
+    bool committed = false;
+    ShutdownState_t state = __atomic_load_n(getShutdownState(), __ATOMIC_ACQUIRE);
+    while ((!committed) && (SHUTDOWN_STATE_STANDBY != state))
+    {
+        committed = __atomic_compare_exchange_n(getShutdownState(), &state, SHUTDOWN_STATE_STANDBY, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+
+    if (committed)
+    {
+        serial_printf("Performing requested shutdown");
+        Shutdown();
+    }
+}
+
+/**
+ * @brief The controller has asked us to shut down (BUS_OFF_ID), must be called from CANTask. Never blocks: if CAN_EN
+ * is already off we go straight to standby, otherwise ServiceShutdown waits for it. A repeat request restarts the
+ * timeout, and a request during a menu fade takes it over
+ * @param now Current tick
+ */
+void RequestBusShutdown(const Timestamp_t now)
+{
+    if (!getBusStatus())
+    {
+        enterStandby();
+    }
+    else
+    {
+        *getRequestTick() = now;
+        if (!transition(SHUTDOWN_STATE_IDLE, SHUTDOWN_STATE_AWAIT_BUS_OFF))
+        {
+            (void)transition(SHUTDOWN_STATE_FADING, SHUTDOWN_STATE_AWAIT_BUS_OFF);
+        }
+    }
+}
+
+/**
+ * @brief Advance a pending bus shutdown, must be called from CANTask every loop while ShutdownPending
+ * @param now Current tick
+ */
+void ServiceShutdown(const Timestamp_t now)
+{
+    if (SHUTDOWN_STATE_AWAIT_BUS_OFF == __atomic_load_n(getShutdownState(), __ATOMIC_ACQUIRE))
+    {
+        if (!getBusStatus())
+        {
+            enterStandby();
+        }
+        else if ((now - *getRequestTick()) >= SHUTDOWN_BUS_OFF_TIMEOUT)
+        {
+            if (transition(SHUTDOWN_STATE_AWAIT_BUS_OFF, SHUTDOWN_STATE_IDLE))
+            {
+                serial_printf("Shutdown attempted but timed out due to missing en signal");
+            }
+        }
+        else
+        {
+            /* Keep waiting */
+        }
+    }
+}
+
+/**
+ * @brief Whether a bus shutdown is waiting on CAN_EN, CANTask polls more often while it is
+ */
+bool ShutdownPending(void)
+{
+    return SHUTDOWN_STATE_AWAIT_BUS_OFF == __atomic_load_n(getShutdownState(), __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief The RGB task is starting the menu shutdown fade. If a bus shutdown is already under way the state stays with
+ * it, but a completed fade still goes to standby
+ */
+void StartShutdownFade(void)
+{
+    __atomic_store_n(getFadeActive(), true, __ATOMIC_RELEASE);
+    (void)transition(SHUTDOWN_STATE_IDLE, SHUTDOWN_STATE_FADING);
+}
+
+/**
+ * @brief The RGB task has finished or abandoned the fade
+ * @param complete True if the menu was held for the whole fade, we go to standby whatever a bus shutdown is doing. False
+ * if it was let go, back to normal unless a bus shutdown has taken over
+ */
+void EndShutdownFade(const bool complete)
+{
+    if (__atomic_exchange_n(getFadeActive(), false, __ATOMIC_ACQ_REL))
+    {
+        if (complete)
+        {
+            enterStandby();
+        }
+        else
+        {
+            (void)transition(SHUTDOWN_STATE_FADING, SHUTDOWN_STATE_IDLE);
+        }
+    }
+}
+
+ShutdownState_t GetShutdownState(void)
+{
+    ShutdownState_t state = __atomic_load_n(getShutdownState(), __ATOMIC_ACQUIRE);
+    assert(state <= SHUTDOWN_STATE_STANDBY);
+    return state;
+}
+
+#ifdef TESTING
+/**
+ * @brief Back to IDLE, Shutdown() returns in testing so STANDBY isn't the end
+ */
+void ResetShutdownStateMachine(void)
+{
+    __atomic_store_n(getShutdownState(), SHUTDOWN_STATE_IDLE, __ATOMIC_RELEASE);
+    __atomic_store_n(getFadeActive(), false, __ATOMIC_RELEASE);
+    *getRequestTick() = 0;
+}
+#endif
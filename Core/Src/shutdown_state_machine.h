@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum
+    {
+        /** @brief Running normally */
+        SHUTDOWN_STATE_IDLE = 0,
+        /** @brief BUS_OFF_ID heard, waiting for the controller to drop CAN_EN */
+        SHUTDOWN_STATE_AWAIT_BUS_OFF,
+        /** @brief Menu shutdown, the RGB task is fading the LEDs out */
+        SHUTDOWN_STATE_FADING,
+        /** @brief Committed, standby is being entered */
+        SHUTDOWN_STATE_STANDBY
+    } ShutdownState_t;
+
+    void RequestBusShutdown(const Timestamp_t now);
+    void ServiceShutdown(const Timestamp_t now);
+    bool ShutdownPending(void);
+    void StartShutdownFade(void);
+    void EndShutdownFade(const bool complete);
+    ShutdownState_t GetShutdownState(void);
+
+#ifdef TESTING
+    void ResetShutdownStateMachine(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,127 @@
+/**
+ * @file BusStateTest.cpp
+ * @brief Unit tests for the decoded bus state cache
+ *
+ * Tests that updates CANTask makes in place read back whole:
+ * - Nothing heard reads as all zero
+ * - Each update stamps its own field's tick and valid bit, the others are kept
+ * - Freshness check against the valid bit and age
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+extern "C" {
+#include "DiveCAN/BusState.h"
+}
+
+TEST_GROUP(BusState)
+{
+    void setup()
+    {
+        ResetBusState();
+    }
+
+    void teardown()
+    {
+        ResetBusState();
+    }
+
+    void updateSetpoint(PPO2_t setpoint, Timestamp_t rxTick)
+    {
+        BusState_t *const state = BeginBusStateUpdate();
+        state->setpoint = setpoint;
+        EndBusStateUpdate(BUS_STATE_SETPOINT, rxTick);
+    }
+};
+
+TEST(BusState, NothingHeard_ReadsZero)
+{
+    BusState_t state = {};
+    state.validMask = 0xFF;
+    state.setpoint = 99;
+
+    ReadBusState(&state);
+
+    CHECK_EQUAL(0, state.validMask);
+    CHECK_EQUAL(0, state.setpoint);
+    CHECK_EQUAL(0, state.rxTick[BUS_STATE_SETPOINT]);
+}
+
+TEST(BusState, Update_ReadsBackWithTick)
+{
+    updateSetpoint(130, 1234);
+
+    BusState_t state = {};
+    ReadBusState(&state);
+
+    CHECK_EQUAL(130, state.setpoint);
+    CHECK_EQUAL(1234, state.rxTick[BUS_STATE_SETPOINT]);
+    CHECK_EQUAL(1U << BUS_STATE_SETPOINT, state.validMask);
+}
+
+TEST(BusState, Fields_KeepEachOther)
+{
+    updateSetpoint(70, 10);
+
+    BusState_t *const update = BeginBusStateUpdate();
+    update->atmosPressure = 1013;
+    EndBusStateUpdate(BUS_STATE_ATMOS, 20);
+
+    updateSetpoint(130, 30);
+
+    BusState_t state = {};
+    ReadBusState(&state);
+
+    CHECK_EQUAL(130, state.setpoint);
+    CHECK_EQUAL(30, state.rxTick[BUS_STATE_SETPOINT]);
+    CHECK_EQUAL(1013, state.atmosPressure);
+    CHECK_EQUAL(20, state.rxTick[BUS_STATE_ATMOS]);
+    CHECK_EQUAL((1U << BUS_STATE_SETPOINT) | (1U << BUS_STATE_ATMOS), state.validMask);
+}
+
+TEST(BusState, Read_IsNonDestructive)
+{
+    updateSetpoint(100, 5);
+
+    BusState_t first = {};
+    BusState_t second = {};
+    ReadBusState(&first);
+    ReadBusState(&second);
+
+    CHECK_EQUAL(first.setpoint, second.setpoint);
+    CHECK_EQUAL(first.validMask, second.validMask);
+    CHECK_EQUAL(first.rxTick[BUS_STATE_SETPOINT], second.rxTick[BUS_STATE_SETPOINT]);
+}
+
+TEST(BusState, Fresh_NeedsValidAndAge)
+{
+    BusState_t state = {};
+    ReadBusState(&state);
+    CHECK_FALSE(BusStateFresh(&state, BUS_STATE_SETPOINT, 0, 100));
+
+    updateSetpoint(100, 1000);
+    ReadBusState(&state);
+
+    CHECK_TRUE(BusStateFresh(&state, BUS_STATE_SETPOINT, 1000, 100));
+    CHECK_TRUE(BusStateFresh(&state, BUS_STATE_SETPOINT, 1100, 100));
+    CHECK_FALSE(BusStateFresh(&state, BUS_STATE_SETPOINT, 1101, 100));
+    CHECK_FALSE(BusStateFresh(&state, BUS_STATE_DIVING, 1000, 100));
+}
+
+/* Tick counter wrapping between the frame and the check */
+TEST(BusState, Fresh_AcrossTickWrap)
+{
+    updateSetpoint(100, UINT32_MAX - 10);
+
+    BusState_t state = {};
+    ReadBusState(&state);
+
+    CHECK_TRUE(BusStateFresh(&state, BUS_STATE_SETPOINT, 20, 100));
+    CHECK_FALSE(BusStateFresh(&state, BUS_STATE_SETPOINT, 200, 100));
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,313 @@
+/**
+ * @file CellSnapshotTest.cpp
+ * @brief Unit tests for the latest cell readings snapshot
+ *
+ * Tests that the snapshot CANTask publishes reads back whole:
+ * - Nothing published reads as all zero
+ * - Values and status mask are published separately, each keeps the other
+ * - Reads are non-destructive
+ * - Alternating copies don't lose anything across many publishes
+ * - Source selection: preferred with fallback, freshest, agreement check and mismatch counting
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+extern "C" {
+#include "DiveCAN/CellSnapshot.h"
+}
+
+TEST_GROUP(CellSnapshot)
+{
+    void setup()
+    {
+        ResetCellSnapshot();
+    }
+
+    void teardown()
+    {
+        ResetCellSnapshot();
+    }
+
+    void publishValues(int16_t c1, int16_t c2, int16_t c3, Timestamp_t rxTick, DiveCANType_t source = DIVECAN_SOLO)
+    {
+        CellValues_t values = {};
+        values.C1 = c1;
+        values.C2 = c2;
+        values.C3 = c3;
+        values.rxCycles = 0x1000U + (uint32_t)c1;
+        PublishCellValues(&values, source, rxTick);
+    }
+
+    void setPolicy(CellSourcePolicy_t policy, DiveCANType_t preferred, Timestamp_t fallbackTicks)
+    {
+        CellSourceConfig_t config = {};
+        config.policy = policy;
+        config.preferred = preferred;
+        config.fallbackTicks = fallbackTicks;
+        SetCellSourceConfig(&config);
+    }
+};
+
+TEST(CellSnapshot, NothingPublished_ReadsZero)
+{
+    CellSnapshot_t snapshot = {};
+    snapshot.sequence = 99;
+    snapshot.statusMask = 0xAA;
+
+    ReadCellSnapshot(&snapshot);
+
+    CHECK_EQUAL(0, snapshot.sequence);
+    CHECK_EQUAL(0, snapshot.statusSequence);
+    CHECK_EQUAL(0, snapshot.statusMask);
+    CHECK_EQUAL(0, snapshot.values.C1);
+}
+
+TEST(CellSnapshot, Values_ReadBack)
+{
+    publishValues(100, 110, 95, 1234);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+
+    CHECK_EQUAL(1, snapshot.sequence);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(110, snapshot.values.C2);
+    CHECK_EQUAL(95, snapshot.values.C3);
+    CHECK_EQUAL(0x1000U + 100U, snapshot.values.rxCycles);
+    CHECK_EQUAL(1234, snapshot.rxTick);
+}
+
+TEST(CellSnapshot, Status_ReadBack)
+{
+    PublishCellStatus(0b101, 77);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+
+    CHECK_EQUAL(1, snapshot.statusSequence);
+    CHECK_EQUAL(0b101, snapshot.statusMask);
+    CHECK_EQUAL(77, snapshot.statusTick);
+    CHECK_EQUAL(0, snapshot.sequence);
+}
+
+TEST(CellSnapshot, ValuesAndStatus_KeepEachOther)
+{
+    publishValues(100, 101, 102, 10);
+    PublishCellStatus(0b011, 20);
+    publishValues(90, 91, 92, 30);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+
+    CHECK_EQUAL(2, snapshot.sequence);
+    CHECK_EQUAL(90, snapshot.values.C1);
+    CHECK_EQUAL(30, snapshot.rxTick);
+    CHECK_EQUAL(1, snapshot.statusSequence);
+    CHECK_EQUAL(0b011, snapshot.statusMask);
+    CHECK_EQUAL(20, snapshot.statusTick);
+}
+
+TEST(CellSnapshot, Read_IsNonDestructive)
+{
+    publishValues(100, 110, 95, 5);
+
+    CellSnapshot_t first = {};
+    CellSnapshot_t second = {};
+    ReadCellSnapshot(&first);
+    ReadCellSnapshot(&second);
+
+    CHECK_EQUAL(first.sequence, second.sequence);
+    CHECK_EQUAL(first.values.C2, second.values.C2);
+    CHECK_EQUAL(first.rxTick, second.rxTick);
+}
+
+TEST(CellSnapshot, ManyPublishes_LatestWins)
+{
+    for (int16_t i = 0; i < 101; ++i)
+    {
+        publishValues(i, (int16_t)(i + 1), (int16_t)(i + 2), (Timestamp_t)i);
+        if (0 == (i % 10))
+        {
+            PublishCellStatus((uint8_t)(i & 0x7), (Timestamp_t)i);
+        }
+    }
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+
+    CHECK_EQUAL(101, snapshot.sequence);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(101, snapshot.values.C2);
+    CHECK_EQUAL(102, snapshot.values.C3);
+    CHECK_EQUAL(100, snapshot.rxTick);
+    CHECK_EQUAL(11, snapshot.statusSequence);
+    CHECK_EQUAL(100 & 0x7, snapshot.statusMask);
+}
+
+TEST(CellSnapshot, DefaultConfig)
+{
+    CellSourceConfig_t config = {};
+    GetCellSourceConfig(&config);
+
+    CHECK_EQUAL(CELL_SOURCE_PREFERRED, config.policy);
+    CHECK_EQUAL(DIVECAN_SOLO, config.preferred);
+    CHECK_EQUAL(TIMEOUT_2S_TICKS, config.fallbackTicks);
+}
+
+TEST(CellSnapshot, SourceTable_KeepsEachSource)
+{
+    publishValues(100, 101, 102, 10, DIVECAN_SOLO);
+    publishValues(103, 104, 105, 20, DIVECAN_OBOE);
+    publishValues(106, 107, 108, 30, DIVECAN_SOLO);
+
+    CellSourceReading_t reading = {};
+    CHECK_TRUE(GetCellSourceReading(DIVECAN_SOLO, &reading));
+    CHECK_EQUAL(2, reading.count);
+    CHECK_EQUAL(106, reading.values.C1);
+    CHECK_EQUAL(30, reading.rxTick);
+
+    CHECK_TRUE(GetCellSourceReading(DIVECAN_OBOE, &reading));
+    CHECK_EQUAL(1, reading.count);
+    CHECK_EQUAL(103, reading.values.C1);
+    CHECK_EQUAL(20, reading.rxTick);
+
+    CHECK_FALSE(GetCellSourceReading(DIVECAN_CONTROLLER, &reading));
+}
+
+TEST(CellSnapshot, OutOfRangeSource_Ignored)
+{
+    publishValues(100, 101, 102, 10, (DiveCANType_t)0xC);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(0, snapshot.sequence);
+
+    CellSourceReading_t reading = {};
+    CHECK_FALSE(GetCellSourceReading((DiveCANType_t)0xC, &reading));
+}
+
+/* Only one source on the bus, it gets shown whichever it is */
+TEST(CellSnapshot, Preferred_LoneOtherSourceShown)
+{
+    publishValues(100, 101, 102, 10, DIVECAN_OBOE);
+    publishValues(103, 104, 105, 20, DIVECAN_OBOE);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(2, snapshot.sequence);
+    CHECK_EQUAL(103, snapshot.values.C1);
+    CHECK_EQUAL(DIVECAN_OBOE, snapshot.source);
+}
+
+TEST(CellSnapshot, Preferred_OtherSourceHeldBackWhileLive)
+{
+    publishValues(100, 101, 102, 10, DIVECAN_SOLO);
+    publishValues(105, 106, 107, 20, DIVECAN_CONTROLLER);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(1, snapshot.sequence);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(DIVECAN_SOLO, snapshot.source);
+}
+
+TEST(CellSnapshot, Preferred_FallsBackOnceQuiet)
+{
+    publishValues(100, 101, 102, 10, DIVECAN_SOLO);
+    publishValues(105, 106, 107, 10 + TIMEOUT_2S_TICKS - 1, DIVECAN_CONTROLLER);
+    publishValues(108, 109, 110, 10 + TIMEOUT_2S_TICKS, DIVECAN_CONTROLLER);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(2, snapshot.sequence);
+    CHECK_EQUAL(108, snapshot.values.C1);
+    CHECK_EQUAL(DIVECAN_CONTROLLER, snapshot.source);
+
+    /* Back to the preferred source as soon as it speaks */
+    publishValues(111, 112, 113, 20 + TIMEOUT_2S_TICKS, DIVECAN_SOLO);
+    publishValues(114, 115, 116, 21 + TIMEOUT_2S_TICKS, DIVECAN_CONTROLLER);
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(3, snapshot.sequence);
+    CHECK_EQUAL(111, snapshot.values.C1);
+    CHECK_EQUAL(DIVECAN_SOLO, snapshot.source);
+}
+
+TEST(CellSnapshot, Freshest_LatestSourceWins)
+{
+    setPolicy(CELL_SOURCE_FRESHEST, DIVECAN_SOLO, TIMEOUT_2S_TICKS);
+    publishValues(100, 101, 102, 10, DIVECAN_SOLO);
+    publishValues(105, 106, 107, 20, DIVECAN_CONTROLLER);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(2, snapshot.sequence);
+    CHECK_EQUAL(105, snapshot.values.C1);
+    CHECK_EQUAL(DIVECAN_CONTROLLER, snapshot.source);
+}
+
+TEST(CellSnapshot, Mismatch_CountedWhateverThePolicy)
+{
+    publishValues(100, 100, 100, 10, DIVECAN_SOLO);
+    /* Within MAX_DEVIATION */
+    publishValues(100 + MAX_DEVIATION, 100, 100 - MAX_DEVIATION, 20, DIVECAN_CONTROLLER);
+    CHECK_EQUAL(0, GetCellSourceMismatches());
+
+    /* Two cells out, still one mismatched reading */
+    publishValues(100, 100 + MAX_DEVIATION + 1, 100 - MAX_DEVIATION - 1, 30, DIVECAN_CONTROLLER);
+    CHECK_EQUAL(1, GetCellSourceMismatches());
+
+    /* Shown as sent, PREFERRED doesn't touch the values */
+    publishValues(70, 100, 100, 40, DIVECAN_SOLO);
+    CHECK_EQUAL(2, GetCellSourceMismatches());
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(70, snapshot.values.C1);
+}
+
+TEST(CellSnapshot, Mismatch_FailedCellOrQuietSourceNotCompared)
+{
+    publishValues(100, 100, 100, 10, DIVECAN_SOLO);
+    publishValues(PPO2_FAIL, 100, 100, 20, DIVECAN_CONTROLLER);
+    CHECK_EQUAL(0, GetCellSourceMismatches());
+
+    /* The SOLO was last heard too long ago to compare against */
+    publishValues(50, 100, 100, 10 + TIMEOUT_2S_TICKS, DIVECAN_CONTROLLER);
+    CHECK_EQUAL(0, GetCellSourceMismatches());
+}
+
+TEST(CellSnapshot, Agreement_DisagreeingCellsShownFailed)
+{
+    setPolicy(CELL_SOURCE_AGREEMENT, DIVECAN_SOLO, TIMEOUT_2S_TICKS);
+    publishValues(100, 100, 100, 10, DIVECAN_CONTROLLER);
+    publishValues(100, 130, 95, 20, DIVECAN_SOLO);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(DIVECAN_SOLO, snapshot.source);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(PPO2_FAIL, snapshot.values.C2);
+    CHECK_EQUAL(95, snapshot.values.C3);
+    CHECK_EQUAL(1, GetCellSourceMismatches());
+
+    /* The table keeps what was actually sent */
+    CellSourceReading_t reading = {};
+    CHECK_TRUE(GetCellSourceReading(DIVECAN_SOLO, &reading));
+    CHECK_EQUAL(130, reading.values.C2);
+}
+
+TEST(CellSnapshot, Agreement_LoneSourceShownAsSent)
+{
+    setPolicy(CELL_SOURCE_AGREEMENT, DIVECAN_SOLO, TIMEOUT_2S_TICKS);
+    publishValues(100, 130, 95, 20, DIVECAN_SOLO);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(130, snapshot.values.C2);
+    CHECK_EQUAL(0, GetCellSourceMismatches());
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
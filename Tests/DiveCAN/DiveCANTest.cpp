@@ -4,15 +4,22 @@
 extern "C" {
 #include "DiveCAN/DiveCAN.h"
 #include "DiveCAN/Transciever.h"
+#include "DiveCAN/Sniffer.h"
+#include "shutdown_state_machine.h"
+#include "DiveCAN/CellSnapshot.h"
+#include "DiveCAN/BusState.h"
 #include "MockCAN.h"
+#include "MockFlash.h"
 #include "MockErrors.h"
 #include "MockPower.h"
+#include "core_cm4.h"
 #include "queue.h"
+#include "printer.h"
 #include "cmsis_os.h"
 
-/* Queue handles are defined in queue.cpp */
-extern osMessageQueueId_t PPO2QueueHandle;
-extern osMessageQueueId_t CellStatQueueHandle;
+/* Test only resets from Transciever.c */
+void ResetCANRxRing(void);
+void ResetCANTxRing(void);
 }
 
 /* Test Group: RespPPO2 - PPO2 Data Handling */
@@ -32,15 +39,15 @@ TEST_GROUP(RespPPO2) {
         MockPower_Reset();
 
         if (!queuesInitialized) {
-            InitRXQueue();
             MockQueue_InitApplicationQueues();
             queuesInitialized = true;
         }
 
         /* Initialize message and device spec */
-        message = {0};
+        ResetCellSnapshot();
+
+        message = {};
         message.id = PPO2_PPO2_ID;
-        message.type = "PPO2_PPO2";
 
         deviceSpec.name = "TestHUD";
         deviceSpec.type = DIVECAN_MONITOR;
@@ -59,7 +66,7 @@ TEST_GROUP(RespPPO2) {
 
 bool TEST_GROUP_CppUTestGroupRespPPO2::queuesInitialized = false;
 
-/* RespPPO2 Tests - PPO2 value extraction and queueing */
+/* RespPPO2 Tests - PPO2 value extraction and publishing */
 TEST(RespPPO2, ExtractCellValues_AllPositive) {
     /* PPO2 values in data[1], data[2], data[3] */
     message.data[0] = 0xFF;  /* Unused */
@@ -69,19 +76,20 @@ TEST(RespPPO2, ExtractCellValues_AllPositive) {
 
     RespPPO2(&message, &deviceSpec);
 
-    /* Verify values queued */
-    CellValues_t cellValues;
-    osStatus_t status = osMessageQueueGet(PPO2QueueHandle, &cellValues, NULL, 0);
-    CHECK_EQUAL(osOK, status);
-    CHECK_EQUAL(100, cellValues.C1);
-    CHECK_EQUAL(110, cellValues.C2);
-    CHECK_EQUAL(95, cellValues.C3);
+    /* Verify values published */
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(1, snapshot.sequence);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(110, snapshot.values.C2);
+    CHECK_EQUAL(95, snapshot.values.C3);
 }
 
-TEST(RespPPO2, QueueResetBeforeEnqueue) {
-    /* Add old data to queue */
-    CellValues_t oldValues = {50, 60, 70};
-    osMessageQueuePut(PPO2QueueHandle, &oldValues, 0, 0);
+TEST(RespPPO2, NewValuesReplaceOld) {
+    message.data[1] = 50;
+    message.data[2] = 60;
+    message.data[3] = 70;
+    RespPPO2(&message, &deviceSpec);
 
     /* Process new PPO2 message */
     message.data[1] = 100;
@@ -90,15 +98,46 @@ TEST(RespPPO2, QueueResetBeforeEnqueue) {
 
     RespPPO2(&message, &deviceSpec);
 
-    /* Queue should have been reset, so only 1 message */
-    CHECK_EQUAL(1, MockQueue_GetMessageCount(PPO2QueueHandle));
-
     /* Verify new values (not old) */
-    CellValues_t cellValues;
-    osMessageQueueGet(PPO2QueueHandle, &cellValues, NULL, 0);
-    CHECK_EQUAL(100, cellValues.C1);
-    CHECK_EQUAL(110, cellValues.C2);
-    CHECK_EQUAL(120, cellValues.C3);
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(2, snapshot.sequence);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(110, snapshot.values.C2);
+    CHECK_EQUAL(120, snapshot.values.C3);
+}
+
+/* Publishing doesn't touch the status mask, that comes in its own frame */
+TEST(RespPPO2, StatusUntouched) {
+    message.data[1] = 100;
+
+    RespPPO2(&message, &deviceSpec);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(0, snapshot.statusSequence);
+}
+
+/* The source nibble picks the row, a second source doesn't displace the SOLO while it is live */
+TEST(RespPPO2, FiledUnderSource) {
+    message.id = PPO2_PPO2_ID | DIVECAN_SOLO;
+    message.data[1] = 100;
+    RespPPO2(&message, &deviceSpec);
+
+    message.id = PPO2_PPO2_ID | DIVECAN_CONTROLLER;
+    message.data[1] = 60;
+    RespPPO2(&message, &deviceSpec);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(1, snapshot.sequence);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(DIVECAN_SOLO, snapshot.source);
+
+    CellSourceReading_t reading = {};
+    CHECK_TRUE(GetCellSourceReading(DIVECAN_CONTROLLER, &reading));
+    CHECK_EQUAL(60, reading.values.C1);
+    CHECK_EQUAL(1, GetCellSourceMismatches());
 }
 
 TEST(RespPPO2, FailedCell_Value0xFF) {
@@ -109,11 +148,11 @@ TEST(RespPPO2, FailedCell_Value0xFF) {
 
     RespPPO2(&message, &deviceSpec);
 
-    CellValues_t cellValues;
-    osMessageQueueGet(PPO2QueueHandle, &cellValues, NULL, 0);
-    CHECK_EQUAL(0xFF, cellValues.C1);
-    CHECK_EQUAL(110, cellValues.C2);
-    CHECK_EQUAL(95, cellValues.C3);
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(0xFF, snapshot.values.C1);
+    CHECK_EQUAL(110, snapshot.values.C2);
+    CHECK_EQUAL(95, snapshot.values.C3);
 }
 
 TEST(RespPPO2, DeviceSpecUnused) {
@@ -126,9 +165,24 @@ TEST(RespPPO2, DeviceSpecUnused) {
     RespPPO2(&message, NULL);
 
     /* Verify still works */
-    CellValues_t cellValues;
-    osStatus_t status = osMessageQueueGet(PPO2QueueHandle, &cellValues, NULL, 0);
-    CHECK_EQUAL(osOK, status);
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(1, snapshot.sequence);
+}
+
+/* The RX ISR stamp and arrival tick of the frame being dispatched ride along with the cell values */
+TEST(RespPPO2, RxStamp_CarriedWithValues) {
+    message.data[1] = 100;
+    message.data[2] = 110;
+    message.data[3] = 95;
+
+    DispatchStampedMessage(&message, &deviceSpec, 0xCAFE0001U, 4321);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(100, snapshot.values.C1);
+    CHECK_EQUAL(0xCAFE0001U, snapshot.values.rxCycles);
+    CHECK_EQUAL(4321, snapshot.rxTick);
 }
 
 /* Test Group: RespPPO2Status - Cell Status Handling */
@@ -147,14 +201,14 @@ TEST_GROUP(RespPPO2Status) {
         MockPower_Reset();
 
         if (!queuesInitialized) {
-            InitRXQueue();
             MockQueue_InitApplicationQueues();
             queuesInitialized = true;
         }
 
-        message = {0};
+        ResetCellSnapshot();
+
+        message = {};
         message.id = PPO2_STATUS_ID;
-        message.type = "PPO2_STATUS";
 
         deviceSpec.name = "TestHUD";
         deviceSpec.type = DIVECAN_MONITOR;
@@ -179,27 +233,27 @@ TEST(RespPPO2Status, ExtractStatusByte) {
 
     RespPPO2Status(&message, &deviceSpec);
 
-    uint8_t status;
-    osStatus_t result = osMessageQueueGet(CellStatQueueHandle, &status, NULL, 0);
-    CHECK_EQUAL(osOK, result);
-    CHECK_EQUAL(0x07, status);
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(1, snapshot.statusSequence);
+    CHECK_EQUAL(0x07, snapshot.statusMask);
 }
 
-TEST(RespPPO2Status, QueueResetBeforeEnqueue) {
-    /* Add old status */
-    uint8_t oldStatus = 0x01;
-    osMessageQueuePut(CellStatQueueHandle, &oldStatus, 0, 0);
+TEST(RespPPO2Status, NewStatusReplacesOld) {
+    message.data[0] = 0x01;
+    RespPPO2Status(&message, &deviceSpec);
 
     /* Process new status */
     message.data[0] = 0x05;
-    RespPPO2Status(&message, &deviceSpec);
-
-    /* Queue should have been reset */
-    CHECK_EQUAL(1, MockQueue_GetMessageCount(CellStatQueueHandle));
-
-    uint8_t status;
-    osMessageQueueGet(CellStatQueueHandle, &status, NULL, 0);
-    CHECK_EQUAL(0x05, status);
+    DispatchStampedMessage(&message, &deviceSpec, 0, 250);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(2, snapshot.statusSequence);
+    CHECK_EQUAL(0x05, snapshot.statusMask);
+    CHECK_EQUAL(250, snapshot.statusTick);
+    /* The cell values come in their own frame */
+    CHECK_EQUAL(0, snapshot.sequence);
 }
 
 TEST(RespPPO2Status, StatusAllCellsFailed_0x00) {
@@ -207,9 +261,10 @@ TEST(RespPPO2Status, StatusAllCellsFailed_0x00) {
 
     RespPPO2Status(&message, &deviceSpec);
 
-    uint8_t status;
-    osMessageQueueGet(CellStatQueueHandle, &status, NULL, 0);
-    CHECK_EQUAL(0x00, status);
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(1, snapshot.statusSequence);
+    CHECK_EQUAL(0x00, snapshot.statusMask);
 }
 
 TEST(RespPPO2Status, DeviceSpecUnused) {
@@ -218,9 +273,9 @@ TEST(RespPPO2Status, DeviceSpecUnused) {
     /* Should not crash with NULL deviceSpec */
     RespPPO2Status(&message, NULL);
 
-    uint8_t status;
-    osStatus_t result = osMessageQueueGet(CellStatQueueHandle, &status, NULL, 0);
-    CHECK_EQUAL(osOK, result);
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(0x03, snapshot.statusMask);
 }
 
 /* Test Group: RespPing - Device Identification */
@@ -239,14 +294,12 @@ TEST_GROUP(RespPing) {
         MockPower_Reset();
 
         if (!queuesInitialized) {
-            InitRXQueue();
             MockQueue_InitApplicationQueues();
             queuesInitialized = true;
         }
 
-        message = {0};
+        message = {};
         message.id = BUS_ID_ID;
-        message.type = "BUS_ID";
 
         deviceSpec.name = "TestHUD";
         deviceSpec.type = DIVECAN_MONITOR;
@@ -378,21 +431,21 @@ TEST_GROUP(RespShutdown) {
         MockPower_Reset();
 
         if (!queuesInitialized) {
-            InitRXQueue();
             MockQueue_InitApplicationQueues();
             queuesInitialized = true;
         }
 
-        message = {0};
+        message = {};
         message.id = BUS_OFF_ID;
-        message.type = "BUS_OFF";
 
         deviceSpec.name = "TestHUD";
         deviceSpec.type = DIVECAN_MONITOR;
         deviceSpec.manufacturerID = DIVECAN_MANUFACTURER_ISC;
         deviceSpec.firmwareVersion = 1;
 
-        /* Default: bus active (pin low) */
+        ResetShutdownStateMachine();
+
+        /* Default: bus inactive (pin high) */
         extern GPIO_TypeDef* CAN_EN_GPIO_Port;
         MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_SET);
     }
@@ -402,6 +455,7 @@ TEST_GROUP(RespShutdown) {
         MockErrors_Reset();
         MockPower_Reset();
         MockQueue_ResetFreeRTOS();
+        ResetShutdownStateMachine();
         queuesInitialized = false;  /* Reset so next test recreates queues */
     }
 };
@@ -409,18 +463,19 @@ TEST_GROUP(RespShutdown) {
 bool TEST_GROUP_CppUTestGroupRespShutdown::queuesInitialized = false;
 
 TEST(RespShutdown, BusActive_DoesNotShutdown) {
-    /* Bus active (CAN_EN pin HIGH) - should NOT shutdown */
+    /* Bus active (CAN_EN pin LOW) - should NOT shutdown yet */
     extern GPIO_TypeDef* CAN_EN_GPIO_Port;
     MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_RESET);
 
     RespShutdown(&message, &deviceSpec);
 
-    /* Should NOT enter STANDBY */
+    /* Should NOT enter STANDBY, but is waiting for the bus to drop */
     CHECK_FALSE(MockPower_GetStandbyEntered());
+    CHECK_TRUE(ShutdownPending());
 }
 
 TEST(RespShutdown, BusInactive_Immediately_EntersShutdown) {
-    /* Bus inactive (CAN_EN pin LOW) from first check */
+    /* Bus inactive (CAN_EN pin HIGH) from first check */
     extern GPIO_TypeDef* CAN_EN_GPIO_Port;
     MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_SET);
 
@@ -430,55 +485,48 @@ TEST(RespShutdown, BusInactive_Immediately_EntersShutdown) {
     CHECK_TRUE(MockPower_GetStandbyEntered());
 }
 
-TEST(RespShutdown, BusGoesInactive_AfterRetries_EntersShutdown) {
-    /* Simulate bus becoming inactive after 10 attempts */
+TEST(RespShutdown, DoesNotBlock) {
     extern GPIO_TypeDef* CAN_EN_GPIO_Port;
-
-    /* Start with bus active */
     MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_RESET);
 
-    /* Note: We can't easily test retry logic without modifying the mock to
-     * change value mid-function. This test verifies immediate shutdown works. */
-    MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_SET);
-
     RespShutdown(&message, &deviceSpec);
 
-    CHECK_TRUE(MockPower_GetStandbyEntered());
+    /* CANTask carries on handling frames while the bus shutdown is pending */
+    CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
 }
 
-TEST(RespShutdown, Timeout_After20Attempts) {
-    /* Bus stays active for all 20 attempts */
+TEST(RespShutdown, BusGoesInactive_Later_EntersShutdown) {
     extern GPIO_TypeDef* CAN_EN_GPIO_Port;
+    MockQueue_SetTickCount(1000);
     MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_RESET);
 
     RespShutdown(&message, &deviceSpec);
-
-    /* Should timeout and NOT shutdown */
+    ServiceShutdown(1000 + TIMEOUT_1S_TICKS);
     CHECK_FALSE(MockPower_GetStandbyEntered());
 
-    /* Should have delayed 20 times (20 * 100ms = 2 seconds) */
-    CHECK_EQUAL(20, MockQueue_GetDelayCallCount());
-    CHECK_EQUAL(20 * 100, MockQueue_GetTotalDelayTicks());
-}
+    /* Controller drops CAN_EN partway through the wait */
+    MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_SET);
+    ServiceShutdown(1000 + TIMEOUT_1S_TICKS + 1);
 
-// TEST(RespShutdown, ShutdownClearsFatalError) {
-//     /* Bus inactive */
-//     extern GPIO_TypeDef* CAN_EN_GPIO_Port;
-//     MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_SET);
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+}
 
-//     RespShutdown(&message, &deviceSpec);
+TEST(RespShutdown, Timeout_After2Seconds) {
+    /* Bus stays active for the whole wait */
+    extern GPIO_TypeDef* CAN_EN_GPIO_Port;
+    MockQueue_SetTickCount(1000);
+    MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_RESET);
 
-//     /* Shutdown() should have been called, which resets fatal error
-//      * We can verify this by checking that the system entered STANDBY */
-//     CHECK_TRUE(MockPower_GetStandbyEntered());
+    RespShutdown(&message, &deviceSpec);
+    ServiceShutdown(1000 + TIMEOUT_2S_TICKS - 1);
+    CHECK_TRUE(ShutdownPending());
 
-//     /* Verify GPIO pull-up/down config was enabled */
-//     CHECK_TRUE(MockPower_GetPullUpDownConfigEnabled());
+    ServiceShutdown(1000 + TIMEOUT_2S_TICKS);
 
-//     /* Verify 14 GPIO pins configured (8 RGB + 4 alert + CAN_EN + PWR_BUS) */
-//     CHECK_EQUAL(12, MockPower_GetPullDownCallCount());  /* 12 pull-downs */
-//     CHECK_EQUAL(1, MockPower_GetPullUpCallCount());     /* 1 pull-up (CAN_EN) */
-// }
+    /* Should timeout and NOT shutdown */
+    CHECK_FALSE(ShutdownPending());
+    CHECK_FALSE(MockPower_GetStandbyEntered());
+}
 
 TEST(RespShutdown, DeviceSpecUnused) {
     extern GPIO_TypeDef* CAN_EN_GPIO_Port;
@@ -506,14 +554,12 @@ TEST_GROUP(RespSerialNumber) {
         MockPower_Reset();
 
         if (!queuesInitialized) {
-            InitRXQueue();
             MockQueue_InitApplicationQueues();
             queuesInitialized = true;
         }
 
-        message = {0};
+        message = {};
         message.id = CAN_SERIAL_NUMBER_ID;
-        message.type = "CAN_SERIAL_NUMBER";
 
         deviceSpec.name = "TestHUD";
         deviceSpec.type = DIVECAN_MONITOR;
@@ -571,6 +617,805 @@ TEST(RespSerialNumber, DeviceSpecUnused) {
     RespSerialNumber(&message, NULL);
 }
 
+/* Test Group: BusStateHandlers - State-like frames decoded into the bus state */
+TEST_GROUP(BusStateHandlers) {
+    DiveCANMessage_t message;
+    DiveCANDevice_t deviceSpec;
+
+    void setup() {
+        MockCAN_Reset();
+        ResetBusState();
+
+        message = {};
+        deviceSpec.name = "TestHUD";
+        deviceSpec.type = DIVECAN_MONITOR;
+        deviceSpec.manufacturerID = DIVECAN_MANUFACTURER_ISC;
+        deviceSpec.firmwareVersion = 1;
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        ResetBusState();
+    }
+
+    /* Dispatch as CANTask would, and read back what any task would see */
+    BusState_t dispatch(uint32_t id, Timestamp_t rxTick) {
+        message.id = id;
+        DispatchStampedMessage(&message, &deviceSpec, 0, rxTick);
+        BusState_t state = {};
+        ReadBusState(&state);
+        return state;
+    }
+};
+
+TEST(BusStateHandlers, Setpoint_Decoded) {
+    message.data[0] = 130;
+
+    const BusState_t state = dispatch(PPO2_SETPOINT_ID | DIVECAN_CONTROLLER, 500);
+
+    CHECK_EQUAL(130, state.setpoint);
+    CHECK_EQUAL(500, state.rxTick[BUS_STATE_SETPOINT]);
+    CHECK_EQUAL(1U << BUS_STATE_SETPOINT, state.validMask);
+}
+
+TEST(BusStateHandlers, Diving_Decoded) {
+    message.data[0] = 1;
+    message.data[1] = 0x12; /* Dive number, not kept */
+    BusState_t state = dispatch(DIVING_ID | DIVECAN_CONTROLLER, 10);
+    CHECK_TRUE(state.diving);
+
+    message.data[0] = 0;
+    state = dispatch(DIVING_ID | DIVECAN_CONTROLLER, 20);
+    CHECK_FALSE(state.diving);
+    CHECK_EQUAL(20, state.rxTick[BUS_STATE_DIVING]);
+}
+
+TEST(BusStateHandlers, Atmos_BigEndianMillibar) {
+    message.data[2] = 0x03;
+    message.data[3] = 0xF5;
+
+    const BusState_t state = dispatch(PPO2_ATMOS_ID | DIVECAN_CONTROLLER, 30);
+
+    CHECK_EQUAL(1013, state.atmosPressure);
+    CHECK_EQUAL(30, state.rxTick[BUS_STATE_ATMOS]);
+}
+
+TEST(BusStateHandlers, Millivolts_PairPerCell) {
+    const uint8_t data[8] = {0x12, 0x34, 0x00, 0x10, 0xFF, 0xFE, 0, 0};
+    memcpy(message.data, data, sizeof(data));
+
+    const BusState_t state = dispatch(PPO2_MILLIS_ID | DIVECAN_SOLO, 40);
+
+    CHECK_EQUAL(0x1234, state.millivolts[0]);
+    CHECK_EQUAL(0x0010, state.millivolts[1]);
+    CHECK_EQUAL(0xFFFE, state.millivolts[2]);
+    CHECK_EQUAL(40, state.rxTick[BUS_STATE_MILLIS]);
+}
+
+/* Not decoded yet, the whole payload is kept as sent with its tick */
+TEST(BusStateHandlers, TankPressure_KeptRaw) {
+    const uint8_t data[8] = {0xDE, 0xAD, 0xBE, 0xEF, 0x01, 0x02, 0x03, 0x04};
+    memcpy(message.data, data, sizeof(data));
+    message.length = 8;
+
+    const BusState_t state = dispatch(TANK_PRESSURE_ID | DIVECAN_CONTROLLER, 50);
+
+    MEMCMP_EQUAL(data, state.tankPressure, BUS_STATE_TANK_PRESSURE_BYTES);
+    CHECK_EQUAL(8, state.tankPressureLength);
+    CHECK_EQUAL(50, state.rxTick[BUS_STATE_TANK_PRESSURE]);
+    CHECK_TRUE(0 != (state.validMask & (1U << BUS_STATE_TANK_PRESSURE)));
+}
+
+/* A short frame doesn't leave bytes from the one before it */
+TEST(BusStateHandlers, TankPressure_ShortFrameZeroFilled) {
+    memset(message.data, 0xAA, sizeof(message.data));
+    message.length = 8;
+    (void)dispatch(TANK_PRESSURE_ID | DIVECAN_CONTROLLER, 50);
+
+    const uint8_t data[8] = {0x11, 0x22, 0x33, 0, 0, 0, 0, 0};
+    memcpy(message.data, data, sizeof(data));
+    message.length = 3;
+    const BusState_t state = dispatch(TANK_PRESSURE_ID | DIVECAN_CONTROLLER, 60);
+
+    MEMCMP_EQUAL(data, state.tankPressure, BUS_STATE_TANK_PRESSURE_BYTES);
+    CHECK_EQUAL(3, state.tankPressureLength);
+    CHECK_EQUAL(60, state.rxTick[BUS_STATE_TANK_PRESSURE]);
+}
+
+TEST(BusStateHandlers, BusStatus_Decoded) {
+    message.data[0] = 74;
+    message.data[5] = 130;
+    message.data[7] = DIVECAN_ERR_NONE;
+
+    const BusState_t state = dispatch(BUS_STATUS_ID | DIVECAN_SOLO, 60);
+
+    CHECK_EQUAL(74, state.batteryVoltage);
+    CHECK_EQUAL(130, state.statusSetpoint);
+    CHECK_EQUAL(DIVECAN_ERR_NONE, state.statusError);
+    CHECK_EQUAL(60, state.rxTick[BUS_STATE_STATUS]);
+}
+
+/* Each frame only stamps its own field */
+TEST(BusStateHandlers, FieldsStampedSeparately) {
+    message.data[0] = 70;
+    (void)dispatch(PPO2_SETPOINT_ID | DIVECAN_CONTROLLER, 100);
+    message.data[0] = 1;
+    const BusState_t state = dispatch(DIVING_ID | DIVECAN_CONTROLLER, 200);
+
+    CHECK_EQUAL(70, state.setpoint);
+    CHECK_EQUAL(100, state.rxTick[BUS_STATE_SETPOINT]);
+    CHECK_EQUAL(200, state.rxTick[BUS_STATE_DIVING]);
+    CHECK_EQUAL((1U << BUS_STATE_SETPOINT) | (1U << BUS_STATE_DIVING), state.validMask);
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+}
+
+/* Test Group: DispatchTable - Type byte keyed handler lookup */
+TEST_GROUP(DispatchTable) {
+    static bool queuesInitialized;
+    DiveCANMessage_t message;
+    DiveCANDevice_t deviceSpec;
+
+    void setup() {
+        if (queuesInitialized) {
+            MockQueue_ClearAllQueues();
+        }
+
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockPower_Reset();
+        ResetDiveCANDispatchCounts();
+
+        if (!queuesInitialized) {
+            MockQueue_InitApplicationQueues();
+            queuesInitialized = true;
+        }
+
+        message = {};
+
+        deviceSpec.name = "TestHUD";
+        deviceSpec.type = DIVECAN_MONITOR;
+        deviceSpec.manufacturerID = DIVECAN_MANUFACTURER_ISC;
+        deviceSpec.firmwareVersion = 10;
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockPower_Reset();
+        MockQueue_ResetFreeRTOS();
+        queuesInitialized = false;  /* Reset so next test recreates queues */
+    }
+};
+
+bool TEST_GROUP_CppUTestGroupDispatchTable::queuesInitialized = false;
+
+TEST(DispatchTable, PPO2_ReachesHandler) {
+    message.id = PPO2_PPO2_ID | DIVECAN_SOLO;
+    message.data[1] = 100;
+    message.data[2] = 110;
+    message.data[3] = 95;
+
+    ResetCellSnapshot();
+    DispatchMessage(&message, &deviceSpec);
+
+    CellSnapshot_t snapshot = {};
+    ReadCellSnapshot(&snapshot);
+    CHECK_EQUAL(1, snapshot.sequence);
+    CHECK_EQUAL(110, snapshot.values.C2);
+
+    DiveCANDispatchCount_t count = {0, 0};
+    CHECK_TRUE(GetDiveCANDispatchCount(PPO2_PPO2_ID, &count));
+    CHECK_EQUAL(1, count.hits);
+    CHECK_EQUAL(0, count.filtered);
+}
+
+TEST(DispatchTable, PingFromHead_Answered) {
+    message.id = BUS_ID_ID | DIVECAN_OBOE;
+
+    DispatchMessage(&message, &deviceSpec);
+
+    CHECK_EQUAL(2, MockCAN_GetTxMessageCount());
+}
+
+/* The source filter drops the message before the handler is called, and counts it */
+TEST(DispatchTable, PingFromController_Filtered) {
+    message.id = BUS_ID_ID | DIVECAN_CONTROLLER;
+
+    DispatchMessage(&message, &deviceSpec);
+
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+    DiveCANDispatchCount_t count = {0, 0};
+    CHECK_TRUE(GetDiveCANDispatchCount(BUS_ID_ID, &count));
+    CHECK_EQUAL(0, count.hits);
+    CHECK_EQUAL(1, count.filtered);
+}
+
+/* Known but unhandled types are counted, not reported as unknown */
+TEST(DispatchTable, KnownWithoutHandler_Counted) {
+    message.id = CAL_ID | DIVECAN_SOLO;
+
+    DispatchMessage(&message, &deviceSpec);
+    DispatchMessage(&message, &deviceSpec);
+
+    DiveCANDispatchCount_t count = {0, 0};
+    CHECK_TRUE(GetDiveCANDispatchCount(CAL_ID | DIVECAN_OBOE, &count));
+    CHECK_EQUAL(2, count.hits);
+    CHECK_EQUAL(0, GetDiveCANUnknownCount());
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+}
+
+/* LOG_TEXT shares BUS_ID's type byte, the full ID check keeps it away from RespPing */
+TEST(DispatchTable, TypeByteCollision_FullIdChecked) {
+    message.id = LOG_TEXT_ID | DIVECAN_SOLO;
+
+    DispatchMessage(&message, &deviceSpec);
+
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(1, GetDiveCANUnknownCount());
+    DiveCANDispatchCount_t count = {0, 0};
+    CHECK_FALSE(GetDiveCANDispatchCount(LOG_TEXT_ID, &count));
+    CHECK_TRUE(GetDiveCANDispatchCount(BUS_ID_ID, &count));
+    CHECK_EQUAL(0, count.hits);
+}
+
+TEST(DispatchTable, UnlistedTypeByte_Unknown) {
+    message.id = 0xD0F0000 | DIVECAN_SOLO;
+
+    DispatchMessage(&message, &deviceSpec);
+
+    CHECK_EQUAL(1, GetDiveCANUnknownCount());
+    STRCMP_EQUAL("UNKNOWN", DiveCANMessageName(message.id));
+}
+
+/* Every recognised ID resolves to its own slot, i.e. no two share a type byte */
+TEST(DispatchTable, AllIds_ResolveToThemselves) {
+    const uint32_t ids[] = {BUS_ID_ID, BUS_NAME_ID, BUS_OFF_ID, PPO2_PPO2_ID, HUD_STAT_ID, PPO2_ATMOS_ID,
+                            MENU_ID, TANK_PRESSURE_ID, PPO2_MILLIS_ID, CAL_ID, CAL_REQ_ID, CO2_STATUS_ID,
+                            CO2_ID, CO2_CAL_ID, CO2_CAL_REQ_ID, BUS_MENU_OPEN_ID, BUS_INIT_ID, RMS_TEMP_ID,
+                            RMS_TEMP_ENABLED_ID, PPO2_SETPOINT_ID, PPO2_STATUS_ID, BUS_STATUS_ID, DIVING_ID,
+                            CAN_SERIAL_NUMBER_ID, RX_STATS_REQ_ID, LATENCY_HIST_REQ_ID};
+    for (uint32_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+        DiveCANDispatchCount_t count = {0, 0};
+        CHECK_TRUE(GetDiveCANDispatchCount(ids[i] | DIVECAN_REVO, &count));
+        CHECK_TRUE(strcmp("UNKNOWN", DiveCANMessageName(ids[i])) != 0);
+    }
+}
+
+TEST(DispatchTable, DebugNames) {
+    STRCMP_EQUAL("PPO2_PPO2_ID", DiveCANMessageName(PPO2_PPO2_ID | DIVECAN_SOLO));
+    STRCMP_EQUAL("BUS_OFF_ID", DiveCANMessageName(BUS_OFF_ID));
+    STRCMP_EQUAL("UNKNOWN", DiveCANMessageName(LOG_TEXT_ID));
+}
+
+/* Test Group: RxStats - Per type and source reception statistics */
+TEST_GROUP(RxStats) {
+    DiveCANMessage_t message;
+    DiveCANDevice_t deviceSpec;
+
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        ResetDiveCANDispatchCounts();
+
+        message = {};
+        message.id = PPO2_PPO2_ID | DIVECAN_SOLO;
+
+        deviceSpec.name = "TestHUD";
+        deviceSpec.type = DIVECAN_MONITOR;
+        deviceSpec.manufacturerID = DIVECAN_MANUFACTURER_ISC;
+        deviceSpec.firmwareVersion = 10;
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+};
+
+/* One frame gives a count and a timestamp, but no interval yet */
+TEST(RxStats, FirstFrame_CountOnly) {
+    RecordDiveCANRx(&message, 1234);
+
+    DiveCANRxStat_t stat = {};
+    CHECK_TRUE(GetDiveCANRxStat(PPO2_PPO2_ID | DIVECAN_SOLO, &stat));
+    CHECK_EQUAL(1, stat.count);
+    CHECK_EQUAL(1234, stat.lastTick);
+    CHECK_EQUAL(0, stat.minInterval);
+    CHECK_EQUAL(0, stat.maxInterval);
+    CHECK_EQUAL(0, stat.meanInterval);
+}
+
+/* Min/max track the extremes, the mean moves 1/8 of the way to each new interval */
+TEST(RxStats, Intervals_MinMaxMean) {
+    RecordDiveCANRx(&message, 0);
+    RecordDiveCANRx(&message, 50);
+    RecordDiveCANRx(&message, 100);
+    RecordDiveCANRx(&message, 160);
+
+    DiveCANRxStat_t stat = {};
+    CHECK_TRUE(GetDiveCANRxStat(PPO2_PPO2_ID | DIVECAN_SOLO, &stat));
+    CHECK_EQUAL(4, stat.count);
+    CHECK_EQUAL(50, stat.minInterval);
+    CHECK_EQUAL(60, stat.maxInterval);
+    /* 50 seeds it, 50 leaves it, 60 adds (60 - 50) / 8 = 1.25 */
+    CHECK_EQUAL((50 << DIVECAN_RX_STAT_MEAN_FRAC_BITS) + (10 << DIVECAN_RX_STAT_MEAN_FRAC_BITS) / 8, stat.meanInterval);
+}
+
+/* A faster cadence pulls the mean down */
+TEST(RxStats, Mean_TracksFasterCadence) {
+    RecordDiveCANRx(&message, 0);
+    RecordDiveCANRx(&message, 100);
+    for (uint32_t i = 1; i <= 40; i++) {
+        RecordDiveCANRx(&message, 100 + (i * 20));
+    }
+
+    DiveCANRxStat_t stat = {};
+    (void)GetDiveCANRxStat(message.id, &stat);
+    CHECK_EQUAL(20, stat.minInterval);
+    CHECK_EQUAL(100, stat.maxInterval);
+    CHECK_TRUE(stat.meanInterval < (21U << DIVECAN_RX_STAT_MEAN_FRAC_BITS));
+    CHECK_TRUE(stat.meanInterval >= (20U << DIVECAN_RX_STAT_MEAN_FRAC_BITS));
+}
+
+/* Each source gets its own column, dest bits are ignored */
+TEST(RxStats, PerSource_Separate) {
+    RecordDiveCANRx(&message, 10);
+    message.id = PPO2_PPO2_ID | DIVECAN_OBOE;
+    RecordDiveCANRx(&message, 20);
+    RecordDiveCANRx(&message, 30);
+
+    DiveCANRxStat_t stat = {};
+    (void)GetDiveCANRxStat(PPO2_PPO2_ID | DIVECAN_SOLO, &stat);
+    CHECK_EQUAL(1, stat.count);
+    (void)GetDiveCANRxStat(PPO2_PPO2_ID | (DIVECAN_SOLO << 8) | DIVECAN_OBOE, &stat);
+    CHECK_EQUAL(2, stat.count);
+    CHECK_EQUAL(10, stat.minInterval);
+    (void)GetDiveCANRxStat(PPO2_PPO2_ID | DIVECAN_REVO, &stat);
+    CHECK_EQUAL(0, stat.count);
+}
+
+/* Unrecognised types share the unknown row, still split by source */
+TEST(RxStats, Unknown_SharedRow) {
+    message.id = 0xD0F0000 | DIVECAN_SOLO;
+    RecordDiveCANRx(&message, 10);
+    message.id = LOG_TEXT_ID | DIVECAN_SOLO;
+    RecordDiveCANRx(&message, 15);
+
+    DiveCANRxStat_t stat = {};
+    CHECK_FALSE(GetDiveCANRxStat(0xD0E0000 | DIVECAN_SOLO, &stat));
+    CHECK_EQUAL(2, stat.count);
+    CHECK_EQUAL(5, stat.minInterval);
+    (void)GetDiveCANRxStat(BUS_ID_ID | DIVECAN_SOLO, &stat);
+    CHECK_EQUAL(0, stat.count);
+}
+
+/* The tick counter wrapping between frames still gives the right interval */
+TEST(RxStats, TickWrap) {
+    RecordDiveCANRx(&message, 0xFFFFFFF0U);
+    RecordDiveCANRx(&message, 0x10U);
+
+    DiveCANRxStat_t stat = {};
+    (void)GetDiveCANRxStat(message.id, &stat);
+    CHECK_EQUAL(0x20, stat.minInterval);
+}
+
+/* A gap longer than 16 bits of ticks pins at the maximum rather than wrapping */
+TEST(RxStats, LongGap_Saturates) {
+    RecordDiveCANRx(&message, 0);
+    RecordDiveCANRx(&message, 100000);
+
+    DiveCANRxStat_t stat = {};
+    (void)GetDiveCANRxStat(message.id, &stat);
+    CHECK_EQUAL(UINT16_MAX, stat.maxInterval);
+}
+
+/* A jump in a coalesced slot's sequence counts the frames it skipped as overwritten, against the newest source */
+TEST(RxStats, Coalesced_SequenceGapCountsOverwrites) {
+    CANCoalesced_t latest = {};
+    latest.message = message;
+    latest.timestamp = 10;
+    latest.sequence = 1;
+    RecordDiveCANCoalescedRx(CAN_COALESCED_PPO2_PPO2_ID, &latest);
+    latest.timestamp = 20;
+    latest.sequence = 2;
+    RecordDiveCANCoalescedRx(CAN_COALESCED_PPO2_PPO2_ID, &latest);
+    latest.timestamp = 50;
+    latest.sequence = 5;
+    RecordDiveCANCoalescedRx(CAN_COALESCED_PPO2_PPO2_ID, &latest);
+
+    DiveCANRxStat_t stat = {};
+    (void)GetDiveCANRxStat(message.id, &stat);
+    CHECK_EQUAL(3, stat.count);
+    CHECK_EQUAL(2, stat.overwritten);
+    CHECK_EQUAL(50, stat.lastTick);
+}
+
+/* The debug request is answered with the cell it names, big endian, mean rounded to whole ticks */
+TEST(RxStats, DebugRequest_Replies) {
+    RecordDiveCANRx(&message, 0);
+    RecordDiveCANRx(&message, 50);
+    RecordDiveCANRx(&message, 100);
+    RecordDiveCANRx(&message, 160);
+
+    DiveCANMessage_t request = {};
+    request.id = RX_STATS_REQ_ID | DIVECAN_CONTROLLER;
+    request.length = 2;
+    request.data[0] = DIVECAN_ID_TYPE(PPO2_PPO2_ID);
+    request.data[1] = DIVECAN_SOLO;
+    DispatchMessage(&request, &deviceSpec);
+
+    uint32_t id = 0;
+    uint8_t length = 0;
+    uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_GetLastTxMessage(&id, &length, data));
+    CHECK_EQUAL(RX_STATS_ID | DIVECAN_MONITOR, id);
+    CHECK_EQUAL(8, length);
+    const uint8_t expected[8] = {0, 4, 0, 50, 0, 60, 0, 51};
+    MEMCMP_EQUAL(expected, data, 8);
+}
+
+/* Asking about a type byte we don't list returns the unknown row */
+TEST(RxStats, DebugRequest_UnknownType) {
+    message.id = 0xD0F0000 | DIVECAN_SOLO;
+    RecordDiveCANRx(&message, 10);
+
+    DiveCANMessage_t request = {};
+    request.id = RX_STATS_REQ_ID | DIVECAN_CONTROLLER;
+    request.data[0] = 0x0F;
+    request.data[1] = DIVECAN_SOLO;
+    DispatchMessage(&request, &deviceSpec);
+
+    uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, nullptr, data));
+    CHECK_EQUAL(1, data[1]);
+}
+
+/* Test Group: UnknownIds - Deduplicated reporting of IDs we don't handle */
+TEST_GROUP(UnknownIds) {
+    DiveCANMessage_t message;
+    DiveCANDevice_t deviceSpec;
+
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockPrinter_Reset();
+        MockQueue_SetTickCount(0);
+        ResetDiveCANDispatchCounts();
+
+        message = {};
+        message.id = 0xD0F0000 | DIVECAN_SOLO;
+
+        deviceSpec.name = "TestHUD";
+        deviceSpec.type = DIVECAN_MONITOR;
+        deviceSpec.manufacturerID = DIVECAN_MANUFACTURER_ISC;
+        deviceSpec.firmwareVersion = 10;
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockPrinter_Reset();
+    }
+
+    void dispatchAt(uint32_t tick, uint32_t id) {
+        MockQueue_SetTickCount(tick);
+        message.id = id;
+        DispatchMessage(&message, &deviceSpec);
+    }
+};
+
+/* A new ID is logged once, repeats are only counted */
+TEST(UnknownIds, NewId_LoggedOnce) {
+    dispatchAt(10, 0xD0F0000 | DIVECAN_SOLO);
+    dispatchAt(20, 0xD0F0000 | DIVECAN_SOLO);
+    dispatchAt(35, 0xD0F0000 | DIVECAN_SOLO);
+
+    CHECK_EQUAL(1, MockPrinter_GetCallCount());
+    CHECK_EQUAL(3, GetDiveCANUnknownCount());
+
+    DiveCANUnknownId_t unknown = {};
+    CHECK_TRUE(GetDiveCANUnknownId(0xD0F0000 | DIVECAN_SOLO, &unknown));
+    CHECK_EQUAL(0xD0F0000 | DIVECAN_SOLO, unknown.id);
+    CHECK_EQUAL(3, unknown.count);
+    CHECK_EQUAL(10, unknown.firstTick);
+    CHECK_EQUAL(35, unknown.lastTick);
+}
+
+/* Same type from another device is its own entry */
+TEST(UnknownIds, PerFullId) {
+    dispatchAt(0, 0xD0F0000 | DIVECAN_SOLO);
+    dispatchAt(0, 0xD0F0000 | DIVECAN_OBOE);
+    dispatchAt(0, LOG_TEXT_ID | DIVECAN_SOLO);
+
+    CHECK_EQUAL(3, MockPrinter_GetCallCount());
+    DiveCANUnknownId_t unknown = {};
+    CHECK_TRUE(GetDiveCANUnknownId(0xD0F0000 | DIVECAN_OBOE, &unknown));
+    CHECK_EQUAL(1, unknown.count);
+    CHECK_FALSE(GetDiveCANUnknownId(0xD0F0000 | DIVECAN_REVO, &unknown));
+    CHECK_EQUAL(0, unknown.count);
+}
+
+/* Known IDs never touch the set */
+TEST(UnknownIds, KnownIds_NotTracked) {
+    dispatchAt(0, BUS_NAME_ID | DIVECAN_SOLO);
+
+    DiveCANUnknownId_t unknown = {};
+    CHECK_FALSE(GetDiveCANUnknownId(BUS_NAME_ID | DIVECAN_SOLO, &unknown));
+    CHECK_EQUAL(0, MockPrinter_GetCallCount());
+}
+
+/* Once the set is full new IDs are counted but not logged, the tracked ones carry on */
+TEST(UnknownIds, Full_Overflows) {
+    for (uint32_t i = 0; i < DIVECAN_UNKNOWN_ID_SLOTS + 3U; i++) {
+        dispatchAt(0, 0xE000000 | (i << 8));
+    }
+    CHECK_EQUAL(DIVECAN_UNKNOWN_ID_SLOTS, MockPrinter_GetCallCount());
+    CHECK_EQUAL(3, GetDiveCANUnknownOverflow());
+
+    /* Every tracked ID is still found through the probe chain */
+    for (uint32_t i = 0; i < DIVECAN_UNKNOWN_ID_SLOTS; i++) {
+        DiveCANUnknownId_t unknown = {};
+        CHECK_TRUE(GetDiveCANUnknownId(0xE000000 | (i << 8), &unknown));
+    }
+    dispatchAt(0, 0xE000000);
+    DiveCANUnknownId_t unknown = {};
+    (void)GetDiveCANUnknownId(0xE000000, &unknown);
+    CHECK_EQUAL(2, unknown.count);
+    CHECK_EQUAL(3, GetDiveCANUnknownOverflow());
+}
+
+/* The summary is periodic and only mentions IDs that have been seen since the last one */
+TEST(UnknownIds, Summary_PeriodicChangedOnly) {
+    dispatchAt(0, 0xD0F0000 | DIVECAN_SOLO);
+    dispatchAt(0, 0xD0E0000 | DIVECAN_SOLO);
+    MockPrinter_Reset();
+
+    ReportDiveCANUnknownIds(DIVECAN_UNKNOWN_SUMMARY_MS - 1U);
+    CHECK_EQUAL(0, MockPrinter_GetCallCount());
+
+    ReportDiveCANUnknownIds(DIVECAN_UNKNOWN_SUMMARY_MS);
+    CHECK_EQUAL(2, MockPrinter_GetCallCount());
+
+    /* Only one of them is heard from again */
+    dispatchAt(DIVECAN_UNKNOWN_SUMMARY_MS + 5U, 0xD0E0000 | DIVECAN_SOLO);
+    MockPrinter_Reset();
+    ReportDiveCANUnknownIds(DIVECAN_UNKNOWN_SUMMARY_MS * 2U);
+    CHECK_EQUAL(1, MockPrinter_GetCallCount());
+
+    /* Nothing new, nothing logged */
+    MockPrinter_Reset();
+    ReportDiveCANUnknownIds(DIVECAN_UNKNOWN_SUMMARY_MS * 3U);
+    CHECK_EQUAL(0, MockPrinter_GetCallCount());
+}
+
+/* Test Group: LatencyHistogram - PPO2 frame to LED latency */
+TEST_GROUP(LatencyHistogram) {
+    DiveCANDevice_t deviceSpec;
+
+    void setup() {
+        MockCAN_Reset();
+        MockCore_Reset();
+        ResetPPO2LatencyHistogram();
+
+        deviceSpec.name = "TestHUD";
+        deviceSpec.type = DIVECAN_MONITOR;
+        deviceSpec.manufacturerID = DIVECAN_MANUFACTURER_ISC;
+        deviceSpec.firmwareVersion = 10;
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockCore_Reset();
+    }
+
+    /* Record a render the given number of microseconds after a frame stamped at rxCycles */
+    void renderAfter(uint32_t rxCycles, uint32_t micros) {
+        MockDWT.CYCCNT = rxCycles + (micros * (SystemCoreClock / 1000000U));
+        RecordPPO2RenderLatency(rxCycles);
+    }
+};
+
+/* Bucket is the bit length of the latency in microseconds */
+TEST(LatencyHistogram, Log2Buckets) {
+    renderAfter(1000, 0);
+    renderAfter(1000, 1);
+    renderAfter(1000, 2);
+    renderAfter(1000, 3);
+    renderAfter(1000, 4);
+    renderAfter(1000, 250000);
+
+    PPO2LatencyHistogram_t histogram = {};
+    GetPPO2LatencyHistogram(&histogram);
+    CHECK_EQUAL(1, histogram.buckets[0]);
+    CHECK_EQUAL(1, histogram.buckets[1]);
+    CHECK_EQUAL(2, histogram.buckets[2]);
+    CHECK_EQUAL(1, histogram.buckets[3]);
+    /* 250ms is 18 bits of microseconds */
+    CHECK_EQUAL(1, histogram.buckets[18]);
+}
+
+/* Partial microseconds round down */
+TEST(LatencyHistogram, SubMicrosecond) {
+    MockDWT.CYCCNT = 15;
+    RecordPPO2RenderLatency(0);
+
+    PPO2LatencyHistogram_t histogram = {};
+    GetPPO2LatencyHistogram(&histogram);
+    CHECK_EQUAL(1, histogram.buckets[0]);
+}
+
+/* The cycle counter wrapping between RX and render still gives the right latency */
+TEST(LatencyHistogram, CycleCounterWrap) {
+    renderAfter(0xFFFFFF00U, 100);
+
+    PPO2LatencyHistogram_t histogram = {};
+    GetPPO2LatencyHistogram(&histogram);
+    CHECK_EQUAL(1, histogram.buckets[7]);
+}
+
+/* Anything longer than the histogram covers lands in the last bucket */
+TEST(LatencyHistogram, LastBucketCatchesOverflow) {
+    SystemCoreClock = 1000000U;
+    MockDWT.CYCCNT = 0xFFFFFFFFU;
+    RecordPPO2RenderLatency(0);
+
+    PPO2LatencyHistogram_t histogram = {};
+    GetPPO2LatencyHistogram(&histogram);
+    CHECK_EQUAL(1, histogram.buckets[PPO2_LATENCY_BUCKET_COUNT - 1]);
+}
+
+/* The debug request names the first of 4 buckets, replied big endian */
+TEST(LatencyHistogram, DebugRequest_Replies) {
+    renderAfter(0, 1);
+    renderAfter(0, 2);
+    renderAfter(0, 3);
+    renderAfter(0, 1000);
+
+    DiveCANMessage_t request = {};
+    request.id = LATENCY_HIST_REQ_ID | DIVECAN_CONTROLLER;
+    request.length = 1;
+    request.data[0] = 1;
+    DispatchMessage(&request, &deviceSpec);
+
+    uint32_t id = 0;
+    uint8_t length = 0;
+    uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_GetLastTxMessage(&id, &length, data));
+    CHECK_EQUAL(LATENCY_HIST_ID | DIVECAN_MONITOR, id);
+    CHECK_EQUAL(8, length);
+    const uint8_t expected[8] = {0, 1, 0, 2, 0, 0, 0, 0};
+    MEMCMP_EQUAL(expected, data, 8);
+
+    request.data[0] = 8;
+    DispatchMessage(&request, &deviceSpec);
+    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, nullptr, data));
+    const uint8_t expectedHigh[8] = {0, 0, 0, 0, 0, 1, 0, 0};
+    MEMCMP_EQUAL(expectedHigh, data, 8);
+}
+
+/* Buckets past the end of the histogram read as 0 */
+TEST(LatencyHistogram, DebugRequest_PastEnd) {
+    SystemCoreClock = 1000000U;
+    MockDWT.CYCCNT = 0xFFFFFFFFU;
+    RecordPPO2RenderLatency(0);
+
+    DiveCANMessage_t request = {};
+    request.id = LATENCY_HIST_REQ_ID | DIVECAN_CONTROLLER;
+    request.data[0] = PPO2_LATENCY_BUCKET_COUNT - 1;
+    DispatchMessage(&request, &deviceSpec);
+
+    uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, nullptr, data));
+    const uint8_t expected[8] = {0, 1, 0, 0, 0, 0, 0, 0};
+    MEMCMP_EQUAL(expected, data, 8);
+}
+
+/* Test Group: SnifferRequests - bus sniffer control and download over DiveCAN */
+TEST_GROUP(SnifferRequests) {
+    DiveCANDevice_t deviceSpec;
+
+    void setup() {
+        MockCAN_Reset();
+        MockFlash_Reset();
+        ResetCANTxRing();
+        ResetCANSniffer();
+
+        deviceSpec.name = "TestHUD";
+        deviceSpec.type = DIVECAN_MONITOR;
+        deviceSpec.manufacturerID = DIVECAN_MANUFACTURER_ISC;
+        deviceSpec.firmwareVersion = 10;
+
+        /* Recognisable ring contents, byte n is n & 0xFF */
+        for (uint32_t i = 0; i < GetCANSnifferFlashSize(); ++i) {
+            *MockFlash_Memory(SNIFFER_TEST_FLASH_BASE + i) = (uint8_t)i;
+        }
+    }
+
+    void teardown() {
+        ResetCANSniffer();
+        ResetCANRxRing();
+        ResetCANTxRing();
+        MockCAN_Reset();
+    }
+
+    void request(uint32_t id, uint8_t length, uint8_t byte0, uint8_t byte1, uint8_t byte2) {
+        DiveCANMessage_t message = {};
+        message.id = id | DIVECAN_CONTROLLER;
+        message.length = length;
+        message.data[0] = byte0;
+        message.data[1] = byte1;
+        message.data[2] = byte2;
+        DispatchMessage(&message, &deviceSpec);
+    }
+};
+
+/* Status replies active flag then frames, dropped and blocks big endian */
+TEST(SnifferRequests, Status_Replies) {
+    request(SNIFFER_REQ_ID, 1, 2, 0, 0);
+
+    uint32_t id = 0;
+    uint8_t length = 0;
+    uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_GetLastTxMessage(&id, &length, data));
+    CHECK_EQUAL(SNIFFER_STATUS_ID | DIVECAN_MONITOR, id);
+    CHECK_EQUAL(7, length);
+    const uint8_t expected[7] = {0, 0, 0, 0, 0, 0, 0};
+    MEMCMP_EQUAL(expected, data, 7);
+}
+
+/* A start takes the controller silent, so it gets no reply, and a stop puts it back */
+TEST(SnifferRequests, StartStop) {
+    request(SNIFFER_REQ_ID, 1, 1, 0, 0);
+    CHECK_TRUE(CANListenOnly());
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+
+    request(SNIFFER_REQ_ID, 1, 0, 0, 0);
+    CHECK_FALSE(CANListenOnly());
+    uint32_t id = 0;
+    uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_GetLastTxMessage(&id, nullptr, data));
+    CHECK_EQUAL(SNIFFER_STATUS_ID | DIVECAN_MONITOR, id);
+    CHECK_EQUAL(0, data[0]);
+}
+
+/* Each chunk is its index big endian then 6 bytes of the ring */
+TEST(SnifferRequests, Read_Chunks) {
+    request(SNIFFER_READ_REQ_ID, 3, 0x01, 0x00, 3);
+
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+    for (uint32_t i = 0; i < 3; ++i) {
+        uint32_t id = 0;
+        uint8_t length = 0;
+        uint8_t data[8] = {0};
+        CHECK_TRUE(MockCAN_GetTxMessageAt(i, &id, &length, data));
+        CHECK_EQUAL(SNIFFER_DATA_ID | DIVECAN_MONITOR, id);
+        CHECK_EQUAL(8, length);
+        const uint32_t chunk = 0x100U + i;
+        CHECK_EQUAL(chunk >> 8, data[0]);
+        CHECK_EQUAL(chunk & 0xFFU, data[1]);
+        CHECK_EQUAL((uint8_t)(chunk * SNIFFER_CHUNK_LEN), data[2]);
+        CHECK_EQUAL((uint8_t)(chunk * SNIFFER_CHUNK_LEN + 5U), data[7]);
+    }
+}
+
+/* The last chunk of the ring is short and nothing past it is sent */
+TEST(SnifferRequests, Read_EndOfRing) {
+    const uint32_t lastChunk = GetCANSnifferFlashSize() / SNIFFER_CHUNK_LEN;
+    request(SNIFFER_READ_REQ_ID, 3, (uint8_t)(lastChunk >> 8), (uint8_t)lastChunk, 4);
+
+    CHECK_EQUAL(1, MockCAN_GetTxMessageCount());
+    uint8_t length = 0;
+    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, &length, nullptr));
+    CHECK_EQUAL(2 + (GetCANSnifferFlashSize() % SNIFFER_CHUNK_LEN), length);
+}
+
+/* Nothing can be read back while recording */
+TEST(SnifferRequests, Read_RefusedWhileRecording) {
+    StartCANSniffer();
+    request(SNIFFER_READ_REQ_ID, 3, 0, 0, 1);
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+}
+
 /* Main runner */
 int main(int argc, char** argv) {
     return CommandLineTestRunner::RunAllTests(argc, argv);
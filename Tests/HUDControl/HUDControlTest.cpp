@@ -8,7 +8,7 @@
  * - Alert detection for dangerous PPO2 levels
  * - Cell failure detection (0xFF values)
  * - Status mask and fail mask handling
- * - Queue empty handling
+ * - No data and stale data handling
  */
 
 #include "CppUTest/TestHarness.h"
@@ -21,6 +21,7 @@
 extern "C" {
     #include "HUDControl.h"
     #include "DiveCAN/DiveCAN.h"
+    #include "DiveCAN/CellSnapshot.h"
     #include "common.h"
 }
 
@@ -42,10 +43,13 @@ TEST_GROUP(HUDControl)
 
         MockQueue_Reset();
         MockLEDs_Reset();
+        ResetCellSnapshot();
+        ResetPPO2Blink();
 
         cellValues.C1 = 0;
         cellValues.C2 = 0;
         cellValues.C3 = 0;
+        cellValues.rxCycles = 0;
         alerting = false;
     }
 
@@ -55,20 +59,21 @@ TEST_GROUP(HUDControl)
         MockLEDs_Reset();
     }
 
-    /* Helper to put PPO2 data into the queue */
-    void enqueuePPO2(int16_t c1, int16_t c2, int16_t c3)
+    /* Helper to publish PPO2 data as CANTask would, arriving now */
+    void publishPPO2(int16_t c1, int16_t c2, int16_t c3, uint32_t rxCycles = 0)
     {
         CellValues_t values;
         values.C1 = c1;
         values.C2 = c2;
         values.C3 = c3;
-        osMessageQueuePut(PPO2QueueHandle, &values, 0, 0);
+        values.rxCycles = rxCycles;
+        PublishCellValues(&values, DIVECAN_SOLO, osKernelGetTickCount());
     }
 
-    /* Helper to put cell status into the queue */
-    void enqueueCellStatus(uint8_t status)
+    /* Helper to publish cell status as CANTask would, arriving now */
+    void publishCellStatus(uint8_t status)
     {
-        osMessageQueuePut(CellStatQueueHandle, &status, 0, 0);
+        PublishCellStatus(status, osKernelGetTickCount());
     }
 };
 
@@ -201,12 +206,12 @@ TEST(CellAlert, FailureValueAlerting)
  * - Normal operation
  * - Alert conditions
  * - Cell failures
- * - Empty queue handling
+ * - No data handling
  */
 
-TEST(HUDControl, EmptyQueueCallsBlinkNoData)
+TEST(HUDControl, NoDataCallsBlinkNoData)
 {
-    /* Queue is empty, should call blinkNoData() AND blinkCode() with current cellValues */
+    /* Nothing published yet, should call blinkNoData() AND blinkCode() with current cellValues */
     PPO2Blink(&cellValues, &alerting);
 
     /* Both blinkNoData and blinkCode should be called */
@@ -226,7 +231,7 @@ TEST(HUDControl, EmptyQueueCallsBlinkNoData)
 TEST(HUDControl, NormalPPO2AtSetpoint)
 {
     /* All cells at setpoint (100 = 1.0 bar) */
-    enqueuePPO2(100, 100, 100);
+    publishPPO2(100, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -246,12 +251,37 @@ TEST(HUDControl, NormalPPO2AtSetpoint)
     CHECK_FALSE(alerting);
 }
 
+TEST(HUDControl, FreshPPO2RecordsRenderLatencyBeforeBlink)
+{
+    publishPPO2(100, 100, 100, 0x12345678);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_EQUAL(1, MockLEDs_GetRenderLatencyCallCount());
+    CHECK_EQUAL(0x12345678, MockLEDs_GetLastRenderLatencyRxCycles());
+    /* Recorded as the value goes to the LEDs, not after the blink sequence has played out */
+    CHECK_EQUAL(0, MockLEDs_GetBlinkCodeCountAtRenderLatency());
+    CHECK_EQUAL(1, MockLEDs_GetBlinkCodeCallCount());
+}
+
+TEST(HUDControl, StalePPO2DoesNotRecordRenderLatency)
+{
+    publishPPO2(100, 100, 100, 42);
+    PPO2Blink(&cellValues, &alerting);
+
+    /* Nothing new published, the same value gets shown again */
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_EQUAL(1, MockLEDs_GetRenderLatencyCallCount());
+    CHECK_EQUAL(2, MockLEDs_GetBlinkCodeCallCount());
+}
+
 TEST(HUDControl, PositiveDeviationRoundsCorrectly)
 {
     /* C1 = 115 -> deviation = +15 -> div10_round(15) = +2 (rounds up) */
     /* C2 = 110 -> deviation = +10 -> div10_round(10) = +1 */
     /* C3 = 104 -> deviation = +4 -> div10_round(4) = 0 (rounds down) */
-    enqueuePPO2(115, 110, 104);
+    publishPPO2(115, 110, 104);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -269,7 +299,7 @@ TEST(HUDControl, NegativeDeviationRoundsCorrectly)
     /* C1 = 85 -> deviation = -15 -> div10_round(-15) = -2 (rounds away from zero) */
     /* C2 = 90 -> deviation = -10 -> div10_round(-10) = -1 */
     /* C3 = 96 -> deviation = -4 -> div10_round(-4) = 0 */
-    enqueuePPO2(85, 90, 96);
+    publishPPO2(85, 90, 96);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -285,7 +315,7 @@ TEST(HUDControl, NegativeDeviationRoundsCorrectly)
 TEST(HUDControl, LowPPO2TriggersAlert)
 {
     /* C1 = 39 (< 40) should trigger alert, but still call blinkCode() */
-    enqueuePPO2(39, 100, 100);
+    publishPPO2(39, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -298,7 +328,7 @@ TEST(HUDControl, LowPPO2TriggersAlert)
 TEST(HUDControl, HighPPO2TriggersAlert)
 {
     /* C2 = 166 (> 165) should trigger alert, but still call blinkCode() */
-    enqueuePPO2(100, 166, 100);
+    publishPPO2(100, 166, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -310,7 +340,7 @@ TEST(HUDControl, HighPPO2TriggersAlert)
 TEST(HUDControl, MultipleCellsAlertingTriggersAlert)
 {
     /* C1 = 30, C3 = 170 - both alerting, but still calls blinkCode() */
-    enqueuePPO2(30, 100, 170);
+    publishPPO2(30, 100, 170);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -321,7 +351,7 @@ TEST(HUDControl, MultipleCellsAlertingTriggersAlert)
 
 TEST(HUDControl, AlertBoundaryCondition_39ShouldAlert)
 {
-    enqueuePPO2(39, 100, 100);
+    publishPPO2(39, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -332,7 +362,7 @@ TEST(HUDControl, AlertBoundaryCondition_39ShouldAlert)
 
 TEST(HUDControl, AlertBoundaryCondition_40ShouldNotAlert)
 {
-    enqueuePPO2(40, 100, 100);
+    publishPPO2(40, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -344,7 +374,7 @@ TEST(HUDControl, AlertBoundaryCondition_40ShouldNotAlert)
 
 TEST(HUDControl, AlertBoundaryCondition_165ShouldNotAlert)
 {
-    enqueuePPO2(100, 165, 100);
+    publishPPO2(100, 165, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -356,7 +386,7 @@ TEST(HUDControl, AlertBoundaryCondition_165ShouldNotAlert)
 
 TEST(HUDControl, AlertBoundaryCondition_166ShouldAlert)
 {
-    enqueuePPO2(100, 166, 100);
+    publishPPO2(100, 166, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -369,7 +399,7 @@ TEST(HUDControl, CellFailureDetection_SingleCell)
 {
     /* C1 = 0xFF indicates cell failure
      * Note: 0xFF (255) > 165, so this triggers alert AND shows failMask */
-    enqueuePPO2(0xFF, 100, 100);
+    publishPPO2(0xFF, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -388,7 +418,7 @@ TEST(HUDControl, CellFailureDetection_SingleCell)
 TEST(HUDControl, CellFailureDetection_MultipleCells)
 {
     /* C1 and C3 failed - both 0xFF will trigger alert */
-    enqueuePPO2(0xFF, 100, 0xFF);
+    publishPPO2(0xFF, 100, 0xFF);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -407,7 +437,7 @@ TEST(HUDControl, CellFailureDetection_MultipleCells)
 TEST(HUDControl, CellFailureDetection_AllCells)
 {
     /* All cells failed */
-    enqueuePPO2(0xFF, 0xFF, 0xFF);
+    publishPPO2(0xFF, 0xFF, 0xFF);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -423,11 +453,11 @@ TEST(HUDControl, CellFailureDetection_AllCells)
     CHECK_EQUAL(0b000, failMask);  /* All cells failed */
 }
 
-TEST(HUDControl, StatusMaskFromQueue)
+TEST(HUDControl, StatusMaskFromSnapshot)
 {
-    /* Put custom status mask in queue */
-    enqueuePPO2(100, 100, 100);
-    enqueueCellStatus(0b101);  /* Only C1 and C3 voted */
+    /* Publish custom status mask */
+    publishPPO2(100, 100, 100);
+    publishCellStatus(0b101);  /* Only C1 and C3 voted */
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -438,10 +468,10 @@ TEST(HUDControl, StatusMaskFromQueue)
     CHECK_EQUAL(0b101, statusMask);
 }
 
-TEST(HUDControl, StatusMaskDefaultWhenQueueEmpty)
+TEST(HUDControl, StatusMaskDefaultWhenNoneReceived)
 {
     /* Don't enqueue status, should default to 0b111 */
-    enqueuePPO2(100, 100, 100);
+    publishPPO2(100, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -454,7 +484,7 @@ TEST(HUDControl, StatusMaskDefaultWhenQueueEmpty)
 
 TEST(HUDControl, DelayCalledOnNormalOperation)
 {
-    enqueuePPO2(100, 100, 100);
+    publishPPO2(100, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -465,7 +495,7 @@ TEST(HUDControl, DelayCalledOnNormalOperation)
 
 TEST(HUDControl, NoDelayOnAlert)
 {
-    enqueuePPO2(30, 100, 100);
+    publishPPO2(30, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -473,19 +503,19 @@ TEST(HUDControl, NoDelayOnAlert)
     CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
 }
 
-TEST(HUDControl, NoDelayOnEmptyQueue)
+TEST(HUDControl, NoDelayOnNoData)
 {
-    /* Empty queue */
+    /* Nothing published */
     PPO2Blink(&cellValues, &alerting);
 
-    /* Should NOT call osDelay when queue empty */
+    /* Should NOT call osDelay when there is no data */
     CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
 }
 
 TEST(HUDControl, MaximumPositiveDeviation)
 {
     /* C1 = 255, deviation = +155, div10_round(155) = +16 */
-    enqueuePPO2(255, 100, 100);
+    publishPPO2(255, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -498,7 +528,7 @@ TEST(HUDControl, MaximumPositiveDeviation)
 TEST(HUDControl, MaximumNegativeDeviation)
 {
     /* C1 = 0, deviation = -100, div10_round(-100) = -10 */
-    enqueuePPO2(0, 100, 100);
+    publishPPO2(0, 100, 100);
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -512,8 +542,8 @@ TEST(HUDControl, MixedNormalAndFailedCells)
 {
     /* C2 = 0xFF would trigger alert since 255 > 165.
      * This test verifies mixed values with status mask and failMask */
-    enqueuePPO2(105, 0xFF, 95);
-    enqueueCellStatus(0b101);  /* C1 and C3 voted */
+    publishPPO2(105, 0xFF, 95);
+    publishCellStatus(0b101);  /* C1 and C3 voted */
 
     PPO2Blink(&cellValues, &alerting);
 
@@ -533,12 +563,9 @@ TEST(HUDControl, MixedNormalAndFailedCells)
 /**
  * Integration test: Multiple calls to PPO2Blink
  */
-TEST(HUDControl, MultipleCallsProcessQueueCorrectly)
+TEST(HUDControl, MultipleCallsShowLatestReading)
 {
-
-    /* Enqueue two sets of values */
-    enqueuePPO2(100, 100, 100);
-    enqueuePPO2(110, 110, 110);
+    publishPPO2(100, 100, 100);
 
     /* First call should get first value */
     PPO2Blink(&cellValues, &alerting);
@@ -552,6 +579,7 @@ TEST(HUDControl, MultipleCallsProcessQueueCorrectly)
     CHECK_EQUAL(0, c3);
 
     /* Second call should get second value */
+    publishPPO2(110, 110, 110);
     PPO2Blink(&cellValues, &alerting);
 
     MockLEDs_GetLastBlinkCode(&c1, &c2, &c3, &statusMask, &failMask);
@@ -561,6 +589,263 @@ TEST(HUDControl, MultipleCallsProcessQueueCorrectly)
     CHECK_EQUAL(1, c3);
 }
 
+TEST(HUDControl, OnlyLatestOfSeveralReadingsShown)
+{
+    publishPPO2(100, 100, 100);
+    publishPPO2(110, 110, 110);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    int8_t c1, c2, c3;
+    uint8_t statusMask, failMask;
+    MockLEDs_GetLastBlinkCode(&c1, &c2, &c3, &statusMask, &failMask);
+    CHECK_EQUAL(1, c1);
+    CHECK_EQUAL(1, MockLEDs_GetRenderLatencyCallCount());
+}
+
+/**
+ * Test Group: reading is non-destructive and aged
+ *
+ * Polling twice between frames mustn't read as no data, only the age of the
+ * reading decides that.
+ */
+TEST(HUDControl, RepeatReadStillFresh)
+{
+    publishPPO2(100, 100, 100);
+
+    PPO2Blink(&cellValues, &alerting);
+    MockQueue_SetTickCount(TIMEOUT_1S_TICKS);
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_EQUAL(0, MockLEDs_GetBlinkNoDataCallCount());
+    CHECK_EQUAL(2, MockLEDs_GetBlinkCodeCallCount());
+}
+
+TEST(HUDControl, OldReadingShowsNoData)
+{
+    publishPPO2(110, 110, 110);
+
+    MockQueue_SetTickCount(TIMEOUT_5S_TICKS - 1);
+    PPO2Blink(&cellValues, &alerting);
+    CHECK_EQUAL(0, MockLEDs_GetBlinkNoDataCallCount());
+
+    MockQueue_SetTickCount(TIMEOUT_5S_TICKS);
+    PPO2Blink(&cellValues, &alerting);
+    CHECK_EQUAL(1, MockLEDs_GetBlinkNoDataCallCount());
+
+    /* The last reading is still what gets blinked out */
+    int8_t c1, c2, c3;
+    uint8_t statusMask, failMask;
+    MockLEDs_GetLastBlinkCode(&c1, &c2, &c3, &statusMask, &failMask);
+    CHECK_EQUAL(1, c1);
+}
+
+TEST(HUDControl, StaleAlertingReadingDoesNotAlert)
+{
+    publishPPO2(30, 100, 100);
+    MockQueue_SetTickCount(TIMEOUT_5S_TICKS);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_FALSE(alerting);
+    CHECK_EQUAL(0, MockLEDs_GetBlinkAlarmCallCount());
+    CHECK_EQUAL(1, MockLEDs_GetBlinkNoDataCallCount());
+}
+
+TEST(HUDControl, OldStatusMaskFallsBackToDefault)
+{
+    publishCellStatus(0b011);
+    MockQueue_SetTickCount(TIMEOUT_5S_TICKS);
+    publishPPO2(100, 100, 100);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    int8_t c1, c2, c3;
+    uint8_t statusMask, failMask;
+    MockLEDs_GetLastBlinkCode(&c1, &c2, &c3, &statusMask, &failMask);
+    CHECK_EQUAL(0b111, statusMask);
+}
+
+TEST(HUDControl, StatusMaskKeptAcrossReads)
+{
+    publishPPO2(100, 100, 100);
+    publishCellStatus(0b110);
+
+    PPO2Blink(&cellValues, &alerting);
+    PPO2Blink(&cellValues, &alerting);
+
+    int8_t c1, c2, c3;
+    uint8_t statusMask, failMask;
+    MockLEDs_GetLastBlinkCode(&c1, &c2, &c3, &statusMask, &failMask);
+    CHECK_EQUAL(0b110, statusMask);
+}
+
+/**
+ * Test Group: fresh / aging / stale
+ *
+ * The reading's age since it arrived picks how it is shown, each state
+ * entry is counted.
+ */
+TEST(HUDControl, FreshReading_NoAgeIndication)
+{
+    publishPPO2(100, 100, 100);
+    MockQueue_SetTickCount(TIMEOUT_2S_TICKS - 1);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_EQUAL(0, MockLEDs_GetBlinkAgingCallCount());
+    CHECK_EQUAL(0, MockLEDs_GetBlinkNoDataCallCount());
+}
+
+TEST(HUDControl, AgingReading_ShownWithAgingBlink)
+{
+    publishPPO2(110, 110, 110);
+    MockQueue_SetTickCount(TIMEOUT_2S_TICKS);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_EQUAL(1, MockLEDs_GetBlinkAgingCallCount());
+    CHECK_EQUAL(0, MockLEDs_GetBlinkNoDataCallCount());
+    int8_t c1, c2, c3;
+    uint8_t statusMask, failMask;
+    MockLEDs_GetLastBlinkCode(&c1, &c2, &c3, &statusMask, &failMask);
+    CHECK_EQUAL(1, c1);
+}
+
+TEST(HUDControl, AgingReading_StillAlarms)
+{
+    publishPPO2(30, 100, 100);
+    MockQueue_SetTickCount(TIMEOUT_2S_TICKS);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_TRUE(alerting);
+    CHECK_EQUAL(1, MockLEDs_GetBlinkAgingCallCount());
+    CHECK_EQUAL(1, MockLEDs_GetBlinkAlarmCallCount());
+}
+
+TEST(HUDControl, StaleReading_NoAgingBlink)
+{
+    publishPPO2(100, 100, 100);
+    MockQueue_SetTickCount(TIMEOUT_5S_TICKS);
+
+    PPO2Blink(&cellValues, &alerting);
+
+    CHECK_EQUAL(0, MockLEDs_GetBlinkAgingCallCount());
+    CHECK_EQUAL(1, MockLEDs_GetBlinkNoDataCallCount());
+}
+
+TEST(HUDControl, ClassifyCellAge_Boundaries)
+{
+    CellSnapshot_t snapshot = {};
+    CHECK_EQUAL(CELL_DATA_STALE, ClassifyCellAge(&snapshot, 0));
+
+    snapshot.sequence = 1;
+    snapshot.rxTick = 1000;
+    CHECK_EQUAL(CELL_DATA_FRESH, ClassifyCellAge(&snapshot, 1000));
+    CHECK_EQUAL(CELL_DATA_FRESH, ClassifyCellAge(&snapshot, 1000 + TIMEOUT_2S_TICKS - 1));
+    CHECK_EQUAL(CELL_DATA_AGING, ClassifyCellAge(&snapshot, 1000 + TIMEOUT_2S_TICKS));
+    CHECK_EQUAL(CELL_DATA_AGING, ClassifyCellAge(&snapshot, 1000 + TIMEOUT_5S_TICKS - 1));
+    CHECK_EQUAL(CELL_DATA_STALE, ClassifyCellAge(&snapshot, 1000 + TIMEOUT_5S_TICKS));
+}
+
+TEST(HUDControl, ClassifyCellAge_TickWrap)
+{
+    CellSnapshot_t snapshot = {};
+    snapshot.sequence = 1;
+    snapshot.rxTick = UINT32_MAX - 10;
+
+    CHECK_EQUAL(CELL_DATA_FRESH, ClassifyCellAge(&snapshot, 10));
+    CHECK_EQUAL(CELL_DATA_AGING, ClassifyCellAge(&snapshot, TIMEOUT_2S_TICKS));
+}
+
+TEST(HUDControl, AgeLimits_Configurable)
+{
+    CellAgeLimits_t limits = {};
+    limits.agingTicks = 300;
+    limits.staleTicks = 600;
+    SetCellAgeLimits(&limits);
+
+    CellAgeLimits_t applied = {};
+    GetCellAgeLimits(&applied);
+    CHECK_EQUAL(300, applied.agingTicks);
+    CHECK_EQUAL(600, applied.staleTicks);
+
+    publishPPO2(100, 100, 100);
+    MockQueue_SetTickCount(300);
+    PPO2Blink(&cellValues, &alerting);
+    CHECK_EQUAL(1, MockLEDs_GetBlinkAgingCallCount());
+
+    MockQueue_SetTickCount(600);
+    PPO2Blink(&cellValues, &alerting);
+    CHECK_EQUAL(1, MockLEDs_GetBlinkNoDataCallCount());
+}
+
+TEST(HUDControl, AgeLimits_AgingClampedToStale)
+{
+    CellAgeLimits_t limits = {};
+    limits.agingTicks = 900;
+    limits.staleTicks = 400;
+    SetCellAgeLimits(&limits);
+
+    CellAgeLimits_t applied = {};
+    GetCellAgeLimits(&applied);
+    CHECK_EQUAL(400, applied.agingTicks);
+    CHECK_EQUAL(400, applied.staleTicks);
+}
+
+TEST(HUDControl, AgeLimits_StatusMaskFollowsStale)
+{
+    CellAgeLimits_t limits = {};
+    limits.agingTicks = 100;
+    limits.staleTicks = 200;
+    SetCellAgeLimits(&limits);
+
+    publishCellStatus(0b011);
+    MockQueue_SetTickCount(200);
+    publishPPO2(100, 100, 100);
+    PPO2Blink(&cellValues, &alerting);
+
+    int8_t c1, c2, c3;
+    uint8_t statusMask, failMask;
+    MockLEDs_GetLastBlinkCode(&c1, &c2, &c3, &statusMask, &failMask);
+    CHECK_EQUAL(0b111, statusMask);
+}
+
+TEST(HUDControl, AgeCounts_CountEntriesNotCycles)
+{
+    publishPPO2(100, 100, 100);
+    PPO2Blink(&cellValues, &alerting);
+    PPO2Blink(&cellValues, &alerting);
+
+    MockQueue_SetTickCount(TIMEOUT_2S_TICKS);
+    PPO2Blink(&cellValues, &alerting);
+    PPO2Blink(&cellValues, &alerting);
+
+    MockQueue_SetTickCount(TIMEOUT_5S_TICKS);
+    PPO2Blink(&cellValues, &alerting);
+
+    /* A new frame brings it back */
+    publishPPO2(100, 100, 100);
+    PPO2Blink(&cellValues, &alerting);
+
+    CellAgeCounts_t counts = {};
+    GetCellAgeCounts(&counts);
+    CHECK_EQUAL(2, counts.entries[CELL_DATA_FRESH]);
+    CHECK_EQUAL(1, counts.entries[CELL_DATA_AGING]);
+    CHECK_EQUAL(1, counts.entries[CELL_DATA_STALE]);
+}
+
+TEST(HUDControl, AgeCounts_NoDataAtStartIsStale)
+{
+    PPO2Blink(&cellValues, &alerting);
+
+    CellAgeCounts_t counts = {};
+    GetCellAgeCounts(&counts);
+    CHECK_EQUAL(0, counts.entries[CELL_DATA_FRESH]);
+    CHECK_EQUAL(1, counts.entries[CELL_DATA_STALE]);
+}
+
 int main(int argc, char** argv)
 {
     /* Disable global memory leak detection for this test suite
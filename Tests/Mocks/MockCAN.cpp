@@ -2,8 +2,8 @@
 #include <cstring>
 #include <cstdlib>
 
-/* CAN message storage using simple array */
-#define MAX_CAN_MESSAGES 64
+/* CAN message storage using simple array, big enough for a second of saturated bus */
+#define MAX_CAN_MESSAGES 2048
 
 struct StoredCANMessage {
     uint32_t id;
@@ -20,10 +20,102 @@ static uint32_t txMessageCount = 0;
 static uint32_t failOnCallNumber = 0;  /* 0 = don't fail */
 static uint32_t txCallCount = 0;
 
+/* Filter storage in the order banks were first configured, reconfiguring a bank replaces it in place */
+#define MAX_CAN_FILTERS 28
+static CAN_FilterTypeDef filters[MAX_CAN_FILTERS];
+static uint32_t filterCount = 0;
+static HAL_StatusTypeDef filterStatus = HAL_OK;
+
+/* Hardware RX FIFOs, 3 frames deep each like bxCAN */
+#define MOCK_RX_FIFO_COUNT 2
+#define MOCK_RX_FIFO_DEPTH 3
+struct MockRxFifo {
+    CAN_RxHeaderTypeDef headers[MOCK_RX_FIFO_DEPTH];
+    uint8_t data[MOCK_RX_FIFO_DEPTH][8];
+    uint32_t fill;
+    bool overrun;
+};
+static MockRxFifo rxFifos[MOCK_RX_FIFO_COUNT];
+static uint32_t rxReadCount = 0;
+
+/* MX_CAN1_Init timing: 16MHz APB1, prescaler 8, 1 + 13 + 2 TQ per bit = 125kbit/s */
+#define MOCK_PCLK1_HZ 16000000U
+#define MOCK_CAN_BTR ((1UL << CAN_BTR_TS2_Pos) | (12UL << CAN_BTR_TS1_Pos) | (7UL << CAN_BTR_BRP_Pos))
+static uint32_t pclk1Hz = MOCK_PCLK1_HZ;
+static uint32_t restartCount = 0;
+
+/* Manual TX completion, mailboxes holding a frame in the order they were loaded */
+#define MOCK_TX_MAILBOX_COUNT 3U
+static bool txManualComplete = false;
+static uint32_t txPending[MOCK_TX_MAILBOX_COUNT];
+static uint32_t txPendingCount = 0;
+static int32_t txMailboxMessage[MOCK_TX_MAILBOX_COUNT];
+static int32_t txOnWire = -1;  /* Mailbox whose frame is being transmitted, out of txPending */
+static uint32_t txAbortCount = 0;
+
+/* TSR flags for one mailbox, the RQCP/TXOK/ALST/TERR nibble repeats every 8 bits */
+static uint32_t txMailboxFlags(uint32_t mailbox, uint32_t mailbox0Flags) {
+    return mailbox0Flags << (8U * mailbox);
+}
+
 /* CAN handle instance */
 static CAN_TypeDef can1_instance;
 CAN_HandleTypeDef hcan1 = {&can1_instance, 0, 0};
 
+/* Touch menu -> CANTask sniffer request, menu_state_machine.c owns it in the firmware */
+bool snifferToggleRequested = false;
+
+/* Same layout as the CAN_RIxR register: STID[31:21] EXID[20:3] IDE[2] RTR[1] */
+static uint32_t rirFor(uint32_t id, bool extended, bool remote) {
+    return (extended ? ((id << CAN_RI0R_EXID_Pos) | CAN_ID_EXT) : (id << CAN_RI0R_STID_Pos)) |
+           (remote ? CAN_RTR_REMOTE : CAN_RTR_DATA);
+}
+
+/* Mirror a FIFO's model into its RFxR and output mailbox registers, the way the hardware presents the oldest frame */
+static void publishRxFifo(uint32_t fifoIndex) {
+    const MockRxFifo *fifo = &rxFifos[fifoIndex];
+    volatile uint32_t *rfr = (fifoIndex == CAN_RX_FIFO1) ? &can1_instance.RF1R : &can1_instance.RF0R;
+    *rfr = (fifo->fill & CAN_RF0R_FMP0) |
+           ((fifo->fill >= MOCK_RX_FIFO_DEPTH) ? CAN_RF0R_FULL0 : 0) |
+           (fifo->overrun ? CAN_RF0R_FOVR0 : 0);
+
+    CAN_FIFOMailBox_TypeDef *mailbox = &can1_instance.sFIFOMailBox[fifoIndex];
+    uint32_t words[2] = {0, 0};
+    if (fifo->fill > 0) {
+        const CAN_RxHeaderTypeDef *header = &fifo->headers[0];
+        mailbox->RIR = rirFor((header->IDE == CAN_ID_EXT) ? header->ExtId : header->StdId, header->IDE == CAN_ID_EXT, header->RTR == CAN_RTR_REMOTE);
+        mailbox->RDTR = header->DLC << CAN_RDT0R_DLC_Pos;
+        memcpy(words, fifo->data[0], sizeof(words));
+    } else {
+        mailbox->RIR = 0;
+        mailbox->RDTR = 0;
+    }
+    mailbox->RDLR = words[0];
+    mailbox->RDHR = words[1];
+}
+
+/* Oldest frame out, the rest shuffle down like the hardware mailboxes */
+static void popRxFifo(uint32_t fifoIndex) {
+    MockRxFifo *fifo = &rxFifos[fifoIndex];
+    fifo->fill--;
+    memmove(&fifo->headers[0], &fifo->headers[1], fifo->fill * sizeof(fifo->headers[0]));
+    memmove(&fifo->data[0], &fifo->data[1], fifo->fill * sizeof(fifo->data[0]));
+    rxReadCount++;
+    publishRxFifo(fifoIndex);
+}
+
+static void resetRegisters(void) {
+    can1_instance.MCR = 0;
+    can1_instance.MSR = 0;
+    can1_instance.TSR = CAN_TSR_TME0 | CAN_TSR_TME1 | CAN_TSR_TME2;
+    can1_instance.IER = 0;
+    can1_instance.ESR = 0;
+    can1_instance.BTR = MOCK_CAN_BTR;
+    for (uint32_t i = 0; i < MOCK_RX_FIFO_COUNT; i++) {
+        publishRxFifo(i);
+    }
+}
+
 extern "C" {
 
 HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan,
@@ -39,6 +131,25 @@ HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan,
         return HAL_ERROR;
     }
 
+    /* The HAL refuses a frame when all three mailboxes are still pending */
+    uint32_t mailbox = 0;
+    if (txManualComplete) {
+        if (HAL_CAN_GetTxMailboxesFreeLevel(hcan) == 0) {
+            return HAL_ERROR;
+        }
+        while ((can1_instance.TSR & (CAN_TSR_TME0 << mailbox)) == 0) {
+            mailbox++;
+        }
+        if (txStatus == HAL_OK) {
+            /* Setting TXRQ clears the mailbox's previous result */
+            can1_instance.TSR &= ~((CAN_TSR_TME0 << mailbox) |
+                                   txMailboxFlags(mailbox, CAN_TSR_RQCP0 | CAN_TSR_TXOK0 | CAN_TSR_ALST0 | CAN_TSR_TERR0));
+            txPending[txPendingCount] = mailbox;
+            txPendingCount++;
+            txMailboxMessage[mailbox] = (int32_t)txMessageCount;
+        }
+    }
+
     /* Store the transmitted message */
     if (pHeader != nullptr && aData != nullptr && txStatus == HAL_OK && txMessageCount < MAX_CAN_MESSAGES) {
         StoredCANMessage *msg = &txMessages[txMessageCount];
@@ -66,18 +177,59 @@ HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan,
 
         /* Set mailbox number if requested */
         if (pTxMailbox != nullptr) {
-            *pTxMailbox = 0;  /* Always return mailbox 0 for simplicity */
+            *pTxMailbox = 1UL << mailbox;
         }
     }
 
     return txStatus;
 }
 
+/* A pending mailbox is pulled back at once, as if it hadn't started arbitration: RQCPx set with TXOKx clear */
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes) {
+    (void)hcan;
+    uint32_t i = 0;
+    while (i < txPendingCount) {
+        const uint32_t mailbox = txPending[i];
+        if ((TxMailboxes & (1UL << mailbox)) != 0) {
+            txPendingCount--;
+            memmove(&txPending[i], &txPending[i + 1], (txPendingCount - i) * sizeof(txPending[0]));
+            txMailboxMessage[mailbox] = -1;
+            can1_instance.TSR |= txMailboxFlags(mailbox, CAN_TSR_RQCP0) | (CAN_TSR_TME0 << mailbox);
+            txAbortCount++;
+        } else {
+            i++;
+        }
+    }
+    return HAL_OK;
+}
+
 uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan) {
     (void)hcan;
+    if (txManualComplete) {
+        return MOCK_TX_MAILBOX_COUNT - txPendingCount - ((txOnWire >= 0) ? 1 : 0);
+    }
     return freeTxMailboxes;
 }
 
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *sFilterConfig) {
+    (void)hcan;
+
+    if (sFilterConfig != nullptr && filterStatus == HAL_OK) {
+        uint32_t index = 0;
+        while (index < filterCount && filters[index].FilterBank != sFilterConfig->FilterBank) {
+            index++;
+        }
+        if (index < MAX_CAN_FILTERS) {
+            filters[index] = *sFilterConfig;
+            if (index == filterCount) {
+                filterCount++;
+            }
+        }
+    }
+
+    return filterStatus;
+}
+
 /* Mock control functions */
 void MockCAN_Reset(void) {
     txStatus = HAL_OK;
@@ -85,9 +237,24 @@ void MockCAN_Reset(void) {
     txMessageCount = 0;
     failOnCallNumber = 0;
     txCallCount = 0;
+    filterCount = 0;
+    filterStatus = HAL_OK;
 
     /* Clear message array */
     memset(txMessages, 0, sizeof(txMessages));
+    memset(filters, 0, sizeof(filters));
+    memset(rxFifos, 0, sizeof(rxFifos));
+    rxReadCount = 0;
+    pclk1Hz = MOCK_PCLK1_HZ;
+    restartCount = 0;
+    txManualComplete = false;
+    txPendingCount = 0;
+    txAbortCount = 0;
+    txOnWire = -1;
+    for (uint32_t i = 0; i < MOCK_TX_MAILBOX_COUNT; i++) {
+        txMailboxMessage[i] = -1;
+    }
+    resetRegisters();
 }
 
 void MockCAN_SetTxBehavior(HAL_StatusTypeDef status, uint32_t freeMailboxes) {
@@ -99,6 +266,32 @@ void MockCAN_SetTxFailOnCall(uint32_t failCallNumber_) {
     failOnCallNumber = failCallNumber_;
 }
 
+void MockCAN_SetFilterStatus(HAL_StatusTypeDef status) {
+    filterStatus = status;
+}
+
+void MockCAN_SetPCLK1Freq(uint32_t hz) {
+    pclk1Hz = hz;
+}
+
+void MockCAN_SetTxManualComplete(bool manual) {
+    txManualComplete = manual;
+}
+
+uint32_t MockCAN_CompleteTx(uint32_t count, uint32_t result) {
+    uint32_t completed = 0;
+    while (completed < count && txPendingCount > 0) {
+        const uint32_t mailbox = txPending[0];
+        txPendingCount--;
+        memmove(&txPending[0], &txPending[1], txPendingCount * sizeof(txPending[0]));
+        txMailboxMessage[mailbox] = -1;
+        can1_instance.TSR |= txMailboxFlags(mailbox, CAN_TSR_RQCP0 | result) |
+                             (CAN_TSR_TME0 << mailbox);
+        completed++;
+    }
+    return completed;
+}
+
 /* Mock query functions */
 uint32_t MockCAN_GetTxMessageCount(void) {
     return txMessageCount;
@@ -148,6 +341,186 @@ bool MockCAN_GetTxMessageAt(uint32_t index, uint32_t *id, uint8_t *length, uint8
     return true;
 }
 
+uint32_t MockCAN_GetFilterCount(void) {
+    return filterCount;
+}
+
+bool MockCAN_GetFilterAt(uint32_t index, CAN_FilterTypeDef *filter) {
+    if (index >= filterCount || filter == nullptr) {
+        return false;
+    }
+
+    *filter = filters[index];
+    return true;
+}
+
+bool MockCAN_FilterAccepts(uint32_t extId) {
+    return MockCAN_FilterFifo(extId) >= 0;
+}
+
+static int32_t filterFifoFor(uint32_t frame) {
+    for (uint32_t i = 0; i < filterCount; i++) {
+        const CAN_FilterTypeDef *f = &filters[i];
+        if (f->FilterActivation != CAN_FILTER_ENABLE ||
+            f->FilterMode != CAN_FILTERMODE_IDMASK ||
+            f->FilterScale != CAN_FILTERSCALE_32BIT) {
+            continue;
+        }
+
+        const uint32_t id = ((f->FilterIdHigh & 0xFFFF) << 16) | (f->FilterIdLow & 0xFFFF);
+        const uint32_t mask = ((f->FilterMaskIdHigh & 0xFFFF) << 16) | (f->FilterMaskIdLow & 0xFFFF);
+        if ((frame & mask) == (id & mask)) {
+            return (int32_t)f->FilterFIFOAssignment;
+        }
+    }
+
+    return -1;
+}
+
+int32_t MockCAN_FilterFifo(uint32_t extId) {
+    return filterFifoFor(rirFor(extId, true, false));
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo,
+                                       CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]) {
+    (void)hcan;
+    if (RxFifo >= MOCK_RX_FIFO_COUNT || rxFifos[RxFifo].fill == 0 || pHeader == nullptr || aData == nullptr) {
+        return HAL_ERROR;
+    }
+
+    const MockRxFifo *fifo = &rxFifos[RxFifo];
+    *pHeader = fifo->headers[0];
+    memcpy(aData, fifo->data[0], 8);
+    popRxFifo(RxFifo);
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t RxFifo) {
+    (void)hcan;
+    return (RxFifo < MOCK_RX_FIFO_COUNT) ? rxFifos[RxFifo].fill : 0;
+}
+
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan) {
+    (void)hcan;
+    return HAL_OK;
+}
+
+/* Counted as a restart, bus-off only ends when the test clears BOFF, as it would after the recovery sequence */
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan) {
+    (void)hcan;
+    restartCount++;
+    return HAL_OK;
+}
+
+uint32_t MockCAN_GetRestartCount(void) {
+    return restartCount;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) {
+    return pclk1Hz;
+}
+
+bool MockCAN_DeliverRxMessage(uint32_t extId, uint8_t length, const uint8_t data[8]) {
+    return MockCAN_DeliverRxFrame(extId, true, false, length, data);
+}
+
+bool MockCAN_DeliverRxFrame(uint32_t id, bool extended, bool remote, uint8_t length, const uint8_t data[8]) {
+    const int32_t route = filterFifoFor(rirFor(id, extended, remote));
+    if (route < 0 || route >= MOCK_RX_FIFO_COUNT) {
+        return false;
+    }
+    if (rxFifos[route].fill >= MOCK_RX_FIFO_DEPTH) {
+        rxFifos[route].overrun = true;
+        publishRxFifo((uint32_t)route);
+        return false;
+    }
+
+    MockRxFifo *fifo = &rxFifos[route];
+    CAN_RxHeaderTypeDef *header = &fifo->headers[fifo->fill];
+    memset(header, 0, sizeof(*header));
+    header->ExtId = extended ? id : 0;
+    header->StdId = extended ? 0 : id;
+    header->IDE = extended ? CAN_ID_EXT : CAN_ID_STD;
+    header->RTR = remote ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+    header->DLC = length;
+    memset(fifo->data[fifo->fill], 0, 8);
+    if (data != nullptr) {
+        memcpy(fifo->data[fifo->fill], data, (length > 8) ? 8 : length);
+    }
+    fifo->fill++;
+    publishRxFifo((uint32_t)route);
+    return true;
+}
+
+uint32_t MockCAN_GetRxReadCount(void) {
+    return rxReadCount;
+}
+
+void MockCAN_WriteRxFifoReg(CAN_TypeDef *can, uint32_t fifo, uint32_t bits) {
+    if (can != &can1_instance || fifo >= MOCK_RX_FIFO_COUNT) {
+        return;
+    }
+
+    /* Releasing an empty FIFO's mailbox has no effect on the hardware */
+    if ((bits & CAN_RF0R_RFOM0) != 0 && rxFifos[fifo].fill > 0) {
+        popRxFifo(fifo);
+    }
+    if ((bits & CAN_RF0R_FOVR0) != 0) {
+        rxFifos[fifo].overrun = false;
+    }
+    publishRxFifo(fifo);
+}
+
+void MockCAN_WriteESR(CAN_TypeDef *can, uint32_t value) {
+    can->ESR = (can->ESR & ~CAN_ESR_LEC) | (value & CAN_ESR_LEC);
+}
+
+int32_t MockCAN_StartNextTx(void) {
+    int32_t sent = -1;
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < txPendingCount && txOnWire < 0; i++) {
+        const int32_t index = txMailboxMessage[txPending[i]];
+        if (sent < 0 || txMessages[index].id < txMessages[sent].id) {
+            sent = index;
+            position = i;
+        }
+    }
+
+    if (sent >= 0) {
+        txOnWire = (int32_t)txPending[position];
+        txPendingCount--;
+        memmove(&txPending[position], &txPending[position + 1], (txPendingCount - position) * sizeof(txPending[0]));
+    }
+    return sent;
+}
+
+bool MockCAN_FinishTx(uint32_t result) {
+    if (txOnWire < 0) {
+        return false;
+    }
+    const uint32_t mailbox = (uint32_t)txOnWire;
+    txMailboxMessage[mailbox] = -1;
+    can1_instance.TSR |= txMailboxFlags(mailbox, CAN_TSR_RQCP0 | result) | (CAN_TSR_TME0 << mailbox);
+    txOnWire = -1;
+    return true;
+}
+
+uint32_t MockCAN_GetAbortCount(void) {
+    return txAbortCount;
+}
+
+int32_t MockCAN_GetPendingTxIndex(uint32_t mailbox) {
+    return (mailbox < MOCK_TX_MAILBOX_COUNT) ? txMailboxMessage[mailbox] : -1;
+}
+
+void MockCAN_WriteTSR(CAN_TypeDef *can, uint32_t bits) {
+    for (uint32_t mailbox = 0; mailbox < MOCK_TX_MAILBOX_COUNT; mailbox++) {
+        if ((bits & txMailboxFlags(mailbox, CAN_TSR_RQCP0)) != 0) {
+            can->TSR &= ~txMailboxFlags(mailbox, CAN_TSR_RQCP0 | CAN_TSR_TXOK0 | CAN_TSR_ALST0 | CAN_TSR_TERR0);
+        }
+    }
+}
+
 /* Verification helpers */
 bool MockCAN_VerifyTxMessage(uint32_t index, uint32_t expectedId, uint8_t expectedLength) {
     if (index >= txMessageCount) {
@@ -28,6 +28,20 @@ extern "C"
 #define CAN_RTR_DATA 0x00000000U   /* Data frame */
 #define CAN_RTR_REMOTE 0x00000002U /* Remote frame */
 
+/* CAN filter configuration */
+#define CAN_FILTERMODE_IDMASK 0x00000000U  /* Identifier mask mode */
+#define CAN_FILTERMODE_IDLIST 0x00000001U  /* Identifier list mode */
+#define CAN_FILTERSCALE_16BIT 0x00000000U  /* Two 16-bit filters */
+#define CAN_FILTERSCALE_32BIT 0x00000001U  /* One 32-bit filter */
+#define CAN_FILTER_FIFO0 0x00000000U       /* Filter FIFO 0 assignment */
+#define CAN_FILTER_FIFO1 0x00000001U       /* Filter FIFO 1 assignment */
+#define CAN_FILTER_DISABLE 0x00000000U     /* Disable filter */
+#define CAN_FILTER_ENABLE 0x00000001U      /* Enable filter */
+
+/* CAN receive FIFO number */
+#define CAN_RX_FIFO0 0x00000000U /* CAN receive FIFO 0 */
+#define CAN_RX_FIFO1 0x00000001U /* CAN receive FIFO 1 */
+
     /* Functional state */
     typedef enum
     {
@@ -35,15 +49,84 @@ extern "C"
         ENABLE = !DISABLE
     } FunctionalState;
 
-/* CAN TypeDef (opaque pointer in tests) */
+/* bxCAN register block, only the registers the driver touches, named as in the CMSIS device header */
 #ifndef CAN_TYPEDEF
 #define CAN_TYPEDEF
     typedef struct
     {
-        uint32_t dummy;
+        volatile uint32_t RIR;  /* Identifier */
+        volatile uint32_t RDTR; /* Length and timestamp */
+        volatile uint32_t RDLR; /* Data bytes 0-3 */
+        volatile uint32_t RDHR; /* Data bytes 4-7 */
+    } CAN_FIFOMailBox_TypeDef;
+
+    typedef struct
+    {
+        volatile uint32_t MCR;  /* Master control */
+        volatile uint32_t MSR;  /* Master status */
+        volatile uint32_t TSR;  /* Transmit status */
+        volatile uint32_t RF0R; /* Receive FIFO 0 */
+        volatile uint32_t RF1R; /* Receive FIFO 1 */
+        volatile uint32_t IER;  /* Interrupt enable */
+        volatile uint32_t ESR;  /* Error status */
+        volatile uint32_t BTR;  /* Bit timing */
+        CAN_FIFOMailBox_TypeDef sFIFOMailBox[2];
     } CAN_TypeDef;
 #endif
 
+/* Register bits, values from the CMSIS device header */
+#define CAN_MSR_ERRI (1UL << 2)
+#define CAN_RF0R_FMP0 (3UL << 0)
+#define CAN_RF0R_FULL0 (1UL << 3)
+#define CAN_RF0R_FOVR0 (1UL << 4)
+#define CAN_RF0R_RFOM0 (1UL << 5)
+#define CAN_RF1R_FMP1 (3UL << 0)
+#define CAN_RF1R_FULL1 (1UL << 3)
+#define CAN_RF1R_FOVR1 (1UL << 4)
+#define CAN_RF1R_RFOM1 (1UL << 5)
+#define CAN_ESR_EWGF (1UL << 0)
+#define CAN_ESR_EPVF (1UL << 1)
+#define CAN_ESR_BOFF (1UL << 2)
+#define CAN_ESR_LEC_Pos 4U
+#define CAN_ESR_LEC (7UL << CAN_ESR_LEC_Pos)
+#define CAN_ESR_TEC_Pos 16U
+#define CAN_ESR_TEC (0xFFUL << CAN_ESR_TEC_Pos)
+#define CAN_ESR_REC_Pos 24U
+#define CAN_ESR_REC (0xFFUL << CAN_ESR_REC_Pos)
+#define CAN_RI0R_RTR (1UL << 1)
+#define CAN_RI0R_IDE (1UL << 2)
+#define CAN_RI0R_EXID_Pos 3U
+#define CAN_RI0R_EXID (0x3FFFFUL << CAN_RI0R_EXID_Pos)
+#define CAN_RI0R_STID_Pos 21U
+#define CAN_RI0R_STID (0x7FFUL << CAN_RI0R_STID_Pos)
+#define CAN_RDT0R_DLC_Pos 0U
+#define CAN_RDT0R_DLC (0xFUL << CAN_RDT0R_DLC_Pos)
+#define CAN_TSR_RQCP0 (1UL << 0)
+#define CAN_TSR_TXOK0 (1UL << 1)
+#define CAN_TSR_ALST0 (1UL << 2)
+#define CAN_TSR_TERR0 (1UL << 3)
+#define CAN_TSR_RQCP1 (1UL << 8)
+#define CAN_TSR_TXOK1 (1UL << 9)
+#define CAN_TSR_ALST1 (1UL << 10)
+#define CAN_TSR_TERR1 (1UL << 11)
+#define CAN_TSR_RQCP2 (1UL << 16)
+#define CAN_TSR_TXOK2 (1UL << 17)
+#define CAN_TSR_ALST2 (1UL << 18)
+#define CAN_TSR_TERR2 (1UL << 19)
+#define CAN_TSR_TME0 (1UL << 26)
+#define CAN_TSR_TME1 (1UL << 27)
+#define CAN_TSR_TME2 (1UL << 28)
+#define CAN_TX_MAILBOX0 (0x00000001U)
+#define CAN_TX_MAILBOX1 (0x00000002U)
+#define CAN_TX_MAILBOX2 (0x00000004U)
+#define CAN_BTR_BRP_Pos 0U
+#define CAN_BTR_BRP (0x3FFUL << CAN_BTR_BRP_Pos)
+#define CAN_BTR_TS1_Pos 16U
+#define CAN_BTR_TS1 (0xFUL << CAN_BTR_TS1_Pos)
+#define CAN_BTR_TS2_Pos 20U
+#define CAN_BTR_TS2 (0x7UL << CAN_BTR_TS2_Pos)
+#define CAN_BTR_SILM (1UL << 31)
+
     /* CAN Tx Header structure */
     typedef struct
     {
@@ -67,6 +150,21 @@ extern "C"
         uint32_t FilterMatchIndex; /* Filter match index */
     } CAN_RxHeaderTypeDef;
 
+    /* CAN filter configuration structure */
+    typedef struct
+    {
+        uint32_t FilterIdHigh;         /* Filter ID MSBs (32-bit) */
+        uint32_t FilterIdLow;          /* Filter ID LSBs (32-bit) */
+        uint32_t FilterMaskIdHigh;     /* Filter mask MSBs (32-bit) */
+        uint32_t FilterMaskIdLow;      /* Filter mask LSBs (32-bit) */
+        uint32_t FilterFIFOAssignment; /* FIFO the filter routes to */
+        uint32_t FilterBank;           /* Filter bank to initialise */
+        uint32_t FilterMode;           /* Mask or list mode */
+        uint32_t FilterScale;          /* 16 or 32 bit */
+        uint32_t FilterActivation;     /* Enable or disable */
+        uint32_t SlaveStartFilterBank; /* Start bank for slave CAN instance */
+    } CAN_FilterTypeDef;
+
 /* CAN Handle structure (simplified for mocking) */
 #ifndef CAN_HANDLETYPEDEF
 #define CAN_HANDLETYPEDEF
@@ -87,16 +185,69 @@ extern "C"
                                            const uint8_t aData[],
                                            uint32_t *pTxMailbox);
     uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan);
+    HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *sFilterConfig);
+    HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo,
+                                           CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]);
+    uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t RxFifo);
+    HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes);
+    HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan);
+    HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan);
+    /* APB1 clock the bxCAN bit timing divides down */
+    uint32_t HAL_RCC_GetPCLK1Freq(void);
 
     /* Mock control functions */
     void MockCAN_Reset(void);
     void MockCAN_SetTxBehavior(HAL_StatusTypeDef status, uint32_t freeMailboxes);
     void MockCAN_SetTxFailOnCall(uint32_t failCallNumber);
+    void MockCAN_SetFilterStatus(HAL_StatusTypeDef status);
+    void MockCAN_SetPCLK1Freq(uint32_t hz);
+    /* By default frames leave their mailbox the moment they're added. With manual completion each added frame holds a
+     * mailbox (AddTxMessage fails with none free, like the HAL) until MockCAN_CompleteTx sends it */
+    void MockCAN_SetTxManualComplete(bool manual);
+    /* Finish the oldest count pending mailboxes, setting RQCPx and the given result (CAN_TSR_TXOK0, CAN_TSR_ALST0 or
+     * CAN_TSR_TERR0, shifted to the mailbox) in TSR as the hardware would. Returns how many completed */
+    uint32_t MockCAN_CompleteTx(uint32_t count, uint32_t result);
+    /* Put the pending frame with the lowest identifier on the wire, as bxCAN arbitrates with TXFP off. It keeps its mailbox
+     * but can no longer be aborted. Returns its index in the TX message log, -1 if nothing is pending or a frame is
+     * already on the wire */
+    int32_t MockCAN_StartNextTx(void);
+    /* Finish the frame on the wire with the given result (see MockCAN_CompleteTx), false if there isn't one */
+    bool MockCAN_FinishTx(uint32_t result);
+    /* Mailboxes HAL_CAN_AbortTxRequest pulled back before they went out, with manual completion on */
+    uint32_t MockCAN_GetAbortCount(void);
+    /* Index into the TX message log of the frame in each pending mailbox, -1 if the mailbox is empty */
+    int32_t MockCAN_GetPendingTxIndex(uint32_t mailbox);
 
     /* Mock query functions */
     uint32_t MockCAN_GetTxMessageCount(void);
     bool MockCAN_GetLastTxMessage(uint32_t *id, uint8_t *length, uint8_t data[8]);
     bool MockCAN_GetTxMessageAt(uint32_t index, uint32_t *id, uint8_t *length, uint8_t data[8]);
+    uint32_t MockCAN_GetFilterCount(void);
+    bool MockCAN_GetFilterAt(uint32_t index, CAN_FilterTypeDef *filter);
+
+    /* Run an extended data frame through the configured filter banks the way bxCAN would,
+     * returns true if any enabled 32 bit mask bank accepts it */
+    bool MockCAN_FilterAccepts(uint32_t extId);
+    /* FIFO the first accepting bank routes the frame to, -1 if it is rejected */
+    int32_t MockCAN_FilterFifo(uint32_t extId);
+
+    /* Receive an extended data frame off the bus: through the filters into the 3 deep hardware FIFO they route it to.
+     * The FIFO's RFxR and output mailbox registers in hcan1.Instance always show its current state.
+     * Returns false if it is filtered out or the FIFO is full (overrun, FOVRx is set) */
+    bool MockCAN_DeliverRxMessage(uint32_t extId, uint8_t length, const uint8_t data[8]);
+    /* As MockCAN_DeliverRxMessage for any frame, standard (11 bit id) and remote ones included */
+    bool MockCAN_DeliverRxFrame(uint32_t id, bool extended, bool remote, uint8_t length, const uint8_t data[8]);
+    /* Frames taken out of the RX FIFOs, by HAL_CAN_GetRxMessage or by releasing the output mailbox */
+    uint32_t MockCAN_GetRxReadCount(void);
+    /* Register store to RF0R/RF1R, plain stores can't be seen by the mock so the driver routes them here in test builds.
+     * RFOMx releases the output mailbox, FOVRx (write 1 to clear) clears the overrun flag */
+    void MockCAN_WriteRxFifoReg(CAN_TypeDef *can, uint32_t fifo, uint32_t bits);
+    /* Firmware's ESR store, only the last error code is writable */
+    void MockCAN_WriteESR(CAN_TypeDef *can, uint32_t value);
+    /* Firmware's TSR store, writing RQCPx acknowledges that mailbox's completion flags */
+    void MockCAN_WriteTSR(CAN_TypeDef *can, uint32_t bits);
+    /* HAL_CAN_Stop/HAL_CAN_Start pairs since reset */
+    uint32_t MockCAN_GetRestartCount(void);
 
     /* Verification helpers */
     bool MockCAN_VerifyTxMessage(uint32_t index, uint32_t expectedId, uint8_t expectedLength);
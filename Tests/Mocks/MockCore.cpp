@@ -0,0 +1,16 @@
+#include "core_cm4.h"
+#include <cstring>
+
+CoreDebug_Type MockCoreDebug;
+DWT_Type MockDWT;
+uint32_t SystemCoreClock = 16000000U;
+
+extern "C" {
+
+void MockCore_Reset(void) {
+    memset(&MockCoreDebug, 0, sizeof(MockCoreDebug));
+    memset(&MockDWT, 0, sizeof(MockDWT));
+    SystemCoreClock = 16000000U;
+}
+
+} /* extern "C" */
@@ -62,7 +62,11 @@ extern "C"
         VCC_UNDER_VOLTAGE_ERR = 29,
         SOLENOID_DISABLED_ERR = 30,
         TSC_ERR = 31,
-        MAX_ERR = TSC_ERR
+        CAN_CONFIG_ERR = 32,
+        CAN_RX_OVERRUN_ERR = 33,
+        CAN_BUS_ERR = 34,
+        SNIFFER_FLASH_ERR = 35,
+        MAX_ERR = SNIFFER_FLASH_ERR
     } NonFatalError_t;
 
 #endif /* _ERRORS_H_DEFINED */
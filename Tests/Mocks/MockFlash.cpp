@@ -6,6 +6,8 @@
 static HAL_StatusTypeDef unlockStatus = HAL_OK;
 static HAL_StatusTypeDef lockStatus = HAL_OK;
 static HAL_StatusTypeDef obProgramStatus = HAL_OK;
+static HAL_StatusTypeDef programStatus = HAL_OK;
+static HAL_StatusTypeDef eraseStatus = HAL_OK;
 static EE_Status initStatus = EE_OK;
 static EE_Status formatStatus = EE_OK;
 static EE_Status writeStatus = EE_OK;
@@ -17,6 +19,8 @@ static EE_Status cleanupStatus = EE_OK;
 static uint32_t unlockCallCount = 0;
 static uint32_t lockCallCount = 0;
 static uint32_t obProgramCallCount = 0;
+static uint32_t programCallCount = 0;
+static uint32_t erasedPageCount = 0;
 static uint32_t initCallCount = 0;
 static uint32_t formatCallCount = 0;
 static uint32_t writeCallCount = 0;
@@ -38,6 +42,9 @@ static FLASH_OBProgramInitTypeDef currentOBConfig = {0};
 /* Simulated EEPROM storage */
 static std::map<uint16_t, uint32_t> eepromStorage;
 
+/* Simulated main flash */
+static uint8_t flashMemory[MOCK_FLASH_SIZE];
+
 extern "C" {
 
 /* HAL Flash Functions */
@@ -65,6 +72,41 @@ HAL_StatusTypeDef HAL_FLASHEx_OBProgram(FLASH_OBProgramInitTypeDef *pOBInit) {
     return obProgramStatus;
 }
 
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+    programCallCount++;
+    uint8_t *target = MockFlash_Memory(Address);
+    if (programStatus != HAL_OK) {
+        return programStatus;
+    }
+    if (TypeProgram != FLASH_TYPEPROGRAM_DOUBLEWORD || target == nullptr || (Address % sizeof(Data)) != 0 ||
+        (Address - FLASH_BASE) > (MOCK_FLASH_SIZE - sizeof(Data))) {
+        return HAL_ERROR;
+    }
+    for (uint32_t i = 0; i < sizeof(Data); i++) {
+        if (target[i] != 0xFF) {
+            return HAL_ERROR; /* PROGERR, the double word wasn't erased */
+        }
+    }
+    std::memcpy(target, &Data, sizeof(Data));
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError) {
+    if (PageError != nullptr) {
+        *PageError = 0xFFFFFFFFU;
+    }
+    if (eraseStatus != HAL_OK) {
+        return eraseStatus;
+    }
+    if (pEraseInit == nullptr || pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES ||
+        (pEraseInit->Page + pEraseInit->NbPages) > (MOCK_FLASH_SIZE / FLASH_PAGE_SIZE)) {
+        return HAL_ERROR;
+    }
+    std::memset(&flashMemory[pEraseInit->Page * FLASH_PAGE_SIZE], 0xFF, pEraseInit->NbPages * FLASH_PAGE_SIZE);
+    erasedPageCount += pEraseInit->NbPages;
+    return HAL_OK;
+}
+
 void HAL_FLASHEx_OBGetConfig(FLASH_OBProgramInitTypeDef *pOBInit) {
     if (pOBInit != nullptr) {
         *pOBInit = currentOBConfig;
@@ -134,6 +176,8 @@ void MockFlash_Reset(void) {
     unlockStatus = HAL_OK;
     lockStatus = HAL_OK;
     obProgramStatus = HAL_OK;
+    programStatus = HAL_OK;
+    eraseStatus = HAL_OK;
     initStatus = EE_OK;
     formatStatus = EE_OK;
     writeStatus = EE_OK;
@@ -144,6 +188,8 @@ void MockFlash_Reset(void) {
     unlockCallCount = 0;
     lockCallCount = 0;
     obProgramCallCount = 0;
+    programCallCount = 0;
+    erasedPageCount = 0;
     initCallCount = 0;
     formatCallCount = 0;
     writeCallCount = 0;
@@ -161,6 +207,7 @@ void MockFlash_Reset(void) {
     std::memset(&currentOBConfig, 0, sizeof(currentOBConfig));
 
     eepromStorage.clear();
+    std::memset(flashMemory, 0xFF, sizeof(flashMemory));
 }
 
 void MockFlash_SetUnlockBehavior(HAL_StatusTypeDef status) {
@@ -175,6 +222,14 @@ void MockFlash_SetOBProgramBehavior(HAL_StatusTypeDef status) {
     obProgramStatus = status;
 }
 
+void MockFlash_SetProgramBehavior(HAL_StatusTypeDef status) {
+    programStatus = status;
+}
+
+void MockFlash_SetEraseBehavior(HAL_StatusTypeDef status) {
+    eraseStatus = status;
+}
+
 void MockFlash_SetInitBehavior(EE_Status status) {
     initStatus = status;
 }
@@ -209,6 +264,14 @@ uint32_t MockFlash_GetOBProgramCallCount(void) {
     return obProgramCallCount;
 }
 
+uint32_t MockFlash_GetProgramCallCount(void) {
+    return programCallCount;
+}
+
+uint32_t MockFlash_GetErasedPageCount(void) {
+    return erasedPageCount;
+}
+
 uint32_t MockFlash_GetInitCallCount(void) {
     return initCallCount;
 }
@@ -260,6 +323,13 @@ bool MockFlash_VerifyOptionBit(uint32_t bitPosition, bool expectedValue) {
     return actualValue == expectedValue;
 }
 
+uint8_t *MockFlash_Memory(uint32_t address) {
+    if (address < FLASH_BASE || (address - FLASH_BASE) >= MOCK_FLASH_SIZE) {
+        return nullptr;
+    }
+    return &flashMemory[address - FLASH_BASE];
+}
+
 void MockFlash_SetStoredValue(uint16_t addr, uint32_t value) {
     eepromStorage[addr] = value;
 }
@@ -97,6 +97,23 @@ extern "C"
 #define OB_USER_nSWBOOT0 ((uint32_t)0x2000)
 #define OB_USER_nBOOT0 ((uint32_t)0x4000)
 
+    /* FLASH page erase structure */
+    typedef struct
+    {
+        uint32_t TypeErase; /*!< Mass erase or page erase */
+        uint32_t Banks;     /*!< Bank to erase */
+        uint32_t Page;      /*!< First page to erase, counted from FLASH_BASE */
+        uint32_t NbPages;   /*!< Number of pages to erase */
+    } FLASH_EraseInitTypeDef;
+
+/* STM32L431 single bank flash geometry */
+#define FLASH_BASE (0x08000000UL)
+#define FLASH_PAGE_SIZE ((uint32_t)0x800)
+#define MOCK_FLASH_SIZE (0x20000UL)
+#define FLASH_BANK_1 ((uint32_t)0x01)
+#define FLASH_TYPEERASE_PAGES ((uint32_t)0x00)
+#define FLASH_TYPEPROGRAM_DOUBLEWORD ((uint32_t)0x00)
+
 /* FLASH Flag clear macro - in tests this is a no-op */
 #define __HAL_FLASH_CLEAR_FLAG(flags) ((void)0)
 
@@ -104,6 +121,8 @@ extern "C"
     HAL_StatusTypeDef HAL_FLASH_Unlock(void);
     HAL_StatusTypeDef HAL_FLASH_Lock(void);
     HAL_StatusTypeDef HAL_FLASHEx_OBProgram(FLASH_OBProgramInitTypeDef *pOBInit);
+    HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+    HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError);
     void HAL_FLASHEx_OBGetConfig(FLASH_OBProgramInitTypeDef *pOBInit);
 
     /* EEPROM Emulation API functions to be mocked */
@@ -118,6 +137,8 @@ extern "C"
     void MockFlash_SetUnlockBehavior(HAL_StatusTypeDef status);
     void MockFlash_SetLockBehavior(HAL_StatusTypeDef status);
     void MockFlash_SetOBProgramBehavior(HAL_StatusTypeDef status);
+    void MockFlash_SetProgramBehavior(HAL_StatusTypeDef status);
+    void MockFlash_SetEraseBehavior(HAL_StatusTypeDef status);
     void MockFlash_SetInitBehavior(EE_Status status);
     void MockFlash_SetFormatBehavior(EE_Status status);
     void MockFlash_SetWriteBehavior(EE_Status status);
@@ -128,6 +149,8 @@ extern "C"
     uint32_t MockFlash_GetUnlockCallCount(void);
     uint32_t MockFlash_GetLockCallCount(void);
     uint32_t MockFlash_GetOBProgramCallCount(void);
+    uint32_t MockFlash_GetProgramCallCount(void);
+    uint32_t MockFlash_GetErasedPageCount(void);
     uint32_t MockFlash_GetInitCallCount(void);
     uint32_t MockFlash_GetFormatCallCount(void);
     uint32_t MockFlash_GetWriteCallCount(void);
@@ -142,6 +165,10 @@ extern "C"
     bool MockFlash_GetLastOBConfig(FLASH_OBProgramInitTypeDef *config);
     bool MockFlash_VerifyOptionBit(uint32_t bitPosition, bool expectedValue);
 
+    /* Simulated main flash, all 0xFF after reset. Programming only clears bits, like the real thing a double word
+     * that isn't erased is refused. Returns a pointer to the byte at a flash address, NULL outside the array */
+    uint8_t *MockFlash_Memory(uint32_t address);
+
     /* Simulated EEPROM storage */
     void MockFlash_SetStoredValue(uint16_t addr, uint32_t value);
     uint32_t MockFlash_GetStoredValue(uint16_t addr);
@@ -19,10 +19,15 @@ static struct {
 } lastBlinkCode;
 
 static uint32_t blinkNoDataCallCount = 0;
+static uint32_t blinkAgingCallCount = 0;
 static uint32_t blinkAlarmCallCount = 0;
 
 static bool menuActiveState = false;
 
+static uint32_t renderLatencyCallCount = 0;
+static uint32_t lastRenderLatencyRxCycles = 0;
+static uint32_t blinkCodeCountAtRenderLatency = 0;
+
 extern "C" {
 
 /* LED brightness constant - must match the definition in leds.c */
@@ -43,8 +48,13 @@ void MockLEDs_Reset(void) {
     lastBlinkCode.failMask = 0;
 
     blinkNoDataCallCount = 0;
+    blinkAgingCallCount = 0;
     blinkAlarmCallCount = 0;
     menuActiveState = false;
+
+    renderLatencyCallCount = 0;
+    lastRenderLatencyRxCycles = 0;
+    blinkCodeCountAtRenderLatency = 0;
 }
 
 void setRGB(uint8_t channel, uint8_t r, uint8_t g, uint8_t b) {
@@ -68,6 +78,10 @@ void blinkNoData(void) {
     blinkNoDataCallCount++;
 }
 
+void blinkAging(void) {
+    blinkAgingCallCount++;
+}
+
 void blinkAlarm(void) {
     blinkAlarmCallCount++;
 }
@@ -103,6 +117,10 @@ uint32_t MockLEDs_GetBlinkNoDataCallCount(void) {
     return blinkNoDataCallCount;
 }
 
+uint32_t MockLEDs_GetBlinkAgingCallCount(void) {
+    return blinkAgingCallCount;
+}
+
 uint32_t MockLEDs_GetBlinkAlarmCallCount(void) {
     return blinkAlarmCallCount;
 }
@@ -111,4 +129,22 @@ void MockLEDs_SetMenuActive(bool active) {
     menuActiveState = active;
 }
 
+void RecordPPO2RenderLatency(uint32_t rxCycles) {
+    renderLatencyCallCount++;
+    lastRenderLatencyRxCycles = rxCycles;
+    blinkCodeCountAtRenderLatency = blinkCodeCallCount;
+}
+
+uint32_t MockLEDs_GetRenderLatencyCallCount(void) {
+    return renderLatencyCallCount;
+}
+
+uint32_t MockLEDs_GetLastRenderLatencyRxCycles(void) {
+    return lastRenderLatencyRxCycles;
+}
+
+uint32_t MockLEDs_GetBlinkCodeCountAtRenderLatency(void) {
+    return blinkCodeCountAtRenderLatency;
+}
+
 } /* extern "C" */
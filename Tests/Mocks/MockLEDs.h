@@ -12,11 +12,15 @@ extern "C"
     void setRGB(uint8_t channel, uint8_t r, uint8_t g, uint8_t b);
     void blinkCode(int8_t c1, int8_t c2, int8_t c3, uint8_t statusMask, uint8_t failMask);
     void blinkNoData(void);
+    void blinkAging(void);
     void blinkAlarm(void);
 
     /* Mock menu state machine function */
     bool menuActive(void);
 
+    /* Mock DiveCAN latency hook */
+    void RecordPPO2RenderLatency(uint32_t rxCycles);
+
     /* Test helper functions to verify LED function calls */
     void MockLEDs_Reset(void);
 
@@ -28,8 +32,14 @@ extern "C"
     void MockLEDs_GetLastBlinkCode(int8_t *c1, int8_t *c2, int8_t *c3, uint8_t *statusMask, uint8_t *failMask);
 
     uint32_t MockLEDs_GetBlinkNoDataCallCount(void);
+    uint32_t MockLEDs_GetBlinkAgingCallCount(void);
     uint32_t MockLEDs_GetBlinkAlarmCallCount(void);
 
+    uint32_t MockLEDs_GetRenderLatencyCallCount(void);
+    uint32_t MockLEDs_GetLastRenderLatencyRxCycles(void);
+    /* blinkCode calls made before the last latency record, to check ordering */
+    uint32_t MockLEDs_GetBlinkCodeCountAtRenderLatency(void);
+
     /* Control menu state for testing */
     void MockLEDs_SetMenuActive(bool active);
 
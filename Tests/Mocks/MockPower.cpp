@@ -28,7 +28,7 @@ GPIO_TypeDef* CAN_EN_GPIO_Port = &GPIOC_instance;
 /* When testing pwr_management, MockCAN is not linked, so define hcan1 here */
 /* Otherwise, hcan1 is defined in MockCAN.cpp */
 #ifdef TESTING_PWR_MANAGEMENT
-static CAN_TypeDef can1_instance = {0};
+static CAN_TypeDef can1_instance;
 CAN_HandleTypeDef hcan1 = {&can1_instance, 0, 0};  /* Instance, State, ErrorCode */
 #else
 extern CAN_HandleTypeDef hcan1;  /* Defined in MockCAN.cpp */
@@ -25,6 +25,9 @@ static MockQueue* cellStatQueue = nullptr;
 static uint32_t delayCallCount = 0;
 static uint32_t totalDelayTicks = 0;
 
+/* osKernelGetTickCount value */
+static uint32_t tickCount = 0;
+
 /* Queue handles */
 osMessageQueueId_t PPO2QueueHandle = nullptr;
 osMessageQueueId_t CellStatQueueHandle = nullptr;
@@ -40,8 +43,8 @@ void MockQueue_Init(void) {
         delete cellStatQueue;
     }
 
-    /* CellValues_t has 3 int16_t values = 6 bytes */
-    ppo2Queue = new MockQueue(6);
+    /* CellValues_t has 3 int16_t values and a uint32_t RX stamp = 12 bytes */
+    ppo2Queue = new MockQueue(12);
     /* Cell status is a single uint8_t */
     cellStatQueue = new MockQueue(1);
 
@@ -68,6 +71,7 @@ void MockQueue_Reset(void) {
 
     delayCallCount = 0;
     totalDelayTicks = 0;
+    tickCount = 0;
 }
 
 void MockQueue_Cleanup(void) {
@@ -92,6 +96,14 @@ uint32_t MockQueue_GetTotalDelayTicks(void) {
     return totalDelayTicks;
 }
 
+void MockQueue_SetTickCount(uint32_t ticks) {
+    tickCount = ticks;
+}
+
+uint32_t osKernelGetTickCount(void) {
+    return tickCount;
+}
+
 osStatus_t osMessageQueuePut(osMessageQueueId_t queue_id, const void *msg_ptr, uint8_t msg_prio, uint32_t timeout) {
     (void)msg_prio;
     (void)timeout;
@@ -21,6 +21,7 @@ extern "C"
     void MockQueue_Cleanup(void);
     uint32_t MockQueue_GetDelayCallCount(void);
     uint32_t MockQueue_GetTotalDelayTicks(void);
+    void MockQueue_SetTickCount(uint32_t ticks);
 
 #ifdef __cplusplus
 }
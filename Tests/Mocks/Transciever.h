@@ -10,7 +10,11 @@ extern "C"
 
 /* Expose private sendCANMessage for testing */
 #ifdef TESTING
-    void sendCANMessage(const DiveCANMessage_t message);
+    void sendCANMessage(const DiveCANMessage_t message, const CANTxClass_t txClass);
+    void ResetCANRxRing(void);
+    void ResetCANTxRing(void);
+    /* Deliver a frame through the mocked filters and FIFO interrupt, as the bus would */
+    void rxInterrupt(const uint32_t id, const uint8_t length, const uint8_t *const data);
 #endif
 
 #ifdef __cplusplus
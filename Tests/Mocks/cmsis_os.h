@@ -69,9 +69,11 @@ typedef enum
 
 /* FreeRTOS/CMSIS-RTOS v2 types for queue operations */
 typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
 typedef void *osMessageQueueId_t;
 typedef void *osThreadId_t;
 typedef void *StaticTask_t;
+typedef void *TaskHandle_t;
 
 /* FreeRTOS constants */
 #define pdTRUE ((BaseType_t)1)
@@ -111,11 +113,27 @@ extern "C"
     osStatus_t osMessageQueueGet(osMessageQueueId_t queue_id, void *msg_ptr, uint8_t *msg_prio, uint32_t timeout);
     osStatus_t osMessageQueueReset(osMessageQueueId_t queue_id);
     void osDelay(TickType_t ticks);
+    uint32_t osKernelGetTickCount(void);
 
     /* Thread management */
     typedef void (*osThreadFunc_t)(void *argument);
     osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr);
 
+    /* Direct-to-task notifications (task.h, pulled in by the real cmsis_os.h) */
+    TaskHandle_t xTaskGetCurrentTaskHandle(void);
+    void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken);
+    uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+    /* Context switch on ISR exit (portmacro.h) */
+    void MockQueue_YieldFromISR(BaseType_t xSwitchRequired);
+#define portYIELD_FROM_ISR(x) MockQueue_YieldFromISR(x)
+
+    /* Critical sections (task.h), nothing pre-empts the host tests */
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskENTER_CRITICAL_FROM_ISR() ((UBaseType_t)0)
+#define taskEXIT_CRITICAL_FROM_ISR(x) ((void)(x))
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Cortex-M4 core debug registers (only the fields we touch) */
+    typedef struct
+    {
+        uint32_t DHCSR;
+        uint32_t DCRSR;
+        uint32_t DCRDR;
+        uint32_t DEMCR;
+    } CoreDebug_Type;
+
+    /* Data watchpoint and trace unit (only the fields we touch) */
+    typedef struct
+    {
+        uint32_t CTRL;
+        uint32_t CYCCNT;
+    } DWT_Type;
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL)
+
+    /* Register blocks, tests drive CYCCNT directly to model elapsed cycles */
+    extern CoreDebug_Type MockCoreDebug;
+    extern DWT_Type MockDWT;
+
+    /* Core clock in Hz, normally from system_stm32l4xx.h */
+    extern uint32_t SystemCoreClock;
+
+#define CoreDebug (&MockCoreDebug)
+#define DWT (&MockDWT)
+
+    void MockCore_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,10 +1,20 @@
 #include "printer.h"
 #include <cstdarg>
 
-/* Mock serial_printf - does nothing for tests */
+static unsigned int printCallCount = 0;
+
+/* Mock serial_printf - only counts calls */
 extern "C" {
 void serial_printf(const char *format, ...) {
     (void)format;
-    /* Stub - do nothing in tests */
+    printCallCount++;
+}
+
+void MockPrinter_Reset(void) {
+    printCallCount = 0;
+}
+
+unsigned int MockPrinter_GetCallCount(void) {
+    return printCallCount;
 }
 }
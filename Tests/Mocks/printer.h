@@ -8,6 +8,10 @@ extern "C"
     /* Mock printer - serial_printf stub */
     void serial_printf(const char *format, ...);
 
+    /* Lines logged since reset, to check what does and doesn't get formatted */
+    void MockPrinter_Reset(void);
+    unsigned int MockPrinter_GetCallCount(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,6 +41,16 @@ static BaseType_t isrReturnValue = pdPASS;
 static uint32_t delayCallCount = 0;
 static uint32_t totalDelayTicks = 0;
 
+/* osKernelGetTickCount value */
+static uint32_t tickCount = 0;
+
+/* Direct-to-task notification state, there is only ever one task */
+static uint32_t dummyTaskHandle = 0x87654321;
+static uint32_t notifyValue = 0;
+static uint32_t notifyGiveCount = 0;
+static uint32_t notifyBlockCount = 0;
+static uint32_t yieldFromISRCount = 0;
+
 /* Application-specific queue handles */
 QueueHandle_t PPO2QueueHandle = nullptr;
 QueueHandle_t CellStatQueueHandle = nullptr;
@@ -284,6 +294,11 @@ void MockQueue_ResetFreeRTOS(void) {
     isrReturnValue = pdPASS;
     delayCallCount = 0;
     totalDelayTicks = 0;
+    tickCount = 0;
+    notifyValue = 0;
+    notifyGiveCount = 0;
+    notifyBlockCount = 0;
+    yieldFromISRCount = 0;
 }
 
 void MockQueue_ClearAllQueues(void) {
@@ -354,19 +369,71 @@ uint32_t MockQueue_GetTotalDelayTicks(void) {
     return totalDelayTicks;
 }
 
+void MockQueue_SetTickCount(uint32_t ticks) {
+    tickCount = ticks;
+}
+
+uint32_t MockQueue_GetNotifyGiveCount(void) {
+    return notifyGiveCount;
+}
+
+uint32_t MockQueue_GetNotifyBlockCount(void) {
+    return notifyBlockCount;
+}
+
+uint32_t MockQueue_GetYieldFromISRCount(void) {
+    return yieldFromISRCount;
+}
+
+void MockQueue_YieldFromISR(BaseType_t xSwitchRequired) {
+    if (xSwitchRequired != pdFALSE) {
+        yieldFromISRCount++;
+    }
+}
+
+/* Task notification implementation, takes never actually block */
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return (TaskHandle_t)&dummyTaskHandle;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken) {
+    (void)xTaskToNotify;
+    /* The task waiting on the notification always outranks whatever was interrupted */
+    if (pxHigherPriorityTaskWoken != nullptr) {
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    }
+    notifyValue++;
+    notifyGiveCount++;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    const uint32_t value = notifyValue;
+    if (value == 0 && xTicksToWait > 0) {
+        notifyBlockCount++;
+    }
+    if (value > 0) {
+        notifyValue = (xClearCountOnExit == pdTRUE) ? 0 : value - 1;
+    }
+    return value;
+}
+
 /* osDelay implementation */
 void osDelay(TickType_t ticks) {
     delayCallCount++;
     totalDelayTicks += ticks;
 }
 
+uint32_t osKernelGetTickCount(void) {
+    return tickCount;
+}
+
 /* Initialize application-specific queues for testing */
 void MockQueue_InitApplicationQueues(void) {
-    /* Create PPO2 queue (length 1, item size for CellValues_t which is 3 int16_t = 6 bytes) */
-    static uint8_t ppo2QueueStorage[1 * 8];  /* Use 8 bytes to be safe */
+    /* Create PPO2 queue (length 1, item size for CellValues_t which is 3 int16_t + uint32_t stamp = 12 bytes) */
+    static uint8_t ppo2QueueStorage[1 * 12];
     static StaticQueue_t ppo2QueueBuffer;
     if (PPO2QueueHandle == nullptr) {
-        PPO2QueueHandle = xQueueCreateStatic(1, 8, ppo2QueueStorage, &ppo2QueueBuffer);
+        PPO2QueueHandle = xQueueCreateStatic(1, 12, ppo2QueueStorage, &ppo2QueueBuffer);
     }
 
     /* Create CellStat queue (length 1, item size uint8_t = 1 byte) */
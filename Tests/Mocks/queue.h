@@ -42,6 +42,10 @@ extern "C"
     void MockQueue_SetISRBehavior(BaseType_t returnValue);
     uint32_t MockQueue_GetDelayCallCount(void);
     uint32_t MockQueue_GetTotalDelayTicks(void);
+    void MockQueue_SetTickCount(uint32_t ticks);
+    uint32_t MockQueue_GetNotifyGiveCount(void);  /* vTaskNotifyGiveFromISR calls, i.e. task wakes */
+    uint32_t MockQueue_GetNotifyBlockCount(void); /* ulTaskNotifyTake calls that would have blocked */
+    uint32_t MockQueue_GetYieldFromISRCount(void); /* portYIELD_FROM_ISR calls that asked for a switch */
 
     /* Application-specific queue handles (from main.c) */
     extern QueueHandle_t PPO2QueueHandle;
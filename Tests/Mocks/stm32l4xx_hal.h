@@ -8,6 +8,9 @@ extern "C"
 {
 #endif
 
+/* Cortex-M4 core peripherals */
+#include "core_cm4.h"             /* DWT cycle counter */
+
 /* Include mock HAL component headers */
 #include "stm32l4xx_hal_def.h"    /* HAL status types */
 #include "stm32l4xx_hal_gpio.h"   /* GPIO types, ports, and pins */
@@ -17,6 +20,7 @@ extern "C"
 /* Include core HAL function mocks */
 #include "MockHAL.h"              /* HAL_GetTick, HAL_GPIO_WritePin */
 #include "MockDelay.h"            /* HAL_Delay, IWDG, IRQ control */
+#include "MockFlash.h"            /* Flash programming, erase and option bytes */
 
 #ifdef __cplusplus
 }
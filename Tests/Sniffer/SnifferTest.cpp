@@ -0,0 +1,492 @@
+/**
+ * SnifferTest.cpp - Unit tests for the listen-only bus sniffer (Sniffer.c) and its recording format (SnifferFormat.c)
+ *
+ * Tests cover record packing, the ISR -> CANTask double buffer, the flash ring and
+ * switching the controller in and out of listen-only.
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+#include <string.h>
+
+extern "C" {
+    #include "Transciever.h"
+    #include "DiveCAN/Sniffer.h"
+    #include "DiveCAN/SnifferFormat.h"
+    #include "MockCAN.h"
+    #include "MockErrors.h"
+    #include "MockFlash.h"
+    #include "queue.h"
+
+    extern bool snifferToggleRequested;
+}
+
+/* DWT cycles per millisecond at the mock's 16MHz core clock */
+static const uint32_t CYCLES_PER_MS = 16000U;
+
+/* Encode then decode a record, returns the encoded length */
+static uint32_t RoundTrip(const SnifferRecord_t &in, SnifferRecord_t *out) {
+    uint8_t buffer[SNIFFER_RECORD_MAX_LEN] = {0};
+    const uint32_t written = SnifferEncodeRecord(&in, buffer, sizeof(buffer));
+    CHECK_EQUAL(written, SnifferDecodeRecord(buffer, written, out));
+    return written;
+}
+
+static void CheckSameRecord(const SnifferRecord_t &expected, const SnifferRecord_t &actual) {
+    CHECK_EQUAL(expected.deltaMicros, actual.deltaMicros);
+    CHECK_EQUAL(expected.id, actual.id);
+    CHECK_EQUAL(expected.extended, actual.extended);
+    CHECK_EQUAL(expected.remote, actual.remote);
+    CHECK_EQUAL(expected.length, actual.length);
+    if (!expected.remote) {
+        MEMCMP_EQUAL(expected.data, actual.data, (expected.length > 8) ? 8 : expected.length);
+    }
+}
+
+/**
+ * TEST_GROUP: SnifferFormat
+ * Tests packing frames into the recording format and reading them back
+ * CRITICAL: The host decoder reads flash with this code, anything that doesn't round trip is lost
+ */
+TEST_GROUP(SnifferFormat) {
+};
+
+TEST(SnifferFormat, DiveCANIdPacksToTwoBytes) {
+    SnifferRecord_t in = {};
+    in.deltaMicros = 100;
+    in.id = PPO2_PPO2_ID | 0x0301U;
+    in.extended = true;
+    in.length = 4;
+    in.data[0] = 0x00;
+    in.data[1] = 0x64;
+    in.data[2] = 0x65;
+    in.data[3] = 0x66;
+
+    SnifferRecord_t out = {};
+    /* Header, one byte of delta, two of ID, four of payload */
+    CHECK_EQUAL(8, RoundTrip(in, &out));
+    CheckSameRecord(in, out);
+}
+
+TEST(SnifferFormat, EveryIdFormRoundTrips) {
+    SnifferRecord_t records[6] = {};
+    /* Extension range */
+    records[0].id = SNIFFER_STATUS_ID | 0x0201U;
+    records[0].extended = true;
+    records[0].length = 7;
+    /* 29 bit ID with bits outside the DiveCAN layout */
+    records[1].id = 0x1ABCDEF1U;
+    records[1].extended = true;
+    records[1].length = 8;
+    records[1].deltaMicros = 200000;
+    /* Standard ID */
+    records[2].id = 0x7FFU;
+    records[2].length = 2;
+    /* Remote frame, DLC but no payload */
+    records[3].id = 0x123U;
+    records[3].remote = true;
+    records[3].length = 8;
+    /* Classic CAN DLC above 8 */
+    records[4].id = 0x0D0A0001U;
+    records[4].extended = true;
+    records[4].length = 15;
+    /* Longest varint */
+    records[5].id = 0x0D0A0001U;
+    records[5].extended = true;
+    records[5].deltaMicros = 0xFFFFFFFFU;
+
+    for (uint32_t i = 0; i < 6; ++i) {
+        for (uint32_t byte = 0; byte < 8; ++byte) {
+            records[i].data[byte] = (uint8_t)(i * 16 + byte);
+        }
+        SnifferRecord_t out = {};
+        RoundTrip(records[i], &out);
+        CheckSameRecord(records[i], out);
+    }
+}
+
+TEST(SnifferFormat, LiteralIdIsFourBytes) {
+    SnifferRecord_t in = {};
+    in.id = 0x1ABCDEF1U;
+    in.extended = true;
+
+    uint8_t buffer[SNIFFER_RECORD_MAX_LEN] = {0};
+    CHECK_EQUAL(6, SnifferEncodeRecord(&in, buffer, sizeof(buffer)));
+}
+
+TEST(SnifferFormat, EncodeRefusesWhenNoRoom) {
+    SnifferRecord_t in = {};
+    in.id = PPO2_PPO2_ID | 0x0301U;
+    in.extended = true;
+    in.length = 8;
+
+    uint8_t buffer[SNIFFER_RECORD_MAX_LEN];
+    memset(buffer, 0xAA, sizeof(buffer));
+    CHECK_EQUAL(0, SnifferEncodeRecord(&in, buffer, 11));
+    /* Nothing written */
+    CHECK_EQUAL(0xAA, buffer[0]);
+    CHECK_EQUAL(12, SnifferEncodeRecord(&in, buffer, 12));
+}
+
+TEST(SnifferFormat, TruncatedRecordIsRejected) {
+    SnifferRecord_t in = {};
+    in.id = 0x1ABCDEF1U;
+    in.extended = true;
+    in.length = 8;
+    in.deltaMicros = 1000000;
+
+    uint8_t buffer[SNIFFER_RECORD_MAX_LEN] = {0};
+    const uint32_t written = SnifferEncodeRecord(&in, buffer, sizeof(buffer));
+    SnifferRecord_t out = {};
+    for (uint32_t available = 0; available < written; ++available) {
+        CHECK_EQUAL(0, SnifferDecodeRecord(buffer, available, &out));
+    }
+}
+
+TEST(SnifferFormat, ErasedFlashIsNotARecordOrBlock) {
+    uint8_t erased[SNIFFER_BLOCK_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+
+    SnifferRecord_t out = {};
+    CHECK_EQUAL(0, SnifferDecodeRecord(erased, sizeof(erased), &out));
+
+    SnifferBlockHeader_t header;
+    memcpy(&header, erased, sizeof(header));
+    CHECK_FALSE(SnifferBlockValid(&header));
+    header.magic = SNIFFER_BLOCK_MAGIC;
+    CHECK_FALSE(SnifferBlockValid(&header));
+    header.length = SNIFFER_BLOCK_PAYLOAD;
+    CHECK_TRUE(SnifferBlockValid(&header));
+}
+
+/**
+ * TEST_GROUP: Sniffer
+ * Tests recording the bus to flash from the RX ISRs
+ * CRITICAL: The controller must not transmit or ack while recording, and the ISRs must never wait on flash
+ */
+TEST_GROUP(Sniffer) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockCore_Reset();
+        MockFlash_Reset();
+        ResetCANRxRing();
+        ResetCANTxRing();
+        ResetCANSniffer();
+        InitCANFilters(&hcan1);
+    }
+
+    void teardown() {
+        ResetCANSniffer();
+        ResetCANRxRing();
+        ResetCANTxRing();
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+};
+
+/* A frame comes off the bus ms milliseconds after the last one, returns false if the filters or a full FIFO lost it */
+static bool Hear(uint32_t ms, uint32_t id, bool extended, bool remote, uint8_t length) {
+    uint8_t data[8] = {0};
+    for (uint32_t byte = 0; byte < 8; ++byte) {
+        data[byte] = (uint8_t)(id + byte);
+    }
+    MockDWT.CYCCNT += ms * CYCLES_PER_MS;
+    const bool delivered = MockCAN_DeliverRxFrame(id, extended, remote, length, data);
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO1);
+    return delivered;
+}
+
+/* A full payload DiveCAN frame with no gap before it packs to 12 bytes, 20 fill a block */
+static const uint32_t FRAMES_PER_BLOCK = SNIFFER_BLOCK_PAYLOAD / 12U;
+
+static void HearBlocks(uint32_t frames) {
+    for (uint32_t i = 0; i < frames; ++i) {
+        Hear(0, PPO2_MILLIS_ID | 0x0401U, true, false, 8);
+    }
+}
+
+static void ReadBlock(uint32_t slot, SnifferBlockHeader_t *header, uint8_t records[SNIFFER_BLOCK_PAYLOAD]) {
+    uint8_t block[SNIFFER_BLOCK_SIZE] = {0};
+    CHECK_TRUE(ReadCANSnifferFlash(slot * SNIFFER_BLOCK_SIZE, block, sizeof(block)));
+    memcpy(header, block, sizeof(*header));
+    if (records != nullptr) {
+        memcpy(records, &block[SNIFFER_BLOCK_HEADER_SIZE], SNIFFER_BLOCK_PAYLOAD);
+    }
+}
+
+TEST(Sniffer, StartGoesSilentAndErasesRing) {
+    StartCANSniffer();
+
+    CHECK_TRUE(CANListenOnly());
+    CHECK_TRUE(0U != (hcan1.Instance->BTR & CAN_BTR_SILM));
+    CHECK_EQUAL(SNIFFER_TEST_FLASH_PAGES, MockFlash_GetErasedPageCount());
+
+    DiveCANMessage_t message = {};
+    message.id = PPO2_PPO2_ID;
+    message.length = 4;
+    CHECK_EQUAL(CAN_TX_SILENT, TrySendCANMessage(message, CAN_TX_CLASS_CRITICAL));
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+
+    SnifferStats_t stats = {};
+    GetCANSnifferStats(&stats);
+    CHECK_TRUE(stats.active);
+}
+
+TEST(Sniffer, StopRestoresNormalOperation) {
+    StartCANSniffer();
+    StopCANSniffer();
+
+    CHECK_FALSE(CANListenOnly());
+    CHECK_EQUAL(0U, hcan1.Instance->BTR & CAN_BTR_SILM);
+
+    DiveCANMessage_t message = {};
+    message.id = PPO2_PPO2_ID;
+    message.length = 4;
+    CHECK_EQUAL(CAN_TX_OK, TrySendCANMessage(message, CAN_TX_CLASS_CRITICAL));
+    CHECK_EQUAL(1, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(0, MockErrors_GetTotalNonFatalCount());
+}
+
+TEST(Sniffer, CatchAllFilterOnlyWhileRecording) {
+    CHECK_FALSE(Hear(1, 0x123U, false, false, 2));
+
+    StartCANSniffer();
+    CHECK_TRUE(Hear(1, 0x123U, false, false, 2));
+    CHECK_TRUE(Hear(1, 0x1ABCDEF1U, true, false, 2));
+
+    StopCANSniffer();
+    CHECK_FALSE(Hear(1, 0x123U, false, false, 2));
+}
+
+TEST(Sniffer, RecordsEveryFrameButOnlyFilesListedOnes) {
+    StartCANSniffer();
+    Hear(0, BUS_ID_ID | 0x0401U, true, false, 4);
+    Hear(5, 0x1ABCDEF1U, true, false, 8);
+    Hear(20, 0x123U, false, true, 3);
+    StopCANSniffer();
+
+    /* Only the bus ID frame reaches CANTask */
+    const CANRxFrame_t *frame = GetLatestCAN(0);
+    CHECK_TRUE(frame != nullptr);
+    CHECK_EQUAL(BUS_ID_ID | 0x0401U, frame->message.id);
+    ReleaseLatestCAN();
+    POINTERS_EQUAL(nullptr, GetLatestCAN(0));
+
+    SnifferBlockHeader_t header = {};
+    uint8_t records[SNIFFER_BLOCK_PAYLOAD] = {0};
+    ReadBlock(0, &header, records);
+    CHECK_TRUE(SnifferBlockValid(&header));
+    CHECK_EQUAL(0, header.sequence);
+    CHECK_EQUAL(0, header.dropped);
+
+    const uint32_t expectedIds[3] = {BUS_ID_ID | 0x0401U, 0x1ABCDEF1U, 0x123U};
+    const uint32_t expectedDeltas[3] = {0, 5000, 20000};
+    SnifferRecord_t record = {};
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+        const uint32_t used = SnifferDecodeRecord(&records[offset], header.length - offset, &record);
+        CHECK_TRUE(used > 0);
+        CHECK_EQUAL(expectedIds[i], record.id);
+        CHECK_EQUAL(expectedDeltas[i], record.deltaMicros);
+        offset += used;
+    }
+    CHECK_EQUAL(header.length, offset);
+
+    /* The last one was a standard remote frame */
+    CHECK_FALSE(record.extended);
+    CHECK_TRUE(record.remote);
+    CHECK_EQUAL(3, record.length);
+
+    SnifferStats_t stats = {};
+    GetCANSnifferStats(&stats);
+    CHECK_FALSE(stats.active);
+    CHECK_EQUAL(3, stats.frames);
+    CHECK_EQUAL(1, stats.blocks);
+}
+
+TEST(Sniffer, FullBlockIsWrittenOnService) {
+    StartCANSniffer();
+    HearBlocks(FRAMES_PER_BLOCK);
+    ServiceCANSniffer();
+    /* Exactly full, not sealed until the next frame needs the room */
+    CHECK_EQUAL(0, MockFlash_GetProgramCallCount());
+
+    HearBlocks(1);
+    CHECK_EQUAL(0, MockFlash_GetProgramCallCount());
+    ServiceCANSniffer();
+    CHECK_EQUAL(SNIFFER_BLOCK_SIZE / sizeof(uint64_t), MockFlash_GetProgramCallCount());
+
+    SnifferBlockHeader_t header = {};
+    StopCANSniffer();
+    ReadBlock(0, &header, nullptr);
+    CHECK_EQUAL(0, header.sequence);
+    CHECK_EQUAL(SNIFFER_BLOCK_PAYLOAD, header.length);
+    ReadBlock(1, &header, nullptr);
+    CHECK_EQUAL(1, header.sequence);
+    CHECK_EQUAL(12, header.length);
+}
+
+TEST(Sniffer, FramesDroppedWhenBothBuffersFull) {
+    StartCANSniffer();
+    /* CANTask doesn't run: both buffers fill and the next two frames have nowhere to go */
+    HearBlocks((2 * FRAMES_PER_BLOCK) + 2);
+
+    SnifferStats_t stats = {};
+    GetCANSnifferStats(&stats);
+    CHECK_EQUAL(2 * FRAMES_PER_BLOCK, stats.frames);
+    CHECK_EQUAL(2, stats.dropped);
+
+    ServiceCANSniffer();
+    HearBlocks(1);
+    StopCANSniffer();
+
+    SnifferBlockHeader_t header = {};
+    ReadBlock(2, &header, nullptr);
+    CHECK_EQUAL(2, header.sequence);
+    CHECK_EQUAL(2, header.dropped);
+    CHECK_EQUAL(12, header.length);
+    ReadBlock(1, &header, nullptr);
+    CHECK_EQUAL(0, header.dropped);
+}
+
+TEST(Sniffer, QuietBusBlockFlushedAfterTimeout) {
+    StartCANSniffer();
+    HearBlocks(1);
+
+    MockDWT.CYCCNT += (SNIFFER_FLUSH_MICROS / 1000U - 2U) * CYCLES_PER_MS;
+    ServiceCANSniffer();
+    CHECK_EQUAL(0, MockFlash_GetProgramCallCount());
+
+    MockDWT.CYCCNT += 2U * CYCLES_PER_MS;
+    ServiceCANSniffer();
+    CHECK_EQUAL(SNIFFER_BLOCK_SIZE / sizeof(uint64_t), MockFlash_GetProgramCallCount());
+
+    SnifferStats_t stats = {};
+    GetCANSnifferStats(&stats);
+    CHECK_EQUAL(1, stats.blocks);
+    CHECK_TRUE(stats.active);
+}
+
+/* One frame per block, each flushed by the timeout */
+static void WriteBlocks(uint32_t blocks) {
+    for (uint32_t block = 0; block < blocks; ++block) {
+        HearBlocks(1);
+        MockDWT.CYCCNT += (SNIFFER_FLUSH_MICROS / 1000U) * CYCLES_PER_MS;
+        ServiceCANSniffer();
+    }
+}
+
+/* The oldest page is erased as the ring moves onto the page before it, not when the wrap gets to it */
+TEST(Sniffer, RingErasesPageAheadOfWrap) {
+    const uint32_t blockCount = SNIFFER_TEST_FLASH_PAGES * SNIFFER_BLOCKS_PER_PAGE;
+    SnifferBlockHeader_t header = {};
+    StartCANSniffer();
+
+    WriteBlocks(blockCount - SNIFFER_BLOCKS_PER_PAGE);
+    CHECK_EQUAL(SNIFFER_TEST_FLASH_PAGES, MockFlash_GetErasedPageCount());
+    (void)memcpy(&header, MockFlash_Memory(SNIFFER_TEST_FLASH_BASE), sizeof(header));
+    CHECK_TRUE(SnifferBlockValid(&header));
+
+    /* First block on the last page, page 0 goes */
+    WriteBlocks(1);
+    CHECK_EQUAL(SNIFFER_TEST_FLASH_PAGES + 1U, MockFlash_GetErasedPageCount());
+    (void)memcpy(&header, MockFlash_Memory(SNIFFER_TEST_FLASH_BASE), sizeof(header));
+    CHECK_FALSE(SnifferBlockValid(&header));
+
+    /* Wrapped onto page 0, which was ready, page 1 goes */
+    WriteBlocks(SNIFFER_BLOCKS_PER_PAGE);
+    CHECK_EQUAL(SNIFFER_TEST_FLASH_PAGES + 2U, MockFlash_GetErasedPageCount());
+    StopCANSniffer();
+    CHECK_EQUAL(0, MockErrors_GetTotalNonFatalCount());
+
+    ReadBlock(0, &header, nullptr);
+    CHECK_EQUAL(blockCount, header.sequence);
+    ReadBlock(1, &header, nullptr);
+    CHECK_FALSE(SnifferBlockValid(&header));
+    ReadBlock(SNIFFER_BLOCKS_PER_PAGE, &header, nullptr);
+    CHECK_FALSE(SnifferBlockValid(&header));
+    ReadBlock(2 * SNIFFER_BLOCKS_PER_PAGE, &header, nullptr);
+    CHECK_EQUAL(2 * SNIFFER_BLOCKS_PER_PAGE, header.sequence);
+}
+
+TEST(Sniffer, ReadRefusedWhileRecordingOrOutOfRange) {
+    uint8_t buffer[8] = {0};
+    CHECK_EQUAL(SNIFFER_TEST_FLASH_PAGES * SNIFFER_FLASH_PAGE_SIZE, GetCANSnifferFlashSize());
+    CHECK_TRUE(ReadCANSnifferFlash(GetCANSnifferFlashSize() - 8U, buffer, 8));
+    CHECK_FALSE(ReadCANSnifferFlash(GetCANSnifferFlashSize() - 4U, buffer, 8));
+    CHECK_FALSE(ReadCANSnifferFlash(GetCANSnifferFlashSize(), buffer, 0));
+
+    StartCANSniffer();
+    CHECK_FALSE(ReadCANSnifferFlash(0, buffer, 8));
+    StopCANSniffer();
+    CHECK_TRUE(ReadCANSnifferFlash(0, buffer, 8));
+}
+
+TEST(Sniffer, ProgramFailureReported) {
+    StartCANSniffer();
+    HearBlocks(1);
+    MockFlash_SetProgramBehavior(HAL_ERROR);
+    StopCANSniffer();
+
+    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(SNIFFER_FLASH_ERR));
+    SnifferStats_t stats = {};
+    GetCANSnifferStats(&stats);
+    CHECK_FALSE(stats.active);
+}
+
+TEST(Sniffer, MenuToggleStartsAndStops) {
+    snifferToggleRequested = true;
+    ServiceCANSniffer();
+    CHECK_TRUE(CANListenOnly());
+    CHECK_FALSE(snifferToggleRequested);
+
+    /* No request, no change */
+    ServiceCANSniffer();
+    CHECK_TRUE(CANListenOnly());
+
+    snifferToggleRequested = true;
+    ServiceCANSniffer();
+    CHECK_FALSE(CANListenOnly());
+}
+
+TEST(Sniffer, FifoOverrunCountedAsDropped) {
+    StartCANSniffer();
+    const uint8_t data[8] = {0};
+    /* Four frames into the 3 deep FIFO before the ISR gets to it */
+    for (uint32_t i = 0; i < 4; ++i) {
+        MockCAN_DeliverRxFrame(0x1ABCDEF1U, true, false, 8, data);
+    }
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+
+    SnifferStats_t stats = {};
+    GetCANSnifferStats(&stats);
+    CHECK_EQUAL(3, stats.frames);
+    CHECK_EQUAL(1, stats.dropped);
+}
+
+TEST(Sniffer, QueuedAndInFlightFramesAbandonedOnStart) {
+    MockCAN_SetTxManualComplete(true);
+    DiveCANMessage_t message = {};
+    message.id = PPO2_PPO2_ID;
+    message.length = 4;
+    for (uint32_t i = 0; i < 5; ++i) {
+        CHECK_EQUAL(CAN_TX_OK, TrySendCANMessage(message, CAN_TX_CLASS_STATUS));
+    }
+    const uint32_t inFlight = MockCAN_GetTxMessageCount();
+    CHECK_TRUE(inFlight < 5);
+
+    StartCANSniffer();
+    CHECK_EQUAL(inFlight, MockCAN_GetAbortCount());
+
+    /* Back on the bus the frames that were still in the ring are not sent late */
+    StopCANSniffer();
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(inFlight, MockCAN_GetTxMessageCount());
+}
+
+int main(int argc, char** argv) {
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -9,36 +9,35 @@
 #include "CppUTest/CommandLineTestRunner.h"
 
 extern "C" {
-    #define TESTING
-    #define TESTING_CAN
     #include "Transciever.h"
     #include "MockCAN.h"
     #include "MockErrors.h"
     #include "queue.h"
 }
 
+/* Copy the next frame out of the RX ring and release its slot */
+static BaseType_t PopCAN(DiveCANMessage_t *msg) {
+    const CANRxFrame_t *slot = GetLatestCAN(0);
+    if (slot == nullptr) {
+        return pdFAIL;
+    }
+    *msg = slot->message;
+    ReleaseLatestCAN();
+    return pdPASS;
+}
+
 /**
  * TEST_GROUP: RxInterrupt_ISRHandling
  * Tests ISR context handling, buffer overflow protection, and queue operations
  * CRITICAL: Must handle buffer overflow and use ISR-safe error reporting
  */
 TEST_GROUP(RxInterrupt_ISRHandling) {
-    static bool queuesInitialized;
-
     void setup() {
-        /* Clear queues from previous test BEFORE CppUTest starts leak tracking */
-        if (queuesInitialized) {
-            MockQueue_ClearAllQueues();
-        }
-
         MockCAN_Reset();
         MockErrors_Reset();
-
-        /* Only initialize queues once */
-        if (!queuesInitialized) {
-            InitRXQueue();
-            queuesInitialized = true;
-        }
+        MockQueue_ResetFreeRTOS();
+        ResetCANRxRing();
+        InitCANFilters(&hcan1);
     }
 
     void teardown() {
@@ -63,7 +62,7 @@ TEST(RxInterrupt_ISRHandling, BufferOverflow_ExceedsMaxLength) {
 TEST(RxInterrupt_ISRHandling, BufferOverflow_ExactlyMaxLength) {
     const uint8_t maxData[8] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF, 0x11, 0x22};
 
-    rxInterrupt(BUS_INIT_ID, 8, maxData);
+    rxInterrupt(BUS_ID_ID, 8, maxData);
 
     /* Should NOT log overflow error (use ISR-specific counter) */
     CHECK_EQUAL(0, MockErrors_GetNonFatalISRCount(CAN_OVERFLOW_ERR));
@@ -73,11 +72,11 @@ TEST(RxInterrupt_ISRHandling, BufferOverflow_ExactlyMaxLength) {
 TEST(RxInterrupt_ISRHandling, BufferOverflow_DataNotCopiedOnOverflow) {
     const uint8_t oversizeData[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
 
-    rxInterrupt(HUD_STAT_ID, 10, oversizeData);
+    rxInterrupt(BUS_ID_ID, 10, oversizeData);
 
     /* Get the queued message */
     DiveCANMessage_t msg;
-    BaseType_t result = GetLatestCAN(0, &msg);
+    BaseType_t result = PopCAN(&msg);
 
     CHECK_EQUAL(pdPASS, result);
     CHECK_EQUAL(10, msg.length);  /* Length field shows actual length */
@@ -92,13 +91,13 @@ TEST(RxInterrupt_ISRHandling, BufferOverflow_DataNotCopiedOnOverflow) {
 TEST(RxInterrupt_ISRHandling, ValidData_CopiedCorrectly) {
     const uint8_t testData[8] = {0x8a, 0xf3, 0x00, 0x12, 0x34, 0x56, 0x78, 0x9A};
 
-    rxInterrupt(BUS_INIT_ID, 8, testData);
+    rxInterrupt(BUS_ID_ID, 8, testData);
 
     DiveCANMessage_t msg;
-    BaseType_t result = GetLatestCAN(0, &msg);
+    BaseType_t result = PopCAN(&msg);
 
     CHECK_EQUAL(pdPASS, result);
-    CHECK_EQUAL(BUS_INIT_ID, msg.id);
+    CHECK_EQUAL(BUS_ID_ID, msg.id);
     CHECK_EQUAL(8, msg.length);
 
     /* Verify all data bytes copied */
@@ -111,10 +110,10 @@ TEST(RxInterrupt_ISRHandling, ValidData_CopiedCorrectly) {
 TEST(RxInterrupt_ISRHandling, PartialData_OnlyLengthBytesCopied) {
     const uint8_t testData[3] = {0x8a, 0xf3, 0x00};
 
-    rxInterrupt(BUS_INIT_ID, 3, testData);
+    rxInterrupt(BUS_ID_ID, 3, testData);
 
     DiveCANMessage_t msg;
-    BaseType_t result = GetLatestCAN(0, &msg);
+    BaseType_t result = PopCAN(&msg);
 
     CHECK_EQUAL(pdPASS, result);
     CHECK_EQUAL(3, msg.length);
@@ -130,164 +129,397 @@ TEST(RxInterrupt_ISRHandling, PartialData_OnlyLengthBytesCopied) {
     }
 }
 
-/* Verify ID field is correctly stored */
+/* Verify ID field is correctly stored, source and all */
 TEST(RxInterrupt_ISRHandling, MessageID_StoredCorrectly) {
     const uint8_t testData[3] = {0x8a, 0xf3, 0x00};
-    const uint32_t testID = 0xDEADBEEF;
+    const uint32_t testID = CAN_SERIAL_NUMBER_ID | DIVECAN_REVO;
 
     rxInterrupt(testID, 3, testData);
 
     DiveCANMessage_t msg;
-    BaseType_t result = GetLatestCAN(0, &msg);
+    BaseType_t result = PopCAN(&msg);
 
     CHECK_EQUAL(pdPASS, result);
     CHECK_EQUAL(testID, msg.id);
 }
 
+/* CRITICAL: IDs off DIVECAN_RX_ID_LIST are stopped by the filter banks and never reach CANTask */
+TEST(RxInterrupt_ISRHandling, FilteredID_NotDelivered) {
+    const uint8_t testData[3] = {0x8a, 0xf3, 0x00};
+
+    rxInterrupt(HUD_STAT_ID, 3, testData);
+    rxInterrupt(BUS_INIT_ID, 3, testData);
+
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdFAIL, PopCAN(&msg));
+    CHECK_EQUAL(0, TakeCoalescedCAN());
+    CHECK_EQUAL(0, MockCAN_GetRxReadCount());
+}
+
 /* Verify multiple messages are queued in order */
 TEST(RxInterrupt_ISRHandling, MultipleMessages_QueuedInOrder) {
     const uint8_t data1[3] = {0x11, 0x22, 0x33};
     const uint8_t data2[3] = {0x44, 0x55, 0x66};
     const uint8_t data3[3] = {0x77, 0x88, 0x99};
 
-    rxInterrupt(BUS_INIT_ID, 3, data1);
-    rxInterrupt(PPO2_PPO2_ID, 3, data2);
-    rxInterrupt(HUD_STAT_ID, 3, data3);
+    rxInterrupt(BUS_ID_ID, 3, data1);
+    rxInterrupt(CAN_SERIAL_NUMBER_ID, 3, data2);
+    rxInterrupt(RX_STATS_REQ_ID, 3, data3);
 
     /* Retrieve in FIFO order */
     DiveCANMessage_t msg;
 
-    CHECK_EQUAL(pdPASS, GetLatestCAN(0, &msg));
-    CHECK_EQUAL(BUS_INIT_ID, msg.id);
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(BUS_ID_ID, msg.id);
     CHECK_EQUAL(0x11, msg.data[0]);
 
-    CHECK_EQUAL(pdPASS, GetLatestCAN(0, &msg));
-    CHECK_EQUAL(PPO2_PPO2_ID, msg.id);
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(CAN_SERIAL_NUMBER_ID, msg.id);
     CHECK_EQUAL(0x44, msg.data[0]);
 
-    CHECK_EQUAL(pdPASS, GetLatestCAN(0, &msg));
-    CHECK_EQUAL(HUD_STAT_ID, msg.id);
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(RX_STATS_REQ_ID, msg.id);
     CHECK_EQUAL(0x77, msg.data[0]);
 }
 
-/* Initialize static flag */
-bool TEST_GROUP_CppUTestGroupRxInterrupt_ISRHandling::queuesInitialized = false;
+/* Frames are handed out in place, the same slot until it is released */
+TEST(RxInterrupt_ISRHandling, InPlace_SlotStableUntilRelease) {
+    const uint8_t data1[1] = {0x11};
+    const uint8_t data2[1] = {0x22};
+
+    rxInterrupt(BUS_ID_ID, 1, data1);
+    rxInterrupt(CAN_SERIAL_NUMBER_ID, 1, data2);
+
+    const CANRxFrame_t *first = GetLatestCAN(0);
+    CHECK_TRUE(first != nullptr);
+    POINTERS_EQUAL(first, GetLatestCAN(0));
+    CHECK_EQUAL(BUS_ID_ID, first->message.id);
+
+    ReleaseLatestCAN();
+    const CANRxFrame_t *second = GetLatestCAN(0);
+    CHECK_TRUE(second != nullptr);
+    CHECK_TRUE(second != first);
+    CHECK_EQUAL(CAN_SERIAL_NUMBER_ID, second->message.id);
+    ReleaseLatestCAN();
+
+    POINTERS_EQUAL(nullptr, GetLatestCAN(0));
+}
+
+/* Ring frames carry the tick and cycle count of the ISR that read them, not when CANTask got to them */
+TEST(RxInterrupt_ISRHandling, Frame_StampedInISR) {
+    const uint8_t data[1] = {0};
+    MockQueue_SetTickCount(42);
+    MockDWT.CYCCNT = 12345;
+    rxInterrupt(BUS_ID_ID, 1, data);
+
+    MockQueue_SetTickCount(90);
+    MockDWT.CYCCNT = 99999;
+    const CANRxFrame_t *frame = GetLatestCAN(0);
+    CHECK_TRUE(frame != nullptr);
+    CHECK_EQUAL(42, frame->timestamp);
+    CHECK_EQUAL(12345, frame->rxCycles);
+    ReleaseLatestCAN();
+}
+
+/* Empty ring returns NULL rather than stale data, releasing it is a logic error */
+TEST(RxInterrupt_ISRHandling, Empty_ReturnsNull) {
+    POINTERS_EQUAL(nullptr, GetLatestCAN(0));
+    POINTERS_EQUAL(nullptr, GetLatestCAN(10));
+
+    ReleaseLatestCAN();
+    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(UNREACHABLE_ERR));
+}
+
+/* CRITICAL: a full ring drops the newest frame, counts it, and keeps the queued ones intact */
+TEST(RxInterrupt_ISRHandling, Overflow_CountedAndOldestKept) {
+    for (uint8_t i = 0; i < 20; i++) {
+        rxInterrupt(BUS_ID_ID | i, 1, &i);
+    }
+
+    CANRxRingStats_t stats = {0, 0, 0};
+    GetCANRxRingStats(CAN_FILTER_FIFO0, &stats);
+    CHECK_EQUAL(4, stats.overflows);
+    CHECK_EQUAL(16, stats.highWater);
+    CHECK_EQUAL(4, MockErrors_GetNonFatalISRCount(QUEUEING_ERR));
+
+    DiveCANMessage_t msg;
+    for (uint8_t i = 0; i < 16; i++) {
+        CHECK_EQUAL(pdPASS, PopCAN(&msg));
+        CHECK_EQUAL(BUS_ID_ID | i, msg.id);
+        CHECK_EQUAL(i, msg.data[0]);
+    }
+    CHECK_EQUAL(pdFAIL, PopCAN(&msg));
+}
+
+/* High water tracks the deepest fill, not the current one, and survives wrapping */
+TEST(RxInterrupt_ISRHandling, HighWater_TracksPeakAcrossWrap) {
+    const uint8_t data[1] = {0};
+    DiveCANMessage_t msg;
+
+    for (int i = 0; i < 3; i++) {
+        rxInterrupt(BUS_ID_ID, 1, data);
+    }
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    }
+
+    /* Wrap the indices a few times with one frame in flight */
+    for (int i = 0; i < 40; i++) {
+        rxInterrupt(BUS_ID_ID, 1, data);
+        CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    }
+
+    CANRxRingStats_t stats = {0, 0, 0};
+    GetCANRxRingStats(CAN_FILTER_FIFO0, &stats);
+    CHECK_EQUAL(3, stats.highWater);
+    CHECK_EQUAL(0, stats.overflows);
+}
 
 /**
- * TEST_GROUP: TxStartDevice_BitManipulation
- * Tests BUS_INIT message ID construction using bit manipulation
- * CRITICAL: ID format must be: BUS_INIT_ID | (deviceType << 8) | targetDeviceType
+ * TEST_GROUP: RxCoalesced_LatestValue
+ * Tests the per-ID latest value slots used for state-like frames
+ * CRITICAL: A burst of other traffic must never drop or delay the newest PPO2
  */
-TEST_GROUP(TxStartDevice_BitManipulation) {
+TEST_GROUP(RxCoalesced_LatestValue) {
     void setup() {
         MockCAN_Reset();
         MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockQueue_SetTickCount(0);
+        ResetCANRxRing();
+        InitCANFilters(&hcan1);
     }
 
     void teardown() {
         MockCAN_Reset();
         MockErrors_Reset();
+        MockQueue_ClearAllQueues();
     }
 };
 
-/* Verify ID bit manipulation: BUS_INIT_ID | (deviceType << 8) | targetDeviceType */
-TEST(TxStartDevice_BitManipulation, MonitorToController_IDBitsCorrect) {
-    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+/* State frames bypass the ring and only the newest survives */
+TEST(RxCoalesced_LatestValue, NewestValueWins) {
+    for (uint8_t i = 1; i <= 5; i++) {
+        const uint8_t data[4] = {0x00, i, i, i};
+        MockQueue_SetTickCount(100 + i);
+        rxInterrupt(PPO2_PPO2_ID | DIVECAN_SOLO, 4, data);
+    }
 
-    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_MONITOR << 8) | DIVECAN_CONTROLLER;
-    /* BUS_INIT_ID = 0xD370000
-     * DIVECAN_MONITOR (3) << 8 = 0x300
-     * DIVECAN_CONTROLLER (1) = 0x1
-     * Result: 0xD370000 | 0x300 | 0x1 = 0xD370301
-     */
-    CHECK_EQUAL(expectedID, 0xD370301);
+    POINTERS_EQUAL(nullptr, GetLatestCAN(0));
+    CHECK_EQUAL(1U << CAN_COALESCED_PPO2_PPO2_ID, TakeCoalescedCAN());
 
-    CHECK_EQUAL(1, MockCAN_GetTxMessageCount());
+    CANCoalesced_t latest = {};
+    CHECK_TRUE(ReadCoalescedCAN(CAN_COALESCED_PPO2_PPO2_ID, &latest));
+    CHECK_EQUAL(PPO2_PPO2_ID | DIVECAN_SOLO, latest.message.id);
+    CHECK_EQUAL(4, latest.message.length);
+    CHECK_EQUAL(5, latest.message.data[1]);
+    CHECK_EQUAL(105, latest.timestamp);
+    CHECK_EQUAL(5, latest.sequence);
+}
 
-    uint32_t actualID;
-    uint8_t length;
-    uint8_t data[8];
-    CHECK_TRUE(MockCAN_GetLastTxMessage(&actualID, &length, data));
-    CHECK_EQUAL(expectedID, actualID);
+/* Taking the dirty mask clears it, a slot only comes back once rewritten */
+TEST(RxCoalesced_LatestValue, DirtyMask_ClearedOnTake) {
+    const uint8_t data[2] = {0x01, 0x02};
+
+    rxInterrupt(PPO2_STATUS_ID | DIVECAN_SOLO, 2, data);
+    rxInterrupt(PPO2_SETPOINT_ID | DIVECAN_SOLO, 2, data);
+
+    CHECK_EQUAL((1U << CAN_COALESCED_PPO2_STATUS_ID) | (1U << CAN_COALESCED_PPO2_SETPOINT_ID), TakeCoalescedCAN());
+    CHECK_EQUAL(0, TakeCoalescedCAN());
+
+    rxInterrupt(PPO2_STATUS_ID | DIVECAN_SOLO, 2, data);
+    CHECK_EQUAL(1U << CAN_COALESCED_PPO2_STATUS_ID, TakeCoalescedCAN());
+
+    /* Value is still readable after it has been taken */
+    CANCoalesced_t latest = {};
+    CHECK_TRUE(ReadCoalescedCAN(CAN_COALESCED_PPO2_SETPOINT_ID, &latest));
+    CHECK_EQUAL(1, latest.sequence);
 }
 
-/* Test all device type combinations */
-TEST(TxStartDevice_BitManipulation, OBOEToController_IDBitsCorrect) {
-    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_OBOE);
+/* The bus state frames each get a slot of their own */
+TEST(RxCoalesced_LatestValue, BusStateFrames_Coalesced) {
+    const uint8_t data[8] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+
+    rxInterrupt(PPO2_ATMOS_ID | DIVECAN_CONTROLLER, 8, data);
+    rxInterrupt(PPO2_MILLIS_ID | DIVECAN_SOLO, 7, data);
+    rxInterrupt(TANK_PRESSURE_ID | DIVECAN_CONTROLLER, 8, data);
+    rxInterrupt(BUS_STATUS_ID | DIVECAN_SOLO, 8, data);
+    rxInterrupt(DIVING_ID | DIVECAN_CONTROLLER, 8, data);
+
+    POINTERS_EQUAL(nullptr, GetLatestCAN(0));
+    CHECK_EQUAL((1U << CAN_COALESCED_PPO2_ATMOS_ID) | (1U << CAN_COALESCED_PPO2_MILLIS_ID) |
+                    (1U << CAN_COALESCED_TANK_PRESSURE_ID) | (1U << CAN_COALESCED_BUS_STATUS_ID) |
+                    (1U << CAN_COALESCED_DIVING_ID),
+                TakeCoalescedCAN());
+
+    CANCoalesced_t latest = {};
+    CHECK_TRUE(ReadCoalescedCAN(CAN_COALESCED_BUS_STATUS_ID, &latest));
+    CHECK_EQUAL(BUS_STATUS_ID | DIVECAN_SOLO, latest.message.id);
+}
 
-    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_OBOE << 8) | DIVECAN_CONTROLLER;
-    /* OBOE (2) << 8 = 0x200, CONTROLLER (1) = 0x1 → 0xD370201 */
+/* Never written, or out of range, reads as invalid */
+TEST(RxCoalesced_LatestValue, EmptySlot_NotValid) {
+    CANCoalesced_t latest = {};
+    CHECK_FALSE(ReadCoalescedCAN(CAN_COALESCED_PPO2_PPO2_ID, &latest));
+    CHECK_FALSE(ReadCoalescedCAN(CAN_COALESCED_SLOT_COUNT, &latest));
+    CHECK_EQUAL(0, TakeCoalescedCAN());
+}
 
-    uint32_t actualID;
-    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
-    CHECK_EQUAL(0xD370201, actualID);
+/* CRITICAL: a full ring of log/event traffic doesn't stop PPO2 getting through */
+TEST(RxCoalesced_LatestValue, RingFull_PPO2StillDelivered) {
+    const uint8_t filler[8] = {0};
+    for (int i = 0; i < 32; i++) {
+        rxInterrupt(BUS_ID_ID, 8, filler);
+    }
+
+    const uint8_t ppo2[4] = {0x00, 0x64, 0x65, 0x66};
+    rxInterrupt(PPO2_PPO2_ID | DIVECAN_SOLO, 4, ppo2);
+
+    CANRxRingStats_t stats = {0, 0, 0};
+    GetCANRxRingStats(CAN_FILTER_FIFO0, &stats);
+    CHECK_EQUAL(16, stats.overflows);
+
+    CHECK_EQUAL(1U << CAN_COALESCED_PPO2_PPO2_ID, TakeCoalescedCAN());
+    CANCoalesced_t latest = {};
+    CHECK_TRUE(ReadCoalescedCAN(CAN_COALESCED_PPO2_PPO2_ID, &latest));
+    CHECK_EQUAL(0x64, latest.message.data[1]);
 }
 
-TEST(TxStartDevice_BitManipulation, SOLOToMonitor_IDBitsCorrect) {
-    txStartDevice(DIVECAN_MONITOR, DIVECAN_SOLO);
+/* Event frames keep FIFO semantics, every BUS_OFF is delivered */
+TEST(RxCoalesced_LatestValue, EventFrames_StayInRing) {
+    const uint8_t data[1] = {0};
+    rxInterrupt(BUS_OFF_ID | DIVECAN_SOLO, 1, data);
+    rxInterrupt(BUS_OFF_ID | DIVECAN_SOLO, 1, data);
 
-    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_SOLO << 8) | DIVECAN_MONITOR;
-    /* SOLO (4) << 8 = 0x400, MONITOR (3) = 0x3 → 0xD370403 */
+    CHECK_EQUAL(0, TakeCoalescedCAN());
 
-    uint32_t actualID;
-    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
-    CHECK_EQUAL(0xD370403, actualID);
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(BUS_OFF_ID | DIVECAN_SOLO, msg.id);
+    CHECK_EQUAL(pdFAIL, PopCAN(&msg));
 }
 
-TEST(TxStartDevice_BitManipulation, RevoToOBOE_IDBitsCorrect) {
-    txStartDevice(DIVECAN_OBOE, DIVECAN_REVO);
+/**
+ * TEST_GROUP: RxFifo_PriorityRouting
+ * Tests the split between the priority (FIFO1) and bulk (FIFO0) paths
+ * CRITICAL: Shutdown must not wait behind bulk traffic, counters are per FIFO
+ */
+TEST_GROUP(RxFifo_PriorityRouting) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        ResetCANRxRing();
+        InitCANFilters(&hcan1);
+    }
 
-    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_REVO << 8) | DIVECAN_OBOE;
-    /* REVO (5) << 8 = 0x500, OBOE (2) = 0x2 → 0xD370502 */
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ClearAllQueues();
+    }
+};
 
-    uint32_t actualID;
-    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
-    CHECK_EQUAL(0xD370502, actualID);
+/* A priority frame overtakes bulk frames that arrived before it */
+TEST(RxFifo_PriorityRouting, PriorityRingDrainedFirst) {
+    const uint8_t data[1] = {0};
+    rxInterrupt(BUS_ID_ID | DIVECAN_SOLO, 1, data);
+    rxInterrupt(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO, 1, data);
+    rxInterrupt(BUS_OFF_ID | DIVECAN_SOLO, 1, data);
+
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(BUS_OFF_ID | DIVECAN_SOLO, msg.id);
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(BUS_ID_ID | DIVECAN_SOLO, msg.id);
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO, msg.id);
+    CHECK_EQUAL(pdFAIL, PopCAN(&msg));
 }
 
-/* Verify magic bytes in data payload */
-TEST(TxStartDevice_BitManipulation, MagicBytes_0x8a_0xf3_0x00) {
-    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+/* A message that has been handed out stays handed out, even if a priority frame lands meanwhile */
+TEST(RxFifo_PriorityRouting, HeldMessage_NotSwitchedUnderneath) {
+    const uint8_t data[1] = {0};
+    rxInterrupt(BUS_ID_ID, 1, data);
 
-    uint8_t data[8];
-    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, nullptr, data));
+    const CANRxFrame_t *held = GetLatestCAN(0);
+    CHECK_TRUE(held != nullptr);
 
-    CHECK_EQUAL(0x8a, data[0]);
-    CHECK_EQUAL(0xf3, data[1]);
-    CHECK_EQUAL(0x00, data[2]);
+    rxInterrupt(BUS_OFF_ID, 1, data);
+    POINTERS_EQUAL(held, GetLatestCAN(0));
+    CHECK_EQUAL(BUS_ID_ID, held->message.id);
+    ReleaseLatestCAN();
+
+    const CANRxFrame_t *next = GetLatestCAN(0);
+    CHECK_TRUE(next != nullptr);
+    CHECK_EQUAL(BUS_OFF_ID, next->message.id);
+    ReleaseLatestCAN();
 }
 
-/* Verify message length is 3 bytes */
-TEST(TxStartDevice_BitManipulation, MessageLength_3Bytes) {
-    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+/* Bulk overflow doesn't cost the priority ring anything */
+TEST(RxFifo_PriorityRouting, RingOverflow_CountedPerFifo) {
+    const uint8_t data[1] = {0};
+    for (int i = 0; i < 20; i++) {
+        rxInterrupt(BUS_ID_ID, 1, data);
+    }
+    rxInterrupt(BUS_OFF_ID, 1, data);
 
-    uint8_t length;
-    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, &length, nullptr));
-    CHECK_EQUAL(3, length);
+    CANRxRingStats_t bulk = {0, 0, 0};
+    CANRxRingStats_t priority = {0, 0, 0};
+    GetCANRxRingStats(CAN_FILTER_FIFO0, &bulk);
+    GetCANRxRingStats(CAN_FILTER_FIFO1, &priority);
+
+    CHECK_EQUAL(4, bulk.overflows);
+    CHECK_EQUAL(16, bulk.highWater);
+    CHECK_EQUAL(0, priority.overflows);
+    CHECK_EQUAL(1, priority.highWater);
+
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(BUS_OFF_ID, msg.id);
 }
 
-/* Verify remaining data bytes are zero */
-TEST(TxStartDevice_BitManipulation, RemainingBytes_AllZero) {
-    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+/* Hardware overruns are counted against the FIFO that overran */
+TEST(RxFifo_PriorityRouting, HardwareOverrun_CountedPerFifo) {
+    rxOverrunInterrupt(CAN_FILTER_FIFO0);
+    rxOverrunInterrupt(CAN_FILTER_FIFO0);
+    rxOverrunInterrupt(CAN_FILTER_FIFO1);
+
+    CANRxRingStats_t bulk = {0, 0, 0};
+    CANRxRingStats_t priority = {0, 0, 0};
+    GetCANRxRingStats(CAN_FILTER_FIFO0, &bulk);
+    GetCANRxRingStats(CAN_FILTER_FIFO1, &priority);
+
+    CHECK_EQUAL(2, bulk.hwOverruns);
+    CHECK_EQUAL(1, priority.hwOverruns);
+    CHECK_EQUAL(0, bulk.overflows);
+    CHECK_EQUAL(3, MockErrors_GetNonFatalISRCount(CAN_RX_OVERRUN_ERR));
+}
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+/* Out of range FIFO is reported, not indexed */
+TEST(RxFifo_PriorityRouting, InvalidFifo_Reported) {
+    CANRxRingStats_t stats = {0, 0, 0};
+    GetCANRxRingStats(CAN_RX_FIFO_COUNT, &stats);
+    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(UNREACHABLE_ERR));
 
-    for (int i = 3; i < 8; i++) {
-        CHECK_EQUAL(0x00, data[i]);
-    }
+    rxOverrunInterrupt(CAN_RX_FIFO_COUNT);
+    CHECK_EQUAL(1, MockErrors_GetNonFatalISRCount(CAN_RX_OVERRUN_ERR));
 }
 
 /**
- * TEST_GROUP: TxID_BitManipulation
- * Tests BUS_ID message ID construction and data payload encoding
- * ID format: BUS_ID_ID | deviceType
- * Data format: [manufacturerID, 0x00, firmwareVersion, 0x00, ...]
+ * TEST_GROUP: RxFifo_DrainBurst
+ * Tests the RX FIFO interrupt handler draining the hardware FIFO in one entry
+ * CRITICAL: The controller's back to back PPO2/millivolt/status frames must cost one ISR entry and one wake
  */
-TEST_GROUP(TxID_BitManipulation) {
+TEST_GROUP(RxFifo_DrainBurst) {
     void setup() {
         MockCAN_Reset();
         MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockCore_Reset();
+        ResetCANRxRing();
+        InitCANFilters(&hcan1);
     }
 
     void teardown() {
@@ -296,105 +528,264 @@ TEST_GROUP(TxID_BitManipulation) {
     }
 };
 
-/* Verify ID bit manipulation: BUS_ID_ID | deviceType */
-TEST(TxID_BitManipulation, Monitor_ISC_FW10_IDBitsCorrect) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+/* Put the frames the controller sends each PPO2 cycle into the hardware FIFOs */
+static void DeliverPPO2Burst(void) {
+    const uint8_t data[8] = {0, 100, 100, 100, 0, 0, 0, 0};
+    MockCAN_DeliverRxMessage(PPO2_PPO2_ID | DIVECAN_SOLO, 4, data);
+    MockCAN_DeliverRxMessage(PPO2_MILLIS_ID | DIVECAN_SOLO, 7, data);
+    MockCAN_DeliverRxMessage(PPO2_STATUS_ID | DIVECAN_SOLO, 2, data);
+}
 
-    uint32_t expectedID = BUS_ID_ID | DIVECAN_MONITOR;
-    /* BUS_ID_ID = 0xD000000, MONITOR (3) → 0xD000003 */
+/* NVIC model: the interrupt keeps firing while the FIFO is non empty, returns how many times it was entered */
+static uint32_t ServiceRxIrq(uint32_t fifo) {
+    uint32_t entries = 0;
+    while (HAL_CAN_GetRxFifoFillLevel(&hcan1, fifo) > 0) {
+        entries++;
+        rxFifoInterrupt(&hcan1, fifo);
+    }
+    return entries;
+}
 
-    uint32_t actualID;
-    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
-    CHECK_EQUAL(0xD000003, actualID);
+/* The old handler: one frame unpacked through the HAL and one wake per entry */
+static uint32_t ServiceRxIrqPerFrame(uint32_t fifo, uint32_t *wakes) {
+    uint32_t entries = 0;
+    while (HAL_CAN_GetRxFifoFillLevel(&hcan1, fifo) > 0) {
+        entries++;
+        CAN_RxHeaderTypeDef header = {0, 0, 0, 0, 0, 0, 0};
+        uint8_t data[8] = {0};
+        CHECK_EQUAL(HAL_OK, HAL_CAN_GetRxMessage(&hcan1, fifo, &header, data));
+        (*wakes)++;
+    }
+    return entries;
 }
 
-TEST(TxID_BitManipulation, OBOE_SRI_FW255_IDBitsCorrect) {
-    txID(DIVECAN_OBOE, DIVECAN_MANUFACTURER_SRI, 255);
+/* ISR entries and wakes per frame, draining vs the old one frame per entry handler */
+TEST(RxFifo_DrainBurst, IsrEntriesPerFrame_DrainVsPerFrame) {
+    const uint32_t bursts = 8;
 
-    uint32_t expectedID = BUS_ID_ID | DIVECAN_OBOE;
-    /* BUS_ID_ID = 0xD000000, OBOE (2) → 0xD000002 */
+    (void)GetLatestCAN(1); /* CANTask registers itself the first time it waits */
 
-    uint32_t actualID;
-    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
-    CHECK_EQUAL(0xD000002, actualID);
+    uint32_t drainEntries = 0;
+    for (uint32_t i = 0; i < bursts; i++) {
+        DeliverPPO2Burst();
+        drainEntries += ServiceRxIrq(CAN_RX_FIFO1);
+    }
+    const uint32_t drainFrames = MockCAN_GetRxReadCount();
+    const uint32_t drainWakes = MockQueue_GetNotifyGiveCount();
+
+    MockCAN_Reset();
+    InitCANFilters(&hcan1);
+    uint32_t perFrameEntries = 0;
+    uint32_t perFrameWakes = 0;
+    for (uint32_t i = 0; i < bursts; i++) {
+        DeliverPPO2Burst();
+        perFrameEntries += ServiceRxIrqPerFrame(CAN_RX_FIFO1, &perFrameWakes);
+    }
+    const uint32_t perFrameFrames = MockCAN_GetRxReadCount();
+
+    /* Millivolts are filtered in hardware, PPO2 and status reach the priority FIFO */
+    CHECK_EQUAL(2 * bursts, drainFrames);
+    CHECK_EQUAL(drainFrames, perFrameFrames);
+
+    /* Before: 1 entry and 1 wake per frame. After: 1 of each per burst */
+    CHECK_EQUAL(perFrameFrames, perFrameEntries);
+    CHECK_EQUAL(perFrameFrames, perFrameWakes);
+    CHECK_EQUAL(bursts, drainEntries);
+    CHECK_EQUAL(bursts, drainWakes);
+    CHECK_EQUAL(0, MockErrors_GetNonFatalISRCount(QUEUEING_ERR));
 }
 
-/* Verify manufacturer ID encoding in data[0] */
-TEST(TxID_BitManipulation, ManufacturerID_ISC_EncodedCorrectly) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+/* A full hardware FIFO is emptied in one entry, in arrival order */
+TEST(RxFifo_DrainBurst, FullFifo_DrainedInOrder) {
+    const uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 3, data));
+    CHECK_TRUE(MockCAN_DeliverRxMessage(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO, 8, data));
+    CHECK_TRUE(MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_OBOE, 3, data));
+    CHECK_FALSE(MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_CONTROLLER, 3, data)); /* 3 deep */
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    CHECK_EQUAL(1, ServiceRxIrq(CAN_RX_FIFO0));
 
-    CHECK_EQUAL(DIVECAN_MANUFACTURER_ISC, data[0]);
-    CHECK_EQUAL(0x00, data[1]);  /* Reserved byte */
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(BUS_ID_ID | DIVECAN_SOLO, msg.id);
+    CHECK_EQUAL(3, msg.length);
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO, msg.id);
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(BUS_ID_ID | DIVECAN_OBOE, msg.id);
+    CHECK_EQUAL(pdFAIL, PopCAN(&msg));
 }
 
-TEST(TxID_BitManipulation, ManufacturerID_SRI_EncodedCorrectly) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_SRI, 10);
+/* Coalesced frames are drained into their slots in the same entry */
+TEST(RxFifo_DrainBurst, CoalescedFrames_DrainedToSlots) {
+    DeliverPPO2Burst();
+    CHECK_EQUAL(1, ServiceRxIrq(CAN_RX_FIFO1));
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    CHECK_EQUAL((1UL << CAN_COALESCED_PPO2_PPO2_ID) | (1UL << CAN_COALESCED_PPO2_STATUS_ID), TakeCoalescedCAN());
+    CANCoalesced_t latest = {};
+    CHECK_TRUE(ReadCoalescedCAN(CAN_COALESCED_PPO2_PPO2_ID, &latest));
+    CHECK_EQUAL(PPO2_PPO2_ID | DIVECAN_SOLO, latest.message.id);
+    CHECK_EQUAL(100, latest.message.data[1]);
+}
 
-    CHECK_EQUAL(DIVECAN_MANUFACTURER_SRI, data[0]);
+/* Nothing to read, nobody woken */
+TEST(RxFifo_DrainBurst, EmptyFifo_NoWake) {
+    (void)GetLatestCAN(1);
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO1);
+
+    CHECK_EQUAL(0, MockQueue_GetNotifyGiveCount());
+    CHECK_EQUAL(0, MockCAN_GetRxReadCount());
 }
 
-TEST(TxID_BitManipulation, ManufacturerID_GEN_EncodedCorrectly) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_GEN, 10);
+/* Non-frame wakes (CAN_EN edge) get CANTask out of its wait without queueing anything */
+TEST(RxFifo_DrainBurst, WakeFromIsr_WakesWithoutFrame) {
+    WakeCANTaskFromISR();
+    CHECK_EQUAL(0, MockQueue_GetNotifyGiveCount()); /* CANTask hasn't registered yet */
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    (void)GetLatestCAN(1);
+    WakeCANTaskFromISR();
 
-    CHECK_EQUAL(DIVECAN_MANUFACTURER_GEN, data[0]);
+    CHECK_EQUAL(1, MockQueue_GetNotifyGiveCount());
+    DiveCANMessage_t msg = {};
+    CHECK_EQUAL(pdFAIL, PopCAN(&msg));
 }
 
-/* Verify firmware version encoding in data[2] */
-TEST(TxID_BitManipulation, FirmwareVersion_10_EncodedCorrectly) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+/* Frames that land before CANTask first waits are still picked up, just without a wake */
+TEST(RxFifo_DrainBurst, NoConsumerYet_FramesKept) {
+    DeliverPPO2Burst();
+    CHECK_EQUAL(1, ServiceRxIrq(CAN_RX_FIFO1));
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    CHECK_EQUAL(0, MockQueue_GetNotifyGiveCount());
+    CHECK_TRUE(0 != TakeCoalescedCAN());
+}
 
-    CHECK_EQUAL(10, data[2]);
+/* A wake for a burst that was already handled doesn't cut the next wait short */
+TEST(RxFifo_DrainBurst, StaleWake_ClearedBeforeBlocking) {
+    (void)GetLatestCAN(1);
+    CHECK_EQUAL(1, MockQueue_GetNotifyBlockCount());
+
+    const uint8_t data[8] = {0};
+    MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 3, data);
+    (void)ServiceRxIrq(CAN_RX_FIFO0);
+    CHECK_EQUAL(1, MockQueue_GetNotifyGiveCount());
+
+    /* Handled without blocking, so the notification is still pending */
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+
+    CHECK_TRUE(GetLatestCAN(10) == nullptr);
+    CHECK_EQUAL(2, MockQueue_GetNotifyBlockCount());
 }
 
-TEST(TxID_BitManipulation, FirmwareVersion_255_EncodedCorrectly) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 255);
+/* The wake asks for a context switch on ISR exit, so CANTask doesn't wait for the next tick */
+TEST(RxFifo_DrainBurst, Wake_YieldsOnIsrExit) {
+    (void)GetLatestCAN(1);
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    CHECK_EQUAL(1, MockQueue_GetNotifyGiveCount());
+    CHECK_EQUAL(1, MockQueue_GetYieldFromISRCount());
+}
 
-    CHECK_EQUAL(255, data[2]);
+/* Nobody to wake, no switch */
+TEST(RxFifo_DrainBurst, NoWake_NoYield) {
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
+
+    CHECK_EQUAL(0, MockQueue_GetYieldFromISRCount());
 }
 
-TEST(TxID_BitManipulation, FirmwareVersion_0_EncodedCorrectly) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 0);
+/* The probe starts the cycle counter */
+TEST(RxFifo_DrainBurst, LatencyProbe_EnablesCycleCounter) {
+    InitCANRxLatencyProbe();
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    CHECK_TRUE(0 != (MockCoreDebug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk));
+    CHECK_TRUE(0 != (MockDWT.CTRL & DWT_CTRL_CYCCNTENA_Msk));
+}
 
-    CHECK_EQUAL(0, data[2]);
+/* ISR entry to pickup is measured per burst, with min/max/last */
+TEST(RxFifo_DrainBurst, LatencyProbe_IsrEntryToPickup) {
+    MockDWT.CYCCNT = 1000;
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
+    MockDWT.CYCCNT = 1800;
+    (void)GetLatestCAN(0);
+
+    MockDWT.CYCCNT = 5000;
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
+    MockDWT.CYCCNT = 5300;
+    (void)GetLatestCAN(0);
+
+    /* Nothing new, nothing measured */
+    MockDWT.CYCCNT = 9000;
+    (void)GetLatestCAN(0);
+
+    CANRxLatency_t latency = {0, 0, 0, 0};
+    GetCANRxLatency(&latency);
+    CHECK_EQUAL(2, latency.samples);
+    CHECK_EQUAL(300, latency.lastCycles);
+    CHECK_EQUAL(300, latency.minCycles);
+    CHECK_EQUAL(800, latency.maxCycles);
 }
 
-/* Verify message length is 3 bytes */
-TEST(TxID_BitManipulation, MessageLength_3Bytes) {
-    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+/* Two bursts before CANTask gets in, the older one is what's measured */
+TEST(RxFifo_DrainBurst, LatencyProbe_MeasuresOldestBurst) {
+    MockDWT.CYCCNT = 100;
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
+    MockDWT.CYCCNT = 400;
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
+    MockDWT.CYCCNT = 1100;
+    (void)GetLatestCAN(0);
+
+    CANRxLatency_t latency = {0, 0, 0, 0};
+    GetCANRxLatency(&latency);
+    CHECK_EQUAL(1, latency.samples);
+    CHECK_EQUAL(1000, latency.lastCycles);
+}
 
-    uint8_t length;
-    MockCAN_GetLastTxMessage(nullptr, &length, nullptr);
-    CHECK_EQUAL(3, length);
+/* Coalesced frames keep the cycle count at entry to the ISR that read them */
+TEST(RxFifo_DrainBurst, Coalesced_StampedAtIsrEntry) {
+    MockDWT.CYCCNT = 4321;
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
+    MockDWT.CYCCNT = 9999;
+
+    CANCoalesced_t latest = {};
+    CHECK_TRUE(ReadCoalescedCAN(CAN_COALESCED_PPO2_PPO2_ID, &latest));
+    CHECK_EQUAL(4321, latest.rxCycles);
+}
+
+/* The probe handles the 32 bit cycle counter wrapping between entry and pickup */
+TEST(RxFifo_DrainBurst, LatencyProbe_CounterWrap) {
+    MockDWT.CYCCNT = 0xFFFFFF00U;
+    DeliverPPO2Burst();
+    (void)ServiceRxIrq(CAN_RX_FIFO1);
+    MockDWT.CYCCNT = 0x100U;
+    (void)GetLatestCAN(0);
+
+    CANRxLatency_t latency = {0, 0, 0, 0};
+    GetCANRxLatency(&latency);
+    CHECK_EQUAL(0x200U, latency.lastCycles);
 }
 
 /**
- * TEST_GROUP: TxName_StringHandling
- * Tests BUS_NAME message string handling with boundary conditions
- * CRITICAL: String length limited to BUS_NAME_LEN (8 bytes)
- * Must handle: exact 8 chars, <8 chars (null padding), >8 chars (truncation)
+ * TEST_GROUP: RxFifo_Registers
+ * Tests the register level RX ISR against the bxCAN register mock, and the SCE error ISR
+ * CRITICAL: Frames must be decoded straight from the FIFO mailbox and the mailbox released, with no HAL in the path
  */
-TEST_GROUP(TxName_StringHandling) {
+TEST_GROUP(RxFifo_Registers) {
     void setup() {
         MockCAN_Reset();
         MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockCore_Reset();
+        ResetCANRxRing();
+        InitCANFilters(&hcan1);
     }
 
     void teardown() {
@@ -403,127 +794,1715 @@ TEST_GROUP(TxName_StringHandling) {
     }
 };
 
-/* CRITICAL: NULL pointer handling */
-TEST(TxName_StringHandling, NullPointer_LogsError) {
-    txName(DIVECAN_MONITOR, nullptr);
-
-    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(NULL_PTR_ERR));
-    /* Should not send message on NULL */
-    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+/* The oldest frame shows up in the output mailbox and the fill level in RFxR */
+TEST(RxFifo_Registers, Mock_PresentsOldestFrame) {
+    const uint8_t data[8] = {1, 2, 3, 4, 5, 0, 0, 0};
+    MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 5, data);
+    MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_OBOE, 1, data);
+
+    CHECK_EQUAL(2, hcan1.Instance->RF0R & CAN_RF0R_FMP0);
+    CHECK_EQUAL(((BUS_ID_ID | DIVECAN_SOLO) << CAN_RI0R_EXID_Pos) | CAN_RI0R_IDE, hcan1.Instance->sFIFOMailBox[0].RIR);
+    CHECK_EQUAL(5, hcan1.Instance->sFIFOMailBox[0].RDTR & CAN_RDT0R_DLC);
+    CHECK_EQUAL(0x04030201U, hcan1.Instance->sFIFOMailBox[0].RDLR);
+    CHECK_EQUAL(0x00000005U, hcan1.Instance->sFIFOMailBox[0].RDHR);
 }
 
-/* Boundary case: Exactly 8 characters (no null terminator fits) */
-TEST(TxName_StringHandling, Exactly8Chars_NoTruncation) {
-    const char *name = "O2HUD123";  /* Exactly 8 chars */
-
-    txName(DIVECAN_MONITOR, name);
+/* ID, DLC and both data words come out of the mailbox intact */
+TEST(RxFifo_Registers, Mailbox_Decoded) {
+    const uint8_t data[8] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+    MockCAN_DeliverRxMessage(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO, 8, data);
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
 
-    /* All 8 bytes should match (strncpy limits to 8) */
-    CHECK_EQUAL('O', data[0]);
-    CHECK_EQUAL('2', data[1]);
-    CHECK_EQUAL('H', data[2]);
-    CHECK_EQUAL('U', data[3]);
-    CHECK_EQUAL('D', data[4]);
-    CHECK_EQUAL('1', data[5]);
-    CHECK_EQUAL('2', data[6]);
-    CHECK_EQUAL('3', data[7]);
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO, msg.id);
+    CHECK_EQUAL(8, msg.length);
+    MEMCMP_EQUAL(data, msg.data, 8);
 }
 
-/* Boundary case: Less than 8 characters - should be null-padded */
-TEST(TxName_StringHandling, LessThan8Chars_NullPadded) {
-    const char *name = "HUD";  /* Only 3 chars */
+/* Whatever the mailbox holds past the DLC is not passed on */
+TEST(RxFifo_Registers, BytesPastDlc_Zeroed) {
+    const uint8_t data[8] = {0xAA, 0xBB, 0xCC, 0, 0, 0, 0, 0};
+    MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 3, data);
+    hcan1.Instance->sFIFOMailBox[0].RDLR |= 0xFF000000U;
+    hcan1.Instance->sFIFOMailBox[0].RDHR = 0xFFFFFFFFU;
 
-    txName(DIVECAN_MONITOR, name);
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
 
-    uint8_t data[8];
+    const uint8_t expected[8] = {0xAA, 0xBB, 0xCC, 0, 0, 0, 0, 0};
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    CHECK_EQUAL(3, msg.length);
+    MEMCMP_EQUAL(expected, msg.data, 8);
+}
+
+/* Data words split at the DLC, 5 bytes is all of RDLR and one byte of RDHR */
+TEST(RxFifo_Registers, HighWord_MaskedToDlc) {
+    const uint8_t data[8] = {1, 2, 3, 4, 5, 0, 0, 0};
+    MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 5, data);
+    hcan1.Instance->sFIFOMailBox[0].RDHR |= 0xFFFFFF00U;
+
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+
+    DiveCANMessage_t msg;
+    CHECK_EQUAL(pdPASS, PopCAN(&msg));
+    MEMCMP_EQUAL(data, msg.data, 8);
+}
+
+/* Every frame read is released, leaving the FIFO empty */
+TEST(RxFifo_Registers, Mailbox_ReleasedPerFrame) {
+    DeliverPPO2Burst();
+    CHECK_EQUAL(2, hcan1.Instance->RF1R & CAN_RF1R_FMP1);
+
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO1);
+
+    CHECK_EQUAL(0, hcan1.Instance->RF1R & CAN_RF1R_FMP1);
+    CHECK_EQUAL(2, MockCAN_GetRxReadCount());
+}
+
+/* A DLC over 8 is reported and the data dropped, but the mailbox is still released */
+TEST(RxFifo_Registers, OversizeDlc_ReportedAndReleased) {
+    const uint8_t data[8] = {0};
+    MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 3, data);
+    hcan1.Instance->sFIFOMailBox[0].RDTR = 12;
+
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+
+    CHECK_EQUAL(1, MockErrors_GetNonFatalISRCount(CAN_OVERFLOW_ERR));
+    CHECK_EQUAL(0, hcan1.Instance->RF0R & CAN_RF0R_FMP0);
+}
+
+/* The overrun flag rides the RX vector, it is counted and cleared in the same entry as the drain */
+TEST(RxFifo_Registers, Overrun_CountedAndCleared) {
+    const uint8_t data[8] = {0};
+    for (uint32_t i = 0; i < 4; i++) {
+        MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 3, data);
+    }
+    CHECK_TRUE(0 != (hcan1.Instance->RF0R & CAN_RF0R_FOVR0));
+
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+
+    CANRxRingStats_t stats = {};
+    GetCANRxRingStats(CAN_RX_FIFO0, &stats);
+    CHECK_EQUAL(1, stats.hwOverruns);
+    CHECK_EQUAL(1, MockErrors_GetNonFatalISRCount(CAN_RX_OVERRUN_ERR));
+    CHECK_EQUAL(0, hcan1.Instance->RF0R & CAN_RF0R_FOVR0);
+    CHECK_EQUAL(3, stats.highWater);
+}
+
+/* The per FIFO ISR cost counters see every frame, for cycles per frame on hardware */
+TEST(RxFifo_Registers, IsrCost_CountsFrames) {
+    DeliverPPO2Burst();
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO1);
+    DeliverPPO2Burst();
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO1);
+
+    CANRxIsrCost_t cost = {0, 0, 0};
+    GetCANRxIsrCost(CAN_RX_FIFO1, &cost);
+    CHECK_EQUAL(4, cost.frames);
+
+    GetCANRxIsrCost(CAN_RX_FIFO0, &cost);
+    CHECK_EQUAL(0, cost.frames);
+
+    cost.frames = 99;
+    GetCANRxIsrCost(CAN_RX_FIFO_COUNT, &cost);
+    CHECK_EQUAL(0, cost.frames);
+}
+
+/* Going bus off is reported with the ESR, then the interrupt and last error code are cleared */
+TEST(RxFifo_Registers, ErrorIsr_BusOffReported) {
+    hcan1.Instance->ESR = CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF | (3UL << 4);
+    hcan1.Instance->MSR = CAN_MSR_ERRI;
+
+    canErrorInterrupt(&hcan1);
+
+    NonFatalError_t error = NONE_ERR;
+    uint32_t detail = 0;
+    CHECK_TRUE(MockErrors_GetLastNonFatalISRDetail(&error, &detail));
+    CHECK_EQUAL(CAN_BUS_ERR, error);
+    CHECK_EQUAL(CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF | (3UL << 4), detail);
+    CHECK_EQUAL(0, hcan1.Instance->ESR & CAN_ESR_LEC);
+}
+
+/* Error warning alone is just cleared */
+TEST(RxFifo_Registers, ErrorIsr_WarningNotReported) {
+    hcan1.Instance->ESR = CAN_ESR_EWGF;
+
+    canErrorInterrupt(&hcan1);
+
+    CHECK_EQUAL(0, MockErrors_GetNonFatalISRCount(CAN_BUS_ERR));
+    CHECK_EQUAL(CAN_MSR_ERRI, hcan1.Instance->MSR);
+}
+
+/* Test Group: CANErrorState - Error counters, state entries and bus-off recovery */
+TEST_GROUP(CANErrorState) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockQueue_SetTickCount(0);
+        ResetCANRxRing();
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ClearAllQueues();
+    }
+
+    /* The controller raising the SCE interrupt at a tick with the given ESR */
+    void errorIrqAt(uint32_t tick, uint32_t esr) {
+        MockQueue_SetTickCount(tick);
+        hcan1.Instance->ESR = esr;
+        canErrorInterrupt(&hcan1);
+    }
+
+    bool serviceAt(uint32_t tick) {
+        MockQueue_SetTickCount(tick);
+        return ServiceCANErrorState();
+    }
+};
+
+#define ESR_COUNTERS(tec, rec) (((uint32_t)(tec) << CAN_ESR_TEC_Pos) | ((uint32_t)(rec) << CAN_ESR_REC_Pos))
+#define ESR_LEC(lec) ((uint32_t)(lec) << CAN_ESR_LEC_Pos)
+
+/* Each protocol error is counted by code, the ISR only clears the code and leaves the counters */
+TEST(CANErrorState, ErrorCodes_Counted) {
+    errorIrqAt(0, ESR_COUNTERS(8, 0) | ESR_LEC(3));
+    errorIrqAt(0, ESR_COUNTERS(16, 0) | ESR_LEC(3));
+    errorIrqAt(0, ESR_COUNTERS(16, 1) | ESR_LEC(6));
+
+    CHECK_EQUAL(ESR_COUNTERS(16, 1), hcan1.Instance->ESR);
+
+    CANErrorStats_t stats = {};
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(2, stats.errorCodeCounts[3]);
+    CHECK_EQUAL(1, stats.errorCodeCounts[6]);
+    CHECK_EQUAL(0, stats.errorCodeCounts[0]);
+    CHECK_EQUAL(6, stats.lastErrorCode);
+}
+
+/* Code 7 is only ever left by software, it isn't a bus error */
+TEST(CANErrorState, SoftwareErrorCode_Ignored) {
+    errorIrqAt(0, ESR_LEC(7));
+
+    CANErrorStats_t stats = {};
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(0, stats.errorCodeCounts[7]);
+    CHECK_EQUAL(0, stats.lastErrorCode);
+}
+
+/* States are counted and reported on the way in, not on every error while in them */
+TEST(CANErrorState, StateEntries_CountedOnce) {
+    errorIrqAt(0, CAN_ESR_EWGF | ESR_LEC(1));
+    errorIrqAt(0, CAN_ESR_EWGF | ESR_LEC(1));
+    errorIrqAt(0, CAN_ESR_EWGF | CAN_ESR_EPVF | ESR_LEC(1));
+    errorIrqAt(0, CAN_ESR_EWGF | CAN_ESR_EPVF | ESR_LEC(1));
+
+    CANErrorStats_t stats = {};
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(1, stats.warningCount);
+    CHECK_EQUAL(1, stats.passiveCount);
+    CHECK_EQUAL(0, stats.busOffCount);
+    CHECK_EQUAL(1, MockErrors_GetNonFatalISRCount(CAN_BUS_ERR));
+
+    /* Back to error active and then passive again is a second entry */
+    errorIrqAt(0, ESR_LEC(1));
+    errorIrqAt(0, CAN_ESR_EWGF | CAN_ESR_EPVF | ESR_LEC(1));
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(2, stats.passiveCount);
+    CHECK_EQUAL(2, MockErrors_GetNonFatalISRCount(CAN_BUS_ERR));
+}
+
+/* A state change wakes CANTask, a plain protocol error doesn't */
+TEST(CANErrorState, StateChange_WakesCANTask) {
+    (void)GetLatestCAN(1);
+
+    errorIrqAt(0, ESR_LEC(2));
+    CHECK_EQUAL(0, MockQueue_GetNotifyGiveCount());
+
+    errorIrqAt(0, CAN_ESR_EWGF | ESR_LEC(2));
+    CHECK_EQUAL(1, MockQueue_GetNotifyGiveCount());
+}
+
+/* The task side picks the state and counters up from ESR */
+TEST(CANErrorState, Service_TracksStateAndCounters) {
+    hcan1.Instance->ESR = CAN_ESR_EWGF | CAN_ESR_EPVF | ESR_COUNTERS(136, 12);
+    CHECK_FALSE(serviceAt(0));
+
+    CANErrorStats_t stats = {};
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(CAN_ERROR_PASSIVE, stats.state);
+    CHECK_EQUAL(136, stats.tec);
+    CHECK_EQUAL(12, stats.rec);
+    CHECK_FALSE(CANBusRecovering());
+
+    hcan1.Instance->ESR = CAN_ESR_EWGF | ESR_COUNTERS(100, 0);
+    (void)serviceAt(10);
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(CAN_ERROR_WARNING, stats.state);
+}
+
+/* Coming back from bus-off is reported once, with how long it took */
+TEST(CANErrorState, BusOff_RejoinTimed) {
+    errorIrqAt(1000, CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF | ESR_COUNTERS(248, 0) | ESR_LEC(3));
+    CHECK_FALSE(serviceAt(1001));
+    CHECK_TRUE(CANBusRecovering());
+    CHECK_FALSE(serviceAt(1005));
+
+    /* Hardware recovery done, the counters start again from zero */
+    hcan1.Instance->ESR = 0;
+    CHECK_TRUE(serviceAt(1012));
+    CHECK_FALSE(CANBusRecovering());
+    CHECK_FALSE(serviceAt(1020));
+
+    CANErrorStats_t stats = {};
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(CAN_ERROR_ACTIVE, stats.state);
+    CHECK_EQUAL(1, stats.busOffCount);
+    CHECK_EQUAL(12, stats.lastRecoveryTicks);
+    CHECK_EQUAL(12, stats.maxRecoveryTicks);
+    CHECK_EQUAL(0, stats.forcedRestarts);
+    CHECK_EQUAL(0, MockCAN_GetRestartCount());
+}
+
+/* Bus-off outlasting the hardware recovery gets the controller restarted, again each deadline until it comes back */
+TEST(CANErrorState, BusOff_RestartedAfterDeadline) {
+    errorIrqAt(0, CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF);
+    (void)serviceAt(10);
+    (void)serviceAt(99);
+    CHECK_EQUAL(0, MockCAN_GetRestartCount());
+
+    (void)serviceAt(100);
+    CHECK_EQUAL(1, MockCAN_GetRestartCount());
+    (void)serviceAt(150);
+    CHECK_EQUAL(1, MockCAN_GetRestartCount());
+    (void)serviceAt(200);
+    CHECK_EQUAL(2, MockCAN_GetRestartCount());
+
+    hcan1.Instance->ESR = 0;
+    CHECK_TRUE(serviceAt(230));
+
+    CANErrorStats_t stats = {};
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(2, stats.forcedRestarts);
+    CHECK_EQUAL(230, stats.lastRecoveryTicks);
+}
+
+/* If the SCE interrupt never saw us go bus-off, the deadline runs from when the task did */
+TEST(CANErrorState, BusOff_UnseenByIsr) {
+    errorIrqAt(0, CAN_ESR_EWGF);
+    hcan1.Instance->ESR = CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF;
+    (void)serviceAt(500);
+    (void)serviceAt(550);
+    CHECK_EQUAL(0, MockCAN_GetRestartCount());
+    (void)serviceAt(600);
+    CHECK_EQUAL(1, MockCAN_GetRestartCount());
+}
+
+/* Worst recovery is kept across bus-off events */
+TEST(CANErrorState, BusOff_MaxRecoveryKept) {
+    errorIrqAt(0, CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF);
+    (void)serviceAt(0);
+    hcan1.Instance->ESR = 0;
+    CHECK_TRUE(serviceAt(40));
+
+    /* Errors climb again before the second bus-off */
+    errorIrqAt(50, CAN_ESR_EWGF | ESR_LEC(3));
+    errorIrqAt(60, CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF | ESR_LEC(3));
+    (void)serviceAt(60);
+    hcan1.Instance->ESR = 0;
+    CHECK_TRUE(serviceAt(75));
+
+    CANErrorStats_t stats = {};
+    GetCANErrorStats(&stats);
+    CHECK_EQUAL(2, stats.busOffCount);
+    CHECK_EQUAL(15, stats.lastRecoveryTicks);
+    CHECK_EQUAL(40, stats.maxRecoveryTicks);
+}
+
+/**
+ * TEST_GROUP: TxStartDevice_BitManipulation
+ * Tests BUS_INIT message ID construction using bit manipulation
+ * CRITICAL: ID format must be: BUS_INIT_ID | (deviceType << 8) | targetDeviceType
+ */
+TEST_GROUP(TxStartDevice_BitManipulation) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+};
+
+/* Verify ID bit manipulation: BUS_INIT_ID | (deviceType << 8) | targetDeviceType */
+TEST(TxStartDevice_BitManipulation, MonitorToController_IDBitsCorrect) {
+    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+
+    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_MONITOR << 8) | DIVECAN_CONTROLLER;
+    /* BUS_INIT_ID = 0xD370000
+     * DIVECAN_MONITOR (3) << 8 = 0x300
+     * DIVECAN_CONTROLLER (1) = 0x1
+     * Result: 0xD370000 | 0x300 | 0x1 = 0xD370301
+     */
+    CHECK_EQUAL(expectedID, 0xD370301);
+
+    CHECK_EQUAL(1, MockCAN_GetTxMessageCount());
+
+    uint32_t actualID;
+    uint8_t length;
+    uint8_t data[8];
+    CHECK_TRUE(MockCAN_GetLastTxMessage(&actualID, &length, data));
+    CHECK_EQUAL(expectedID, actualID);
+}
+
+/* Test all device type combinations */
+TEST(TxStartDevice_BitManipulation, OBOEToController_IDBitsCorrect) {
+    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_OBOE);
+
+    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_OBOE << 8) | DIVECAN_CONTROLLER;
+    /* OBOE (2) << 8 = 0x200, CONTROLLER (1) = 0x1 → 0xD370201 */
+
+    uint32_t actualID;
+    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
+    CHECK_EQUAL(0xD370201, actualID);
+}
+
+TEST(TxStartDevice_BitManipulation, SOLOToMonitor_IDBitsCorrect) {
+    txStartDevice(DIVECAN_MONITOR, DIVECAN_SOLO);
+
+    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_SOLO << 8) | DIVECAN_MONITOR;
+    /* SOLO (4) << 8 = 0x400, MONITOR (3) = 0x3 → 0xD370403 */
+
+    uint32_t actualID;
+    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
+    CHECK_EQUAL(0xD370403, actualID);
+}
+
+TEST(TxStartDevice_BitManipulation, RevoToOBOE_IDBitsCorrect) {
+    txStartDevice(DIVECAN_OBOE, DIVECAN_REVO);
+
+    uint32_t expectedID = BUS_INIT_ID | (DIVECAN_REVO << 8) | DIVECAN_OBOE;
+    /* REVO (5) << 8 = 0x500, OBOE (2) = 0x2 → 0xD370502 */
+
+    uint32_t actualID;
+    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
+    CHECK_EQUAL(0xD370502, actualID);
+}
+
+/* Verify magic bytes in data payload */
+TEST(TxStartDevice_BitManipulation, MagicBytes_0x8a_0xf3_0x00) {
+    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+
+    uint8_t data[8];
+    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, nullptr, data));
+
+    CHECK_EQUAL(0x8a, data[0]);
+    CHECK_EQUAL(0xf3, data[1]);
+    CHECK_EQUAL(0x00, data[2]);
+}
+
+/* Verify message length is 3 bytes */
+TEST(TxStartDevice_BitManipulation, MessageLength_3Bytes) {
+    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+
+    uint8_t length;
+    CHECK_TRUE(MockCAN_GetLastTxMessage(nullptr, &length, nullptr));
+    CHECK_EQUAL(3, length);
+}
+
+/* Verify remaining data bytes are zero */
+TEST(TxStartDevice_BitManipulation, RemainingBytes_AllZero) {
+    txStartDevice(DIVECAN_CONTROLLER, DIVECAN_MONITOR);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    for (int i = 3; i < 8; i++) {
+        CHECK_EQUAL(0x00, data[i]);
+    }
+}
+
+/**
+ * TEST_GROUP: TxID_BitManipulation
+ * Tests BUS_ID message ID construction and data payload encoding
+ * ID format: BUS_ID_ID | deviceType
+ * Data format: [manufacturerID, 0x00, firmwareVersion, 0x00, ...]
+ */
+TEST_GROUP(TxID_BitManipulation) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+};
+
+/* Verify ID bit manipulation: BUS_ID_ID | deviceType */
+TEST(TxID_BitManipulation, Monitor_ISC_FW10_IDBitsCorrect) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+
+    uint32_t expectedID = BUS_ID_ID | DIVECAN_MONITOR;
+    /* BUS_ID_ID = 0xD000000, MONITOR (3) → 0xD000003 */
+
+    uint32_t actualID;
+    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
+    CHECK_EQUAL(0xD000003, actualID);
+}
+
+TEST(TxID_BitManipulation, OBOE_SRI_FW255_IDBitsCorrect) {
+    txID(DIVECAN_OBOE, DIVECAN_MANUFACTURER_SRI, 255);
+
+    uint32_t expectedID = BUS_ID_ID | DIVECAN_OBOE;
+    /* BUS_ID_ID = 0xD000000, OBOE (2) → 0xD000002 */
+
+    uint32_t actualID;
+    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
+    CHECK_EQUAL(0xD000002, actualID);
+}
+
+/* Verify manufacturer ID encoding in data[0] */
+TEST(TxID_BitManipulation, ManufacturerID_ISC_EncodedCorrectly) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    CHECK_EQUAL(DIVECAN_MANUFACTURER_ISC, data[0]);
+    CHECK_EQUAL(0x00, data[1]);  /* Reserved byte */
+}
+
+TEST(TxID_BitManipulation, ManufacturerID_SRI_EncodedCorrectly) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_SRI, 10);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    CHECK_EQUAL(DIVECAN_MANUFACTURER_SRI, data[0]);
+}
+
+TEST(TxID_BitManipulation, ManufacturerID_GEN_EncodedCorrectly) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_GEN, 10);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    CHECK_EQUAL(DIVECAN_MANUFACTURER_GEN, data[0]);
+}
+
+/* Verify firmware version encoding in data[2] */
+TEST(TxID_BitManipulation, FirmwareVersion_10_EncodedCorrectly) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+
+    uint8_t data[8];
     MockCAN_GetLastTxMessage(nullptr, nullptr, data);
 
-    CHECK_EQUAL('H', data[0]);
-    CHECK_EQUAL('U', data[1]);
-    CHECK_EQUAL('D', data[2]);
+    CHECK_EQUAL(10, data[2]);
+}
+
+TEST(TxID_BitManipulation, FirmwareVersion_255_EncodedCorrectly) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 255);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    CHECK_EQUAL(255, data[2]);
+}
+
+TEST(TxID_BitManipulation, FirmwareVersion_0_EncodedCorrectly) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 0);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    CHECK_EQUAL(0, data[2]);
+}
+
+/* Verify message length is 3 bytes */
+TEST(TxID_BitManipulation, MessageLength_3Bytes) {
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_ISC, 10);
+
+    uint8_t length;
+    MockCAN_GetLastTxMessage(nullptr, &length, nullptr);
+    CHECK_EQUAL(3, length);
+}
+
+/**
+ * TEST_GROUP: TxName_StringHandling
+ * Tests BUS_NAME message string handling with boundary conditions
+ * CRITICAL: String length limited to BUS_NAME_LEN (8 bytes)
+ * Must handle: exact 8 chars, <8 chars (null padding), >8 chars (truncation)
+ */
+TEST_GROUP(TxName_StringHandling) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+    }
+};
+
+/* CRITICAL: NULL pointer handling */
+TEST(TxName_StringHandling, NullPointer_LogsError) {
+    txName(DIVECAN_MONITOR, nullptr);
+
+    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(NULL_PTR_ERR));
+    /* Should not send message on NULL */
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+}
+
+/* Boundary case: Exactly 8 characters (no null terminator fits) */
+TEST(TxName_StringHandling, Exactly8Chars_NoTruncation) {
+    const char *name = "O2HUD123";  /* Exactly 8 chars */
+
+    txName(DIVECAN_MONITOR, name);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    /* All 8 bytes should match (strncpy limits to 8) */
+    CHECK_EQUAL('O', data[0]);
+    CHECK_EQUAL('2', data[1]);
+    CHECK_EQUAL('H', data[2]);
+    CHECK_EQUAL('U', data[3]);
+    CHECK_EQUAL('D', data[4]);
+    CHECK_EQUAL('1', data[5]);
+    CHECK_EQUAL('2', data[6]);
+    CHECK_EQUAL('3', data[7]);
+}
+
+/* Boundary case: Less than 8 characters - should be null-padded */
+TEST(TxName_StringHandling, LessThan8Chars_NullPadded) {
+    const char *name = "HUD";  /* Only 3 chars */
+
+    txName(DIVECAN_MONITOR, name);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    CHECK_EQUAL('H', data[0]);
+    CHECK_EQUAL('U', data[1]);
+    CHECK_EQUAL('D', data[2]);
+
+    /* Remaining bytes should be null */
+    for (int i = 3; i < 8; i++) {
+        CHECK_EQUAL(0x00, data[i]);
+    }
+}
+
+/* Boundary case: More than 8 characters - should be truncated */
+TEST(TxName_StringHandling, MoreThan8Chars_Truncated) {
+    const char *name = "VeryLongDeviceName";  /* 18 chars */
+
+    txName(DIVECAN_MONITOR, name);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    /* Only first 8 chars should be copied */
+    CHECK_EQUAL('V', data[0]);
+    CHECK_EQUAL('e', data[1]);
+    CHECK_EQUAL('r', data[2]);
+    CHECK_EQUAL('y', data[3]);
+    CHECK_EQUAL('L', data[4]);
+    CHECK_EQUAL('o', data[5]);
+    CHECK_EQUAL('n', data[6]);
+    CHECK_EQUAL('g', data[7]);
+}
+
+/* Verify empty string handling */
+TEST(TxName_StringHandling, EmptyString_AllZeros) {
+    const char *name = "";
+
+    txName(DIVECAN_MONITOR, name);
+
+    uint8_t data[8];
+    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+
+    /* All bytes should be zero */
+    for (int i = 0; i < 8; i++) {
+        CHECK_EQUAL(0x00, data[i]);
+    }
+}
+
+/* Verify ID encoding: BUS_NAME_ID | deviceType */
+TEST(TxName_StringHandling, Monitor_IDBitsCorrect) {
+    txName(DIVECAN_MONITOR, "HUD");
+
+    uint32_t expectedID = BUS_NAME_ID | DIVECAN_MONITOR;
+    /* BUS_NAME_ID = 0xD010000, MONITOR (3) → 0xD010003 */
+
+    uint32_t actualID;
+    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
+    CHECK_EQUAL(0xD010003, actualID);
+}
+
+TEST(TxName_StringHandling, OBOE_IDBitsCorrect) {
+    txName(DIVECAN_OBOE, "OBOE1");
+
+    uint32_t expectedID = BUS_NAME_ID | DIVECAN_OBOE;
+    /* BUS_NAME_ID = 0xD010000, OBOE (2) → 0xD010002 */
+
+    uint32_t actualID;
+    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
+    CHECK_EQUAL(0xD010002, actualID);
+}
+
+/* Verify message length is always 8 bytes */
+TEST(TxName_StringHandling, MessageLength_Always8Bytes) {
+    txName(DIVECAN_MONITOR, "HUD");
+
+    uint8_t length;
+    MockCAN_GetLastTxMessage(nullptr, &length, nullptr);
+    CHECK_EQUAL(8, length);
+}
+
+/**
+ * TEST_GROUP: SendCANMessage_MailboxWait
+ * Tests queueing behind busy mailboxes and error handling
+ * CRITICAL: Must not block (osDelay) when mailboxes are full, handle HAL errors
+ */
+TEST_GROUP(SendCANMessage_MailboxWait) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        ResetCANTxRing();
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        ResetCANTxRing();
+    }
+};
+
+/* Busy mailboxes queue the frame in the TX ring, the mailbox empty ISR sends it */
+TEST(SendCANMessage_MailboxWait, AllMailboxesBusy_QueuedUntilFree) {
+    MockCAN_SetTxManualComplete(true);
+
+    DiveCANMessage_t msg = {
+        .id = BUS_INIT_ID,
+        .length = 3,
+        .data = {0x8a, 0xf3, 0x00, 0, 0, 0, 0, 0}
+    };
+
+    for (uint32_t i = 0; i < 4; i++) {
+        sendCANMessage(msg, CAN_TX_CLASS_CRITICAL);
+    }
+
+    /* Three in the mailboxes, one waiting, and the caller never slept */
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
+
+    CHECK_EQUAL(1, MockCAN_CompleteTx(1, CAN_TSR_TXOK0));
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(0, MockErrors_GetNonFatalCount(CAN_TX_ERR));
+}
+
+/* Verify osDelay called when waiting for mailbox */
+TEST(SendCANMessage_MailboxWait, MailboxBusy_CallsOsDelay) {
+    /* This test would require tracking osDelay calls */
+    /* For now, verify behavior when mailbox is immediately available */
+    MockCAN_SetTxBehavior(HAL_OK, 3);  /* All mailboxes free */
+
+    DiveCANMessage_t msg = {
+        .id = PPO2_PPO2_ID,
+        .length = 8,
+        .data = {0x64, 0x64, 0x64, 0, 0, 0, 0, 0}
+    };
+
+    sendCANMessage(msg, CAN_TX_CLASS_CRITICAL);
+
+    /* osDelay should NOT be called if mailbox immediately free */
+    CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
+}
+
+/* Verify HAL error handling */
+TEST(SendCANMessage_MailboxWait, HAL_AddTxMessage_Error) {
+    MockCAN_SetTxBehavior(HAL_ERROR, 3);
+
+    DiveCANMessage_t msg = {
+        .id = HUD_STAT_ID,
+        .length = 5,
+        .data = {0x01, 0x02, 0x03, 0x04, 0x05, 0, 0, 0}
+    };
+
+    sendCANMessage(msg, CAN_TX_CLASS_CRITICAL);
+
+    /* Should log non-fatal error */
+    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(CAN_TX_ERR));
+}
+
+/* Verify correct header configuration */
+TEST(SendCANMessage_MailboxWait, HeaderConfiguration_ExtendedID) {
+    MockCAN_SetTxBehavior(HAL_OK, 3);
+
+    DiveCANMessage_t msg = {
+        .id = 0xDEADBEEF,
+        .length = 5,
+        .data = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0, 0, 0}
+    };
+
+    sendCANMessage(msg, CAN_TX_CLASS_CRITICAL);
+
+    /* Verify message ID matches */
+    uint32_t txID;
+    uint8_t txLen;
+    uint8_t txData[8];
+    CHECK_TRUE(MockCAN_GetLastTxMessage(&txID, &txLen, txData));
+
+    CHECK_EQUAL(0xDEADBEEF, txID);
+    CHECK_EQUAL(5, txLen);
+
+    /* Verify data copied correctly */
+    CHECK_EQUAL(0xAA, txData[0]);
+    CHECK_EQUAL(0xBB, txData[1]);
+    CHECK_EQUAL(0xCC, txData[2]);
+    CHECK_EQUAL(0xDD, txData[3]);
+    CHECK_EQUAL(0xEE, txData[4]);
+}
+
+/* A full ring that never drains gives up after the timeout and reports it */
+TEST(SendCANMessage_MailboxWait, RingFull_TimesOut) {
+    MockCAN_SetTxBehavior(HAL_OK, 0);
+    const DiveCANMessage_t msg = {BUS_ID_ID, 8, {0}};
+
+    for (uint32_t i = 0; i < 16; i++) {
+        sendCANMessage(msg, CAN_TX_CLASS_CRITICAL);
+    }
+    CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
+    CHECK_EQUAL(0, MockErrors_GetNonFatalCount(CAN_TX_ERR));
+
+    sendCANMessage(msg, CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(10, MockQueue_GetDelayCallCount());
+    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(CAN_TX_ERR));
+    CHECK_EQUAL(0, MockCAN_GetTxMessageCount());
+}
+
+/* Verify data length handling */
+TEST(SendCANMessage_MailboxWait, DataLength_VariesCorrectly) {
+    MockCAN_SetTxBehavior(HAL_OK, 3);
+
+    /* Test with length = 1 */
+    DiveCANMessage_t msg1 = {.id = BUS_INIT_ID, .length = 1, .data = {0xFF}};
+    sendCANMessage(msg1, CAN_TX_CLASS_CRITICAL);
+
+    uint8_t len;
+    MockCAN_GetLastTxMessage(nullptr, &len, nullptr);
+    CHECK_EQUAL(1, len);
+
+    /* Test with length = 8 */
+    DiveCANMessage_t msg8 = {
+        .id = PPO2_PPO2_ID,
+        .length = 8,
+        .data = {1, 2, 3, 4, 5, 6, 7, 8}
+    };
+    sendCANMessage(msg8, CAN_TX_CLASS_CRITICAL);
+
+    MockCAN_GetLastTxMessage(nullptr, &len, nullptr);
+    CHECK_EQUAL(8, len);
+}
+
+/**
+ * TEST_GROUP: TxRing
+ * Tests the task -> TX mailbox ISR frame ring
+ * CRITICAL: Frames go out in order, nothing is lost while there is room, a full ring never blocks TrySendCANMessage
+ */
+TEST_GROUP(TxRing) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        ResetCANTxRing();
+        MockCAN_SetTxManualComplete(true);
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        ResetCANTxRing();
+    }
+
+    static DiveCANMessage_t frame(uint8_t n) {
+        DiveCANMessage_t message = {BUS_ID_ID, 1, {n}};
+        return message;
+    }
+
+    /* Complete every loaded mailbox and run the ISR until the ring is empty */
+    static void drainAll(void) {
+        while (MockCAN_CompleteTx(3, CAN_TSR_TXOK0) > 0) {
+            txMailboxInterrupt(&hcan1);
+        }
+    }
+};
+
+/* An idle controller gets the frame straight away, no ISR needed */
+TEST(TxRing, IdleController_LoadsImmediately) {
+    CHECK_EQUAL(CAN_TX_OK, TrySendCANMessage(frame(1), CAN_TX_CLASS_CRITICAL));
+    CHECK_EQUAL(1, MockCAN_GetTxMessageCount());
+
+    CANTxRingStats_t stats = {};
+    GetCANTxRingStats(CAN_TX_CLASS_CRITICAL, &stats);
+    CHECK_EQUAL(0, stats.highWater);
+}
+
+/* A burst longer than the mailboxes goes out in order as the ISR refills them */
+TEST(TxRing, Burst_SentInOrder) {
+    for (uint8_t i = 0; i < 10; i++) {
+        CHECK_EQUAL(CAN_TX_OK, TrySendCANMessage(frame(i), CAN_TX_CLASS_CRITICAL));
+    }
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+
+    drainAll();
+    CHECK_EQUAL(10, MockCAN_GetTxMessageCount());
+    for (uint8_t i = 0; i < 10; i++) {
+        uint8_t data[8] = {0};
+        CHECK_TRUE(MockCAN_GetTxMessageAt(i, nullptr, nullptr, data));
+        CHECK_EQUAL(i, data[0]);
+    }
+
+    CANTxRingStats_t stats = {};
+    GetCANTxRingStats(CAN_TX_CLASS_CRITICAL, &stats);
+    CHECK_EQUAL(7, stats.highWater);
+    CHECK_EQUAL(0, stats.rejected);
+}
+
+/* One completed mailbox lets exactly one queued frame in */
+TEST(TxRing, Isr_RefillsOnlyFreedMailboxes) {
+    for (uint8_t i = 0; i < 6; i++) {
+        TrySendCANMessage(frame(i), CAN_TX_CLASS_CRITICAL);
+    }
+    MockCAN_CompleteTx(1, CAN_TSR_TXOK0);
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+
+    /* Spurious entry with nothing completed sends nothing */
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+}
+
+/* The ISR acknowledges completed mailboxes, including failed ones, so the interrupt doesn't refire */
+TEST(TxRing, Isr_ClearsCompletionFlags) {
+    TrySendCANMessage(frame(0), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(1), CAN_TX_CLASS_CRITICAL);
+    MockCAN_CompleteTx(1, CAN_TSR_TXOK0);
+    MockCAN_CompleteTx(1, CAN_TSR_TERR0);
+    CHECK(0 != (hcan1.Instance->TSR & (CAN_TSR_RQCP0 | CAN_TSR_RQCP1)));
+
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(0, hcan1.Instance->TSR & (CAN_TSR_RQCP0 | CAN_TSR_TXOK0 | CAN_TSR_RQCP1 | CAN_TSR_TERR1));
+    CHECK_EQUAL(0, MockErrors_GetTotalNonFatalISRCount());
+}
+
+/* Full ring turns the frame away without blocking */
+TEST(TxRing, Full_ReturnsFull) {
+    for (uint8_t i = 0; i < 19; i++) {
+        CHECK_EQUAL(CAN_TX_OK, TrySendCANMessage(frame(i), CAN_TX_CLASS_CRITICAL));
+    }
+    CHECK_EQUAL(CAN_TX_FULL, TrySendCANMessage(frame(19), CAN_TX_CLASS_CRITICAL));
+    CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
+
+    CANTxRingStats_t stats = {};
+    GetCANTxRingStats(CAN_TX_CLASS_CRITICAL, &stats);
+    CHECK_EQUAL(16, stats.highWater);
+    CHECK_EQUAL(1, stats.rejected);
+
+    /* Everything that was accepted still goes out */
+    drainAll();
+    CHECK_EQUAL(19, MockCAN_GetTxMessageCount());
+}
+
+/* The bounded variant waits one tick at a time, up to the timeout */
+TEST(TxRing, Timeout_BoundedWait) {
+    for (uint8_t i = 0; i < 19; i++) {
+        TrySendCANMessage(frame(i), CAN_TX_CLASS_CRITICAL);
+    }
+    CHECK_EQUAL(CAN_TX_FULL, SendCANMessageTimeout(frame(19), CAN_TX_CLASS_CRITICAL, 5));
+    CHECK_EQUAL(5, MockQueue_GetDelayCallCount());
+    CHECK_EQUAL(5, MockQueue_GetTotalDelayTicks());
+
+    /* Zero timeout is just a try */
+    CHECK_EQUAL(CAN_TX_FULL, SendCANMessageTimeout(frame(19), CAN_TX_CLASS_CRITICAL, 0));
+    CHECK_EQUAL(5, MockQueue_GetDelayCallCount());
+
+    MockCAN_CompleteTx(1, CAN_TSR_TXOK0);
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(CAN_TX_OK, SendCANMessageTimeout(frame(19), CAN_TX_CLASS_CRITICAL, 5));
+    CHECK_EQUAL(5, MockQueue_GetDelayCallCount());
+}
+
+/* A frame the HAL refuses from the ISR is dropped and reported from ISR context, the rest still go */
+TEST(TxRing, Isr_HalErrorDropsFrame) {
+    for (uint8_t i = 0; i < 5; i++) {
+        TrySendCANMessage(frame(i), CAN_TX_CLASS_CRITICAL);
+    }
+    MockCAN_SetTxFailOnCall(4);
+    MockCAN_CompleteTx(2, CAN_TSR_TXOK0);
+    txMailboxInterrupt(&hcan1);
+
+    CHECK_EQUAL(1, MockErrors_GetNonFatalISRCount(CAN_TX_ERR));
+    CHECK_EQUAL(0, MockErrors_GetNonFatalCount(CAN_TX_ERR));
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+
+    uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_GetTxMessageAt(3, nullptr, nullptr, data));
+    CHECK_EQUAL(4, data[0]);
+}
+
+/* Frames only count towards bus load once they're in a mailbox */
+TEST(TxRing, BusLoad_ChargedWhenLoaded) {
+    ResetCANRxRing();
+    InitCANBusLoad(&hcan1);
+    MockQueue_SetTickCount(0);
+    for (uint8_t i = 0; i < 5; i++) {
+        TrySendCANMessage({BUS_ID_ID, 8, {i}}, CAN_TX_CLASS_CRITICAL);
+    }
+    MockQueue_SetTickCount(CAN_BUS_LOAD_SLOT_MS);
+    UpdateCANBusLoad();
+
+    /* 3 x 160 bits in 100ms at 125kbit/s */
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(38, load.slotPermille);
+}
+
+/**
+ * TEST_GROUP: TxPriority
+ * Tests the class scheduling across the three TX mailboxes
+ * CRITICAL: A protocol reply always has a mailbox to go to, diagnostic traffic gives way to it
+ */
+TEST_GROUP(TxPriority) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        ResetCANTxRing();
+        MockCAN_SetTxManualComplete(true);
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        ResetCANTxRing();
+    }
+
+    static DiveCANMessage_t frame(uint32_t id) {
+        DiveCANMessage_t message = {id, 0, {0}};
+        return message;
+    }
+
+    static uint32_t sentId(uint32_t index) {
+        uint32_t id = 0;
+        CHECK_TRUE(MockCAN_GetTxMessageAt(index, &id, nullptr, nullptr));
+        return id;
+    }
+};
+
+/* Diagnostic and status frames never take the last mailbox */
+TEST(TxPriority, LowerClasses_LeaveReservedMailbox) {
+    for (uint32_t i = 0; i < 3; i++) {
+        TrySendCANMessage(frame(LOG_TEXT_ID + i), CAN_TX_CLASS_DIAGNOSTIC);
+    }
+    CHECK_EQUAL(2, MockCAN_GetTxMessageCount());
+
+    MockCAN_CompleteTx(2, CAN_TSR_TXOK0);
+    txMailboxInterrupt(&hcan1);
+    TrySendCANMessage(frame(HUD_STAT_ID), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(HUD_STAT_ID + 1), CAN_TX_CLASS_STATUS);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+
+    /* The reserved mailbox is still there for a ping reply */
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(5, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(BUS_ID_ID, sentId(4));
+    CHECK_EQUAL(0, MockCAN_GetAbortCount());
+}
+
+/* Freed mailboxes go to the waiting classes in priority order, not arrival order */
+TEST(TxPriority, FreedMailboxes_ServedByClass) {
+    TrySendCANMessage(frame(HUD_STAT_ID), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(HUD_STAT_ID + 1), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(HUD_STAT_ID + 2), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+
+    MockCAN_CompleteTx(3, CAN_TSR_TXOK0);
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(5, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(HUD_STAT_ID, sentId(0));
+    CHECK_EQUAL(HUD_STAT_ID + 1, sentId(1));
+    CHECK_EQUAL(BUS_ID_ID, sentId(2));
+    CHECK_EQUAL(HUD_STAT_ID + 2, sentId(3));
+    CHECK_EQUAL(LOG_TEXT_ID, sentId(4));
+}
+
+/* A critical frame with every mailbox taken pulls a diagnostic frame back out */
+TEST(TxPriority, Critical_AbortsDiagnostic) {
+    TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(LOG_TEXT_ID + 1), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(0, MockCAN_GetAbortCount());
+
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(1, MockCAN_GetAbortCount());
+    CHECK_EQUAL(-1, MockCAN_GetPendingTxIndex(0));
+
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(BUS_NAME_ID, sentId(3));
+    CHECK_EQUAL(3, MockCAN_GetPendingTxIndex(0));
+    CHECK_EQUAL(0, MockErrors_GetTotalNonFatalISRCount());
+
+    CANTxRingStats_t stats = {};
+    GetCANTxRingStats(CAN_TX_CLASS_DIAGNOSTIC, &stats);
+    CHECK_EQUAL(1, stats.outcomes[CAN_TX_OUTCOME_ABORTED]);
+    GetCANTxRingStats(CAN_TX_CLASS_CRITICAL, &stats);
+    CHECK_EQUAL(0, stats.outcomes[CAN_TX_OUTCOME_ABORTED]);
+}
+
+/* A mailbox freed by an abort and refilled by the next send before the ISR runs is still charged to the aborted class */
+TEST(TxPriority, Abort_SettledBeforeMailboxReused) {
+    TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(LOG_TEXT_ID + 1), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(1, MockCAN_GetAbortCount());
+
+    /* Takes the aborted mailbox and has to abort the other diagnostic frame for the next one */
+    TrySendCANMessage(frame(BUS_NAME_ID + 1), CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(2, MockCAN_GetAbortCount());
+
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(5, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(BUS_NAME_ID + 1, sentId(4));
+
+    CANTxRingStats_t stats = {};
+    GetCANTxRingStats(CAN_TX_CLASS_DIAGNOSTIC, &stats);
+    CHECK_EQUAL(2, stats.outcomes[CAN_TX_OUTCOME_ABORTED]);
+    GetCANTxRingStats(CAN_TX_CLASS_CRITICAL, &stats);
+    CHECK_EQUAL(0, stats.outcomes[CAN_TX_OUTCOME_ABORTED]);
+}
+
+/* Status frames are never aborted, the critical frame waits for a mailbox to complete */
+TEST(TxPriority, Status_NotAborted) {
+    TrySendCANMessage(frame(HUD_STAT_ID), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(HUD_STAT_ID + 1), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(0, MockCAN_GetAbortCount());
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+
+    MockCAN_CompleteTx(1, CAN_TSR_TXOK0);
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(BUS_NAME_ID, sentId(3));
+}
+
+/* The debug replies go out as diagnostic, the ping replies as critical */
+TEST(TxPriority, TxFunctions_Classified) {
+    txRxStats(DIVECAN_MONITOR, 0, 0, 0, 0);
+    txLatencyHistogram(DIVECAN_MONITOR, 0, 0, 0, 0);
+    txRxStats(DIVECAN_MONITOR, 0, 0, 0, 0);
+    CHECK_EQUAL(2, MockCAN_GetTxMessageCount());
+
+    txID(DIVECAN_MONITOR, DIVECAN_MANUFACTURER_SRI, 1);
+    txName(DIVECAN_MONITOR, "HUD");
+    CHECK_EQUAL(1, MockCAN_GetAbortCount());
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(BUS_ID_ID | DIVECAN_MONITOR, sentId(2));
+    CHECK_EQUAL(BUS_NAME_ID | DIVECAN_MONITOR, sentId(3));
+}
+
+/**
+ * TEST_GROUP: TxOutcome
+ * Tests completion tracking from TSR and the per class retry policy
+ * CRITICAL: Protocol replies survive a lost arbitration or bus error, nothing is retried without bound
+ */
+TEST_GROUP(TxOutcome) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        ResetCANTxRing();
+        MockCAN_SetTxManualComplete(true);
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        ResetCANTxRing();
+    }
+
+    static DiveCANMessage_t frame(uint32_t id) {
+        DiveCANMessage_t message = {id, 0, {0}};
+        return message;
+    }
+
+    static uint32_t sentId(uint32_t index) {
+        uint32_t id = 0;
+        CHECK_TRUE(MockCAN_GetTxMessageAt(index, &id, nullptr, nullptr));
+        return id;
+    }
+
+    static CANTxRingStats_t stats(CANTxClass_t txClass) {
+        CANTxRingStats_t result = {};
+        GetCANTxRingStats(txClass, &result);
+        return result;
+    }
+
+    static void complete(uint32_t count, uint32_t result) {
+        MockCAN_CompleteTx(count, result);
+        txMailboxInterrupt(&hcan1);
+    }
+};
+
+/* Each finished mailbox is counted once against its class */
+TEST(TxOutcome, Sent_CountedPerClass) {
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(HUD_STAT_ID), CAN_TX_CLASS_STATUS);
+    complete(2, CAN_TSR_TXOK0);
+    txMailboxInterrupt(&hcan1);
+
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_CRITICAL).outcomes[CAN_TX_OUTCOME_SENT]);
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_STATUS).outcomes[CAN_TX_OUTCOME_SENT]);
+    CHECK_EQUAL(0, stats(CAN_TX_CLASS_CRITICAL).retries);
+    CHECK_EQUAL(2, MockCAN_GetTxMessageCount());
+}
+
+/* A critical frame that loses arbitration goes again */
+TEST(TxOutcome, ArbitrationLost_CriticalRetried) {
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    complete(1, CAN_TSR_ALST0);
+    CHECK_EQUAL(2, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(BUS_ID_ID, sentId(1));
+
+    complete(1, CAN_TSR_TXOK0);
+    const CANTxRingStats_t critical = stats(CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(1, critical.outcomes[CAN_TX_OUTCOME_ARBITRATION_LOST]);
+    CHECK_EQUAL(1, critical.outcomes[CAN_TX_OUTCOME_SENT]);
+    CHECK_EQUAL(1, critical.retries);
+    CHECK_EQUAL(0, critical.abandoned);
+    CHECK_EQUAL(2, MockCAN_GetTxMessageCount());
+}
+
+/* Retries are bounded, one try plus three more */
+TEST(TxOutcome, Error_CriticalGivesUpAfterLimit) {
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+    for (uint32_t i = 0; i < 5; i++) {
+        complete(1, CAN_TSR_TERR0);
+    }
+
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    const CANTxRingStats_t critical = stats(CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(4, critical.outcomes[CAN_TX_OUTCOME_ERROR]);
+    CHECK_EQUAL(3, critical.retries);
+    CHECK_EQUAL(1, critical.abandoned);
+}
+
+/* Status and diagnostic frames are one shot */
+TEST(TxOutcome, LowerClasses_NotRetried) {
+    TrySendCANMessage(frame(HUD_STAT_ID), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    MockCAN_CompleteTx(1, CAN_TSR_ALST0);
+    complete(1, CAN_TSR_TERR0);
+
+    CHECK_EQUAL(2, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_STATUS).outcomes[CAN_TX_OUTCOME_ARBITRATION_LOST]);
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_STATUS).abandoned);
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_DIAGNOSTIC).outcomes[CAN_TX_OUTCOME_ERROR]);
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_DIAGNOSTIC).abandoned);
+}
+
+/* A retry goes ahead of frames of its class still waiting, so a multi frame reply stays in order */
+TEST(TxOutcome, Retry_AheadOfQueuedFrames) {
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(BUS_INIT_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(BUS_OFF_ID), CAN_TX_CLASS_CRITICAL);
+    complete(1, CAN_TSR_ALST0);
+
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(BUS_ID_ID, sentId(3));
+    complete(1, CAN_TSR_TXOK0);
+    CHECK_EQUAL(BUS_OFF_ID, sentId(4));
+}
+
+/* A failure the task side finds before the ISR runs is retried just the same */
+TEST(TxOutcome, FailureSeenFromTaskSide_Retried) {
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    MockCAN_CompleteTx(1, CAN_TSR_TERR0);
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(BUS_ID_ID, sentId(1));
+    CHECK_EQUAL(BUS_NAME_ID, sentId(2));
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_CRITICAL).retries);
+
+    /* The ISR that was pending for it finds nothing more to count */
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(1, stats(CAN_TX_CLASS_CRITICAL).outcomes[CAN_TX_OUTCOME_ERROR]);
+    CHECK_EQUAL(0, hcan1.Instance->TSR & (CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2));
+}
 
-    /* Remaining bytes should be null */
-    for (int i = 3; i < 8; i++) {
-        CHECK_EQUAL(0x00, data[i]);
+/* An aborted diagnostic frame is counted as aborted and requeued, not failed or retried */
+TEST(TxOutcome, Aborted_RequeuedNotRetried) {
+    TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(LOG_TEXT_ID + 1), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+    txMailboxInterrupt(&hcan1);
+
+    const CANTxRingStats_t diagnostic = stats(CAN_TX_CLASS_DIAGNOSTIC);
+    CHECK_EQUAL(1, diagnostic.outcomes[CAN_TX_OUTCOME_ABORTED]);
+    CHECK_EQUAL(0, diagnostic.outcomes[CAN_TX_OUTCOME_ERROR]);
+    CHECK_EQUAL(0, diagnostic.retries);
+    CHECK_EQUAL(1, diagnostic.requeued);
+    CHECK_EQUAL(0, diagnostic.abandoned);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+}
+
+/* Priority only delays a diagnostic frame, it goes once the critical frames are out */
+TEST(TxOutcome, Aborted_SentAfterCritical) {
+    TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(LOG_TEXT_ID + 1), CAN_TX_CLASS_DIAGNOSTIC);
+    TrySendCANMessage(frame(BUS_ID_ID), CAN_TX_CLASS_CRITICAL);
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+    txMailboxInterrupt(&hcan1);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+
+    /* Everything in the mailboxes out leaves room past the reserve */
+    CHECK_EQUAL(3, MockCAN_CompleteTx(3, CAN_TSR_TXOK0));
+    txMailboxInterrupt(&hcan1);
+
+    CHECK_EQUAL(5, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(LOG_TEXT_ID, sentId(4));
+    CHECK_EQUAL(0, stats(CAN_TX_CLASS_DIAGNOSTIC).abandoned);
+}
+
+/**
+ * TEST_GROUP: TxLatency
+ * Tests the enqueue to completion latency histograms and throughput counters, and holds the scheduler to latency
+ * budgets under a synthetic saturating load
+ * CRITICAL: Ping replies and status stay within a few frame times however much debug traffic is queued
+ */
+TEST_GROUP(TxLatency) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockCore_Reset();
+        ResetCANTxRing();
+        MockCAN_SetTxManualComplete(true);
+    }
+
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        ResetCANTxRing();
+    }
+
+    static constexpr uint32_t CYCLES_PER_US = 16;
+    static constexpr uint32_t CYCLES_PER_MS = 16000;
+
+    static DiveCANMessage_t frame(uint32_t id, uint8_t length) {
+        DiveCANMessage_t message = {id, length, {0}};
+        return message;
+    }
+
+    static void complete(uint32_t result) {
+        MockCAN_CompleteTx(1, result);
+        txMailboxInterrupt(&hcan1);
+    }
+
+    static CANTxLatency_t latency(CANTxClass_t txClass) {
+        CANTxLatency_t result = {};
+        GetCANTxLatency(txClass, &result);
+        return result;
+    }
+
+    static CANTxThroughput_t throughput(void) {
+        CANTxThroughput_t result = {};
+        GetCANTxThroughput(&result);
+        return result;
+    }
+
+    /* Highest non-empty bucket, so budgets can be asserted on the whole distribution */
+    static uint32_t topBucket(const CANTxLatency_t &histogram) {
+        uint32_t top = 0;
+        for (uint32_t i = 0; i < CAN_TX_LATENCY_BUCKET_COUNT; i++) {
+            if (histogram.buckets[i] != 0) {
+                top = i;
+            }
+        }
+        return top;
     }
+};
+
+/* Latency runs from the send call to the completion being collected */
+TEST(TxLatency, QueueAndWire_Measured) {
+    MockDWT.CYCCNT = 1000;
+    TrySendCANMessage(frame(BUS_ID_ID, 8), CAN_TX_CLASS_CRITICAL);
+    MockDWT.CYCCNT += 1280 * CYCLES_PER_US;
+    complete(CAN_TSR_TXOK0);
+
+    const CANTxLatency_t critical = latency(CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(1, critical.samples);
+    CHECK_EQUAL(1280, critical.maxMicros);
+    /* 1280 is 11 bits long */
+    CHECK_EQUAL(1, critical.buckets[11]);
+    CHECK_EQUAL(0, latency(CAN_TX_CLASS_STATUS).samples);
 }
 
-/* Boundary case: More than 8 characters - should be truncated */
-TEST(TxName_StringHandling, MoreThan8Chars_Truncated) {
-    const char *name = "VeryLongDeviceName";  /* 18 chars */
+/* A retried frame is timed from when it was first queued */
+TEST(TxLatency, Retry_TimedFromFirstQueue) {
+    TrySendCANMessage(frame(BUS_ID_ID, 8), CAN_TX_CLASS_CRITICAL);
+    MockDWT.CYCCNT += 1000 * CYCLES_PER_US;
+    complete(CAN_TSR_ALST0);
+    CHECK_EQUAL(0, latency(CAN_TX_CLASS_CRITICAL).samples);
+
+    MockDWT.CYCCNT += 1500 * CYCLES_PER_US;
+    complete(CAN_TSR_TXOK0);
+    CHECK_EQUAL(1, latency(CAN_TX_CLASS_CRITICAL).samples);
+    CHECK_EQUAL(2500, latency(CAN_TX_CLASS_CRITICAL).maxMicros);
+}
 
-    txName(DIVECAN_MONITOR, name);
+/* Frames that never made it aren't in the latency or throughput numbers */
+TEST(TxLatency, Failed_NotCounted) {
+    TrySendCANMessage(frame(HUD_STAT_ID, 8), CAN_TX_CLASS_STATUS);
+    complete(CAN_TSR_TERR0);
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+    CHECK_EQUAL(0, latency(CAN_TX_CLASS_STATUS).samples);
+    CHECK_EQUAL(0, throughput().frames);
+    CHECK_EQUAL(0, throughput().bytes);
+}
 
-    /* Only first 8 chars should be copied */
-    CHECK_EQUAL('V', data[0]);
-    CHECK_EQUAL('e', data[1]);
-    CHECK_EQUAL('r', data[2]);
-    CHECK_EQUAL('y', data[3]);
-    CHECK_EQUAL('L', data[4]);
-    CHECK_EQUAL('o', data[5]);
-    CHECK_EQUAL('n', data[6]);
-    CHECK_EQUAL('g', data[7]);
+/* Rates are recomputed once per window and scaled to a second however late the update runs */
+TEST(TxLatency, Throughput_PerWindow) {
+    for (uint32_t i = 0; i < 10; i++) {
+        TrySendCANMessage(frame(HUD_STAT_ID, 8), CAN_TX_CLASS_STATUS);
+        complete(CAN_TSR_TXOK0);
+    }
+    CHECK_EQUAL(10, throughput().frames);
+    CHECK_EQUAL(80, throughput().bytes);
+
+    MockQueue_SetTickCount(999);
+    UpdateCANTxThroughput();
+    CHECK_EQUAL(0, throughput().framesPerSecond);
+
+    MockQueue_SetTickCount(1000);
+    UpdateCANTxThroughput();
+    CHECK_EQUAL(10, throughput().framesPerSecond);
+    CHECK_EQUAL(80, throughput().bytesPerSecond);
+
+    for (uint32_t i = 0; i < 6; i++) {
+        TrySendCANMessage(frame(HUD_STAT_ID, 2), CAN_TX_CLASS_STATUS);
+        complete(CAN_TSR_TXOK0);
+    }
+    MockQueue_SetTickCount(2500);
+    UpdateCANTxThroughput();
+    CHECK_EQUAL(4, throughput().framesPerSecond);
+    CHECK_EQUAL(8, throughput().bytesPerSecond);
+    CHECK_EQUAL(16, throughput().frames);
 }
 
-/* Verify empty string handling */
-TEST(TxName_StringHandling, EmptyString_AllZeros) {
-    const char *name = "";
+/* One second of a saturated 125kbit/s bus: debug frames queued as fast as the ring takes them, status every 100ms and
+ * a controller ping (ID and name replies) every 250ms. Frames arbitrate by ID like the hardware and anything queued
+ * while a frame is on the wire waits for it to finish */
+TEST(TxLatency, SyntheticLoad_WithinBudget) {
+    /* This is about the scheduler keeping the bus full, the bandwidth cap has its own load test */
+    const CANTxThrottleConfig_t lifted = {0, 0, CAN_TX_THROTTLE_DEFER};
+    SetCANTxThrottle(&lifted);
+    const uint32_t bitCycles = SystemCoreClock / 125000U;
+    const uint32_t statusPeriod = 100 * CYCLES_PER_MS;
+    const uint32_t pingPeriod = 250 * CYCLES_PER_MS;
+    uint32_t nextStatus = 0;
+    uint32_t nextPing = 0;
+
+    while (MockDWT.CYCCNT < 1000 * CYCLES_PER_MS) {
+        const int32_t onWire = MockCAN_StartNextTx();
+
+        TrySendCANMessage(frame(LOG_TEXT_ID, 8), CAN_TX_CLASS_DIAGNOSTIC);
+        if (MockDWT.CYCCNT >= nextStatus) {
+            TrySendCANMessage(frame(HUD_STAT_ID, 8), CAN_TX_CLASS_STATUS);
+            nextStatus += statusPeriod;
+        }
+        if (MockDWT.CYCCNT >= nextPing) {
+            TrySendCANMessage(frame(BUS_ID_ID, 3), CAN_TX_CLASS_CRITICAL);
+            TrySendCANMessage(frame(BUS_NAME_ID, 8), CAN_TX_CLASS_CRITICAL);
+            nextPing += pingPeriod;
+        }
 
-    txName(DIVECAN_MONITOR, name);
+        if (onWire >= 0) {
+            uint8_t length = 0;
+            MockCAN_GetTxMessageAt((uint32_t)onWire, nullptr, &length, nullptr);
+            MockDWT.CYCCNT += CANFrameBits(length) * bitCycles;
+            MockCAN_FinishTx(CAN_TSR_TXOK0);
+        } else {
+            MockDWT.CYCCNT += bitCycles;
+        }
+        MockQueue_SetTickCount(MockDWT.CYCCNT / CYCLES_PER_MS);
+        txMailboxInterrupt(&hcan1);
+    }
+    UpdateCANTxThroughput();
+
+    /* Every ping reply went, within the frame on the wire plus the ID and name frames (3.44ms) */
+    const CANTxLatency_t critical = latency(CAN_TX_CLASS_CRITICAL);
+    CHECK_EQUAL(8, critical.samples);
+    CHECK(critical.maxMicros <= 3440);
+    CHECK(topBucket(critical) <= 12);
+
+    /* Status waits for a debug frame to free a mailbox and can also land behind a ping reply, 4 frame times at most */
+    const CANTxLatency_t status = latency(CAN_TX_CLASS_STATUS);
+    CHECK_EQUAL(10, status.samples);
+    CHECK(status.maxMicros <= 5000);
+    CHECK(topBucket(status) <= 13);
+
+    /* Debug frames give way, some pulled from their mailbox for the name replies */
+    CANTxRingStats_t diagnostic = {};
+    GetCANTxRingStats(CAN_TX_CLASS_DIAGNOSTIC, &diagnostic);
+    CHECK(diagnostic.outcomes[CAN_TX_OUTCOME_ABORTED] > 0);
+
+    /* And the bus stays full, 1280us per 8 byte frame is 781 a second */
+    CHECK(throughput().framesPerSecond >= 770);
+    CHECK(throughput().bytesPerSecond >= 770 * 8 - 100);
+}
 
-    uint8_t data[8];
-    MockCAN_GetLastTxMessage(nullptr, nullptr, data);
+/**
+ * TEST_GROUP: TxThrottle
+ * Tests the token bucket over extension ID transmissions, its defer and drop policies and its counters
+ * CRITICAL: Debug traffic can't take more than its share of the bus, protocol frames are never held by it
+ */
+TEST_GROUP(TxThrottle) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockCore_Reset();
+        ResetCANTxRing();
+    }
 
-    /* All bytes should be zero */
-    for (int i = 0; i < 8; i++) {
-        CHECK_EQUAL(0x00, data[i]);
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        ResetCANTxRing();
     }
+
+    static constexpr uint32_t CYCLES_PER_MS = 16000;
+    /* CANFrameBits(8) */
+    static constexpr uint32_t FULL_FRAME_BITS = 160;
+
+    static DiveCANMessage_t frame(uint32_t id) {
+        DiveCANMessage_t message = {id, 8, {0}};
+        return message;
+    }
+
+    /* 1000 bits/s refills a full frame every 160ms, the burst is 3 full frames */
+    static void configure(CANTxThrottlePolicy_t policy) {
+        const CANTxThrottleConfig_t config = {1000, 3 * FULL_FRAME_BITS, policy};
+        SetCANTxThrottle(&config);
+    }
+
+    static CANTxThrottleStats_t stats(void) {
+        CANTxThrottleStats_t result = {};
+        GetCANTxThrottleStats(&result);
+        return result;
+    }
+};
+
+/* Out of the box the cap is on at 10% of the bus, deferring, with a full ring's worth of burst */
+TEST(TxThrottle, Default_TenPercentDeferring) {
+    CANTxThrottleConfig_t config = {};
+    GetCANTxThrottle(&config);
+    CHECK_EQUAL(12500, config.bitsPerSecond);
+    CHECK_EQUAL(16 * FULL_FRAME_BITS, config.burstBits);
+    CHECK_EQUAL(CAN_TX_THROTTLE_DEFER, config.policy);
+    CHECK_EQUAL(16 * FULL_FRAME_BITS, stats().availableBits);
 }
 
-/* Verify ID encoding: BUS_NAME_ID | deviceType */
-TEST(TxName_StringHandling, Monitor_IDBitsCorrect) {
-    txName(DIVECAN_MONITOR, "HUD");
+/* Extension IDs are everything in the 0xF... range and nothing else */
+TEST(TxThrottle, ExtensionRange) {
+    CHECK_TRUE(DIVECAN_IS_EXTENSION_ID(LOG_TEXT_ID));
+    CHECK_TRUE(DIVECAN_IS_EXTENSION_ID(PRECISION_CELL_3_ID | 0x04));
+    CHECK_TRUE(DIVECAN_IS_EXTENSION_ID(LATENCY_HIST_ID));
+    CHECK_FALSE(DIVECAN_IS_EXTENSION_ID(BUS_ID_ID));
+    CHECK_FALSE(DIVECAN_IS_EXTENSION_ID(HUD_STAT_ID));
+    CHECK_FALSE(DIVECAN_IS_EXTENSION_ID(0x1F000000));
+}
 
-    uint32_t expectedID = BUS_NAME_ID | DIVECAN_MONITOR;
-    /* BUS_NAME_ID = 0xD010000, MONITOR (3) → 0xD010003 */
+/* The burst goes straight out, the next frame waits in the ring until the bucket has refilled enough to cover it */
+TEST(TxThrottle, Defer_HeldUntilRefilled) {
+    configure(CAN_TX_THROTTLE_DEFER);
+    for (uint32_t i = 0; i < 4; i++) {
+        CHECK_EQUAL(CAN_TX_OK, TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC));
+    }
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(3, stats().passed);
+    CHECK_EQUAL(1, stats().deferred);
+
+    /* Draining again before the refill doesn't count it twice */
+    MockDWT.CYCCNT = 159 * CYCLES_PER_MS;
+    ServiceCANTxThrottle();
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(1, stats().deferred);
+
+    MockDWT.CYCCNT = 160 * CYCLES_PER_MS;
+    ServiceCANTxThrottle();
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(4, stats().passed);
+    CHECK_EQUAL(1, stats().deferred);
+    CHECK_EQUAL(0, stats().dropped);
+    CHECK_EQUAL(0, stats().availableBits);
+}
 
-    uint32_t actualID;
-    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
-    CHECK_EQUAL(0xD010003, actualID);
+/* CANTask sleeps until the bucket covers the held frame rather than for its whole idle timeout */
+TEST(TxThrottle, Defer_BlockTimeUntilRefilled) {
+    configure(CAN_TX_THROTTLE_DEFER);
+    CHECK_EQUAL(1000, CANTxThrottleBlockTime(1000));
+    for (uint32_t i = 0; i < 4; i++) {
+        TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    }
+    CHECK_EQUAL(160, CANTxThrottleBlockTime(1000));
+    CHECK_EQUAL(100, CANTxThrottleBlockTime(100));
+
+    MockDWT.CYCCNT = 100 * CYCLES_PER_MS;
+    CHECK_EQUAL(60, CANTxThrottleBlockTime(1000));
+
+    /* Covered but not loaded yet, come straight back */
+    MockDWT.CYCCNT = 160 * CYCLES_PER_MS;
+    CHECK_EQUAL(1, CANTxThrottleBlockTime(1000));
+
+    ServiceCANTxThrottle();
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(1000, CANTxThrottleBlockTime(1000));
 }
 
-TEST(TxName_StringHandling, OBOE_IDBitsCorrect) {
-    txName(DIVECAN_OBOE, "OBOE1");
+/* A deferred frame only blocks its own ring, protocol traffic isn't charged */
+TEST(TxThrottle, Defer_ProtocolUnaffected) {
+    configure(CAN_TX_THROTTLE_DEFER);
+    for (uint32_t i = 0; i < 4; i++) {
+        TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    }
+    TrySendCANMessage(frame(HUD_STAT_ID), CAN_TX_CLASS_STATUS);
+    TrySendCANMessage(frame(BUS_NAME_ID), CAN_TX_CLASS_CRITICAL);
+
+    CHECK_EQUAL(5, MockCAN_GetTxMessageCount());
+    CHECK_TRUE(MockCAN_VerifyTxMessage(3, HUD_STAT_ID, 8));
+    CHECK_TRUE(MockCAN_VerifyTxMessage(4, BUS_NAME_ID, 8));
+    CHECK_EQUAL(3, stats().passed);
+    CHECK_EQUAL(0, stats().availableBits);
+}
 
-    uint32_t expectedID = BUS_NAME_ID | DIVECAN_OBOE;
-    /* BUS_NAME_ID = 0xD010000, OBOE (2) → 0xD010002 */
+/* Dropping discards what the bucket can't cover and keeps the ring moving */
+TEST(TxThrottle, Drop_DiscardedAndCounted) {
+    configure(CAN_TX_THROTTLE_DROP);
+    for (uint32_t i = 0; i < 5; i++) {
+        TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    }
+    CHECK_EQUAL(3, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(2, stats().dropped);
+    CHECK_EQUAL(0, stats().deferred);
+
+    MockDWT.CYCCNT = 160 * CYCLES_PER_MS;
+    TrySendCANMessage(frame(PID_P_GAIN_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    CHECK_EQUAL(4, MockCAN_GetTxMessageCount());
+    CHECK_TRUE(MockCAN_VerifyTxMessage(3, PID_P_GAIN_ID, 8));
+    CHECK_EQUAL(2, stats().dropped);
+}
 
-    uint32_t actualID;
-    MockCAN_GetLastTxMessage(&actualID, nullptr, nullptr);
-    CHECK_EQUAL(0xD010002, actualID);
+/* Frames are charged their worst case stuffed length, shorter frames fit more into the burst */
+TEST(TxThrottle, ChargedByFrameBits) {
+    configure(CAN_TX_THROTTLE_DEFER);
+    DiveCANMessage_t empty = {LOG_TEXT_ID, 0, {0}};
+    const uint32_t fits = (3 * FULL_FRAME_BITS) / CANFrameBits(0);
+    for (uint32_t i = 0; i < fits + 1; i++) {
+        TrySendCANMessage(empty, CAN_TX_CLASS_DIAGNOSTIC);
+    }
+    CHECK_EQUAL(fits, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL((3 * FULL_FRAME_BITS) - (fits * CANFrameBits(0)), stats().availableBits);
 }
 
-/* Verify message length is always 8 bytes */
-TEST(TxName_StringHandling, MessageLength_Always8Bytes) {
-    txName(DIVECAN_MONITOR, "HUD");
+/* A burst too small for one full frame would wedge a deferring ring, so it is raised */
+TEST(TxThrottle, Burst_AtLeastOneFrame) {
+    const CANTxThrottleConfig_t tiny = {1000, 10, CAN_TX_THROTTLE_DEFER};
+    SetCANTxThrottle(&tiny);
+    CANTxThrottleConfig_t applied = {};
+    GetCANTxThrottle(&applied);
+    CHECK_EQUAL(CANFrameBits(8), applied.burstBits);
 
-    uint8_t length;
-    MockCAN_GetLastTxMessage(nullptr, &length, nullptr);
-    CHECK_EQUAL(8, length);
+    TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    CHECK_EQUAL(1, MockCAN_GetTxMessageCount());
+}
+
+/* Zero bits per second lifts the cap entirely */
+TEST(TxThrottle, Lifted_NothingCharged) {
+    const CANTxThrottleConfig_t lifted = {0, 0, CAN_TX_THROTTLE_DROP};
+    SetCANTxThrottle(&lifted);
+    for (uint32_t i = 0; i < 40; i++) {
+        TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+    }
+    CHECK_EQUAL(40, MockCAN_GetTxMessageCount());
+    CHECK_EQUAL(0, stats().passed);
+    CHECK_EQUAL(0, stats().dropped);
+}
+
+/* The synthetic saturating load from TxLatency under the default cap: debug frames get their 10% plus the burst and
+ * no more, and the protocol frames are all still sent on time */
+TEST(TxThrottle, SyntheticLoad_CapHeld) {
+    MockCAN_SetTxManualComplete(true);
+    const uint32_t bitCycles = SystemCoreClock / 125000U;
+    uint32_t nextStatus = 0;
+
+    while (MockDWT.CYCCNT < 1000 * CYCLES_PER_MS) {
+        const int32_t onWire = MockCAN_StartNextTx();
+
+        TrySendCANMessage(frame(LOG_TEXT_ID), CAN_TX_CLASS_DIAGNOSTIC);
+        if (MockDWT.CYCCNT >= nextStatus) {
+            TrySendCANMessage(frame(HUD_STAT_ID), CAN_TX_CLASS_STATUS);
+            nextStatus += 100 * CYCLES_PER_MS;
+        }
+
+        if (onWire >= 0) {
+            uint8_t length = 0;
+            MockCAN_GetTxMessageAt((uint32_t)onWire, nullptr, &length, nullptr);
+            MockDWT.CYCCNT += CANFrameBits(length) * bitCycles;
+            MockCAN_FinishTx(CAN_TSR_TXOK0);
+        } else {
+            MockDWT.CYCCNT += bitCycles;
+        }
+        txMailboxInterrupt(&hcan1);
+    }
+
+    const CANTxThrottleStats_t throttle = stats();
+    CHECK(throttle.passed * FULL_FRAME_BITS <= 12500 + (16 * FULL_FRAME_BITS) + FULL_FRAME_BITS);
+    CHECK(throttle.passed * FULL_FRAME_BITS >= 12500);
+    CHECK(throttle.deferred > 0);
+
+    CANTxLatency_t status = {};
+    GetCANTxLatency(CAN_TX_CLASS_STATUS, &status);
+    CHECK_EQUAL(10, status.samples);
+    /* The frame already on the wire, then its own */
+    CHECK(status.maxMicros <= 2560);
 }
 
 /**
- * TEST_GROUP: SendCANMessage_MailboxWait
- * Tests mailbox wait loop and error handling
- * CRITICAL: Must wait (osDelay) when mailboxes full, handle HAL errors
+ * TEST_GROUP: CANFilters_Acceptance
+ * Tests the bxCAN filter banks generated from DIVECAN_RX_ID_LIST
+ * CRITICAL: Anything CANTask acts on must get through, from any source device
  */
-TEST_GROUP(SendCANMessage_MailboxWait) {
+TEST_GROUP(CANFilters_Acceptance) {
     void setup() {
         MockCAN_Reset();
         MockErrors_Reset();
@@ -535,115 +2514,298 @@ TEST_GROUP(SendCANMessage_MailboxWait) {
     }
 };
 
-/* Verify mailbox wait loop when all mailboxes busy */
-TEST(SendCANMessage_MailboxWait, AllMailboxesBusy_WaitsUntilFree) {
-    /* Start with no free mailboxes, then free after 3 checks */
-    MockCAN_SetTxBehavior(HAL_OK, 0);  /* Initially busy */
+/* One 32 bit mask bank per list entry, in list order */
+TEST(CANFilters_Acceptance, OneBankPerConsumedId) {
+    InitCANFilters(&hcan1);
+
+    CHECK_EQUAL(DIVECAN_RX_ID_COUNT, MockCAN_GetFilterCount());
+    for (uint32_t i = 0; i < MockCAN_GetFilterCount(); i++) {
+        CAN_FilterTypeDef filter = {};
+        CHECK_TRUE(MockCAN_GetFilterAt(i, &filter));
+        CHECK_EQUAL(i, filter.FilterBank);
+        CHECK_EQUAL(CAN_FILTERMODE_IDMASK, filter.FilterMode);
+        CHECK_EQUAL(CAN_FILTERSCALE_32BIT, filter.FilterScale);
+        CHECK_EQUAL(CAN_FILTER_ENABLE, filter.FilterActivation);
+    }
+    CHECK_EQUAL(0, MockErrors_GetNonFatalCount(CAN_CONFIG_ERR));
+}
 
-    DiveCANMessage_t msg = {
-        .id = BUS_INIT_ID,
-        .length = 3,
-        .data = {0x8a, 0xf3, 0x00, 0, 0, 0, 0, 0}
-    };
+/* Verify bit packing of the first bank (BUS_ID_ID) against the register layout */
+TEST(CANFilters_Acceptance, FilterRegisterLayout) {
+    InitCANFilters(&hcan1);
 
-    /* Simulate mailbox becoming free after 3rd call */
-    MockCAN_SetTxFailOnCall(3);  /* Will set free level to 1 on 3rd call */
-    /* Actually, looking at MockCAN, SetTxFailOnCall makes AddTxMessage fail, not GetTxMailboxesFreeLevel */
-    /* I need a different approach - need to track call count in test */
+    CAN_FilterTypeDef filter = {};
+    CHECK_TRUE(MockCAN_GetFilterAt(0, &filter));
 
-    /* For now, test with mailbox immediately free */
-    MockCAN_SetTxBehavior(HAL_OK, 1);
-    sendCANMessage(msg);
+    /* (0xD000000 << 3) | IDE = 0x68000004 */
+    CHECK_EQUAL(0x6800, filter.FilterIdHigh);
+    CHECK_EQUAL(0x0004, filter.FilterIdLow);
+    /* (0x1FFFF000 << 3) | IDE | RTR = 0xFFFF8006 */
+    CHECK_EQUAL(0xFFFF, filter.FilterMaskIdHigh);
+    CHECK_EQUAL(0x8006, filter.FilterMaskIdLow);
+}
 
-    /* Verify message was sent */
-    CHECK_EQUAL(1, MockCAN_GetTxMessageCount());
+/* Consumed IDs are accepted regardless of the source/dest nibbles */
+TEST(CANFilters_Acceptance, ConsumedIds_AnySource) {
+    InitCANFilters(&hcan1);
+
+    CHECK_TRUE(MockCAN_FilterAccepts(PPO2_PPO2_ID));
+    CHECK_TRUE(MockCAN_FilterAccepts(PPO2_PPO2_ID | DIVECAN_SOLO));
+    CHECK_TRUE(MockCAN_FilterAccepts(PPO2_PPO2_ID | DIVECAN_OBOE));
+    CHECK_TRUE(MockCAN_FilterAccepts(PPO2_STATUS_ID | 0xFFF));
+    CHECK_TRUE(MockCAN_FilterAccepts(BUS_ID_ID | DIVECAN_CONTROLLER));
+    CHECK_TRUE(MockCAN_FilterAccepts(BUS_OFF_ID | (DIVECAN_SOLO << 8)));
+    CHECK_TRUE(MockCAN_FilterAccepts(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO));
+    CHECK_TRUE(MockCAN_FilterAccepts(PPO2_MILLIS_ID | DIVECAN_SOLO));
+    CHECK_TRUE(MockCAN_FilterAccepts(BUS_STATUS_ID | DIVECAN_SOLO));
+    CHECK_TRUE(MockCAN_FilterAccepts(DIVING_ID | DIVECAN_CONTROLLER));
 }
 
-/* Verify osDelay called when waiting for mailbox */
-TEST(SendCANMessage_MailboxWait, MailboxBusy_CallsOsDelay) {
-    /* This test would require tracking osDelay calls */
-    /* For now, verify behavior when mailbox is immediately available */
-    MockCAN_SetTxBehavior(HAL_OK, 3);  /* All mailboxes free */
+/* The extension requests share one bank, their replies still don't get through */
+TEST(CANFilters_Acceptance, ExtensionRequests_ShareBank) {
+    InitCANFilters(&hcan1);
 
-    DiveCANMessage_t msg = {
-        .id = PPO2_PPO2_ID,
-        .length = 8,
-        .data = {0x64, 0x64, 0x64, 0, 0, 0, 0, 0}
-    };
+    CHECK_TRUE(MockCAN_FilterAccepts(RX_STATS_REQ_ID | DIVECAN_CONTROLLER));
+    CHECK_TRUE(MockCAN_FilterAccepts(LATENCY_HIST_REQ_ID | DIVECAN_CONTROLLER));
+    CHECK_TRUE(MockCAN_FilterAccepts(SNIFFER_REQ_ID | DIVECAN_CONTROLLER));
+    CHECK_TRUE(MockCAN_FilterAccepts(SNIFFER_READ_REQ_ID | DIVECAN_CONTROLLER));
 
-    sendCANMessage(msg);
+    CHECK_FALSE(MockCAN_FilterAccepts(RX_STATS_ID | DIVECAN_MONITOR));
+    CHECK_FALSE(MockCAN_FilterAccepts(LATENCY_HIST_ID | DIVECAN_MONITOR));
+    CHECK_FALSE(MockCAN_FilterAccepts(SNIFFER_STATUS_ID | DIVECAN_MONITOR));
+    CHECK_FALSE(MockCAN_FilterAccepts(SNIFFER_DATA_ID | DIVECAN_MONITOR));
+    CHECK_FALSE(MockCAN_FilterAccepts(PRECISION_CELL_1_ID | DIVECAN_MONITOR));
+}
 
-    /* osDelay should NOT be called if mailbox immediately free */
-    CHECK_EQUAL(0, MockQueue_GetDelayCallCount());
+/* Traffic we don't act on is dropped in hardware */
+TEST(CANFilters_Acceptance, UnconsumedIds_Rejected) {
+    InitCANFilters(&hcan1);
+
+    CHECK_FALSE(MockCAN_FilterAccepts(HUD_STAT_ID | DIVECAN_SOLO));
+    CHECK_FALSE(MockCAN_FilterAccepts(BUS_NAME_ID | DIVECAN_SOLO));
+    CHECK_FALSE(MockCAN_FilterAccepts(MENU_ID));
+    CHECK_FALSE(MockCAN_FilterAccepts(LOG_TEXT_ID | DIVECAN_SOLO));
+    CHECK_FALSE(MockCAN_FilterAccepts(CAL_ID));
 }
 
-/* Verify HAL error handling */
-TEST(SendCANMessage_MailboxWait, HAL_AddTxMessage_Error) {
-    MockCAN_SetTxBehavior(HAL_ERROR, 3);
+/* CRITICAL: PPO2, cell status and shutdown get the priority FIFO, everything else stays on FIFO0 */
+TEST(CANFilters_Acceptance, SafetyCriticalIds_RoutedToFifo1) {
+    InitCANFilters(&hcan1);
 
-    DiveCANMessage_t msg = {
-        .id = HUD_STAT_ID,
-        .length = 5,
-        .data = {0x01, 0x02, 0x03, 0x04, 0x05, 0, 0, 0}
-    };
+    CHECK_EQUAL(CAN_FILTER_FIFO1, MockCAN_FilterFifo(PPO2_PPO2_ID | DIVECAN_SOLO));
+    CHECK_EQUAL(CAN_FILTER_FIFO1, MockCAN_FilterFifo(PPO2_STATUS_ID | DIVECAN_SOLO));
+    CHECK_EQUAL(CAN_FILTER_FIFO1, MockCAN_FilterFifo(BUS_OFF_ID | DIVECAN_CONTROLLER));
 
-    sendCANMessage(msg);
+    CHECK_EQUAL(CAN_FILTER_FIFO0, MockCAN_FilterFifo(BUS_ID_ID | DIVECAN_SOLO));
+    CHECK_EQUAL(CAN_FILTER_FIFO0, MockCAN_FilterFifo(PPO2_SETPOINT_ID | DIVECAN_SOLO));
+    CHECK_EQUAL(CAN_FILTER_FIFO0, MockCAN_FilterFifo(CAN_SERIAL_NUMBER_ID | DIVECAN_SOLO));
 
-    /* Should log non-fatal error */
-    CHECK_EQUAL(1, MockErrors_GetNonFatalCount(CAN_TX_ERR));
+    CHECK_EQUAL(-1, MockCAN_FilterFifo(LOG_TEXT_ID));
 }
 
-/* Verify correct header configuration */
-TEST(SendCANMessage_MailboxWait, HeaderConfiguration_ExtendedID) {
-    MockCAN_SetTxBehavior(HAL_OK, 3);
+/* The compile time routing agrees with what the banks were loaded with */
+TEST(CANFilters_Acceptance, FifoMacroMatchesBanks) {
+    InitCANFilters(&hcan1);
 
-    DiveCANMessage_t msg = {
-        .id = 0xDEADBEEF,
-        .length = 5,
-        .data = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0, 0, 0}
-    };
+    const uint32_t ids[] = {BUS_ID_ID, BUS_OFF_ID, PPO2_PPO2_ID, PPO2_STATUS_ID, PPO2_SETPOINT_ID, CAN_SERIAL_NUMBER_ID};
+    for (uint32_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+        CHECK_EQUAL((int32_t)DIVECAN_RX_FIFO(ids[i]), MockCAN_FilterFifo(ids[i] | DIVECAN_OBOE));
+    }
+}
 
-    sendCANMessage(msg);
+/* The compile time membership check agrees with the hardware model */
+TEST(CANFilters_Acceptance, AcceptedMacroMatchesBanks) {
+    InitCANFilters(&hcan1);
 
-    /* Verify message ID matches */
-    uint32_t txID;
-    uint8_t txLen;
-    uint8_t txData[8];
-    CHECK_TRUE(MockCAN_GetLastTxMessage(&txID, &txLen, txData));
+    const uint32_t ids[] = {BUS_ID_ID, BUS_NAME_ID, BUS_OFF_ID, PPO2_PPO2_ID, HUD_STAT_ID, PPO2_ATMOS_ID,
+                            MENU_ID, TANK_PRESSURE_ID, PPO2_SETPOINT_ID, PPO2_STATUS_ID, BUS_STATUS_ID,
+                            DIVING_ID, CAN_SERIAL_NUMBER_ID, LOG_TEXT_ID, PPO2_MILLIS_ID, CAL_ID,
+                            RX_STATS_REQ_ID, RX_STATS_ID, SNIFFER_READ_REQ_ID, SNIFFER_DATA_ID};
+    for (uint32_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+        CHECK_EQUAL(DIVECAN_RX_ACCEPTED(ids[i]), MockCAN_FilterAccepts(ids[i] | DIVECAN_SOLO));
+    }
+}
 
-    CHECK_EQUAL(0xDEADBEEF, txID);
-    CHECK_EQUAL(5, txLen);
+/* HAL failures are reported per bank, not swallowed */
+TEST(CANFilters_Acceptance, HalError_Reported) {
+    MockCAN_SetFilterStatus(HAL_ERROR);
 
-    /* Verify data copied correctly */
-    CHECK_EQUAL(0xAA, txData[0]);
-    CHECK_EQUAL(0xBB, txData[1]);
-    CHECK_EQUAL(0xCC, txData[2]);
-    CHECK_EQUAL(0xDD, txData[3]);
-    CHECK_EQUAL(0xEE, txData[4]);
+    InitCANFilters(&hcan1);
+
+    CHECK_EQUAL(DIVECAN_RX_ID_COUNT, MockErrors_GetNonFatalCount(CAN_CONFIG_ERR));
 }
 
-/* Verify data length handling */
-TEST(SendCANMessage_MailboxWait, DataLength_VariesCorrectly) {
-    MockCAN_SetTxBehavior(HAL_OK, 3);
+/* Test Group: BusLoad - Worst case stuffed bit accounting against the configured bit rate */
+TEST_GROUP(BusLoad) {
+    void setup() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ResetFreeRTOS();
+        MockQueue_SetTickCount(0);
+        ResetCANRxRing();
+        InitCANFilters(&hcan1);
+        InitCANBusLoad(&hcan1);
+    }
 
-    /* Test with length = 1 */
-    DiveCANMessage_t msg1 = {.id = BUS_INIT_ID, .length = 1, .data = {0xFF}};
-    sendCANMessage(msg1);
+    void teardown() {
+        MockCAN_Reset();
+        MockErrors_Reset();
+        MockQueue_ClearAllQueues();
+    }
 
-    uint8_t len;
-    MockCAN_GetLastTxMessage(nullptr, &len, nullptr);
-    CHECK_EQUAL(1, len);
+    /* Receive a number of 8 byte frames (160 bits each) at the current tick */
+    void receiveFull(uint32_t frames) {
+        const uint8_t data[8] = {0};
+        for (uint32_t i = 0; i < frames; i++) {
+            rxInterrupt(BUS_ID_ID | DIVECAN_SOLO, 8, data);
+        }
+    }
 
-    /* Test with length = 8 */
-    DiveCANMessage_t msg8 = {
-        .id = PPO2_PPO2_ID,
-        .length = 8,
-        .data = {1, 2, 3, 4, 5, 6, 7, 8}
-    };
-    sendCANMessage(msg8);
+    void updateAt(uint32_t tick) {
+        MockQueue_SetTickCount(tick);
+        UpdateCANBusLoad();
+    }
+};
 
-    MockCAN_GetLastTxMessage(nullptr, &len, nullptr);
-    CHECK_EQUAL(8, len);
+/* Empty frames are 80 bit times, full ones 160, oversize DLCs count as 8 bytes */
+TEST(BusLoad, FrameBits_WorstCaseStuffed) {
+    CHECK_EQUAL(80, CANFrameBits(0));
+    CHECK_EQUAL(120, CANFrameBits(4));
+    CHECK_EQUAL(160, CANFrameBits(8));
+    CHECK_EQUAL(160, CANFrameBits(15));
+}
+
+/* MX_CAN1_Init's 125kbit/s is 12500 bits per 100ms slot */
+TEST(BusLoad, SlotAndWindow_FromBitTiming) {
+    receiveFull(50);
+    updateAt(CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(640, load.slotPermille);
+    CHECK_EQUAL(64, load.windowPermille);
+    CHECK_EQUAL(640, load.peakSlotPermille);
+    CHECK_EQUAL(64, load.peakWindowPermille);
+}
+
+/* Nothing is reported for the slot still in progress */
+TEST(BusLoad, CurrentSlot_NotCounted) {
+    receiveFull(50);
+    updateAt(CAN_BUS_LOAD_SLOT_MS - 1);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(0, load.slotPermille);
+    CHECK_EQUAL(0, load.windowPermille);
+}
+
+/* A faster APB1 clock with the same divider is a faster bus, so the same frames are half the load */
+TEST(BusLoad, BitRate_TracksClock) {
+    MockCAN_SetPCLK1Freq(32000000U);
+    InitCANBusLoad(&hcan1);
+
+    receiveFull(50);
+    updateAt(CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(320, load.slotPermille);
+}
+
+/* Worst case stuffing can add up to more than the bus carries, report it as full */
+TEST(BusLoad, Saturates_AtFull) {
+    receiveFull(100);
+    updateAt(CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(1000, load.slotPermille);
+}
+
+/* The window slides, peaks stay */
+TEST(BusLoad, Window_SlidesPeakHolds) {
+    for (uint32_t slot = 0; slot < CAN_BUS_LOAD_SLOT_COUNT; slot++) {
+        MockQueue_SetTickCount(slot * CAN_BUS_LOAD_SLOT_MS);
+        receiveFull(25);
+    }
+    updateAt(CAN_BUS_LOAD_SLOT_COUNT * CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(320, load.windowPermille);
+
+    /* Half the window goes quiet */
+    updateAt((CAN_BUS_LOAD_SLOT_COUNT + (CAN_BUS_LOAD_SLOT_COUNT / 2)) * CAN_BUS_LOAD_SLOT_MS);
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(160, load.windowPermille);
+    CHECK_EQUAL(0, load.slotPermille);
+    CHECK_EQUAL(320, load.peakSlotPermille);
+    CHECK_EQUAL(320, load.peakWindowPermille);
+}
+
+/* A slot's peak is caught even when it is neither the newest nor the update happens straight after it */
+TEST(BusLoad, PeakSlot_SeenBetweenUpdates) {
+    MockQueue_SetTickCount(2 * CAN_BUS_LOAD_SLOT_MS);
+    receiveFull(70);
+    MockQueue_SetTickCount(3 * CAN_BUS_LOAD_SLOT_MS);
+    receiveFull(10);
+    updateAt(5 * CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(896, load.peakSlotPermille);
+    CHECK_EQUAL(0, load.slotPermille);
+}
+
+/* Slots from long ago don't come back when the period counter lines up with them again */
+TEST(BusLoad, StaleSlots_Ignored) {
+    receiveFull(50);
+    updateAt(CAN_BUS_LOAD_SLOT_MS);
+    updateAt(500 * CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(0, load.windowPermille);
+    CHECK_EQUAL(640, load.peakSlotPermille);
+}
+
+/* Our own transmissions load the bus too */
+TEST(BusLoad, TxFrames_Counted) {
+    const DiveCANMessage_t message = {BUS_ID_ID, 8, {0}};
+    for (uint32_t i = 0; i < 10; i++) {
+        sendCANMessage(message, CAN_TX_CLASS_CRITICAL);
+    }
+    updateAt(CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(128, load.slotPermille);
+}
+
+/* A frame the HAL refuses never reaches the bus */
+TEST(BusLoad, TxFailure_NotCounted) {
+    MockCAN_SetTxBehavior(HAL_ERROR, 3);
+    const DiveCANMessage_t message = {BUS_ID_ID, 8, {0}};
+    sendCANMessage(message, CAN_TX_CLASS_CRITICAL);
+    updateAt(CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(0, load.slotPermille);
+}
+
+/* Frames read at register level by the FIFO ISR are charged as well */
+TEST(BusLoad, RxFifoInterrupt_Counted) {
+    InitCANFilters(&hcan1);
+    const uint8_t data[8] = {0};
+    CHECK_TRUE(MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 8, data));
+    CHECK_TRUE(MockCAN_DeliverRxMessage(BUS_ID_ID | DIVECAN_SOLO, 0, data));
+    rxFifoInterrupt(&hcan1, CAN_RX_FIFO0);
+    updateAt(CAN_BUS_LOAD_SLOT_MS);
+
+    CANBusLoad_t load = {};
+    GetCANBusLoad(&load);
+    CHECK_EQUAL(19, load.slotPermille);
 }
 
 /* Main test runner */
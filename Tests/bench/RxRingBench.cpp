@@ -0,0 +1,138 @@
+/**
+ * RxRingBench.cpp - Host benchmark for the inbound CAN path
+ *
+ * Compares the SPSC frame ring (filters -> rxFifoInterrupt -> GetLatestCAN/ReleaseLatestCAN, read in place)
+ * against the previous path: two FreeRTOS queue calls per frame from the ISR and a copying
+ * xQueueReceive in CANTask. Both run against the host queue mock, so the absolute numbers say
+ * nothing about the STM32, but the relative per-frame cost of the copies and queue calls does carry over.
+ *
+ * Not part of `make test`, run with `make bench`.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+extern "C" {
+    #include "Transciever.h"
+    #include "MockErrors.h"
+    #include "queue.h"
+}
+
+namespace {
+
+const uint32_t FRAMES = 2000000;
+const uint8_t FRAME_DATA[8] = {0x01, 0x45, 0x46, 0x47, 0x00, 0x00, 0x00, 0x00};
+
+/* Copy of the pre-ring inbound path, kept here as the baseline */
+QueueHandle_t legacyInbound = nullptr;
+QueueHandle_t legacyDataAvail = nullptr;
+
+void legacyInit() {
+    static StaticQueue_t inboundStruct;
+    static uint8_t inboundStorage[10 * sizeof(DiveCANMessage_t)];
+    static StaticQueue_t dataAvailStruct;
+    static uint8_t dataAvailStorage[sizeof(bool)];
+    legacyInbound = xQueueCreateStatic(10, sizeof(DiveCANMessage_t), inboundStorage, &inboundStruct);
+    legacyDataAvail = xQueueCreateStatic(1, sizeof(bool), dataAvailStorage, &dataAvailStruct);
+}
+
+/* The old handler pulled one frame out through the HAL per interrupt, the frame gets into the FIFO the same way as on
+ * the ring side so both pay the same mock filter cost */
+void legacyRxInterrupt(const uint32_t id, const uint8_t length, const uint8_t *const data) {
+    const int32_t fifo = MockCAN_FilterFifo(id);
+    (void)MockCAN_DeliverRxMessage(id, length, data);
+    CAN_RxHeaderTypeDef header = {0, 0, 0, 0, 0, 0, 0};
+    DiveCANMessage_t message = {0, 0, {0, 0, 0, 0, 0, 0, 0, 0}};
+    (void)HAL_CAN_GetRxMessage(&hcan1, (uint32_t)fifo, &header, message.data);
+    message.id = header.ExtId;
+    message.length = (uint8_t)header.DLC;
+
+    bool dataReady = true;
+    (void)xQueueOverwriteFromISR(legacyDataAvail, &dataReady, nullptr);
+    (void)xQueueSendToBackFromISR(legacyInbound, &message, nullptr);
+}
+
+uint32_t legacyConsume() {
+    DiveCANMessage_t message;
+    uint32_t sum = 0;
+    while (pdTRUE == xQueueReceive(legacyInbound, &message, 0)) {
+        sum += message.data[1];
+    }
+    return sum;
+}
+
+uint32_t ringConsume() {
+    /* The ring side wakes the task once per burst rather than once per frame */
+    vTaskNotifyGiveFromISR(xTaskGetCurrentTaskHandle(), nullptr);
+    (void)ulTaskNotifyTake(pdTRUE, 0);
+
+    uint32_t sum = 0;
+    const CANRxFrame_t *frame = GetLatestCAN(0);
+    while (frame != nullptr) {
+        sum += frame->message.data[1];
+        ReleaseLatestCAN();
+        frame = GetLatestCAN(0);
+    }
+    return sum;
+}
+
+struct Result {
+    double nsPerFrame;
+    double framesPerSecond;
+    uint32_t checksum;
+};
+
+/* ISR fires `burst` times back to back, then the task drains, like a bus burst would */
+template <typename Produce, typename Consume>
+Result run(uint32_t burst, Produce produce, Consume consume) {
+    uint32_t checksum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t sent = 0; sent < FRAMES; sent += burst) {
+        for (uint32_t i = 0; i < burst; i++) {
+            produce(BUS_ID_ID | DIVECAN_SOLO, 4, FRAME_DATA);
+        }
+        checksum += consume();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    Result r = {ns / FRAMES, (FRAMES * 1e9) / ns, checksum};
+    return r;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    MockQueue_ResetFreeRTOS();
+    MockErrors_Reset();
+    legacyInit();
+    InitCANFilters(&hcan1);
+
+    const uint32_t bursts[] = {1, 4, 8};
+
+    printf("%-8s %-6s %12s %14s\n", "path", "burst", "ns/frame", "frames/s");
+    for (uint32_t b : bursts) {
+        const Result legacy = run(b, legacyRxInterrupt, legacyConsume);
+        const Result ring = run(b, rxInterrupt, ringConsume);
+
+        if (legacy.checksum != ring.checksum) {
+            printf("checksum mismatch: %u vs %u\n", legacy.checksum, ring.checksum);
+            return EXIT_FAILURE;
+        }
+
+        printf("%-8s %-6u %12.1f %14.0f\n", "queue", b, legacy.nsPerFrame, legacy.framesPerSecond);
+        printf("%-8s %-6u %12.1f %14.0f\n", "ring", b, ring.nsPerFrame, ring.framesPerSecond);
+        printf("%-8s %-6u %11.2fx\n", "speedup", b, legacy.nsPerFrame / ring.nsPerFrame);
+    }
+
+    CANRxRingStats_t stats = {0, 0, 0};
+    GetCANRxRingStats(CAN_FILTER_FIFO0, &stats);
+    printf("ring overflows: %u, high water: %u\n", stats.overflows, stats.highWater);
+
+    return (stats.overflows == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -359,6 +359,41 @@ TEST(BlinkNoData, AllChannelsBlue) {
     CHECK_EQUAL(GPIO_PIN_RESET, MockHAL_GetPinState(B1_GPIO_Port, B1_Pin));
 }
 
+/**
+ * TEST_GROUP: BlinkAging
+ * Tests the single dim blue blink shown ahead of an aging reading
+ */
+TEST_GROUP(BlinkAging) {
+    void setup() {
+        MockHAL_Reset();
+        MockDelay_Reset();
+        MockQueue_ResetFreeRTOS();
+    }
+
+    void teardown() {
+        MockHAL_Reset();
+        MockDelay_Reset();
+        MockQueue_ResetFreeRTOS();
+    }
+};
+
+/* One blink, shorter than the no data pattern so the two can be told apart */
+TEST(BlinkAging, SingleBlink) {
+    blinkAging();
+
+    CHECK_EQUAL(2, MockQueue_GetDelayCallCount());
+    CHECK_EQUAL(2 * BLINK_PERIOD, MockQueue_GetTotalDelayTicks());
+}
+
+/* Verify all channels are off afterwards */
+TEST(BlinkAging, AllChannelsOffAtEnd) {
+    blinkAging();
+
+    CHECK_EQUAL(GPIO_PIN_RESET, MockHAL_GetPinState(B1_GPIO_Port, B1_Pin));
+    CHECK_EQUAL(GPIO_PIN_RESET, MockHAL_GetPinState(B2_GPIO_Port, B2_Pin));
+    CHECK_EQUAL(GPIO_PIN_RESET, MockHAL_GetPinState(B3_GPIO_Port, B3_Pin));
+}
+
 /**
  * TEST_GROUP: BlinkAlarm
  * Tests "Nightrider" sweep pattern for alarm indication
@@ -5,6 +5,7 @@ extern "C" {
 #include "../../Core/Src/menu_state_machine.h"
 #include "../Mocks/MockHAL.h"
 extern bool inShutdown;
+extern bool snifferToggleRequested;
 }
 
 TEST_GROUP(MenuStateMachine)
@@ -13,6 +14,7 @@ TEST_GROUP(MenuStateMachine)
     {
         MockHAL_Reset();
         resetMenuStateMachine();
+        snifferToggleRequested = false;
     }
 
     void teardown()
@@ -286,6 +288,36 @@ TEST(MenuStateMachine, ShutdownStateSetsFlag)
     CHECK_TRUE(inShutdown);
 }
 
+/*
+ * Test: HoldOn6thPressTogglesSniffer
+ * Setup: Menu starts in idle state
+ * Action: Six short presses, then hold, then release
+ * Expected: Sniffer toggle requested once with the outer LEDs lit, menu back to idle on release
+ */
+TEST(MenuStateMachine, HoldOn6thPressTogglesSniffer)
+{
+    for (int i = 0; i < 6; i++) {
+        simulateShortPress();
+    }
+    CHECK_FALSE(snifferToggleRequested);
+    simulateHoldNoRelease();
+    menuStateMachineTick();
+
+    CHECK_TRUE(snifferToggleRequested);
+    CHECK_TRUE(menuActive());
+    verifyLEDState(GPIO_PIN_SET, GPIO_PIN_RESET, GPIO_PIN_RESET, GPIO_PIN_SET);
+
+    /* Only the entry requests a toggle, holding on doesn't flip it back */
+    snifferToggleRequested = false;
+    advanceTime(1000);
+    CHECK_FALSE(snifferToggleRequested);
+
+    simulateRelease();
+    CHECK_FALSE(menuActive());
+    CHECK_FALSE(inShutdown);
+    CHECK_FALSE(snifferToggleRequested);
+}
+
 /*
  * Test: CalibrationStateIsPersistent
  * Setup: Menu starts in idle state
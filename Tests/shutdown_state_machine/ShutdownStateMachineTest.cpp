@@ -0,0 +1,231 @@
+/**
+ * @file ShutdownStateMachineTest.cpp
+ * @brief Unit tests for the shutdown state machine
+ *
+ * Tests how BUS_OFF_ID and the menu shutdown fade get to standby:
+ * - Bus shutdown goes straight to standby if CAN_EN is already off
+ * - Otherwise it waits, without blocking, for CAN_EN or the timeout
+ * - Menu fade goes to standby if held, back to normal if let go
+ * - Bus shutdown takes over a fade in progress, a completed fade still goes to standby
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+extern "C" {
+#include "shutdown_state_machine.h"
+#include "MockPower.h"
+
+extern GPIO_TypeDef *CAN_EN_GPIO_Port;
+}
+
+static void setBusOn(void)
+{
+    MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_RESET);
+}
+
+static void setBusOff(void)
+{
+    MockPower_SetPinReadValue(CAN_EN_GPIO_Port, GPIO_PIN_14, GPIO_PIN_SET);
+}
+
+TEST_GROUP(ShutdownStateMachine)
+{
+    void setup()
+    {
+        MockPower_Reset();
+        ResetShutdownStateMachine();
+        setBusOn();
+    }
+
+    void teardown()
+    {
+        MockPower_Reset();
+        ResetShutdownStateMachine();
+    }
+};
+
+TEST(ShutdownStateMachine, StartsIdle)
+{
+    CHECK_EQUAL(SHUTDOWN_STATE_IDLE, GetShutdownState());
+    CHECK_FALSE(ShutdownPending());
+}
+
+TEST(ShutdownStateMachine, BusRequest_BusAlreadyOff_EntersStandby)
+{
+    setBusOff();
+
+    RequestBusShutdown(100);
+
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_STANDBY, GetShutdownState());
+}
+
+TEST(ShutdownStateMachine, BusRequest_BusOn_WaitsWithoutStandby)
+{
+    RequestBusShutdown(100);
+
+    CHECK_FALSE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_AWAIT_BUS_OFF, GetShutdownState());
+    CHECK_TRUE(ShutdownPending());
+
+    ServiceShutdown(150);
+    CHECK_FALSE(MockPower_GetStandbyEntered());
+    CHECK_TRUE(ShutdownPending());
+}
+
+TEST(ShutdownStateMachine, BusRequest_BusDrops_EntersStandbyOnService)
+{
+    RequestBusShutdown(100);
+    setBusOff();
+
+    ServiceShutdown(110);
+
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_STANDBY, GetShutdownState());
+    CHECK_FALSE(ShutdownPending());
+}
+
+TEST(ShutdownStateMachine, BusRequest_Timeout_BackToIdle)
+{
+    RequestBusShutdown(100);
+
+    ServiceShutdown(100 + TIMEOUT_2S_TICKS - 1);
+    CHECK_TRUE(ShutdownPending());
+
+    ServiceShutdown(100 + TIMEOUT_2S_TICKS);
+    CHECK_FALSE(ShutdownPending());
+    CHECK_EQUAL(SHUTDOWN_STATE_IDLE, GetShutdownState());
+
+    /* CAN_EN dropping after we gave up doesn't shut us down on its own */
+    setBusOff();
+    ServiceShutdown(100 + TIMEOUT_2S_TICKS + 1);
+    CHECK_FALSE(MockPower_GetStandbyEntered());
+}
+
+TEST(ShutdownStateMachine, BusRequest_Timeout_SurvivesTickWrap)
+{
+    const Timestamp_t start = UINT32_MAX - 10;
+    RequestBusShutdown(start);
+
+    ServiceShutdown(start + TIMEOUT_2S_TICKS - 1);
+    CHECK_TRUE(ShutdownPending());
+
+    ServiceShutdown(start + TIMEOUT_2S_TICKS);
+    CHECK_FALSE(ShutdownPending());
+}
+
+TEST(ShutdownStateMachine, BusRequest_Repeat_RestartsTimeout)
+{
+    RequestBusShutdown(100);
+    RequestBusShutdown(100 + TIMEOUT_1S_TICKS);
+
+    ServiceShutdown(100 + TIMEOUT_2S_TICKS);
+    CHECK_TRUE(ShutdownPending());
+
+    ServiceShutdown(100 + TIMEOUT_1S_TICKS + TIMEOUT_2S_TICKS);
+    CHECK_FALSE(ShutdownPending());
+}
+
+TEST(ShutdownStateMachine, Fade_Complete_EntersStandby)
+{
+    StartShutdownFade();
+    CHECK_EQUAL(SHUTDOWN_STATE_FADING, GetShutdownState());
+    CHECK_FALSE(ShutdownPending());
+
+    EndShutdownFade(true);
+
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_STANDBY, GetShutdownState());
+}
+
+TEST(ShutdownStateMachine, Fade_Released_BackToIdle)
+{
+    StartShutdownFade();
+
+    EndShutdownFade(false);
+
+    CHECK_FALSE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_IDLE, GetShutdownState());
+}
+
+TEST(ShutdownStateMachine, Fade_EndWithoutStart_Ignored)
+{
+    EndShutdownFade(true);
+
+    CHECK_FALSE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_IDLE, GetShutdownState());
+}
+
+TEST(ShutdownStateMachine, BusRequest_DuringFade_TakesOver)
+{
+    StartShutdownFade();
+    RequestBusShutdown(100);
+    CHECK_EQUAL(SHUTDOWN_STATE_AWAIT_BUS_OFF, GetShutdownState());
+
+    /* Letting go of the menu doesn't cancel the controller's request */
+    EndShutdownFade(false);
+    CHECK_TRUE(ShutdownPending());
+
+    setBusOff();
+    ServiceShutdown(110);
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+}
+
+TEST(ShutdownStateMachine, Fade_DuringBusRequest_DoesNotStart)
+{
+    RequestBusShutdown(100);
+
+    StartShutdownFade();
+    CHECK_EQUAL(SHUTDOWN_STATE_AWAIT_BUS_OFF, GetShutdownState());
+
+    /* The diver held it through, that's a shutdown whatever CAN_EN does */
+    EndShutdownFade(true);
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_STANDBY, GetShutdownState());
+}
+
+/* CRITICAL: a bus request that never sees CAN_EN drop can't swallow a completed menu shutdown */
+TEST(ShutdownStateMachine, BusRequest_DuringFade_BusStuckOn_FadeCompletes)
+{
+    StartShutdownFade();
+    RequestBusShutdown(100);
+
+    ServiceShutdown(100 + TIMEOUT_2S_TICKS);
+    CHECK_EQUAL(SHUTDOWN_STATE_IDLE, GetShutdownState());
+    CHECK_FALSE(MockPower_GetStandbyEntered());
+
+    EndShutdownFade(true);
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+    CHECK_EQUAL(SHUTDOWN_STATE_STANDBY, GetShutdownState());
+}
+
+TEST(ShutdownStateMachine, Fade_DuringBusRequest_BusTimesOut_FadeCompletes)
+{
+    RequestBusShutdown(100);
+    StartShutdownFade();
+
+    ServiceShutdown(100 + TIMEOUT_2S_TICKS);
+    CHECK_FALSE(ShutdownPending());
+
+    EndShutdownFade(true);
+    CHECK_TRUE(MockPower_GetStandbyEntered());
+}
+
+TEST(ShutdownStateMachine, Standby_OnlyEnteredOnce)
+{
+    StartShutdownFade();
+    EndShutdownFade(true);
+    CHECK_EQUAL(1, MockPower_GetPullUpCallCount());
+
+    setBusOff();
+    RequestBusShutdown(100);
+    ServiceShutdown(110);
+
+    CHECK_EQUAL(1, MockPower_GetPullUpCallCount());
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
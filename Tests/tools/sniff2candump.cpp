@@ -0,0 +1,173 @@
+/**
+ * sniff2candump.cpp - Turn a bus sniffer recording into a candump log
+ *
+ * Input is the whole ring, either read straight off the part from _sniffer_start to _sniffer_end (see the .map, the
+ * ring is whatever flash the image leaves free)
+ *   st-flash read sniff.bin <_sniffer_start> <_sniffer_end - _sniffer_start>
+ * or downloaded over DiveCAN with SNIFFER_READ_REQ_ID and captured with candump -L, in which case
+ * pass -c and the SNIFFER_DATA_ID replies are put back together here. Output is candump -L format
+ * on stdout, so it feeds straight into canplayer or the DiveCAN decoders. Lost frames are reported on stderr.
+ *
+ * Built with `make tools`, it uses the firmware's own record decoder so the two can't disagree.
+ *
+ * Usage: sniff2candump [-c] <file> [interface]
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+    #include "DiveCAN/SnifferFormat.h"
+}
+
+namespace {
+
+/* Kept in step with Sniffer.h and Transciever.h, which need the HAL. The ring's size is set by the link, so take
+ * anything up to the whole application region, erased space past its end holds no valid blocks */
+const uint32_t FLASH_SIZE = 0x1A000;
+const uint32_t DATA_ID = 0xF470000;
+const uint32_t CHUNK_LEN = 6;
+const uint32_t ID_MASK = 0x1FFFF000;
+
+struct Block {
+    SnifferBlockHeader_t header;
+    const uint8_t *records;
+};
+
+bool readImage(const char *path, std::vector<uint8_t> &image) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        perror(path);
+        return false;
+    }
+    image.assign(FLASH_SIZE, 0xFF);
+    const size_t read = fread(image.data(), 1, FLASH_SIZE, file);
+    fclose(file);
+    if ((read % SNIFFER_BLOCK_SIZE) != 0) {
+        fprintf(stderr, "%s: %zu bytes, not a whole number of %u byte blocks\n", path, read, (unsigned int)SNIFFER_BLOCK_SIZE);
+    }
+    return true;
+}
+
+/* Put the ring back together from a candump -L capture of the SNIFFER_DATA_ID replies, chunks not seen stay erased */
+bool readCandump(const char *path, std::vector<uint8_t> &image) {
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        perror(path);
+        return false;
+    }
+    image.assign(FLASH_SIZE, 0xFF);
+
+    uint32_t chunks = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        unsigned int id = 0;
+        char payload[32] = {0};
+        if ((sscanf(line, "(%*f) %*s %x#%31s", &id, payload) == 2) && ((id & ID_MASK) == DATA_ID)) {
+            uint8_t data[8] = {0};
+            const size_t length = std::min(strlen(payload) / 2, sizeof(data));
+            for (size_t i = 0; i < length; ++i) {
+                unsigned int byte = 0;
+                sscanf(&payload[i * 2], "%2x", &byte);
+                data[i] = (uint8_t)byte;
+            }
+            const uint32_t chunk = ((uint32_t)data[0] << 8) | data[1];
+            const uint32_t offset = chunk * CHUNK_LEN;
+            if ((length > 2) && (offset < FLASH_SIZE)) {
+                memcpy(&image[offset], &data[2], std::min<size_t>(length - 2, FLASH_SIZE - offset));
+                ++chunks;
+            }
+        }
+    }
+    fclose(file);
+    fprintf(stderr, "%s: %" PRIu32 " chunks\n", path, chunks);
+    return true;
+}
+
+void printFrame(const char *interface, uint64_t micros, const SnifferRecord_t &record) {
+    printf("(%" PRIu64 ".%06" PRIu64 ") %s ", micros / 1000000U, micros % 1000000U, interface);
+    printf(record.extended ? "%08" PRIX32 "#" : "%03" PRIX32 "#", record.id);
+    if (record.remote) {
+        printf("R");
+    } else {
+        for (uint32_t i = 0; i < std::min<uint32_t>(record.length, 8); ++i) {
+            printf("%02X", record.data[i]);
+        }
+    }
+    printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    bool candump = false;
+    int arg = 1;
+    if ((arg < argc) && (strcmp(argv[arg], "-c") == 0)) {
+        candump = true;
+        ++arg;
+    }
+    if (arg >= argc) {
+        fprintf(stderr, "Usage: %s [-c] <file> [interface]\n", argv[0]);
+        return 2;
+    }
+    const char *interface = (arg + 1 < argc) ? argv[arg + 1] : "can0";
+
+    std::vector<uint8_t> image;
+    if (!(candump ? readCandump(argv[arg], image) : readImage(argv[arg], image))) {
+        return 1;
+    }
+
+    /* Slots are reused once the ring wraps, the sequence number puts the blocks back in order */
+    std::vector<Block> blocks;
+    for (uint32_t offset = 0; offset + SNIFFER_BLOCK_SIZE <= FLASH_SIZE; offset += SNIFFER_BLOCK_SIZE) {
+        Block block;
+        memcpy(&block.header, &image[offset], sizeof(block.header));
+        block.records = &image[offset + SNIFFER_BLOCK_HEADER_SIZE];
+        if (SnifferBlockValid(&block.header)) {
+            blocks.push_back(block);
+        }
+    }
+    std::sort(blocks.begin(), blocks.end(), [](const Block &a, const Block &b) { return a.header.sequence < b.header.sequence; });
+
+    uint32_t frames = 0;
+    uint64_t wraps = 0;
+    uint32_t lastFirstMicros = 0;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const SnifferBlockHeader_t &header = blocks[i].header;
+        if ((i > 0) && (header.sequence != blocks[i - 1].header.sequence + 1)) {
+            fprintf(stderr, "blocks %" PRIu32 "-%" PRIu32 " missing\n", blocks[i - 1].header.sequence + 1, header.sequence - 1);
+        }
+        if (header.dropped != 0) {
+            fprintf(stderr, "%" PRIu16 "%s frames lost before block %" PRIu32 "\n", header.dropped, (header.dropped == UINT16_MAX) ? "+" : "", header.sequence);
+        }
+
+        /* The recording clock is 32 bit microseconds, the blocks are far closer together than its wrap */
+        if ((i > 0) && (header.firstMicros < lastFirstMicros)) {
+            ++wraps;
+        }
+        lastFirstMicros = header.firstMicros;
+
+        uint64_t micros = (wraps << 32) + header.firstMicros;
+        uint32_t offset = 0;
+        bool valid = true;
+        while (valid && (offset < header.length)) {
+            SnifferRecord_t record;
+            const uint32_t used = SnifferDecodeRecord(&blocks[i].records[offset], header.length - offset, &record);
+            valid = used != 0;
+            if (valid) {
+                micros += record.deltaMicros;
+                printFrame(interface, micros, record);
+                offset += used;
+                ++frames;
+            } else {
+                fprintf(stderr, "block %" PRIu32 " corrupt at byte %" PRIu32 "\n", header.sequence, offset);
+            }
+        }
+    }
+
+    fprintf(stderr, "%zu blocks, %" PRIu32 " frames\n", blocks.size(), frames);
+    return 0;
+}